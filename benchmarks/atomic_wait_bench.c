@@ -0,0 +1,90 @@
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic_wait.h"
+#include "bench_utils.h"
+
+#define NOTIFIES 10000000
+#define ROUND_TRIPS 100000
+
+// A notify with nobody waiting should stay out of the kernel.
+static void bench_uncontended_notify(void) {
+    cp_atomic32 word32 = 0;
+    cp_atomic64 word64 = 0;
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < NOTIFIES; i++) {
+        cp_atomic_store32(&word32, i);
+        cp_atomic_notify_one32(&word32);
+    }
+    bench_report("notify32 without waiters", NOTIFIES, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for(int i = 0; i < NOTIFIES; i++) {
+        cp_atomic_store64(&word64, i);
+        cp_atomic_notify_one64(&word64);
+    }
+    bench_report("notify64 without waiters", NOTIFIES, bench_now_ns() - start);
+}
+
+typedef struct Turn {
+    cp_atomic32 turn32;
+    cp_atomic64 turn64;
+} Turn;
+
+static int pong32(void* arg) {
+    Turn* turn = arg;
+    for(int i = 0; i < ROUND_TRIPS; i++) {
+        while(cp_atomic_load32(&turn->turn32) != 1)
+            cp_atomic_wait32(&turn->turn32, 0, NULL);
+        cp_atomic_store32(&turn->turn32, 0);
+        cp_atomic_notify_one32(&turn->turn32);
+    }
+    return 0;
+}
+
+static int pong64(void* arg) {
+    Turn* turn = arg;
+    for(int i = 0; i < ROUND_TRIPS; i++) {
+        while(cp_atomic_load64(&turn->turn64) != 1)
+            cp_atomic_wait64(&turn->turn64, 0, NULL);
+        cp_atomic_store64(&turn->turn64, 0);
+        cp_atomic_notify_one64(&turn->turn64);
+    }
+    return 0;
+}
+
+// Hands a token back and forth between two threads, one wait and one
+// notify per hop on each side.
+static void bench_round_trip(void) {
+    Turn turn = { 0, 0 };
+    thrd_t thread;
+
+    thrd_create(&thread, pong32, &turn);
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < ROUND_TRIPS; i++) {
+        cp_atomic_store32(&turn.turn32, 1);
+        cp_atomic_notify_one32(&turn.turn32);
+        while(cp_atomic_load32(&turn.turn32) != 0)
+            cp_atomic_wait32(&turn.turn32, 1, NULL);
+    }
+    bench_report("wait32/notify32 round trip", ROUND_TRIPS, bench_now_ns() - start);
+    thrd_join(thread, NULL);
+
+    thrd_create(&thread, pong64, &turn);
+    start = bench_now_ns();
+    for(int i = 0; i < ROUND_TRIPS; i++) {
+        cp_atomic_store64(&turn.turn64, 1);
+        cp_atomic_notify_one64(&turn.turn64);
+        while(cp_atomic_load64(&turn.turn64) != 0)
+            cp_atomic_wait64(&turn.turn64, 1, NULL);
+    }
+    bench_report("wait64/notify64 round trip", ROUND_TRIPS, bench_now_ns() - start);
+    thrd_join(thread, NULL);
+}
+
+int main(void) {
+    bench_uncontended_notify();
+    bench_round_trip();
+    return 0;
+}
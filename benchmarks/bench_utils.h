@@ -0,0 +1,72 @@
+#ifndef CP_THREADS_BENCH_UTILS_H
+#define CP_THREADS_BENCH_UTILS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../cpthreads.h"
+
+#if defined(_MSC_VER)
+
+static __inline unsigned long long bench_now_ns(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if(frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart * 1000000000.0 / frequency.QuadPart);
+}
+
+static __inline int bench_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+#else
+
+#include <unistd.h>
+
+static __inline unsigned long long bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+static __inline int bench_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+#endif
+
+// Prints one result line in a fixed format so runs can be diffed or
+// collected into bench_output.txt.
+static __inline void bench_report(const char* name, unsigned long long ops, unsigned long long elapsed_ns) {
+    double seconds = elapsed_ns / 1e9;
+    printf("%-48s %12llu ops %10.2f ns/op %14.0f ops/s\n",
+           name,
+           ops,
+           ops ? (double)elapsed_ns / ops : 0.0,
+           seconds > 0 ? ops / seconds : 0.0);
+}
+
+static __inline int bench_compare_ull(const void* lhs, const void* rhs) {
+    unsigned long long a = *(const unsigned long long*)lhs;
+    unsigned long long b = *(const unsigned long long*)rhs;
+    return a < b ? -1 : a > b;
+}
+
+// Sorts the samples in place and prints the 50th, 99th and 99.9th percentiles.
+static __inline void bench_report_percentiles(const char* name, unsigned long long* samples, size_t count) {
+    if(count == 0)
+        return;
+    qsort(samples, count, sizeof(*samples), bench_compare_ull);
+    printf("%-48s p50 %8llu ns  p99 %8llu ns  p99.9 %8llu ns\n",
+           name,
+           samples[count / 2],
+           samples[(size_t)(count * 0.99)],
+           samples[(size_t)(count * 0.999)]);
+}
+
+#endif
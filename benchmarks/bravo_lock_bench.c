@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_bravo_lock.h"
+#include "../cp_stamped_lock.h"
+#include "bench_utils.h"
+
+#define READS 2000000
+#define WRITES 2000
+#define MAX_READERS 64
+
+typedef struct Table {
+    cp_bravo_lock_t bravo;
+    cp_stamped_lock_t stamped;
+    int entries[16];
+    cp_atomic32 stop;
+    cp_atomic32 ready;
+} Table;
+
+static Table table;
+
+static int read_bravo(void* arg) {
+    int sum = 0;
+    for(int i = 0; i < READS; i++) {
+        cp_bravo_read_lock(&table.bravo);
+        sum += table.entries[i & 15];
+        cp_bravo_read_unlock(&table.bravo);
+    }
+    return sum;
+}
+
+static int read_stamped(void* arg) {
+    int sum = 0;
+    for(int i = 0; i < READS; i++) {
+        cp_stamp_t stamp = cp_stamped_lock_read(&table.stamped);
+        sum += table.entries[i & 15];
+        cp_stamped_lock_read_unlock(&table.stamped, stamp);
+    }
+    return sum;
+}
+
+// Total read throughput as readers are added. With a shared counter every
+// reader bounces the same line; with slots the readers don't interact.
+static void bench_readers(const char* name, int (*reader)(void*), int count) {
+    thrd_t threads[MAX_READERS];
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < count; i++)
+        thrd_create(threads + i, reader, NULL);
+    for(int i = 0; i < count; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s read, %d threads", name, count);
+    bench_report(label, (unsigned long long)READS * count, elapsed);
+}
+
+static int keep_reading(void* arg) {
+    int sum = 0;
+    cp_atomic_fetch_add32(&table.ready, 1);
+    while(!cp_atomic_load32(&table.stop)) {
+        cp_bravo_read_lock(&table.bravo);
+        sum += table.entries[sum & 15];
+        cp_bravo_read_unlock(&table.bravo);
+    }
+    return sum;
+}
+
+// Time from asking for the write lock to holding it. The first write after
+// readers biased the lock pays for the revocation; the ones right after it
+// find the bias still off.
+static void bench_writer_latency(int readers) {
+    thrd_t threads[MAX_READERS];
+    unsigned long long* samples = malloc(sizeof(*samples) * WRITES);
+    unsigned long long* revocations = malloc(sizeof(*revocations) * WRITES);
+    size_t revoked = 0;
+
+    table.stop = 0;
+    table.ready = 0;
+    for(int i = 0; i < readers; i++)
+        thrd_create(threads + i, keep_reading, NULL);
+    while(cp_atomic_load32(&table.ready) < readers)
+        thrd_yield();
+
+    for(int i = 0; i < WRITES; i++) {
+        bool biased = cp_atomic_load32(&table.bravo.bias) != 0;
+        unsigned long long start = bench_now_ns();
+        cp_bravo_write_lock(&table.bravo);
+        samples[i] = bench_now_ns() - start;
+        table.entries[i & 15]++;
+        cp_bravo_write_unlock(&table.bravo);
+        if(biased)
+            revocations[revoked++] = samples[i];
+        thrd_sleep(&(struct timespec){ .tv_sec = 0, .tv_nsec = 100000 }, NULL);
+    }
+
+    cp_atomic_store32(&table.stop, 1);
+    for(int i = 0; i < readers; i++)
+        thrd_join(threads[i], NULL);
+
+    char label[64];
+    snprintf(label, sizeof(label), "write lock, %d readers", readers);
+    bench_report_percentiles(label, samples, WRITES);
+    if(revoked) {
+        snprintf(label, sizeof(label), "write lock revoking bias, %d readers", readers);
+        bench_report_percentiles(label, revocations, revoked);
+    }
+
+    free(revocations);
+    free(samples);
+}
+
+int main(void) {
+    int cpus = bench_cpu_count();
+    int max_readers = cpus * 2 < MAX_READERS ? cpus * 2 : MAX_READERS;
+    cp_bravo_lock_init(&table.bravo);
+    cp_stamped_lock_init(&table.stamped);
+
+    printf("readers fence themselves: %s\n", ___cp_bravo_reader_fence ? "yes" : "no (membarrier)");
+    for(int readers = 1; readers <= max_readers; readers *= 2) {
+        bench_readers("bravo", read_bravo, readers);
+        bench_readers("stamped", read_stamped, readers);
+    }
+    bench_writer_latency(1);
+    bench_writer_latency(max_readers);
+
+    cp_stamped_lock_destroy(&table.stamped);
+    cp_bravo_lock_destroy(&table.bravo);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_chan.h"
+#include "bench_utils.h"
+
+#define PING_PONGS 20000
+#define THROUGHPUT_VALUES 1000000
+#define SELECT_VALUES 200000
+#define MAX_SELECT_CHANNELS 16
+
+static cp_chan_t ping;
+static cp_chan_t pong;
+
+static int echo(void* arg) {
+    unsigned long long value;
+    while(cp_chan_recv(&ping, &value) == thrd_success)
+        cp_chan_send(&pong, &value);
+    return 0;
+}
+
+// Round trips through a pair of channels; half a round trip is one handoff.
+static void bench_ping_pong(size_t capacity) {
+    cp_chan_init(&ping, sizeof(unsigned long long), capacity);
+    cp_chan_init(&pong, sizeof(unsigned long long), capacity);
+
+    thrd_t thread;
+    thrd_create(&thread, echo, NULL);
+
+    unsigned long long* samples = malloc(sizeof(*samples) * PING_PONGS);
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < PING_PONGS; i++) {
+        unsigned long long sent = bench_now_ns();
+        unsigned long long value;
+        cp_chan_send(&ping, &sent);
+        cp_chan_recv(&pong, &value);
+        samples[i] = (bench_now_ns() - value) / 2;
+    }
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    cp_chan_close(&ping);
+    thrd_join(thread, NULL);
+
+    char name[64];
+    snprintf(name, sizeof(name), "chan handoff (capacity %zu)", capacity);
+    bench_report(name, PING_PONGS * 2ull, elapsed);
+    bench_report_percentiles(name, samples, PING_PONGS);
+
+    free(samples);
+    cp_chan_destroy(&pong);
+    cp_chan_destroy(&ping);
+}
+
+static int produce(void* arg) {
+    cp_chan_t* chan = arg;
+    for(int i = 0; i < THROUGHPUT_VALUES; i++)
+        cp_chan_send(chan, &i);
+    cp_chan_close(chan);
+    return 0;
+}
+
+static void bench_throughput(size_t capacity) {
+    cp_chan_t chan;
+    cp_chan_init(&chan, sizeof(int), capacity);
+
+    thrd_t thread;
+    unsigned long long start = bench_now_ns();
+    thrd_create(&thread, produce, &chan);
+
+    int value;
+    long long sum = 0;
+    while(cp_chan_recv(&chan, &value) == thrd_success)
+        sum += value;
+    unsigned long long elapsed = bench_now_ns() - start;
+    thrd_join(thread, NULL);
+
+    char name[64];
+    snprintf(name, sizeof(name), "chan stream (capacity %zu)", capacity);
+    bench_report(name, THROUGHPUT_VALUES, elapsed);
+    if(sum < 0)
+        printf("unreachable\n");
+    cp_chan_destroy(&chan);
+}
+
+typedef struct SelectProducer {
+    cp_chan_t* chan;
+    int values;
+} SelectProducer;
+
+static int select_produce(void* arg) {
+    SelectProducer* producer = arg;
+    for(int i = 0; i < producer->values; i++)
+        cp_chan_send(producer->chan, &i);
+    return 0;
+}
+
+// One consumer selecting over every channel, each fed by its own producer.
+static void bench_select(int channels, size_t capacity) {
+    cp_chan_t chans[MAX_SELECT_CHANNELS];
+    SelectProducer producers[MAX_SELECT_CHANNELS];
+    thrd_t threads[MAX_SELECT_CHANNELS];
+    cp_select_case_t cases[MAX_SELECT_CHANNELS];
+    int values[MAX_SELECT_CHANNELS];
+
+    for(int i = 0; i < channels; i++) {
+        cp_chan_init(chans + i, sizeof(int), capacity);
+        producers[i] = (SelectProducer){ chans + i, SELECT_VALUES / channels };
+        cases[i] = (cp_select_case_t){ chans + i, cp_select_recv, values + i, 0 };
+    }
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < channels; i++)
+        thrd_create(threads + i, select_produce, producers + i);
+
+    int total = SELECT_VALUES / channels * channels;
+    for(int received = 0; received < total; received++) {
+        int index;
+        cp_select(cases, channels, &index, NULL);
+    }
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    for(int i = 0; i < channels; i++)
+        thrd_join(threads[i], NULL);
+
+    char name[64];
+    snprintf(name, sizeof(name), "select over %d (capacity %zu)", channels, capacity);
+    bench_report(name, total, elapsed);
+
+    for(int i = 0; i < channels; i++)
+        cp_chan_destroy(chans + i);
+}
+
+int main(void) {
+    bench_ping_pong(0);
+    bench_ping_pong(1);
+
+    bench_throughput(0);
+    bench_throughput(64);
+    bench_throughput(1024);
+
+    for(int channels = 2; channels <= MAX_SELECT_CHANNELS; channels *= 2) {
+        bench_select(channels, 0);
+        bench_select(channels, 64);
+    }
+    return 0;
+}
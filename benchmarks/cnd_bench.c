@@ -0,0 +1,122 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "bench_utils.h"
+
+#if !defined(_MSC_VER)
+#include <sys/resource.h>
+#endif
+
+#define BROADCASTS 20000
+#define MIN_ROUNDS 200
+// Conditions on Windows queue at most 64 waiters at a time.
+#define MAX_WAITERS 64
+
+typedef struct Herd {
+    mtx_t mutex;
+    cnd_t cond;
+    cnd_t done;
+    unsigned long long generation;
+    int waiters;
+    int acknowledged;
+    bool stop;
+} Herd;
+
+// Voluntary and involuntary context switches of the whole process, or -1
+// where there's no cheap way to ask.
+static long context_switches(void) {
+#if defined(_MSC_VER)
+    return -1;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+#endif
+}
+
+static int herd_waiter(void* arg) {
+    Herd* herd = arg;
+    mtx_lock(&herd->mutex);
+    unsigned long long seen = herd->generation;
+    while(true) {
+        if(++herd->acknowledged == herd->waiters)
+            cnd_signal(&herd->done);
+        while(herd->generation == seen && !herd->stop)
+            cnd_wait(&herd->cond, &herd->mutex);
+        if(herd->stop)
+            break;
+        seen = herd->generation;
+    }
+    mtx_unlock(&herd->mutex);
+    return 0;
+}
+
+// Every round wakes all waiters with one broadcast and waits until each of
+// them has had the mutex. Without wait morphing most of them wake only to
+// block again on the mutex, which shows up as extra context switches.
+static void bench_broadcast(int type, const char* type_name, int waiters) {
+    Herd herd;
+    mtx_init(&herd.mutex, type);
+    cnd_init(&herd.cond);
+    cnd_init(&herd.done);
+    herd.generation = 0;
+    herd.waiters = waiters;
+    herd.acknowledged = 0;
+    herd.stop = false;
+
+    thrd_t threads[MAX_WAITERS];
+    for(int i = 0; i < waiters; i++)
+        thrd_create(threads + i, herd_waiter, &herd);
+
+    int rounds = BROADCASTS / waiters;
+    if(rounds < MIN_ROUNDS)
+        rounds = MIN_ROUNDS;
+
+    mtx_lock(&herd.mutex);
+    while(herd.acknowledged < waiters)
+        cnd_wait(&herd.done, &herd.mutex);
+
+    long switches = context_switches();
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < rounds; i++) {
+        herd.acknowledged = 0;
+        herd.generation++;
+        cnd_broadcast(&herd.cond);
+        while(herd.acknowledged < waiters)
+            cnd_wait(&herd.done, &herd.mutex);
+    }
+    unsigned long long elapsed = bench_now_ns() - start;
+    long after = context_switches();
+
+    herd.stop = true;
+    cnd_broadcast(&herd.cond);
+    mtx_unlock(&herd.mutex);
+    for(int i = 0; i < waiters; i++)
+        thrd_join(threads[i], NULL);
+
+    char name[64];
+    snprintf(name, sizeof(name), "broadcast to %d waiters (%s)", waiters, type_name);
+    bench_report(name, rounds, elapsed);
+    if(switches >= 0 && after >= 0)
+        printf("%-48s %12.2f context switches/broadcast\n", "", (double)(after - switches) / rounds);
+
+    cnd_destroy(&herd.done);
+    cnd_destroy(&herd.cond);
+    mtx_destroy(&herd.mutex);
+}
+
+int main(void) {
+    static const int waiter_counts[] = { 1, 4, 16, MAX_WAITERS };
+    for(size_t i = 0; i < sizeof(waiter_counts) / sizeof(*waiter_counts); i++) {
+        bench_broadcast(mtx_plain, "plain", waiter_counts[i]);
+        bench_broadcast(mtx_timed, "timed", waiter_counts[i]);
+    }
+    return 0;
+}
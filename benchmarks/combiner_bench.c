@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_combiner.h"
+#include "bench_utils.h"
+
+#define OPS 400000
+#define MAX_THREADS 64
+#define HEAP_CAPACITY (OPS + 1024)
+
+// A binary min-heap. Small enough per operation that moving its lines
+// between threads is most of what a lock handoff costs.
+typedef struct Heap {
+    uint64_t* items;
+    size_t count;
+} Heap;
+
+static void heap_push(Heap* heap, uint64_t value) {
+    size_t i = heap->count++;
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if(heap->items[parent] <= value)
+            break;
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = value;
+}
+
+static uint64_t heap_pop(Heap* heap) {
+    if(heap->count == 0)
+        return UINT64_MAX;
+    uint64_t top = heap->items[0];
+    uint64_t last = heap->items[--heap->count];
+    size_t i = 0;
+    for(;;) {
+        size_t child = i * 2 + 1;
+        if(child >= heap->count)
+            break;
+        if(child + 1 < heap->count && heap->items[child + 1] < heap->items[child])
+            child++;
+        if(last <= heap->items[child])
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    heap->items[i] = last;
+    return top;
+}
+
+static void* combined_push(void* object, void* arg) {
+    heap_push(object, (uint64_t)(uintptr_t)arg);
+    return NULL;
+}
+
+static void* combined_pop(void* object, void* arg) {
+    return (void*)(uintptr_t)heap_pop(object);
+}
+
+typedef struct Worker {
+    Heap* heap;
+    mtx_t* lock;
+    cp_combiner_t* combiner;
+    int ops;
+    uint64_t seed;
+} Worker;
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Alternates pushing a random key and popping the smallest one.
+static int locked_ops(Worker* worker) {
+    for(int i = 0; i < worker->ops; i++) {
+        uint64_t key = next_random(&worker->seed) >> 32;
+        mtx_lock(worker->lock);
+        if(i & 1)
+            heap_pop(worker->heap);
+        else
+            heap_push(worker->heap, key);
+        mtx_unlock(worker->lock);
+    }
+    return 0;
+}
+
+static int combined_ops(Worker* worker) {
+    cp_combiner_slot_t* slot;
+    if(cp_combiner_join(worker->combiner, &slot) != thrd_success)
+        return 1;
+    for(int i = 0; i < worker->ops; i++) {
+        uint64_t key = next_random(&worker->seed) >> 32;
+        if(i & 1)
+            cp_combiner_apply(worker->combiner, slot, combined_pop, NULL);
+        else
+            cp_combiner_apply(worker->combiner, slot, combined_push, (void*)(uintptr_t)key);
+    }
+    cp_combiner_leave(worker->combiner, slot);
+    return 0;
+}
+
+static void bench_heap(const char* name, int threads, int combined) {
+    Heap heap = { malloc(sizeof(uint64_t) * HEAP_CAPACITY), 0 };
+    mtx_t lock;
+    cp_combiner_t combiner;
+    thrd_t handles[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    mtx_init(&lock, mtx_plain);
+    cp_combiner_init(&combiner, &heap, threads);
+
+    // Starts half full, so pops have real work to do.
+    uint64_t seed = 88172645463325252ull;
+    for(int i = 0; i < 1024; i++)
+        heap_push(&heap, next_random(&seed) >> 32);
+
+    for(int i = 0; i < threads; i++)
+        workers[i] = (Worker){ &heap, &lock, &combiner, OPS / threads, seed + (uint64_t)i * 7919 };
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < threads; i++)
+        thrd_create(handles + i, (thrd_start_t)(combined ? combined_ops : locked_ops), workers + i);
+    for(int i = 0; i < threads; i++)
+        thrd_join(handles[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char label[96];
+    snprintf(label, sizeof(label), "%s, %d threads", name, threads);
+    bench_report(label, (unsigned long long)(OPS / threads) * threads, elapsed);
+
+    cp_combiner_destroy(&combiner);
+    mtx_destroy(&lock);
+    free(heap.items);
+}
+
+int main(void) {
+    for(int threads = 2; threads <= MAX_THREADS; threads *= 2) {
+        bench_heap("mtx_plain heap", threads, 0);
+        bench_heap("cp_combiner heap", threads, 1);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_counter.h"
+#include "bench_utils.h"
+
+#define INCS_PER_THREAD 2000000
+#define MAX_THREADS 64
+
+static cp_atomic64 single;
+static cp_counter_t counter;
+static cp_atomic32 ready;
+static cp_atomic32 go;
+static cp_atomic32 writers_left;
+
+static void wait_start(void) {
+    cp_atomic_fetch_add32(&ready, 1);
+    while(!cp_atomic_load32(&go))
+        thrd_yield();
+}
+
+static int atomic_writer(void* arg) {
+    wait_start();
+    for(int i = 0; i < INCS_PER_THREAD; i++)
+        cp_atomic_fetch_add64(&single, 1);
+    cp_atomic_fetch_add32(&writers_left, -1);
+    return 0;
+}
+
+static int counter_writer(void* arg) {
+    wait_start();
+    for(int i = 0; i < INCS_PER_THREAD; i++)
+        cp_counter_inc(&counter);
+    cp_atomic_fetch_add32(&writers_left, -1);
+    return 0;
+}
+
+// Polls the total the whole time, like a metrics exporter would.
+static int poller(void* arg) {
+    int use_counter = arg != NULL;
+    int64_t last = 0;
+    wait_start();
+    while(cp_atomic_load32(&writers_left) > 0) {
+        last = use_counter ? cp_counter_read(&counter) : cp_atomic_load64(&single);
+        thrd_yield();
+    }
+    return last < 0;
+}
+
+static void bench_incs(const char* label, thrd_start_t writer, int writer_count, int use_counter, int with_poller) {
+    thrd_t threads[MAX_THREADS + 1];
+    int total = writer_count + (with_poller ? 1 : 0);
+    ready = 0;
+    go = 0;
+    writers_left = writer_count;
+    single = 0;
+
+    for(int i = 0; i < writer_count; i++)
+        thrd_create(threads + i, writer, NULL);
+    if(with_poller)
+        thrd_create(threads + writer_count, poller, use_counter ? &counter : NULL);
+    while(cp_atomic_load32(&ready) != total)
+        thrd_yield();
+
+    unsigned long long start = bench_now_ns();
+    cp_atomic_store32(&go, 1);
+    for(int i = 0; i < writer_count; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+    if(with_poller)
+        thrd_join(threads[writer_count], NULL);
+
+    int64_t expected = (int64_t)INCS_PER_THREAD * writer_count;
+    int64_t got = use_counter ? cp_counter_read_exact(&counter) : cp_atomic_load64(&single);
+    if(got != expected)
+        printf("%s: expected %lld, got %lld\n", label, (long long)expected, (long long)got);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s (%d threads)", label, with_poller ? " + poller" : "", writer_count);
+    bench_report(name, (unsigned long long)expected, elapsed);
+}
+
+int main(void) {
+    for(int poll = 0; poll <= 1; poll++) {
+        for(int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+            bench_incs("single atomic", atomic_writer, threads, 0, poll);
+
+            cp_counter_init(&counter, 0);
+            bench_incs("cp_counter", counter_writer, threads, 1, poll);
+            cp_counter_destroy(&counter);
+
+            if(poll) {
+                cp_counter_init(&counter, 10);
+                bench_incs("cp_counter approx 10ms", counter_writer, threads, 1, poll);
+                cp_counter_destroy(&counter);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_future.h"
+#include "bench_utils.h"
+
+#define FUTURES 10000
+#define ROUNDS 20
+#define MAX_SETTERS 8
+
+typedef struct Setter {
+    cp_promise_t* promises;
+    int first;
+    int stride;
+} Setter;
+
+static int set_promises(void* arg) {
+    Setter* setter = arg;
+    for(int i = setter->first; i < FUTURES; i += setter->stride)
+        cp_promise_set(setter->promises + i, (void*)(uintptr_t)i);
+    return 0;
+}
+
+static void* add_one(void* value, void* arg) {
+    return (void*)((uintptr_t)value + 1);
+}
+
+// Fans FUTURES promises out to a few threads that complete them, and joins
+// them back with one cp_when_all. Each round covers creating the promises,
+// registering the join, completing them and waking the waiter.
+static void bench_fan_out(int setters) {
+    cp_promise_t* promises = malloc(sizeof(*promises) * FUTURES);
+    cp_future_t* futures = malloc(sizeof(*futures) * FUTURES);
+    thrd_t threads[MAX_SETTERS];
+    Setter args[MAX_SETTERS];
+
+    unsigned long long start = bench_now_ns();
+    for(int round = 0; round < ROUNDS; round++) {
+        for(int i = 0; i < FUTURES; i++) {
+            cp_promise_init(promises + i);
+            cp_promise_get_future(futures + i, promises + i);
+        }
+
+        cp_future_t all;
+        cp_when_all(&all, futures, FUTURES);
+        for(int i = 0; i < setters; i++) {
+            args[i] = (Setter){ promises, i, setters };
+            thrd_create(threads + i, set_promises, args + i);
+        }
+        cp_future_wait(&all, NULL);
+
+        for(int i = 0; i < setters; i++)
+            thrd_join(threads[i], NULL);
+        cp_future_destroy(&all);
+        for(int i = 0; i < FUTURES; i++) {
+            cp_future_destroy(futures + i);
+            cp_promise_destroy(promises + i);
+        }
+    }
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "when_all of %d futures (%d setters)", FUTURES, setters);
+    bench_report(name, (unsigned long long)FUTURES * ROUNDS, elapsed);
+
+    free(futures);
+    free(promises);
+}
+
+// Builds a chain of FUTURES continuations on an unset promise, then sets it
+// and lets the completing thread run the whole chain.
+static void bench_then_chain(void) {
+    cp_future_t* futures = malloc(sizeof(*futures) * (FUTURES + 1));
+
+    unsigned long long start = bench_now_ns();
+    for(int round = 0; round < ROUNDS; round++) {
+        cp_promise_t promise;
+        cp_promise_init(&promise);
+        cp_promise_get_future(futures, &promise);
+        for(int i = 0; i < FUTURES; i++)
+            cp_future_then(futures + i + 1, futures + i, add_one, NULL);
+
+        void* value;
+        cp_promise_set(&promise, NULL);
+        cp_future_wait(futures + FUTURES, &value);
+        if((uintptr_t)value != FUTURES)
+            printf("then chain computed %llu\n", (unsigned long long)(uintptr_t)value);
+
+        for(int i = 0; i <= FUTURES; i++)
+            cp_future_destroy(futures + i);
+        cp_promise_destroy(&promise);
+    }
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    bench_report("then chain of 10000 continuations", (unsigned long long)FUTURES * ROUNDS, elapsed);
+    free(futures);
+}
+
+int main(void) {
+    int cpus = bench_cpu_count();
+    for(int setters = 1; setters <= MAX_SETTERS; setters *= 2) {
+        bench_fan_out(setters);
+        if(setters >= cpus)
+            break;
+    }
+    bench_then_chain();
+    return 0;
+}
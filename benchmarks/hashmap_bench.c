@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_hashmap.h"
+#include "bench_utils.h"
+
+#define KEY_RANGE (1 << 17)
+#define OPS_PER_THREAD 500000
+#define MAX_THREADS 64
+#define LOCKED_BUCKETS (1 << 17)
+
+#define KEY(i) ((void*)(uintptr_t)(i))
+
+// The baseline: a plain chained table behind one mutex.
+typedef struct LockedNode {
+    struct LockedNode* next;
+    uintptr_t key;
+    void* value;
+} LockedNode;
+
+typedef struct LockedMap {
+    mtx_t lock;
+    LockedNode** buckets;
+} LockedMap;
+
+static size_t locked_index(uintptr_t key) {
+    uint64_t x = key * UINT64_C(0x9e3779b97f4a7c15);
+    return (size_t)(x >> 47) & (LOCKED_BUCKETS - 1);
+}
+
+static int locked_get(LockedMap* map, uintptr_t key, void** value) {
+    int found = 0;
+    mtx_lock(&map->lock);
+    for(LockedNode* node = map->buckets[locked_index(key)]; node; node = node->next) {
+        if(node->key == key) {
+            *value = node->value;
+            found = 1;
+            break;
+        }
+    }
+    mtx_unlock(&map->lock);
+    return found;
+}
+
+static void locked_put(LockedMap* map, uintptr_t key, void* value) {
+    LockedNode* fresh = malloc(sizeof(*fresh));
+    fresh->key = key;
+    fresh->value = value;
+
+    mtx_lock(&map->lock);
+    LockedNode** link = map->buckets + locked_index(key);
+    while(*link && (*link)->key != key)
+        link = &(*link)->next;
+    LockedNode* old = *link;
+    fresh->next = old ? old->next : NULL;
+    *link = fresh;
+    mtx_unlock(&map->lock);
+
+    free(old);
+}
+
+static void locked_remove(LockedMap* map, uintptr_t key) {
+    mtx_lock(&map->lock);
+    LockedNode** link = map->buckets + locked_index(key);
+    while(*link && (*link)->key != key)
+        link = &(*link)->next;
+    LockedNode* old = *link;
+    if(old)
+        *link = old->next;
+    mtx_unlock(&map->lock);
+
+    free(old);
+}
+
+typedef struct Bench {
+    cp_hashmap_t* map;
+    LockedMap* locked;
+    int write_percent;
+    cp_atomic32 ready;
+    cp_atomic32 go;
+    cp_atomic64 hits;
+} Bench;
+
+typedef struct Worker {
+    Bench* bench;
+    uint32_t seed;
+} Worker;
+
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void wait_start(Bench* bench) {
+    cp_atomic_fetch_add32(&bench->ready, 1);
+    while(!cp_atomic_load32(&bench->go))
+        thrd_yield();
+}
+
+static int hashmap_run(void* arg) {
+    Worker* worker = arg;
+    Bench* bench = worker->bench;
+    long long hits = 0;
+    wait_start(bench);
+
+    for(int i = 0; i < OPS_PER_THREAD; i++) {
+        uint32_t r = next_random(&worker->seed);
+        uintptr_t key = 1 + (r >> 9) % KEY_RANGE;
+        void* value;
+        if((int)(r & 0xff) * 100 >= bench->write_percent * 256)
+            hits += cp_hashmap_get(bench->map, KEY(key), &value);
+        else if(r & 0x100)
+            cp_hashmap_put(bench->map, KEY(key), KEY(key));
+        else
+            cp_hashmap_remove(bench->map, KEY(key));
+    }
+
+    cp_atomic_fetch_add64(&bench->hits, hits);
+    return 0;
+}
+
+static int locked_run(void* arg) {
+    Worker* worker = arg;
+    Bench* bench = worker->bench;
+    long long hits = 0;
+    wait_start(bench);
+
+    for(int i = 0; i < OPS_PER_THREAD; i++) {
+        uint32_t r = next_random(&worker->seed);
+        uintptr_t key = 1 + (r >> 9) % KEY_RANGE;
+        void* value;
+        if((int)(r & 0xff) * 100 >= bench->write_percent * 256)
+            hits += locked_get(bench->locked, key, &value);
+        else if(r & 0x100)
+            locked_put(bench->locked, key, KEY(key));
+        else
+            locked_remove(bench->locked, key);
+    }
+
+    cp_atomic_fetch_add64(&bench->hits, hits);
+    return 0;
+}
+
+static void run_threads(const char* label, int thread_count, thrd_start_t run, Bench* bench) {
+    thrd_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    bench->ready = 0;
+    bench->go = 0;
+    for(int i = 0; i < thread_count; i++) {
+        workers[i] = (Worker){ bench, 2654435761u * (uint32_t)(i + 1) };
+        thrd_create(threads + i, run, workers + i);
+    }
+    while(cp_atomic_load32(&bench->ready) != thread_count)
+        thrd_yield();
+
+    unsigned long long start = bench_now_ns();
+    cp_atomic_store32(&bench->go, 1);
+    for(int i = 0; i < thread_count; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s %d/%d (%d threads)", label, 100 - bench->write_percent, bench->write_percent, thread_count);
+    bench_report(name, (unsigned long long)OPS_PER_THREAD * thread_count, elapsed);
+}
+
+static void bench_mix(int write_percent, int max_threads) {
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        // Both maps start half full so reads hit about half the time.
+        cp_hashmap_t map;
+        cp_hashmap_init(&map, KEY_RANGE, NULL, NULL, NULL);
+        LockedMap locked;
+        mtx_init(&locked.lock, mtx_plain);
+        locked.buckets = calloc(LOCKED_BUCKETS, sizeof(*locked.buckets));
+        for(uintptr_t key = 1; key <= KEY_RANGE; key += 2) {
+            cp_hashmap_put(&map, KEY(key), KEY(key));
+            locked_put(&locked, key, KEY(key));
+        }
+
+        Bench bench = { &map, &locked, write_percent };
+        run_threads("cp_hashmap", threads, hashmap_run, &bench);
+        run_threads("mutex map", threads, locked_run, &bench);
+
+        cp_hashmap_destroy(&map);
+        for(size_t i = 0; i < LOCKED_BUCKETS; i++) {
+            while(locked.buckets[i]) {
+                LockedNode* next = locked.buckets[i]->next;
+                free(locked.buckets[i]);
+                locked.buckets[i] = next;
+            }
+        }
+        free(locked.buckets);
+        mtx_destroy(&locked.lock);
+    }
+}
+
+int main(void) {
+    int max_threads = bench_cpu_count();
+    if(max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if(max_threads < 4)
+        max_threads = 4;
+
+    bench_mix(5, max_threads);
+    bench_mix(50, max_threads);
+    return 0;
+}
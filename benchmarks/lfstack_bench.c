@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_lfstack.h"
+#include "bench_utils.h"
+
+#define OPS_PER_THREAD 1000000
+#define NODES 1024
+#define MAX_THREADS 64
+
+// The same freelist workload behind a plain mutex, for comparison.
+typedef struct LockedStack {
+    mtx_t lock;
+    cp_lfstack_node_t* top;
+} LockedStack;
+
+typedef struct Bench {
+    cp_lfstack_t* stack;
+    LockedStack* locked;
+    cp_atomic32 ready;
+    cp_atomic32 go;
+} Bench;
+
+static void bench_wait_start(Bench* bench) {
+    cp_atomic_fetch_add32(&bench->ready, 1);
+    while(!cp_atomic_load32(&bench->go))
+        thrd_yield();
+}
+
+static int lfstack_run(void* arg) {
+    Bench* bench = arg;
+    bench_wait_start(bench);
+    for(int i = 0; i < OPS_PER_THREAD; i++) {
+        cp_lfstack_node_t* node = cp_lfstack_pop(bench->stack);
+        if(node)
+            cp_lfstack_push(bench->stack, node);
+    }
+    return 0;
+}
+
+static int locked_run(void* arg) {
+    Bench* bench = arg;
+    LockedStack* stack = bench->locked;
+    bench_wait_start(bench);
+    for(int i = 0; i < OPS_PER_THREAD; i++) {
+        mtx_lock(&stack->lock);
+        cp_lfstack_node_t* node = stack->top;
+        if(node)
+            stack->top = node->next;
+        mtx_unlock(&stack->lock);
+
+        if(node) {
+            mtx_lock(&stack->lock);
+            node->next = stack->top;
+            stack->top = node;
+            mtx_unlock(&stack->lock);
+        }
+    }
+    return 0;
+}
+
+static void bench_threads(const char* label, int thread_count, thrd_start_t run, Bench* bench) {
+    thrd_t threads[MAX_THREADS];
+    bench->ready = 0;
+    bench->go = 0;
+    for(int i = 0; i < thread_count; i++)
+        thrd_create(threads + i, run, bench);
+    while(cp_atomic_load32(&bench->ready) != thread_count)
+        thrd_yield();
+
+    unsigned long long start = bench_now_ns();
+    cp_atomic_store32(&bench->go, 1);
+    for(int i = 0; i < thread_count; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s pop+push (%d threads)", label, thread_count);
+    bench_report(name, (unsigned long long)OPS_PER_THREAD * thread_count, elapsed);
+}
+
+int main(void) {
+    cp_lfstack_node_t* nodes = malloc(sizeof(*nodes) * NODES);
+    int max_threads = bench_cpu_count() * 2;
+    if(max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if(max_threads < 4)
+        max_threads = 4;
+
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        cp_lfstack_t plain, eliminating;
+        cp_lfstack_init(&plain, 0);
+        cp_lfstack_init(&eliminating, cp_lfstack_elimination);
+
+        LockedStack locked;
+        mtx_init(&locked.lock, mtx_plain);
+        locked.top = NULL;
+
+        // Each stack starts with its own copy of the nodes.
+        for(int i = 0; i < NODES; i++)
+            cp_lfstack_push(&plain, nodes + i);
+        Bench bench = { &plain, NULL };
+        bench_threads("lfstack", threads, lfstack_run, &bench);
+        cp_lfstack_pop_all(&plain);
+
+        for(int i = 0; i < NODES; i++)
+            cp_lfstack_push(&eliminating, nodes + i);
+        bench.stack = &eliminating;
+        bench_threads("lfstack elimination", threads, lfstack_run, &bench);
+        cp_lfstack_pop_all(&eliminating);
+
+        for(int i = 0; i < NODES; i++) {
+            nodes[i].next = locked.top;
+            locked.top = nodes + i;
+        }
+        bench.locked = &locked;
+        bench_threads("mutex stack", threads, locked_run, &bench);
+
+        mtx_destroy(&locked.lock);
+        cp_lfstack_destroy(&plain);
+        cp_lfstack_destroy(&eliminating);
+    }
+
+    free(nodes);
+    return 0;
+}
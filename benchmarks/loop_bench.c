@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_loop.h"
+#include "bench_utils.h"
+
+#define THROUGHPUT_POSTS 1000000
+#define LATENCY_ROUNDS 20000
+
+typedef struct Counter {
+    cp_loop_t* loop;
+    long long count;
+    long long target;
+} Counter;
+
+static void count_post(void* arg) {
+    Counter* counter = arg;
+    if(++counter->count == counter->target)
+        cp_loop_stop(counter->loop);
+}
+
+static int post_many(void* arg) {
+    Counter* counter = arg;
+    for(long long i = 0; i < counter->target; i++)
+        cp_loop_post(counter->loop, count_post, counter);
+    return 0;
+}
+
+static void bench_post_throughput(void) {
+    cp_loop_t loop;
+    cp_loop_init(&loop);
+    Counter counter = { &loop, 0, THROUGHPUT_POSTS };
+
+    thrd_t thread;
+    unsigned long long start = bench_now_ns();
+    thrd_create(&thread, post_many, &counter);
+    cp_loop_run(&loop);
+    unsigned long long elapsed = bench_now_ns() - start;
+    thrd_join(thread, NULL);
+
+    bench_report("loop post throughput (1 producer)", THROUGHPUT_POSTS, elapsed);
+    printf("%-48s %12lld\n", "  doorbell writes", (long long)loop.doorbells);
+    cp_loop_destroy(&loop);
+}
+
+// Two loops on two threads bounce a message back and forth.
+// Half the round trip is the one-way post latency.
+typedef struct PingPong {
+    cp_loop_t loops[2];
+    int rounds;
+    unsigned long long sent;
+    unsigned long long* samples;
+} PingPong;
+
+static void pong(void* arg);
+
+static void ping(void* arg) {
+    PingPong* pp = arg;
+    unsigned long long now = bench_now_ns();
+    if(pp->sent)
+        pp->samples[pp->rounds] = (now - pp->sent) / 2;
+    if(++pp->rounds > LATENCY_ROUNDS) {
+        cp_loop_stop(&pp->loops[1]);
+        cp_loop_stop(&pp->loops[0]);
+        return;
+    }
+    pp->sent = now;
+    cp_loop_post(&pp->loops[1], pong, pp);
+}
+
+static void pong(void* arg) {
+    PingPong* pp = arg;
+    cp_loop_post(&pp->loops[0], ping, pp);
+}
+
+static int run_pong_loop(void* arg) {
+    PingPong* pp = arg;
+    return cp_loop_run(&pp->loops[1]);
+}
+
+static void bench_post_latency(void) {
+    PingPong pp = { 0 };
+    pp.rounds = -1;
+    pp.samples = malloc(sizeof(*pp.samples) * (LATENCY_ROUNDS + 1));
+    cp_loop_init(&pp.loops[0]);
+    cp_loop_init(&pp.loops[1]);
+
+    thrd_t thread;
+    thrd_create(&thread, run_pong_loop, &pp);
+    cp_loop_post(&pp.loops[0], ping, &pp);
+    cp_loop_run(&pp.loops[0]);
+    thrd_join(thread, NULL);
+
+    bench_report_percentiles("loop cross-thread post latency", pp.samples, LATENCY_ROUNDS);
+    free(pp.samples);
+    cp_loop_destroy(&pp.loops[0]);
+    cp_loop_destroy(&pp.loops[1]);
+}
+
+int main(void) {
+    bench_post_throughput();
+    bench_post_latency();
+    return 0;
+}
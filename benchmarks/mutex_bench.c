@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_pi_mutex.h"
+#include "bench_utils.h"
+
+#define LOCKS 20000000
+
+static cp_atomic64 sink;
+
+// Uncontended lock/unlock pairs, generic entry points against the typed
+// fast paths. On Windows the generic ones are out of line calls that
+// switch on the mutex type; building with -Dlto=true lets the compiler
+// inline them as well.
+static void bench_generic(const char* name, mtx_t* mutex) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        mtx_lock(mutex);
+        cp_atomic_store64(&sink, i);
+        mtx_unlock(mutex);
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+}
+
+static void bench_plain(const char* name, mtx_t* mutex) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        cp_mtx_plain_lock(mutex);
+        cp_atomic_store64(&sink, i);
+        cp_mtx_plain_unlock(mutex);
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+}
+
+static void bench_recursive(const char* name, mtx_t* mutex) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        cp_mtx_recursive_lock(mutex);
+        cp_atomic_store64(&sink, i);
+        cp_mtx_recursive_unlock(mutex);
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+}
+
+static void bench_generic_trylock(const char* name, mtx_t* mutex) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        if(mtx_trylock(mutex) == thrd_success) {
+            cp_atomic_store64(&sink, i);
+            mtx_unlock(mutex);
+        }
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+}
+
+static void bench_plain_trylock(const char* name, mtx_t* mutex) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        if(cp_mtx_plain_trylock(mutex) == thrd_success) {
+            cp_atomic_store64(&sink, i);
+            cp_mtx_plain_unlock(mutex);
+        }
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+}
+
+// On Linux the priority inheriting mutex only calls into the kernel when
+// it's contended, so this should stay close to the plain fast path.
+static void bench_pi(const char* name) {
+    cp_pi_mutex_t mutex;
+    cp_pi_mutex_init(&mutex);
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < LOCKS; i++) {
+        cp_pi_mutex_lock(&mutex);
+        cp_atomic_store64(&sink, i);
+        cp_pi_mutex_unlock(&mutex);
+    }
+    bench_report(name, LOCKS, bench_now_ns() - start);
+    cp_pi_mutex_destroy(&mutex);
+}
+
+int main(void) {
+    mtx_t plain, recursive;
+    mtx_init(&plain, mtx_plain);
+    mtx_init(&recursive, mtx_plain | mtx_recursive);
+
+    bench_generic("mtx_lock (plain)", &plain);
+    bench_plain("cp_mtx_plain_lock", &plain);
+    bench_generic_trylock("mtx_trylock (plain)", &plain);
+    bench_plain_trylock("cp_mtx_plain_trylock", &plain);
+    bench_generic("mtx_lock (plain | recursive)", &recursive);
+    bench_recursive("cp_mtx_recursive_lock", &recursive);
+    bench_pi("cp_pi_mutex_lock");
+
+    mtx_destroy(&recursive);
+    mtx_destroy(&plain);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_parallel.h"
+#include "bench_utils.h"
+
+#define FOR_COUNT 2000000
+#define SORT_COUNT 2000000
+
+static double* values;
+static volatile double sink;
+
+// Later indices do more work so a static split would be badly unbalanced.
+static double skewed_work(long long i) {
+    double x = (double)i;
+    int rounds = 1 + (int)(i * 16 / FOR_COUNT);
+    for(int r = 0; r < rounds; r++)
+        x = sqrt(x + r);
+    return x;
+}
+
+static void for_body(long long begin, long long end, void* ctx) {
+    for(long long i = begin; i < end; i++)
+        values[i] = skewed_work(i);
+}
+
+static void reduce_body(long long begin, long long end, void* partial, void* ctx) {
+    double sum = 0;
+    for(long long i = begin; i < end; i++)
+        sum += skewed_work(i);
+    *(double*)partial += sum;
+}
+
+static void reduce_join(void* into, const void* from, void* ctx) {
+    *(double*)into += *(const double*)from;
+}
+
+static int compare_doubles(const void* lhs, const void* rhs) {
+    double a = *(const double*)lhs;
+    double b = *(const double*)rhs;
+    return a < b ? -1 : a > b;
+}
+
+static void fill_random(double* data, int count) {
+    srand(42);
+    for(int i = 0; i < count; i++)
+        data[i] = (double)rand() / RAND_MAX;
+}
+
+static void bench_serial(double* sort_data) {
+    unsigned long long start = bench_now_ns();
+    for(long long i = 0; i < FOR_COUNT; i++)
+        values[i] = skewed_work(i);
+    bench_report("serial loop", FOR_COUNT, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    double sum = 0;
+    for(long long i = 0; i < FOR_COUNT; i++)
+        sum += skewed_work(i);
+    sink = sum;
+    bench_report("serial sum", FOR_COUNT, bench_now_ns() - start);
+
+    fill_random(sort_data, SORT_COUNT);
+    start = bench_now_ns();
+    qsort(sort_data, SORT_COUNT, sizeof(*sort_data), compare_doubles);
+    bench_report("serial qsort", SORT_COUNT, bench_now_ns() - start);
+}
+
+static void bench_threads(int threads, double* sort_data) {
+    cp_pool_t pool;
+    cp_pool_init(&pool, threads - 1);
+    char name[64];
+
+    unsigned long long start = bench_now_ns();
+    cp_parallel_for(&pool, 0, FOR_COUNT, 0, for_body, NULL);
+    snprintf(name, sizeof(name), "cp_parallel_for (%d threads)", threads);
+    bench_report(name, FOR_COUNT, bench_now_ns() - start);
+
+    double sum = 0, zero = 0;
+    start = bench_now_ns();
+    cp_parallel_reduce(&pool, 0, FOR_COUNT, 0, &sum, sizeof(sum), &zero, reduce_body, reduce_join, NULL);
+    sink = sum;
+    snprintf(name, sizeof(name), "cp_parallel_reduce (%d threads)", threads);
+    bench_report(name, FOR_COUNT, bench_now_ns() - start);
+
+    fill_random(sort_data, SORT_COUNT);
+    start = bench_now_ns();
+    cp_parallel_sort(&pool, sort_data, SORT_COUNT, sizeof(*sort_data), compare_doubles);
+    snprintf(name, sizeof(name), "cp_parallel_sort (%d threads)", threads);
+    bench_report(name, SORT_COUNT, bench_now_ns() - start);
+
+    cp_pool_destroy(&pool);
+}
+
+int main(void) {
+    values = malloc(sizeof(*values) * FOR_COUNT);
+    double* sort_data = malloc(sizeof(*sort_data) * SORT_COUNT);
+    if(!values || !sort_data)
+        return EXIT_FAILURE;
+
+    bench_serial(sort_data);
+    int cpus = bench_cpu_count();
+    for(int threads = 1; threads <= cpus; threads *= 2)
+        bench_threads(threads, sort_data);
+    if((cpus & (cpus - 1)) != 0)
+        bench_threads(cpus, sort_data);
+
+    free(sort_data);
+    free(values);
+    return 0;
+}
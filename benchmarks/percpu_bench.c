@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_counter.h"
+#include "../cp_lfstack.h"
+#include "../cp_percpu.h"
+#include "bench_utils.h"
+
+#define OPS 4000000
+#define MAX_THREADS 64
+#define SPARES 1024
+
+enum {
+    COUNTER_PERCPU,
+    COUNTER_ATOMIC,
+    COUNTER_SHARDED,
+    LIST_PERCPU,
+    LIST_LFSTACK
+};
+
+typedef struct Shared {
+    cp_percpu_counter_t percpu;
+    cp_counter_t sharded;
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic64 atomic;
+    cp_percpu_list_t list;
+    cp_lfstack_t stack;
+} Shared;
+
+typedef struct Worker {
+    Shared* shared;
+    int kind;
+    int ops;
+    cp_lfstack_node_t* spares;
+} Worker;
+
+static int run_worker(Worker* worker) {
+    Shared* shared = worker->shared;
+    cp_lfstack_node_t* spares = worker->spares;
+    cp_lfstack_node_t* node = spares;
+    int spare = 1;
+    switch(worker->kind) {
+        case COUNTER_PERCPU:
+            for(int i = 0; i < worker->ops; i++)
+                cp_percpu_counter_add(&shared->percpu, 1);
+            break;
+        case COUNTER_ATOMIC:
+            for(int i = 0; i < worker->ops; i++)
+                cp_atomic_fetch_add64(&shared->atomic, 1);
+            break;
+        case COUNTER_SHARDED:
+            for(int i = 0; i < worker->ops; i++)
+                cp_counter_inc(&shared->sharded);
+            break;
+        case LIST_PERCPU:
+            // A freelist in steady state: free an object and allocate one
+            // back. A thread that moved between the two finds its CPU's
+            // list empty and falls back on a spare of its own.
+            for(int i = 0; i < worker->ops; i++) {
+                cp_percpu_list_push(&shared->list, node);
+                node = cp_percpu_list_pop(&shared->list);
+                if(!node)
+                    node = spares + (spare++ % SPARES);
+            }
+            break;
+        case LIST_LFSTACK:
+            for(int i = 0; i < worker->ops; i++) {
+                cp_lfstack_push(&shared->stack, node);
+                node = cp_lfstack_pop(&shared->stack);
+            }
+            break;
+    }
+    return 0;
+}
+
+static void bench_kind(Shared* shared, const char* name, int kind, int threads) {
+    thrd_t handles[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < threads; i++) {
+        workers[i] = (Worker){ shared, kind, OPS / threads, malloc(sizeof(cp_lfstack_node_t) * SPARES) };
+        thrd_create(handles + i, (thrd_start_t)run_worker, workers + i);
+    }
+    for(int i = 0; i < threads; i++)
+        thrd_join(handles[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char label[96];
+    snprintf(label, sizeof(label), "%s, %d threads", name, threads);
+    bench_report(label, (unsigned long long)(OPS / threads) * threads, elapsed);
+
+    // The lists may still hold spares of any worker.
+    cp_percpu_list_drain(&shared->list);
+    cp_lfstack_pop_all(&shared->stack);
+    for(int i = 0; i < threads; i++)
+        free(workers[i].spares);
+}
+
+int main(void) {
+    Shared* shared = malloc(sizeof(*shared) + CP_CACHE_LINE);
+    shared = (Shared*)(((uintptr_t)shared + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1));
+    cp_percpu_counter_init(&shared->percpu);
+    cp_counter_init(&shared->sharded, 0);
+    shared->atomic = 0;
+    cp_percpu_list_init(&shared->list);
+    cp_lfstack_init(&shared->stack, 0);
+
+    printf("restartable sequences: %s\n", cp_percpu_register() == thrd_success ? "yes" : "no");
+
+    int cpus = bench_cpu_count();
+    int max = cpus * 2 < MAX_THREADS ? cpus * 2 : MAX_THREADS;
+    for(int threads = 1; threads <= max; threads *= 2) {
+        bench_kind(shared, "cp_percpu_counter_add", COUNTER_PERCPU, threads);
+        bench_kind(shared, "cp_atomic_fetch_add64", COUNTER_ATOMIC, threads);
+        bench_kind(shared, "cp_counter_inc (per-thread)", COUNTER_SHARDED, threads);
+        bench_kind(shared, "cp_percpu_list pop/push", LIST_PERCPU, threads);
+        bench_kind(shared, "cp_lfstack pop/push", LIST_LFSTACK, threads);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_pipeline.h"
+#include "bench_utils.h"
+
+#define ITEMS 20000
+#define BLOCK_SIZE 4096
+#define WORDS (int)(BLOCK_SIZE / sizeof(uint32_t))
+
+// A synthetic ingest job: parse fills a block, transform and compress churn
+// over it, and write folds it into a checksum in input order.
+typedef struct Block {
+    uint32_t data[WORDS];
+    int index;
+} Block;
+
+typedef struct Job {
+    int produced;
+    uint64_t checksum;
+} Job;
+
+static void* parse(void* item, void* arg) {
+    Job* job = arg;
+    if(job->produced == ITEMS)
+        return NULL;
+
+    Block* block = malloc(sizeof(*block));
+    block->index = job->produced++;
+    uint32_t seed = (uint32_t)block->index * 2654435761u;
+    for(int i = 0; i < WORDS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        block->data[i] = seed;
+    }
+    return block;
+}
+
+static void* transform(void* item, void* arg) {
+    Block* block = item;
+    for(int round = 0; round < 4; round++) {
+        for(int i = 1; i < WORDS; i++)
+            block->data[i] += (block->data[i - 1] >> 3) ^ (uint32_t)round;
+    }
+    return block;
+}
+
+static void* compress(void* item, void* arg) {
+    Block* block = item;
+    for(int round = 0; round < 8; round++) {
+        uint32_t run = 0;
+        for(int i = 0; i < WORDS; i++) {
+            run = (run * 31) ^ block->data[i];
+            block->data[i] = run;
+        }
+    }
+    return block;
+}
+
+static void* write_out(void* item, void* arg) {
+    Job* job = arg;
+    Block* block = item;
+    job->checksum = job->checksum * 1099511628211ull ^ block->data[WORDS - 1] ^ (uint64_t)block->index;
+    free(block);
+    return NULL;
+}
+
+static uint64_t bench_sequential(void) {
+    Job job = { 0 };
+    unsigned long long start = bench_now_ns();
+    void* item;
+    while((item = parse(NULL, &job)))
+        write_out(compress(transform(item, NULL), NULL), &job);
+    bench_report("sequential loop", ITEMS, bench_now_ns() - start);
+    return job.checksum;
+}
+
+static void bench_tokens(cp_pool_t* pool, int tokens, uint64_t expected) {
+    Job job = { 0 };
+    cp_pipeline_t pipeline;
+    cp_pipeline_init(&pipeline, pool);
+    cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, parse, &job);
+    cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, transform, NULL);
+    cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, compress, NULL);
+    cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, write_out, &job);
+
+    unsigned long long start = bench_now_ns();
+    cp_pipeline_run(&pipeline, tokens);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char label[64];
+    snprintf(label, sizeof(label), "cp_pipeline, %d tokens", tokens);
+    bench_report(label, ITEMS, elapsed);
+    if(job.checksum != expected)
+        printf("checksum mismatch with %d tokens\n", tokens);
+
+    cp_pipeline_destroy(&pipeline);
+}
+
+int main(void) {
+    cp_pool_t pool;
+    cp_pool_init(&pool, -1);
+    printf("pool workers: %d\n", cp_pool_size(&pool));
+
+    uint64_t expected = bench_sequential();
+    for(int tokens = 1; tokens <= 64; tokens *= 2)
+        bench_tokens(&pool, tokens, expected);
+
+    cp_pool_destroy(&pool);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_ring.h"
+#include "bench_utils.h"
+
+#define EVENTS 2000000
+#define CAPACITY 4096
+#define MAX_PRODUCERS 4
+
+typedef struct Event {
+    unsigned long long stamp;
+    int64_t value;
+} Event;
+
+typedef struct Stage {
+    cp_ring_consumer_t consumer;
+    // Only the last stage records latencies.
+    unsigned long long* samples;
+    int64_t sum;
+} Stage;
+
+static int run_stage(void* arg) {
+    Stage* stage = arg;
+    cp_ring_t* ring = stage->consumer.ring;
+    int64_t first;
+    size_t count;
+    while((count = cp_ring_wait(&stage->consumer, &first)) > 0) {
+        unsigned long long now = stage->samples ? bench_now_ns() : 0;
+        for(size_t i = 0; i < count; i++) {
+            Event* event = cp_ring_slot(ring, first + (int64_t)i);
+            stage->sum += event->value;
+            if(stage->samples)
+                stage->samples[first + (int64_t)i] = now - event->stamp;
+        }
+        cp_ring_release(&stage->consumer, count);
+    }
+    return 0;
+}
+
+typedef struct Producer {
+    cp_ring_t* ring;
+    int64_t events;
+} Producer;
+
+static int produce(void* arg) {
+    Producer* producer = arg;
+    for(int64_t i = 0; i < producer->events; i++) {
+        int64_t sequence = cp_ring_claim(producer->ring, 1);
+        Event* event = cp_ring_slot(producer->ring, sequence);
+        event->stamp = bench_now_ns();
+        event->value = i;
+        cp_ring_publish(producer->ring, sequence, 1);
+    }
+    return 0;
+}
+
+static const char* wait_name(int wait) {
+    switch(wait) {
+        case CP_RING_BUSY_SPIN: return "busy spin";
+        case CP_RING_YIELD: return "yield";
+        default: return "park";
+    }
+}
+
+// A journal and a replicator read every event in parallel, and the logic
+// stage reads it after both. Latency is from the producer stamping an event
+// to the logic stage picking it up.
+static void bench_diamond(int producers, int wait) {
+    cp_ring_t ring;
+    Stage journal = { 0 }, replicate = { 0 }, logic = { 0 };
+    cp_ring_init(&ring, sizeof(Event), CAPACITY, producers > 1 ? CP_RING_MULTI_PRODUCER : CP_RING_SINGLE_PRODUCER, wait);
+    cp_ring_consumer_init(&journal.consumer, &ring, NULL, 0);
+    cp_ring_consumer_init(&replicate.consumer, &ring, NULL, 0);
+    cp_ring_consumer_t* both[] = { &journal.consumer, &replicate.consumer };
+    cp_ring_consumer_init(&logic.consumer, &ring, both, 2);
+    logic.samples = malloc(sizeof(*logic.samples) * EVENTS);
+
+    thrd_t stages[3], threads[MAX_PRODUCERS];
+    Producer args[MAX_PRODUCERS];
+    Stage* all[] = { &journal, &replicate, &logic };
+    for(int i = 0; i < 3; i++)
+        thrd_create(stages + i, run_stage, all[i]);
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < producers; i++) {
+        args[i] = (Producer){ &ring, EVENTS / producers };
+        thrd_create(threads + i, produce, args + i);
+    }
+    for(int i = 0; i < producers; i++)
+        thrd_join(threads[i], NULL);
+    cp_ring_close(&ring);
+    for(int i = 0; i < 3; i++)
+        thrd_join(stages[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "diamond, %d producer(s), %s", producers, wait_name(wait));
+    bench_report(name, EVENTS, elapsed);
+    bench_report_percentiles(name, logic.samples, EVENTS);
+
+    free(logic.samples);
+    cp_ring_destroy(&ring);
+}
+
+int main(void) {
+    int cpus = bench_cpu_count();
+    for(int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+        // Spinning only makes sense with a core for every thread.
+        if(cpus >= producers + 3)
+            bench_diamond(producers, CP_RING_BUSY_SPIN);
+        bench_diamond(producers, CP_RING_YIELD);
+        bench_diamond(producers, CP_RING_PARK);
+    }
+    return 0;
+}
@@ -0,0 +1,445 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "bench_utils.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+// Runs each standard primitive at 1 to N threads and prints one row per
+// run with throughput and, where the kernel allows it, hardware and
+// software counters per operation. Counters that can't be opened are left
+// empty (CSV) or null (JSON), so a curve is still produced without them.
+//
+//     scalability_bench [--json] [--max-threads N] [--ops N]
+
+#define MAX_THREADS 256
+#define DEFAULT_OPS 200000
+
+// ============================================================================
+// Counters
+// ============================================================================
+
+enum {
+    counter_cycles,
+    counter_instructions,
+    counter_cache_misses,
+    counter_llc_misses,
+    counter_context_switches,
+    counter_migrations,
+    counter_count
+};
+
+static const char* counter_names[counter_count] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "llc_misses",
+    "context_switches",
+    "cpu_migrations"
+};
+
+typedef struct Counters {
+    int fds[counter_count];
+    // Negative when the counter isn't available.
+    double values[counter_count];
+#if defined(__linux__)
+    long switches_before;
+#endif
+} Counters;
+
+#if defined(__linux__)
+
+static int perf_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    // Worker threads are created after the counter is opened, so they
+    // inherit it and their counts are folded in when they exit.
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if(fd < 0) {
+        // Unprivileged users are often limited to user space counts.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+static long rusage_switches(void) {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static void counters_open(Counters* counters) {
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[counter_count] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS }
+    };
+
+    for(int i = 0; i < counter_count; i++)
+        counters->fds[i] = perf_open(events[i].type, events[i].config);
+}
+
+static void counters_start(Counters* counters) {
+    for(int i = 0; i < counter_count; i++) {
+        if(counters->fds[i] < 0)
+            continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    counters->switches_before = rusage_switches();
+}
+
+static void counters_stop(Counters* counters) {
+    for(int i = 0; i < counter_count; i++) {
+        counters->values[i] = -1;
+        if(counters->fds[i] < 0)
+            continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // Scale up if the kernel had to multiplex the counter.
+        uint64_t data[3];
+        if(read(counters->fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        counters->values[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+    }
+
+    // getrusage still counts switches when perf events are off limits.
+    long switches = rusage_switches();
+    if(counters->values[counter_context_switches] < 0 && switches >= 0 && counters->switches_before >= 0)
+        counters->values[counter_context_switches] = (double)(switches - counters->switches_before);
+}
+
+static void counters_close(Counters* counters) {
+    for(int i = 0; i < counter_count; i++) {
+        if(counters->fds[i] >= 0)
+            close(counters->fds[i]);
+    }
+}
+
+#else
+
+static void counters_open(Counters* counters) {
+    for(int i = 0; i < counter_count; i++)
+        counters->fds[i] = -1;
+}
+
+static void counters_start(Counters* counters) {
+}
+
+static void counters_stop(Counters* counters) {
+    for(int i = 0; i < counter_count; i++)
+        counters->values[i] = -1;
+}
+
+static void counters_close(Counters* counters) {
+}
+
+#endif
+
+// ============================================================================
+// Workloads
+// ============================================================================
+
+typedef struct Workload {
+    const char* name;
+    // Receives type, which only the mutex workloads use.
+    void (*setup)(int type);
+    void (*teardown)(void);
+    // Runs ops operations on behalf of thread index of count.
+    void (*run)(int index, int count, int ops);
+    // Some workloads are much slower per op, so they run fewer.
+    int ops_divisor;
+    int type;
+} Workload;
+
+static mtx_t mutex;
+static cnd_t cond;
+static tss_t key;
+static once_flag once = ONCE_FLAG_INIT;
+static cp_atomic64 shared;
+static int64_t turn;
+
+static void mutex_setup(int type) {
+    mtx_init(&mutex, type);
+    shared = 0;
+}
+
+static void mutex_teardown(void) {
+    mtx_destroy(&mutex);
+}
+
+static void mutex_run(int index, int count, int ops) {
+    for(int i = 0; i < ops; i++) {
+        mtx_lock(&mutex);
+        cp_atomic_store64(&shared, cp_atomic_load64(&shared) + 1);
+        mtx_unlock(&mutex);
+    }
+}
+
+static void cnd_setup(int type) {
+    mtx_init(&mutex, mtx_plain);
+    cnd_init(&cond);
+    turn = 0;
+}
+
+static void cnd_teardown(void) {
+    cnd_destroy(&cond);
+    mtx_destroy(&mutex);
+}
+
+// The threads pass a turn around in order, so every op is a wait for the
+// previous thread and a broadcast to the rest.
+static void cnd_run(int index, int count, int ops) {
+    mtx_lock(&mutex);
+    for(int i = 0; i < ops; i++) {
+        while(turn % count != index)
+            cnd_wait(&cond, &mutex);
+        turn++;
+        cnd_broadcast(&cond);
+    }
+    mtx_unlock(&mutex);
+}
+
+static void tss_setup(int type) {
+    tss_create(&key, NULL);
+}
+
+static void tss_teardown(void) {
+    tss_delete(key);
+}
+
+static void tss_run(int index, int count, int ops) {
+    intptr_t sum = 0;
+    for(int i = 0; i < ops; i++) {
+        tss_set(key, (void*)(intptr_t)i);
+        sum += (intptr_t)tss_get(key);
+    }
+    cp_atomic_fetch_add64(&shared, (int64_t)sum);
+}
+
+static void once_init(void) {
+    cp_atomic_fetch_add64(&shared, 1);
+}
+
+static void once_run(int index, int count, int ops) {
+    for(int i = 0; i < ops; i++)
+        call_once(&once, once_init);
+}
+
+static void once_setup(int type) {
+}
+
+static void once_teardown(void) {
+}
+
+static const Workload workloads[] = {
+    { "mtx_plain", mutex_setup, mutex_teardown, mutex_run, 1, mtx_plain },
+    { "mtx_timed", mutex_setup, mutex_teardown, mutex_run, 1, mtx_timed },
+    { "mtx_recursive", mutex_setup, mutex_teardown, mutex_run, 1, mtx_plain | mtx_recursive },
+    { "mtx_timed_recursive", mutex_setup, mutex_teardown, mutex_run, 1, mtx_timed | mtx_recursive },
+    { "cnd_broadcast_ring", cnd_setup, cnd_teardown, cnd_run, 20, 0 },
+    { "tss_get_set", tss_setup, tss_teardown, tss_run, 1, 0 },
+    { "call_once", once_setup, once_teardown, once_run, 1, 0 }
+};
+
+// ============================================================================
+// Runner
+// ============================================================================
+
+typedef struct Worker {
+    const Workload* workload;
+    int index;
+    int count;
+    int ops;
+} Worker;
+
+static cp_atomic32 ready;
+static cp_atomic32 go;
+
+static int worker_main(void* arg) {
+    Worker* worker = arg;
+    cp_atomic_fetch_add32(&ready, 1);
+    while(!cp_atomic_load32(&go))
+        thrd_yield();
+    worker->workload->run(worker->index, worker->count, worker->ops);
+    return 0;
+}
+
+typedef struct Result {
+    unsigned long long ops;
+    unsigned long long elapsed_ns;
+    double values[counter_count];
+} Result;
+
+static Result run_once(const Workload* workload, int threads, int ops) {
+    Worker workers[MAX_THREADS];
+    thrd_t handles[MAX_THREADS];
+    Counters counters;
+    Result result;
+
+    workload->setup(workload->type);
+    counters_open(&counters);
+    ready = 0;
+    go = 0;
+    for(int i = 0; i < threads; i++) {
+        workers[i] = (Worker){ workload, i, threads, ops };
+        thrd_create(handles + i, worker_main, workers + i);
+    }
+    while(cp_atomic_load32(&ready) != threads)
+        thrd_yield();
+
+    counters_start(&counters);
+    unsigned long long start = bench_now_ns();
+    cp_atomic_store32(&go, 1);
+    for(int i = 0; i < threads; i++)
+        thrd_join(handles[i], NULL);
+    result.elapsed_ns = bench_now_ns() - start;
+    counters_stop(&counters);
+    counters_close(&counters);
+    workload->teardown();
+
+    result.ops = (unsigned long long)ops * threads;
+    memcpy(result.values, counters.values, sizeof(result.values));
+    return result;
+}
+
+static void print_csv_header(void) {
+    printf("primitive,threads,ops,seconds,ops_per_sec,ns_per_op");
+    for(int i = 0; i < counter_count; i++) {
+        if(i == counter_context_switches || i == counter_migrations)
+            printf(",%s", counter_names[i]);
+        else
+            printf(",%s_per_op", counter_names[i]);
+    }
+    printf("\n");
+}
+
+// Cycles, instructions and misses are reported per op, switches and
+// migrations as totals for the run.
+static double counter_value(const Result* result, int counter) {
+    if(counter == counter_context_switches || counter == counter_migrations)
+        return result->values[counter];
+    return result->values[counter] / (double)result->ops;
+}
+
+static void print_csv_row(const char* name, int threads, const Result* result) {
+    double seconds = result->elapsed_ns / 1e9;
+    printf("%s,%d,%llu,%.6f,%.0f,%.2f",
+           name,
+           threads,
+           result->ops,
+           seconds,
+           seconds > 0 ? result->ops / seconds : 0.0,
+           (double)result->elapsed_ns / result->ops);
+    for(int i = 0; i < counter_count; i++) {
+        if(result->values[i] < 0)
+            printf(",");
+        else
+            printf(",%.3f", counter_value(result, i));
+    }
+    printf("\n");
+}
+
+static void print_json_row(const char* name, int threads, const Result* result, int first) {
+    double seconds = result->elapsed_ns / 1e9;
+    printf("%s\n    {\"primitive\":\"%s\",\"threads\":%d,\"ops\":%llu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"ns_per_op\":%.2f",
+           first ? "" : ",",
+           name,
+           threads,
+           result->ops,
+           seconds,
+           seconds > 0 ? result->ops / seconds : 0.0,
+           (double)result->elapsed_ns / result->ops);
+    for(int i = 0; i < counter_count; i++) {
+        int total = i == counter_context_switches || i == counter_migrations;
+        printf(",\"%s%s\":", counter_names[i], total ? "" : "_per_op");
+        if(result->values[i] < 0)
+            printf("null");
+        else
+            printf("%.3f", counter_value(result, i));
+    }
+    printf("}");
+}
+
+int main(int argc, char** argv) {
+    int json = 0;
+    int max_threads = bench_cpu_count();
+    int ops = DEFAULT_OPS;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--json") == 0)
+            json = 1;
+        else if(strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc)
+            max_threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+            ops = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--json] [--max-threads N] [--ops N]\n", argv[0]);
+            return 1;
+        }
+    }
+    // A single core machine still gets a curve to look at.
+    if(max_threads < 4)
+        max_threads = 4;
+    if(max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if(ops < 1)
+        ops = DEFAULT_OPS;
+
+    if(json)
+        printf("{\"runs\":[");
+    else
+        print_csv_header();
+
+    int first = 1;
+    for(size_t w = 0; w < sizeof(workloads) / sizeof(*workloads); w++) {
+        const Workload* workload = workloads + w;
+        int workload_ops = ops / workload->ops_divisor;
+        if(workload_ops < 1)
+            workload_ops = 1;
+
+        // Powers of two, with max_threads itself as the last point.
+        for(int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+            Result result = run_once(workload, threads, workload_ops);
+            if(json)
+                print_json_row(workload->name, threads, &result, first);
+            else
+                print_csv_row(workload->name, threads, &result);
+            first = 0;
+            fflush(stdout);
+        }
+    }
+
+    if(json)
+        printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_stack_arena.h"
+#include "bench_utils.h"
+
+#if !defined(_MSC_VER)
+#include <sys/resource.h>
+#endif
+
+#define SPAWNS 5000
+#define STACK_SIZE (2 << 20)
+// How much stack each thread writes, as a worker with deep call chains would.
+#define TOUCH_SIZE (256 * 1024)
+
+static long minor_faults(void) {
+#if defined(_MSC_VER)
+    return -1;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_minflt;
+#endif
+}
+
+static int touch_stack(void* arg) {
+    volatile unsigned char buffer[TOUCH_SIZE];
+    for(size_t i = 0; i < TOUCH_SIZE; i += 512)
+        buffer[i] = (unsigned char)i;
+    return buffer[0];
+}
+
+static int nothing(void* arg) {
+    return 0;
+}
+
+// Latency of each create until the thread has been joined, with the page
+// faults the whole run took. Threads run one at a time, as short lived
+// workers would.
+static void bench_spawn(const char* name, cp_stack_arena_t* arena, thrd_start_t func) {
+    unsigned long long* samples = malloc(sizeof(*samples) * SPAWNS);
+    long faults = minor_faults();
+    unsigned long long total = bench_now_ns();
+
+    for(int i = 0; i < SPAWNS; i++) {
+        thrd_t thread;
+        unsigned long long start = bench_now_ns();
+        if(arena) {
+            cp_stack_arena_create(arena, &thread, func, NULL);
+            cp_stack_arena_join(arena, thread, NULL);
+        } else {
+            thrd_create(&thread, func, NULL);
+            thrd_join(thread, NULL);
+        }
+        samples[i] = bench_now_ns() - start;
+    }
+
+    total = bench_now_ns() - total;
+    long after = minor_faults();
+    bench_report(name, SPAWNS, total);
+    bench_report_percentiles(name, samples, SPAWNS);
+    if(faults >= 0 && after >= 0)
+        printf("%-48s %12.2f page faults/thread\n", "", (double)(after - faults) / SPAWNS);
+    free(samples);
+}
+
+// Stacks are only reused one at a time above, so this run keeps many
+// threads alive at once to show the first touch of every stack.
+static void bench_first_touch(const char* name, int flags, int threads) {
+    cp_stack_arena_t arena;
+    thrd_t* handles = malloc(sizeof(*handles) * threads);
+    if(cp_stack_arena_init(&arena, threads, STACK_SIZE, flags) != thrd_success) {
+        printf("%-48s unavailable\n", name);
+        free(handles);
+        return;
+    }
+
+    long faults = minor_faults();
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < threads; i++)
+        cp_stack_arena_create(&arena, handles + i, touch_stack, NULL);
+    for(int i = 0; i < threads; i++)
+        cp_stack_arena_join(&arena, handles[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+    long after = minor_faults();
+
+    cp_stack_arena_stats_t stats;
+    cp_stack_arena_stats(&arena, &stats);
+    bench_report(name, threads, elapsed);
+    if(faults >= 0 && after >= 0)
+        printf("%-48s %12.2f page faults/thread %10zu KiB resident\n", "", (double)(after - faults) / threads, stats.resident_bytes / 1024);
+
+    cp_stack_arena_destroy(&arena);
+    free(handles);
+}
+
+int main(void) {
+    cp_stack_arena_t arena;
+    cp_stack_arena_init(&arena, 4, STACK_SIZE, 0);
+
+    bench_spawn("spawn, thrd_create", NULL, nothing);
+    bench_spawn("spawn, arena", &arena, nothing);
+    bench_spawn("spawn and touch, thrd_create", NULL, touch_stack);
+    bench_spawn("spawn and touch, arena", &arena, touch_stack);
+    cp_stack_arena_destroy(&arena);
+
+    bench_first_touch("first touch, 256 stacks", 0, 256);
+    bench_first_touch("first touch, 256 prefaulted stacks", CP_STACK_PREFAULT, 256);
+    bench_first_touch("first touch, 256 huge page stacks", CP_STACK_HUGE_PAGES, 256);
+    return 0;
+}
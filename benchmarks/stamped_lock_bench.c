@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_stamped_lock.h"
+#include "bench_utils.h"
+
+#define READS_PER_THREAD 2000000
+#define MAX_THREADS 64
+
+// A small config-like record read as a whole.
+typedef struct Snapshot {
+    cp_atomic64 fields[4];
+} Snapshot;
+
+static Snapshot snapshot;
+static cp_stamped_lock_t lock;
+static mtx_t mutex;
+static cp_atomic32 ready;
+static cp_atomic32 go;
+static cp_atomic32 readers_left;
+static cp_atomic64 sink;
+
+static void wait_start(void) {
+    cp_atomic_fetch_add32(&ready, 1);
+    while(!cp_atomic_load32(&go))
+        thrd_yield();
+}
+
+static int64_t read_fields(void) {
+    int64_t sum = 0;
+    for(int i = 0; i < 4; i++)
+        sum += cp_atomic_load64(&snapshot.fields[i]);
+    return sum;
+}
+
+static int optimistic_reader(void* arg) {
+    int64_t sum = 0;
+    int fallbacks = 0;
+    wait_start();
+    for(int i = 0; i < READS_PER_THREAD; i++) {
+        cp_stamp_t stamp = cp_stamped_lock_optimistic(&lock);
+        int64_t value = read_fields();
+        if(!cp_stamped_lock_validate(&lock, stamp)) {
+            stamp = cp_stamped_lock_read(&lock);
+            value = read_fields();
+            cp_stamped_lock_read_unlock(&lock, stamp);
+            fallbacks++;
+        }
+        sum += value;
+    }
+    cp_atomic_fetch_add64(&sink, sum + fallbacks);
+    cp_atomic_fetch_add32(&readers_left, -1);
+    return 0;
+}
+
+static int shared_reader(void* arg) {
+    int64_t sum = 0;
+    wait_start();
+    for(int i = 0; i < READS_PER_THREAD; i++) {
+        cp_stamp_t stamp = cp_stamped_lock_read(&lock);
+        sum += read_fields();
+        cp_stamped_lock_read_unlock(&lock, stamp);
+    }
+    cp_atomic_fetch_add64(&sink, sum);
+    cp_atomic_fetch_add32(&readers_left, -1);
+    return 0;
+}
+
+static int mutex_reader(void* arg) {
+    int64_t sum = 0;
+    wait_start();
+    for(int i = 0; i < READS_PER_THREAD; i++) {
+        mtx_lock(&mutex);
+        sum += read_fields();
+        mtx_unlock(&mutex);
+    }
+    cp_atomic_fetch_add64(&sink, sum);
+    cp_atomic_fetch_add32(&readers_left, -1);
+    return 0;
+}
+
+// Updates the record about every 100us until the readers finish.
+static int slow_writer(void* arg) {
+    wait_start();
+    while(cp_atomic_load32(&readers_left) > 0) {
+        cp_stamp_t stamp = cp_stamped_lock_write(&lock);
+        for(int i = 0; i < 4; i++)
+            cp_atomic_store64(&snapshot.fields[i], cp_atomic_load64(&snapshot.fields[i]) + 1);
+        cp_stamped_lock_write_unlock(&lock, stamp);
+
+        unsigned long long until = bench_now_ns() + 100000;
+        while(bench_now_ns() < until && cp_atomic_load32(&readers_left) > 0)
+            thrd_yield();
+    }
+    return 0;
+}
+
+static void bench_readers(const char* label, thrd_start_t reader, int reader_count, int with_writer) {
+    thrd_t threads[MAX_THREADS + 1];
+    int total = reader_count + (with_writer ? 1 : 0);
+    ready = 0;
+    go = 0;
+    readers_left = reader_count;
+
+    for(int i = 0; i < reader_count; i++)
+        thrd_create(threads + i, reader, NULL);
+    if(with_writer)
+        thrd_create(threads + reader_count, slow_writer, NULL);
+    while(cp_atomic_load32(&ready) != total)
+        thrd_yield();
+
+    unsigned long long start = bench_now_ns();
+    cp_atomic_store32(&go, 1);
+    for(int i = 0; i < total; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s (%d readers)", label, with_writer ? " + writer" : "", reader_count);
+    bench_report(name, (unsigned long long)READS_PER_THREAD * reader_count, elapsed);
+}
+
+int main(void) {
+    cp_stamped_lock_init(&lock);
+    mtx_init(&mutex, mtx_plain);
+
+    int max_threads = bench_cpu_count();
+    if(max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if(max_threads < 4)
+        max_threads = 4;
+
+    for(int writer = 0; writer <= 1; writer++) {
+        for(int threads = 1; threads <= max_threads; threads *= 2) {
+            bench_readers("stamped optimistic", optimistic_reader, threads, writer);
+            bench_readers("stamped read lock", shared_reader, threads, writer);
+            if(!writer)
+                bench_readers("mutex", mutex_reader, threads, writer);
+        }
+    }
+
+    mtx_destroy(&mutex);
+    cp_stamped_lock_destroy(&lock);
+    return 0;
+}
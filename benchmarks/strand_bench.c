@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_pool.h"
+#include "../cp_strand.h"
+#include "bench_utils.h"
+
+#define OPS 400000
+#define MAX_THREADS 8
+
+// The object every thread updates. Big enough that an update is a few
+// dependent writes rather than one instruction.
+typedef struct Account {
+    uint64_t balance[8];
+    uint64_t updates;
+} Account;
+
+static void account_update(Account* account, uint64_t amount) {
+    for(int i = 0; i < 8; i++)
+        account->balance[i] += amount + account->balance[(i + 1) & 7];
+    account->updates++;
+}
+
+typedef struct Update {
+    cp_strand_task_t task;
+    Account* account;
+    uint64_t amount;
+} Update;
+
+static void run_update(cp_strand_task_t* task) {
+    Update* update = (Update*)task;
+    account_update(update->account, update->amount);
+}
+
+typedef struct Worker {
+    Account* account;
+    mtx_t* lock;
+    cp_strand_t* strand;
+    Update* updates;
+    int ops;
+} Worker;
+
+static int locked_updates(Worker* worker) {
+    for(int i = 0; i < worker->ops; i++) {
+        mtx_lock(worker->lock);
+        account_update(worker->account, (uint64_t)i);
+        mtx_unlock(worker->lock);
+    }
+    return 0;
+}
+
+static int strand_updates(Worker* worker) {
+    for(int i = 0; i < worker->ops; i++) {
+        worker->updates[i] = (Update){ { run_update }, worker->account, (uint64_t)i };
+        cp_strand_post(worker->strand, &worker->updates[i].task);
+    }
+    return 0;
+}
+
+// Splits OPS updates between the threads and times until every update has
+// been applied. With a strand that includes tasks still queued when the
+// posters finish.
+static void bench_updates(const char* name, int threads, cp_pool_t* pool, int use_strand) {
+    Account account = { { 0 }, 0 };
+    mtx_t lock;
+    cp_strand_t strand;
+    thrd_t handles[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    mtx_init(&lock, mtx_plain);
+    cp_strand_init(&strand, pool);
+
+    for(int i = 0; i < threads; i++) {
+        workers[i] = (Worker){ &account, &lock, &strand, NULL, OPS / threads };
+        if(use_strand)
+            workers[i].updates = malloc(sizeof(Update) * workers[i].ops);
+    }
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < threads; i++)
+        thrd_create(handles + i, (thrd_start_t)(use_strand ? strand_updates : locked_updates), workers + i);
+    for(int i = 0; i < threads; i++)
+        thrd_join(handles[i], NULL);
+    while(cp_atomic_load32(&strand.count) != 0)
+        thrd_yield();
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    char label[96];
+    snprintf(label, sizeof(label), "%s, %d threads", name, threads);
+    bench_report(label, account.updates, elapsed);
+
+    for(int i = 0; i < threads; i++)
+        free(workers[i].updates);
+    cp_strand_destroy(&strand);
+    mtx_destroy(&lock);
+}
+
+int main(void) {
+    cp_pool_t pool;
+    cp_pool_init(&pool, 1);
+
+    int cpus = bench_cpu_count();
+    int max = cpus * 2 < MAX_THREADS ? cpus * 2 : MAX_THREADS;
+    for(int threads = 1; threads <= max; threads *= 2) {
+        bench_updates("mtx_plain", threads, NULL, 0);
+        bench_updates("cp_strand (inline)", threads, NULL, 1);
+        bench_updates("cp_strand (pool)", threads, &pool, 1);
+    }
+
+    cp_pool_destroy(&pool);
+    return 0;
+}
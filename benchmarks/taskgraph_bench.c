@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_taskgraph.h"
+#include "bench_utils.h"
+
+#define TASK_COUNT 100000
+#define RUNS 10
+#define LAYER_WIDTH 1000
+
+static cp_atomic64 work_done;
+
+static void tiny_task(void* arg) {
+    cp_atomic_fetch_add64(&work_done, 1);
+}
+
+static void bench_graph(const char* name, cp_taskgraph_t* graph) {
+    // The first run validates the graph, so keep it out of the timing.
+    cp_taskgraph_run_and_wait(graph);
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < RUNS; i++)
+        cp_taskgraph_run_and_wait(graph);
+    bench_report(name, (unsigned long long)graph->node_count * RUNS, bench_now_ns() - start);
+}
+
+// One root, 100k independent tasks, one sink.
+static void bench_wide(cp_pool_t* pool) {
+    cp_taskgraph_t graph;
+    cp_taskgraph_init(&graph, pool);
+    int root, sink;
+    cp_taskgraph_add(&graph, &root, tiny_task, NULL);
+    cp_taskgraph_add(&graph, &sink, tiny_task, NULL);
+    for(int i = 0; i < TASK_COUNT; i++) {
+        int id;
+        cp_taskgraph_add(&graph, &id, tiny_task, NULL);
+        cp_taskgraph_precede(&graph, root, id);
+        cp_taskgraph_precede(&graph, id, sink);
+    }
+    bench_graph("taskgraph wide (100k)", &graph);
+    cp_taskgraph_destroy(&graph);
+}
+
+// A single chain of 100k tasks. Measures the continuation path.
+static void bench_deep(cp_pool_t* pool) {
+    cp_taskgraph_t graph;
+    cp_taskgraph_init(&graph, pool);
+    int previous = -1;
+    for(int i = 0; i < TASK_COUNT; i++) {
+        int id;
+        cp_taskgraph_add(&graph, &id, tiny_task, NULL);
+        if(previous >= 0)
+            cp_taskgraph_precede(&graph, previous, id);
+        previous = id;
+    }
+    bench_graph("taskgraph deep (100k chain)", &graph);
+    cp_taskgraph_destroy(&graph);
+}
+
+// Layers of 1000 tasks, each depending on two tasks of the layer before.
+static void bench_layered(cp_pool_t* pool) {
+    cp_taskgraph_t graph;
+    cp_taskgraph_init(&graph, pool);
+    srand(7);
+    for(int i = 0; i < TASK_COUNT; i++) {
+        int id;
+        cp_taskgraph_add(&graph, &id, tiny_task, NULL);
+        if(i >= LAYER_WIDTH) {
+            int layer_start = (i / LAYER_WIDTH - 1) * LAYER_WIDTH;
+            cp_taskgraph_precede(&graph, layer_start + rand() % LAYER_WIDTH, id);
+            cp_taskgraph_precede(&graph, layer_start + (i % LAYER_WIDTH), id);
+        }
+    }
+    bench_graph("taskgraph layered (100 x 1000)", &graph);
+    cp_taskgraph_destroy(&graph);
+}
+
+int main(void) {
+    cp_pool_t pool;
+    cp_pool_init(&pool, -1);
+    printf("pool workers: %d\n", cp_pool_size(&pool));
+
+    bench_wide(&pool);
+    bench_deep(&pool);
+    bench_layered(&pool);
+
+    cp_pool_destroy(&pool);
+    return 0;
+}
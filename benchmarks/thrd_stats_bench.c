@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_thrd_stats.h"
+#include "bench_utils.h"
+
+#define THREADS 64
+#define PASSES 200
+#define SELF_SAMPLES 200000
+
+static cp_atomic32 registered;
+static cp_atomic32 stop;
+
+static int idle(void* arg) {
+    cp_atomic_fetch_add32(&registered, 1);
+    while(!cp_atomic_load32(&stop))
+        thrd_sleep(&(struct timespec){ 0, 1000000 }, NULL);
+    return 0;
+}
+
+// What a once a second sampler pays: list the registry, then read the
+// statistics of every thread in it.
+static void bench_sampling(void) {
+    thrd_t threads[THREADS];
+    char name[CP_THRD_NAME_SIZE];
+    for(int i = 0; i < THREADS; i++) {
+        snprintf(name, sizeof(name), "idle %d", i);
+        cp_thrd_create_named(threads + i, idle, NULL, name);
+    }
+    while(cp_atomic_load32(&registered) < THREADS)
+        thrd_yield();
+
+    cp_thrd_info_t infos[THREADS];
+    cp_thrd_stats_t stats;
+    unsigned long long list_ns = 0, stats_ns = 0;
+    for(int pass = 0; pass < PASSES; pass++) {
+        unsigned long long start = bench_now_ns();
+        size_t count = cp_thrd_list(infos, THREADS);
+        unsigned long long listed = bench_now_ns();
+        for(size_t i = 0; i < count && i < THREADS; i++)
+            cp_thrd_stats(&stats, infos[i].thread);
+        unsigned long long done = bench_now_ns();
+        list_ns += listed - start;
+        stats_ns += done - listed;
+    }
+
+    cp_atomic_store32(&stop, 1);
+    for(int i = 0; i < THREADS; i++)
+        thrd_join(threads[i], NULL);
+
+    char label[64];
+    snprintf(label, sizeof(label), "cp_thrd_list (%d threads)", THREADS);
+    bench_report(label, PASSES, list_ns);
+    bench_report("cp_thrd_stats (other thread)", (unsigned long long)PASSES * THREADS, stats_ns);
+    bench_report("full sampling pass", PASSES, list_ns + stats_ns);
+}
+
+static void bench_self(void) {
+    cp_thrd_stats_t stats;
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < SELF_SAMPLES; i++)
+        cp_thrd_stats(&stats, thrd_current());
+    bench_report("cp_thrd_stats (calling thread)", SELF_SAMPLES, bench_now_ns() - start);
+}
+
+int main(void) {
+    bench_self();
+    bench_sampling();
+    return 0;
+}
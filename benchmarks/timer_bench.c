@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_timer.h"
+#include "bench_utils.h"
+
+#define TIMER_COUNT 1000000
+#define THREAD_COUNT 4
+
+static void nop_timer(void* arg) {
+    (void)arg;
+}
+
+static void bench_schedule_cancel(cp_timer_t* timers) {
+    cp_timer_wheel_t wheel;
+    cp_timer_wheel_init(&wheel, 1);
+
+    // Spread deadlines over the first three levels like request timeouts would be.
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < TIMER_COUNT; i++)
+        cp_timer_wheel_schedule(&wheel, timers + i, 1000 + (i % 200000), nop_timer, NULL);
+    unsigned long long scheduled = bench_now_ns();
+    for(int i = 0; i < TIMER_COUNT; i++)
+        cp_timer_wheel_cancel(&wheel, timers + i);
+    unsigned long long cancelled = bench_now_ns();
+
+    bench_report("timer wheel schedule", TIMER_COUNT, scheduled - start);
+    bench_report("timer wheel cancel", TIMER_COUNT, cancelled - scheduled);
+    cp_timer_wheel_destroy(&wheel);
+}
+
+static void bench_expire(cp_timer_t* timers) {
+    cp_timer_wheel_t wheel;
+    cp_timer_wheel_init(&wheel, 1);
+
+    for(int i = 0; i < TIMER_COUNT; i++)
+        cp_timer_wheel_schedule(&wheel, timers + i, 1 + (i % 100000), nop_timer, NULL);
+
+    unsigned long long start = bench_now_ns();
+    int fired = 0;
+    while(fired < TIMER_COUNT)
+        fired += cp_timer_wheel_advance(&wheel, 1000);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    bench_report("timer wheel expire and dispatch", TIMER_COUNT, elapsed);
+    cp_timer_wheel_destroy(&wheel);
+}
+
+typedef struct Worker {
+    cp_timer_wheel_t* wheel;
+    cp_timer_t* timers;
+    int count;
+} Worker;
+
+static int schedule_cancel_worker(void* arg) {
+    Worker* worker = arg;
+    for(int i = 0; i < worker->count; i++) {
+        cp_timer_wheel_schedule(worker->wheel, worker->timers + i, 5000 + i % 1000, nop_timer, NULL);
+        cp_timer_wheel_cancel(worker->wheel, worker->timers + i);
+    }
+    return 0;
+}
+
+static void bench_contended(cp_timer_t* timers) {
+    cp_timer_wheel_t wheel;
+    cp_timer_wheel_init(&wheel, 1);
+
+    thrd_t threads[THREAD_COUNT];
+    Worker workers[THREAD_COUNT];
+    int per_thread = TIMER_COUNT / THREAD_COUNT;
+
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < THREAD_COUNT; i++) {
+        workers[i] = (Worker){ &wheel, timers + i * per_thread, per_thread };
+        thrd_create(threads + i, schedule_cancel_worker, workers + i);
+    }
+    for(int i = 0; i < THREAD_COUNT; i++)
+        thrd_join(threads[i], NULL);
+    unsigned long long elapsed = bench_now_ns() - start;
+
+    bench_report("timer wheel schedule+cancel (4 threads)", (unsigned long long)per_thread * THREAD_COUNT, elapsed);
+    cp_timer_wheel_destroy(&wheel);
+}
+
+int main(void) {
+    cp_timer_t* timers = calloc(TIMER_COUNT, sizeof(*timers));
+    if(!timers)
+        return EXIT_FAILURE;
+
+    bench_schedule_cancel(timers);
+    bench_expire(timers);
+    bench_contended(timers);
+
+    free(timers);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef CP_TRACE
+#define CP_TRACE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_trace.h"
+#include "bench_utils.h"
+
+#define UNCONTENDED_LOCKS 5000000
+#define CONTENDED_LOCKS 200000
+#define PING_PONGS 50000
+#define CONTENDING_THREADS 4
+
+// Overhead budgets per call, in ns. With tracing off a wrapper is a load
+// and a branch. With it on it also reads the clock and writes one event.
+// Percentages are misleading next to a 15 ns lock, so the budgets are
+// absolute.
+#define BUDGET_OFF_NS 5.0
+#define BUDGET_ON_NS 50.0
+// A cnd round trip is microseconds of context switching that varies by
+// hundreds of ns from run to run, so it only gets a coarse check.
+#define BUDGET_WAKE_NS 1000.0
+
+static mtx_t mutex;
+static cnd_t cond;
+static int turn;
+static cp_atomic64 shared;
+
+// The parentheses keep the tracing macros from applying, which gives the
+// baseline the wrappers are measured against.
+static unsigned long long bench_raw_uncontended(void) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < UNCONTENDED_LOCKS; i++) {
+        (mtx_lock)(&mutex);
+        cp_atomic_store64(&shared, i);
+        mtx_unlock(&mutex);
+    }
+    return bench_now_ns() - start;
+}
+
+static unsigned long long bench_uncontended(void) {
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < UNCONTENDED_LOCKS; i++) {
+        mtx_lock(&mutex);
+        cp_atomic_store64(&shared, i);
+        mtx_unlock(&mutex);
+    }
+    return bench_now_ns() - start;
+}
+
+static int contend(void* arg) {
+    for(int i = 0; i < CONTENDED_LOCKS; i++) {
+        mtx_lock(&mutex);
+        cp_atomic_store64(&shared, cp_atomic_load64(&shared) + 1);
+        mtx_unlock(&mutex);
+    }
+    return 0;
+}
+
+static unsigned long long bench_contended(void) {
+    thrd_t threads[CONTENDING_THREADS];
+    unsigned long long start = bench_now_ns();
+    for(int i = 0; i < CONTENDING_THREADS; i++)
+        thrd_create(threads + i, contend, NULL);
+    for(int i = 0; i < CONTENDING_THREADS; i++)
+        thrd_join(threads[i], NULL);
+    return bench_now_ns() - start;
+}
+
+static int pong(void* arg) {
+    mtx_lock(&mutex);
+    for(int i = 0; i < PING_PONGS; i++) {
+        while(turn != 1)
+            cnd_wait(&cond, &mutex);
+        turn = 0;
+        cnd_signal(&cond);
+    }
+    mtx_unlock(&mutex);
+    return 0;
+}
+
+// Two threads taking turns through one condition variable, so every round
+// trip is two waits and two wakes.
+static unsigned long long bench_ping_pong(void) {
+    thrd_t thread;
+    turn = 0;
+    unsigned long long start = bench_now_ns();
+    thrd_create(&thread, pong, NULL);
+    mtx_lock(&mutex);
+    for(int i = 0; i < PING_PONGS; i++) {
+        turn = 1;
+        cnd_signal(&cond);
+        while(turn != 0)
+            cnd_wait(&cond, &mutex);
+    }
+    mtx_unlock(&mutex);
+    thrd_join(thread, NULL);
+    return bench_now_ns() - start;
+}
+
+static int over_budget;
+
+// Every op here makes one wrapped call, so the budget applies per op.
+static void report_overhead(const char* name, unsigned long long ops, unsigned long long base, unsigned long long traced, double budget_ns) {
+    double per_call = ((double)traced - (double)base) / ops;
+    int over = per_call > budget_ns;
+    over_budget |= over;
+    bench_report(name, ops, traced);
+    printf("%-48s %+10.2f ns/op %+9.1f%%  budget %.0f ns%s\n",
+           "  overhead",
+           per_call,
+           base ? ((double)traced - (double)base) * 100.0 / base : 0.0,
+           budget_ns,
+           over ? "  OVER BUDGET" : "");
+}
+
+int main(void) {
+    mtx_init(&mutex, mtx_plain);
+    cnd_init(&cond);
+
+    unsigned long long raw = bench_raw_uncontended();
+    unsigned long long stopped = bench_uncontended();
+    cp_trace_start(0);
+    unsigned long long running = bench_uncontended();
+    cp_trace_stop();
+    cp_trace_clear();
+
+    bench_report("uncontended lock (untraced)", UNCONTENDED_LOCKS, raw);
+    report_overhead("uncontended lock (tracing off)", UNCONTENDED_LOCKS, raw, stopped, BUDGET_OFF_NS);
+    report_overhead("uncontended lock (tracing on)", UNCONTENDED_LOCKS, raw, running, BUDGET_ON_NS);
+
+    unsigned long long contended_ops = (unsigned long long)CONTENDED_LOCKS * CONTENDING_THREADS;
+    stopped = bench_contended();
+    cp_trace_start(0);
+    running = bench_contended();
+    cp_trace_stop();
+    bench_report("contended lock (tracing off)", contended_ops, stopped);
+    report_overhead("contended lock (tracing on)", contended_ops, stopped, running, BUDGET_ON_NS);
+
+    stopped = bench_ping_pong();
+    cp_trace_start(0);
+    running = bench_ping_pong();
+    cp_trace_stop();
+    bench_report("cnd ping-pong (tracing off)", PING_PONGS * 2ull, stopped);
+    report_overhead("cnd ping-pong (tracing on)", PING_PONGS * 2ull, stopped, running, BUDGET_WAKE_NS);
+
+    // Export what the last two runs recorded, to measure that as well.
+    FILE* out = tmpfile();
+    if(out) {
+        unsigned long long start = bench_now_ns();
+        cp_trace_export_chrome(out);
+        unsigned long long elapsed = bench_now_ns() - start;
+        printf("%-48s %12ld bytes %10.2f ms\n", "chrome export", ftell(out), elapsed / 1e6);
+        fclose(out);
+    }
+    cp_trace_clear();
+
+    if(over_budget)
+        printf("tracing overhead is over budget\n");
+
+    cnd_destroy(&cond);
+    mtx_destroy(&mutex);
+    return 0;
+}
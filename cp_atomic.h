@@ -0,0 +1,271 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_ATOMIC_H
+#define CP_THREADS_CP_ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Minimal set of atomic operations shared by the cpthreads extensions.
+// MSVC doesn't ship <stdatomic.h> for C, so it gets the Interlocked family,
+// and everything else uses the GCC/Clang __atomic builtins.
+//
+// Loads are acquire, stores are release, and every read-modify-write
+// operation is sequentially consistent.
+
+#define CP_CACHE_LINE 64
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+#include <intrin.h>
+
+#define CP_ALIGNAS(n) __declspec(align(n))
+
+typedef volatile LONG cp_atomic32;
+typedef volatile LONG64 cp_atomic64;
+typedef void* volatile cp_atomic_ptr;
+
+static __inline int32_t cp_atomic_load32(cp_atomic32* obj) {
+    int32_t value = *obj;
+    _ReadWriteBarrier();
+    return value;
+}
+
+static __inline void cp_atomic_store32(cp_atomic32* obj, int32_t value) {
+    InterlockedExchange(obj, value);
+}
+
+static __inline int32_t cp_atomic_fetch_add32(cp_atomic32* obj, int32_t value) {
+    return InterlockedExchangeAdd(obj, value);
+}
+
+static __inline int32_t cp_atomic_exchange32(cp_atomic32* obj, int32_t value) {
+    return InterlockedExchange(obj, value);
+}
+
+static __inline bool cp_atomic_cas32(cp_atomic32* obj, int32_t* expected, int32_t desired) {
+    int32_t prev = InterlockedCompareExchange(obj, desired, *expected);
+    if(prev == *expected)
+        return true;
+    *expected = prev;
+    return false;
+}
+
+static __inline int64_t cp_atomic_load64(cp_atomic64* obj) {
+#if defined(_WIN64)
+    int64_t value = *obj;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return InterlockedCompareExchange64(obj, 0, 0);
+#endif
+}
+
+static __inline void cp_atomic_store64(cp_atomic64* obj, int64_t value) {
+    InterlockedExchange64(obj, value);
+}
+
+static __inline int64_t cp_atomic_fetch_add64(cp_atomic64* obj, int64_t value) {
+    return InterlockedExchangeAdd64(obj, value);
+}
+
+static __inline int64_t cp_atomic_exchange64(cp_atomic64* obj, int64_t value) {
+    return InterlockedExchange64(obj, value);
+}
+
+static __inline bool cp_atomic_cas64(cp_atomic64* obj, int64_t* expected, int64_t desired) {
+    int64_t prev = InterlockedCompareExchange64(obj, desired, *expected);
+    if(prev == *expected)
+        return true;
+    *expected = prev;
+    return false;
+}
+
+static __inline void* cp_atomic_load_ptr(cp_atomic_ptr* obj) {
+    void* value = *obj;
+    _ReadWriteBarrier();
+    return value;
+}
+
+static __inline void cp_atomic_store_ptr(cp_atomic_ptr* obj, void* value) {
+    InterlockedExchangePointer(obj, value);
+}
+
+static __inline void* cp_atomic_exchange_ptr(cp_atomic_ptr* obj, void* value) {
+    return InterlockedExchangePointer(obj, value);
+}
+
+static __inline bool cp_atomic_cas_ptr(cp_atomic_ptr* obj, void** expected, void* desired) {
+    void* prev = InterlockedCompareExchangePointer(obj, desired, *expected);
+    if(prev == *expected)
+        return true;
+    *expected = prev;
+    return false;
+}
+
+// Release stores for a word only one thread ever writes, such as a per-thread
+// slot. The stores above are locked exchanges on MSVC; on x86 and x64 these
+// are a plain mov like the GCC/Clang ones. They don't order the store before
+// later loads.
+static __inline void cp_atomic_store_plain64(cp_atomic64* obj, int64_t value) {
+#if defined(_M_X64)
+    _ReadWriteBarrier();
+    *obj = value;
+    _ReadWriteBarrier();
+#else
+    InterlockedExchange64(obj, value);
+#endif
+}
+
+static __inline void cp_atomic_store_plain_ptr(cp_atomic_ptr* obj, void* value) {
+#if defined(_M_IX86) || defined(_M_X64)
+    _ReadWriteBarrier();
+    *obj = value;
+    _ReadWriteBarrier();
+#else
+    InterlockedExchangePointer(obj, value);
+#endif
+}
+
+static __inline void cp_atomic_fence(void) {
+    MemoryBarrier();
+}
+
+// Keeps earlier loads ahead of later loads and stores. Free on x86.
+static __inline void cp_atomic_fence_acquire(void) {
+#if defined(_M_ARM) || defined(_M_ARM64)
+    MemoryBarrier();
+#else
+    _ReadWriteBarrier();
+#endif
+}
+
+// Only stops the compiler from moving memory accesses across it.
+static __inline void cp_compiler_barrier(void) {
+    _ReadWriteBarrier();
+}
+
+static __inline void cp_cpu_relax(void) {
+    YieldProcessor();
+}
+
+#else
+
+#define CP_ALIGNAS(n) __attribute__((aligned(n)))
+
+typedef volatile int32_t cp_atomic32;
+typedef volatile int64_t cp_atomic64;
+typedef void* volatile cp_atomic_ptr;
+
+static __inline int32_t cp_atomic_load32(cp_atomic32* obj) {
+    return __atomic_load_n(obj, __ATOMIC_ACQUIRE);
+}
+
+static __inline void cp_atomic_store32(cp_atomic32* obj, int32_t value) {
+    __atomic_store_n(obj, value, __ATOMIC_RELEASE);
+}
+
+static __inline int32_t cp_atomic_fetch_add32(cp_atomic32* obj, int32_t value) {
+    return __atomic_fetch_add(obj, value, __ATOMIC_SEQ_CST);
+}
+
+static __inline int32_t cp_atomic_exchange32(cp_atomic32* obj, int32_t value) {
+    return __atomic_exchange_n(obj, value, __ATOMIC_SEQ_CST);
+}
+
+static __inline bool cp_atomic_cas32(cp_atomic32* obj, int32_t* expected, int32_t desired) {
+    return __atomic_compare_exchange_n(obj, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static __inline int64_t cp_atomic_load64(cp_atomic64* obj) {
+    return __atomic_load_n(obj, __ATOMIC_ACQUIRE);
+}
+
+static __inline void cp_atomic_store64(cp_atomic64* obj, int64_t value) {
+    __atomic_store_n(obj, value, __ATOMIC_RELEASE);
+}
+
+static __inline int64_t cp_atomic_fetch_add64(cp_atomic64* obj, int64_t value) {
+    return __atomic_fetch_add(obj, value, __ATOMIC_SEQ_CST);
+}
+
+static __inline int64_t cp_atomic_exchange64(cp_atomic64* obj, int64_t value) {
+    return __atomic_exchange_n(obj, value, __ATOMIC_SEQ_CST);
+}
+
+static __inline bool cp_atomic_cas64(cp_atomic64* obj, int64_t* expected, int64_t desired) {
+    return __atomic_compare_exchange_n(obj, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static __inline void* cp_atomic_load_ptr(cp_atomic_ptr* obj) {
+    return __atomic_load_n(obj, __ATOMIC_ACQUIRE);
+}
+
+static __inline void cp_atomic_store_ptr(cp_atomic_ptr* obj, void* value) {
+    __atomic_store_n(obj, value, __ATOMIC_RELEASE);
+}
+
+static __inline void* cp_atomic_exchange_ptr(cp_atomic_ptr* obj, void* value) {
+    return __atomic_exchange_n(obj, value, __ATOMIC_SEQ_CST);
+}
+
+static __inline bool cp_atomic_cas_ptr(cp_atomic_ptr* obj, void** expected, void* desired) {
+    return __atomic_compare_exchange_n(obj, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static __inline void cp_atomic_store_plain64(cp_atomic64* obj, int64_t value) {
+    __atomic_store_n(obj, value, __ATOMIC_RELEASE);
+}
+
+static __inline void cp_atomic_store_plain_ptr(cp_atomic_ptr* obj, void* value) {
+    __atomic_store_n(obj, value, __ATOMIC_RELEASE);
+}
+
+static __inline void cp_atomic_fence(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// Keeps earlier loads ahead of later loads and stores. Free on x86.
+static __inline void cp_atomic_fence_acquire(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+// Only stops the compiler from moving memory accesses across it.
+static __inline void cp_compiler_barrier(void) {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static __inline void cp_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#endif
+
+#endif
@@ -0,0 +1,367 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stddef.h>
+
+#include "cp_atomic_wait.h"
+
+#if defined(_MSC_VER)
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// A power of two. Addresses that share a bucket only cost each other a
+// skipped fast path, or on the table a spurious wakeup check.
+#define WAIT_BUCKETS 256
+
+typedef struct wait_node {
+    void* addr;
+    struct wait_node* next;
+    int notified;
+} wait_node;
+
+// The mutex, condition and list are only used by words that sleep in the
+// table. The waiter count is used by every wait.
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) wait_bucket {
+    cp_atomic32 waiters;
+    wait_node* head;
+    wait_node* tail;
+    mtx_t lock;
+    cnd_t wake;
+} wait_bucket;
+
+static wait_bucket buckets[WAIT_BUCKETS];
+
+static wait_bucket* bucket_of(void* addr) {
+    uint64_t key = (uint64_t)(uintptr_t)addr;
+    key ^= key >> 29;
+    key *= 0x9E3779B97F4A7C15ull;
+    return buckets + (key >> 56);
+}
+
+// The waiter counts itself before it checks the word, and a notify checks
+// the count after the store that changed the word, each with a full fence
+// in between. Either the waiter sees the new value and doesn't sleep, or
+// the notify sees the waiter and wakes it.
+static void waiter_enter(wait_bucket* bucket) {
+    cp_atomic_fetch_add32(&bucket->waiters, 1);
+    cp_atomic_fence();
+}
+
+static void waiter_leave(wait_bucket* bucket) {
+    cp_atomic_fetch_add32(&bucket->waiters, -1);
+}
+
+static bool has_waiters(wait_bucket* bucket) {
+    cp_atomic_fence();
+    return cp_atomic_load32(&bucket->waiters) != 0;
+}
+
+static bool word_changed(void* addr, int64_t expected, bool wide) {
+    if(wide)
+        return cp_atomic_load64(addr) != expected;
+    return cp_atomic_load32(addr) != (int32_t)expected;
+}
+
+#if !defined(_MSC_VER)
+
+// ============================================================================
+// Wait Table
+// ============================================================================
+
+static once_flag table_once = ONCE_FLAG_INIT;
+static int table_valid = 0;
+
+static void table_init(void) {
+    for(int i = 0; i < WAIT_BUCKETS; i++) {
+        if(mtx_init(&buckets[i].lock, mtx_plain) != thrd_success)
+            return;
+        if(cnd_init(&buckets[i].wake) != thrd_success)
+            return;
+    }
+    table_valid = 1;
+}
+
+static void table_unlink(wait_bucket* bucket, wait_node* node) {
+    wait_node* prev = NULL;
+    for(wait_node* current = bucket->head; current; prev = current, current = current->next) {
+        if(current != node)
+            continue;
+        if(prev)
+            prev->next = node->next;
+        else
+            bucket->head = node->next;
+        if(bucket->tail == node)
+            bucket->tail = prev;
+        return;
+    }
+}
+
+// Notifies change the word before they take the bucket lock, and the word
+// is checked under it, so one can't slip in between the check and the node
+// going on the list.
+static int table_wait(void* addr, int64_t expected, bool wide, const struct timespec* time_point) {
+    call_once(&table_once, table_init);
+    if(!table_valid)
+        return thrd_error;
+
+    wait_bucket* bucket = bucket_of(addr);
+    int result = thrd_success;
+    mtx_lock(&bucket->lock);
+    waiter_enter(bucket);
+
+    if(!word_changed(addr, expected, wide)) {
+        wait_node node = { addr, NULL, 0 };
+        if(bucket->tail)
+            bucket->tail->next = &node;
+        else
+            bucket->head = &node;
+        bucket->tail = &node;
+
+        while(!node.notified) {
+            if(!time_point) {
+                cnd_wait(&bucket->wake, &bucket->lock);
+            } else if(cnd_timedwait(&bucket->wake, &bucket->lock, time_point) == thrd_timedout) {
+                if(!node.notified) {
+                    table_unlink(bucket, &node);
+                    result = thrd_timedout;
+                }
+                break;
+            }
+        }
+    }
+
+    waiter_leave(bucket);
+    mtx_unlock(&bucket->lock);
+    return result;
+}
+
+static void table_notify(void* addr, bool all) {
+    wait_bucket* bucket = bucket_of(addr);
+    if(!has_waiters(bucket) || !table_valid)
+        return;
+
+    bool woke = false;
+    mtx_lock(&bucket->lock);
+    wait_node* prev = NULL;
+    wait_node* node = bucket->head;
+    while(node) {
+        wait_node* next = node->next;
+        if(node->addr != addr) {
+            prev = node;
+            node = next;
+            continue;
+        }
+        if(prev)
+            prev->next = next;
+        else
+            bucket->head = next;
+        if(bucket->tail == node)
+            bucket->tail = prev;
+        node->notified = 1;
+        woke = true;
+        if(!all)
+            break;
+        node = next;
+    }
+    // The bucket's waiters share one condition, so each one checks whether
+    // it was the one notified.
+    if(woke)
+        cnd_broadcast(&bucket->wake);
+    mtx_unlock(&bucket->lock);
+}
+
+#endif
+
+#if defined(_MSC_VER)
+
+// ============================================================================
+// WaitOnAddress
+// ============================================================================
+
+// Rounds up, so a wait that returns early only does so by a timer tick.
+static DWORD wait_ms(const struct timespec* time_point) {
+    if(!time_point)
+        return INFINITE;
+
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    long long ns = (long long)(time_point->tv_sec - now.tv_sec) * 1000000000ll + (time_point->tv_nsec - now.tv_nsec);
+    if(ns <= 0)
+        return 0;
+    long long ms = (ns + 999999) / 1000000;
+    return ms >= INFINITE ? INFINITE - 1 : (DWORD)ms;
+}
+
+static int address_wait(void* addr, int64_t expected, bool wide, const struct timespec* time_point) {
+    wait_bucket* bucket = bucket_of(addr);
+    int32_t expected32 = (int32_t)expected;
+    int result = thrd_success;
+
+    waiter_enter(bucket);
+    while(!word_changed(addr, expected, wide)) {
+        DWORD ms = wait_ms(time_point);
+        if(ms == 0) {
+            result = thrd_timedout;
+            break;
+        }
+        if(WaitOnAddress(addr, wide ? (void*)&expected : (void*)&expected32, wide ? 8 : 4, ms))
+            break;
+        if(GetLastError() != ERROR_TIMEOUT) {
+            result = thrd_error;
+            break;
+        }
+    }
+    waiter_leave(bucket);
+    return result;
+}
+
+static void address_notify(void* addr, bool all) {
+    if(!has_waiters(bucket_of(addr)))
+        return;
+    if(all)
+        WakeByAddressAll(addr);
+    else
+        WakeByAddressSingle(addr);
+}
+
+int ___cp_atomic_wait32_slow(cp_atomic32* addr, int32_t expected, const struct timespec* time_point) {
+    return address_wait((void*)addr, expected, false, time_point);
+}
+
+int ___cp_atomic_wait64_slow(cp_atomic64* addr, int64_t expected, const struct timespec* time_point) {
+    return address_wait((void*)addr, expected, true, time_point);
+}
+
+void cp_atomic_notify_one32(cp_atomic32* addr) {
+    address_notify((void*)addr, false);
+}
+
+void cp_atomic_notify_all32(cp_atomic32* addr) {
+    address_notify((void*)addr, true);
+}
+
+void cp_atomic_notify_one64(cp_atomic64* addr) {
+    address_notify((void*)addr, false);
+}
+
+void cp_atomic_notify_all64(cp_atomic64* addr) {
+    address_notify((void*)addr, true);
+}
+
+#elif defined(__linux__)
+
+// ============================================================================
+// Futex
+// ============================================================================
+
+// FUTEX_WAIT_BITSET takes an absolute deadline, and FUTEX_CLOCK_REALTIME
+// makes it the clock TIME_UTC reads.
+int ___cp_atomic_wait32_slow(cp_atomic32* addr, int32_t expected, const struct timespec* time_point) {
+    wait_bucket* bucket = bucket_of((void*)addr);
+    int result = thrd_success;
+
+    waiter_enter(bucket);
+    long status = syscall(SYS_futex, addr, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME,
+                          expected, time_point, NULL, FUTEX_BITSET_MATCH_ANY);
+    if(status != 0) {
+        switch(errno) {
+            case EAGAIN:
+            case EINTR:
+                // The word had already changed, or a signal came in.
+                break;
+            case ETIMEDOUT:
+                result = thrd_timedout;
+                break;
+            default:
+                result = thrd_error;
+                break;
+        }
+    }
+    waiter_leave(bucket);
+    return result;
+}
+
+static void futex_notify(cp_atomic32* addr, int count) {
+    if(has_waiters(bucket_of((void*)addr)))
+        syscall(SYS_futex, addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, NULL, NULL, 0);
+}
+
+void cp_atomic_notify_one32(cp_atomic32* addr) {
+    futex_notify(addr, 1);
+}
+
+void cp_atomic_notify_all32(cp_atomic32* addr) {
+    futex_notify(addr, INT_MAX);
+}
+
+// Futexes are 32 bits wide.
+int ___cp_atomic_wait64_slow(cp_atomic64* addr, int64_t expected, const struct timespec* time_point) {
+    return table_wait((void*)addr, expected, true, time_point);
+}
+
+void cp_atomic_notify_one64(cp_atomic64* addr) {
+    table_notify((void*)addr, false);
+}
+
+void cp_atomic_notify_all64(cp_atomic64* addr) {
+    table_notify((void*)addr, true);
+}
+
+#else
+
+int ___cp_atomic_wait32_slow(cp_atomic32* addr, int32_t expected, const struct timespec* time_point) {
+    return table_wait((void*)addr, expected, false, time_point);
+}
+
+int ___cp_atomic_wait64_slow(cp_atomic64* addr, int64_t expected, const struct timespec* time_point) {
+    return table_wait((void*)addr, expected, true, time_point);
+}
+
+void cp_atomic_notify_one32(cp_atomic32* addr) {
+    table_notify((void*)addr, false);
+}
+
+void cp_atomic_notify_all32(cp_atomic32* addr) {
+    table_notify((void*)addr, true);
+}
+
+void cp_atomic_notify_one64(cp_atomic64* addr) {
+    table_notify((void*)addr, false);
+}
+
+void cp_atomic_notify_all64(cp_atomic64* addr) {
+    table_notify((void*)addr, true);
+}
+
+#endif
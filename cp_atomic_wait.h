@@ -0,0 +1,99 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_ATOMIC_WAIT_H
+#define CP_THREADS_CP_ATOMIC_WAIT_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Atomic Wait
+// ============================================================================
+
+// Sleeps until an atomic word changes, the building block for custom locks,
+// events and counters that only enter the kernel when a thread has to block.
+//
+//     while(cp_atomic_load32(&ready) == 0)
+//         cp_atomic_wait32(&ready, 0, NULL);
+//
+//     cp_atomic_store32(&ready, 1);
+//     cp_atomic_notify_all32(&ready);
+//
+// A wait returns thrd_success right away if the word doesn't hold expected.
+// Otherwise it sleeps until a notify on the same address, and may also
+// return spuriously, so callers check the word again. It returns
+// thrd_timedout once time_point (absolute, against TIME_UTC) passes, or
+// never if time_point is NULL. A notify that follows the store which
+// changed the word can't be lost, even if the waiter was between its check
+// and going to sleep.
+//
+// Before sleeping a wait checks the word CP_ATOMIC_WAIT_SPINS times. Define
+// it before including this header to change that, or to 0 to go straight
+// to sleep.
+//
+// 32-bit words wait on a futex on Linux, and on WaitOnAddress on Windows,
+// which also takes 64-bit words. Other words and platforms sleep in a
+// table of buckets, each with a mutex and condition variable, hashed by
+// address. Every bucket counts its waiters, and a notify with none skips
+// the kernel, so notifying is cheap when nobody waits.
+
+#if !defined(CP_ATOMIC_WAIT_SPINS)
+#define CP_ATOMIC_WAIT_SPINS 64
+#endif
+
+int ___cp_atomic_wait32_slow(cp_atomic32* addr, int32_t expected, const struct timespec* time_point);
+int ___cp_atomic_wait64_slow(cp_atomic64* addr, int64_t expected, const struct timespec* time_point);
+
+static __inline int cp_atomic_wait32(cp_atomic32* addr, int32_t expected, const struct timespec* time_point) {
+    if(!addr)
+        return thrd_error;
+    for(int i = 0; i < CP_ATOMIC_WAIT_SPINS; i++) {
+        if(cp_atomic_load32(addr) != expected)
+            return thrd_success;
+        cp_cpu_relax();
+    }
+    return ___cp_atomic_wait32_slow(addr, expected, time_point);
+}
+
+static __inline int cp_atomic_wait64(cp_atomic64* addr, int64_t expected, const struct timespec* time_point) {
+    if(!addr)
+        return thrd_error;
+    for(int i = 0; i < CP_ATOMIC_WAIT_SPINS; i++) {
+        if(cp_atomic_load64(addr) != expected)
+            return thrd_success;
+        cp_cpu_relax();
+    }
+    return ___cp_atomic_wait64_slow(addr, expected, time_point);
+}
+
+// Wakes one, or every, thread waiting on the address.
+void cp_atomic_notify_one32(cp_atomic32* addr);
+void cp_atomic_notify_all32(cp_atomic32* addr);
+void cp_atomic_notify_one64(cp_atomic64* addr);
+void cp_atomic_notify_all64(cp_atomic64* addr);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
+#include "cp_bravo_lock.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#endif
+
+// Slots are handed out from blocks that are never freed. Writers walk the
+// blocks without a lock, so a block is fully set up before it's linked in.
+#define SLOTS_PER_BLOCK 64
+
+// How many times longer than the last revocation the bias stays off.
+#define BRAVO_INHIBIT_MULTIPLIER 9
+
+// A writer waiting for a reader to leave its slot spins this many times
+// before yielding.
+#define BRAVO_SPINS 128
+
+typedef struct slot_block {
+    ___cp_bravo_slot slots[SLOTS_PER_BLOCK];
+    struct slot_block* next;
+} slot_block;
+
+thread_local ___cp_bravo_slot* ___cp_bravo_self;
+int ___cp_bravo_reader_fence = 1;
+
+static once_flag bravo_once = ONCE_FLAG_INIT;
+static int bravo_valid = 0;
+static tss_t slot_key;
+static mtx_t slot_lock;
+static cp_atomic_ptr blocks;
+static ___cp_bravo_slot* free_slots;
+
+static int64_t bravo_now_ns(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Runs on the exiting thread, which holds no read lock, so its slot is
+// already clear.
+static void slot_release(void* arg) {
+    ___cp_bravo_slot* slot = arg;
+    mtx_lock(&slot_lock);
+    slot->next_free = free_slots;
+    free_slots = slot;
+    mtx_unlock(&slot_lock);
+}
+
+static void bravo_init(void) {
+    if(mtx_init(&slot_lock, mtx_plain) != thrd_success)
+        return;
+    if(tss_create(&slot_key, slot_release) != thrd_success) {
+        mtx_destroy(&slot_lock);
+        return;
+    }
+
+#if defined(_MSC_VER)
+    ___cp_bravo_reader_fence = 0;
+#elif defined(__linux__)
+    // Registering is what lets this process use the expedited command.
+    long commands = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0);
+    if(commands > 0 && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+       && syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+        ___cp_bravo_reader_fence = 0;
+#endif
+
+    bravo_valid = 1;
+}
+
+// Every thread that was running when this returns has executed a full
+// fence, so its store to a slot is visible or its next load of the bias
+// will see it cleared.
+static void heavy_fence(void) {
+    if(___cp_bravo_reader_fence) {
+        cp_atomic_fence();
+        return;
+    }
+#if defined(_MSC_VER)
+    FlushProcessWriteBuffers();
+#elif defined(__linux__)
+    syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+#endif
+}
+
+static ___cp_bravo_slot* slot_acquire(void) {
+    mtx_lock(&slot_lock);
+    ___cp_bravo_slot* slot = free_slots;
+    if(slot) {
+        free_slots = slot->next_free;
+    } else {
+        void* memory = malloc(sizeof(slot_block) + CP_CACHE_LINE);
+        if(!memory) {
+            mtx_unlock(&slot_lock);
+            return NULL;
+        }
+        uintptr_t aligned = ((uintptr_t)memory + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1);
+        slot_block* block = (slot_block*)aligned;
+        for(int i = 0; i < SLOTS_PER_BLOCK; i++) {
+            block->slots[i].lock = NULL;
+            block->slots[i].next_free = i + 1 < SLOTS_PER_BLOCK ? block->slots + i + 1 : NULL;
+        }
+        block->next = cp_atomic_load_ptr(&blocks);
+        cp_atomic_store_ptr(&blocks, block);
+        slot = block->slots;
+        free_slots = slot->next_free;
+    }
+    mtx_unlock(&slot_lock);
+
+    if(tss_set(slot_key, slot) != thrd_success) {
+        slot_release(slot);
+        return NULL;
+    }
+    ___cp_bravo_self = slot;
+    return slot;
+}
+
+int cp_bravo_lock_init(cp_bravo_lock_t* lock) {
+    if(!lock)
+        return thrd_error;
+
+    call_once(&bravo_once, bravo_init);
+    if(!bravo_valid)
+        return thrd_error;
+
+    lock->bias = 1;
+    lock->inhibit_until = 0;
+    return cp_stamped_lock_init(&lock->lock);
+}
+
+void cp_bravo_lock_destroy(cp_bravo_lock_t* lock) {
+    if(!lock)
+        return;
+    cp_stamped_lock_destroy(&lock->lock);
+}
+
+void ___cp_bravo_read_slow(cp_bravo_lock_t* lock) {
+    // A thread's first read sets up its slot and tries again.
+    if(!___cp_bravo_self && slot_acquire()) {
+        cp_bravo_read_lock(lock);
+        return;
+    }
+
+    cp_stamped_lock_read(&lock->lock);
+    if(!cp_atomic_load32(&lock->bias) && bravo_now_ns() >= lock->inhibit_until)
+        cp_atomic_store32(&lock->bias, 1);
+}
+
+void cp_bravo_write_lock(cp_bravo_lock_t* lock) {
+    cp_stamped_lock_write(&lock->lock);
+    if(!cp_atomic_load32(&lock->bias))
+        return;
+
+    int64_t start = bravo_now_ns();
+    cp_atomic_store32(&lock->bias, 0);
+    heavy_fence();
+
+    for(slot_block* block = cp_atomic_load_ptr(&blocks); block; block = block->next) {
+        for(int i = 0; i < SLOTS_PER_BLOCK; i++) {
+            ___cp_bravo_slot* slot = block->slots + i;
+            for(int spins = 0; cp_atomic_load_ptr(&slot->lock) == lock; spins++) {
+                if(spins < BRAVO_SPINS)
+                    cp_cpu_relax();
+                else
+                    thrd_yield();
+            }
+        }
+    }
+
+    int64_t now = bravo_now_ns();
+    lock->inhibit_until = now + (now - start) * BRAVO_INHIBIT_MULTIPLIER;
+}
@@ -0,0 +1,121 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_BRAVO_LOCK_H
+#define CP_THREADS_CP_BRAVO_LOCK_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+#include "cp_stamped_lock.h"
+
+// ============================================================================
+// Reader Biased Lock
+// ============================================================================
+
+// A reader/writer lock for data that is read constantly and written rarely,
+// such as routing or configuration tables, after BRAVO (Biased Locking for
+// Reader-Writer Locks).
+//
+// Even a shared lock makes every reader increment one counter, so at high
+// core counts readers spend their time passing its cache line around. Here
+// each thread owns a reader slot on its own cache line, shared by every
+// cp_bravo_lock_t. While the lock is biased towards readers, a read lock
+// stores the lock's address in the thread's slot and checks the bias is
+// still on, with nothing in between but a compiler barrier, and a read
+// unlock clears the slot. No reader writes to a line another thread uses.
+//
+// A writer takes the underlying cp_stamped_lock_t, turns the bias off and
+// then has to wait for every slot holding this lock to clear. Because
+// readers don't fence, the writer forces a fence onto every running thread
+// of the process first: membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) on
+// Linux, FlushProcessWriteBuffers on Windows. Where neither is available,
+// readers fence after their store instead.
+//
+// That makes the first write after a read-heavy phase expensive, so after
+// one the lock stays unbiased for several times as long as revoking took,
+// with readers going through the stamped lock, and the first reader after
+// that turns the bias back on.
+//
+// A thread can hold one read lock through its slot at a time; nested read
+// locks, of this lock or any other, use the underlying lock. Read and write
+// locks aren't reentrant, and a thread must not exit holding one.
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_bravo_slot {
+    // The lock this thread holds through its slot, or NULL.
+    cp_atomic_ptr lock;
+    struct ___cp_bravo_slot* next_free;
+} ___cp_bravo_slot;
+
+typedef struct cp_bravo_lock_t {
+    // Nonzero while readers may use their slots.
+    cp_atomic32 bias;
+    // TIME_UTC in nanoseconds before which readers leave the bias off.
+    // Written with the write lock held and read with the read lock held.
+    int64_t inhibit_until;
+    cp_stamped_lock_t lock;
+} cp_bravo_lock_t;
+
+extern thread_local ___cp_bravo_slot* ___cp_bravo_self;
+
+// Nonzero when the writers can't fence for the readers.
+extern int ___cp_bravo_reader_fence;
+
+void ___cp_bravo_read_slow(cp_bravo_lock_t* lock);
+
+int cp_bravo_lock_init(cp_bravo_lock_t* lock);
+void cp_bravo_lock_destroy(cp_bravo_lock_t* lock);
+
+static __inline void cp_bravo_read_lock(cp_bravo_lock_t* lock) {
+    ___cp_bravo_slot* slot = ___cp_bravo_self;
+    if(slot && !slot->lock && cp_atomic_load32(&lock->bias)) {
+        cp_atomic_store_plain_ptr(&slot->lock, lock);
+        if(___cp_bravo_reader_fence)
+            cp_atomic_fence();
+        else
+            cp_compiler_barrier();
+        if(cp_atomic_load32(&lock->bias))
+            return;
+        cp_atomic_store_plain_ptr(&slot->lock, NULL);
+    }
+    ___cp_bravo_read_slow(lock);
+}
+
+static __inline void cp_bravo_read_unlock(cp_bravo_lock_t* lock) {
+    ___cp_bravo_slot* slot = ___cp_bravo_self;
+    if(slot && slot->lock == lock) {
+        cp_atomic_store_plain_ptr(&slot->lock, NULL);
+        return;
+    }
+    cp_stamped_lock_read_unlock(&lock->lock, 0);
+}
+
+void cp_bravo_write_lock(cp_bravo_lock_t* lock);
+
+static __inline void cp_bravo_write_unlock(cp_bravo_lock_t* lock) {
+    cp_stamped_lock_write_unlock(&lock->lock, 0);
+}
+
+#endif
@@ -0,0 +1,527 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cp_chan.h"
+
+// ============================================================================
+// Parker
+// ============================================================================
+
+// Each thread blocks on its own parker, created the first time it has to
+// wait. A blocking operation resets it, queues waiters that point at it,
+// and sleeps until one of them is claimed. Claiming is a CAS on fired, so
+// only one channel can complete a select.
+
+typedef struct chan_parker {
+    mtx_t lock;
+    cnd_t wake;
+    cp_atomic32 fired;
+    int woken;
+    int winner;
+} chan_parker;
+
+struct ___cp_chan_waiter {
+    struct ___cp_chan_waiter* next;
+    struct ___cp_chan_waiter* prev;
+    ___cp_chan_queue* queue;
+    chan_parker* parker;
+    void* elem;
+    int case_index;
+    int ok;
+};
+
+typedef struct ___cp_chan_waiter chan_waiter;
+
+static once_flag parker_once = ONCE_FLAG_INIT;
+static tss_t parker_key;
+static int parker_key_valid = 0;
+static thread_local chan_parker* current_parker;
+static thread_local uint32_t select_seed;
+
+static void parker_free(void* arg) {
+    chan_parker* parker = arg;
+    cnd_destroy(&parker->wake);
+    mtx_destroy(&parker->lock);
+    free(parker);
+}
+
+static void parker_key_init(void) {
+    parker_key_valid = tss_create(&parker_key, parker_free) == thrd_success;
+}
+
+static chan_parker* parker_get(void) {
+    if(current_parker)
+        return current_parker;
+
+    call_once(&parker_once, parker_key_init);
+    chan_parker* parker = malloc(sizeof(*parker));
+    if(!parker)
+        return NULL;
+    if(mtx_init(&parker->lock, mtx_plain) != thrd_success) {
+        free(parker);
+        return NULL;
+    }
+    if(cnd_init(&parker->wake) != thrd_success) {
+        mtx_destroy(&parker->lock);
+        free(parker);
+        return NULL;
+    }
+
+    if(parker_key_valid)
+        tss_set(parker_key, parker);
+    current_parker = parker;
+    return parker;
+}
+
+static void parker_wake(chan_parker* parker) {
+    mtx_lock(&parker->lock);
+    parker->woken = 1;
+    cnd_signal(&parker->wake);
+    mtx_unlock(&parker->lock);
+}
+
+// ============================================================================
+// Wait Queues
+// ============================================================================
+
+static void queue_push(___cp_chan_queue* queue, chan_waiter* waiter) {
+    waiter->queue = queue;
+    waiter->next = NULL;
+    waiter->prev = queue->tail;
+    if(queue->tail)
+        queue->tail->next = waiter;
+    else
+        queue->head = waiter;
+    queue->tail = waiter;
+}
+
+static void queue_unlink(chan_waiter* waiter) {
+    ___cp_chan_queue* queue = waiter->queue;
+    if(waiter->prev)
+        waiter->prev->next = waiter->next;
+    else
+        queue->head = waiter->next;
+    if(waiter->next)
+        waiter->next->prev = waiter->prev;
+    else
+        queue->tail = waiter->prev;
+    waiter->queue = NULL;
+}
+
+// Pops waiters until one can be claimed. Waiters whose select was already
+// decided elsewhere are dropped on the way; their owner skips them when it
+// cleans up.
+static chan_waiter* queue_claim(___cp_chan_queue* queue) {
+    chan_waiter* waiter;
+    while((waiter = queue->head) != NULL) {
+        queue_unlink(waiter);
+        int32_t expected = 0;
+        if(cp_atomic_cas32(&waiter->parker->fired, &expected, 1)) {
+            waiter->parker->winner = waiter->case_index;
+            return waiter;
+        }
+    }
+    return NULL;
+}
+
+// ============================================================================
+// Channel
+// ============================================================================
+
+int cp_chan_init(cp_chan_t* chan, size_t elem_size, size_t capacity) {
+    if(!chan)
+        return thrd_error;
+
+    chan->buffer = NULL;
+    if(capacity > 0 && elem_size > 0) {
+        chan->buffer = malloc(elem_size * capacity);
+        if(!chan->buffer)
+            return thrd_nomem;
+    }
+    if(mtx_init(&chan->lock, mtx_plain) != thrd_success) {
+        free(chan->buffer);
+        return thrd_error;
+    }
+
+    chan->elem_size = elem_size;
+    chan->capacity = capacity;
+    chan->count = 0;
+    chan->head = 0;
+    chan->closed = 0;
+    chan->senders.head = chan->senders.tail = NULL;
+    chan->receivers.head = chan->receivers.tail = NULL;
+    return thrd_success;
+}
+
+void cp_chan_destroy(cp_chan_t* chan) {
+    if(!chan)
+        return;
+
+    mtx_destroy(&chan->lock);
+    free(chan->buffer);
+    chan->buffer = NULL;
+}
+
+int cp_chan_close(cp_chan_t* chan) {
+    if(!chan)
+        return thrd_error;
+
+    mtx_lock(&chan->lock);
+    if(chan->closed) {
+        mtx_unlock(&chan->lock);
+        return thrd_error;
+    }
+    chan->closed = 1;
+
+    // Fail every sender and empty-hand every receiver. Their parkers are
+    // woken after the lock is dropped; the waiters stay valid until then
+    // because their owners can't return before being woken.
+    chan_waiter* woken = NULL;
+    chan_waiter* waiter;
+    while((waiter = queue_claim(&chan->receivers)) != NULL) {
+        if(waiter->elem && chan->elem_size)
+            memset(waiter->elem, 0, chan->elem_size);
+        waiter->ok = 0;
+        waiter->next = woken;
+        woken = waiter;
+    }
+    while((waiter = queue_claim(&chan->senders)) != NULL) {
+        waiter->ok = 0;
+        waiter->next = woken;
+        woken = waiter;
+    }
+    mtx_unlock(&chan->lock);
+
+    while(woken) {
+        chan_waiter* next = woken->next;
+        parker_wake(woken->parker);
+        woken = next;
+    }
+    return thrd_success;
+}
+
+size_t cp_chan_len(cp_chan_t* chan) {
+    if(!chan)
+        return 0;
+
+    mtx_lock(&chan->lock);
+    size_t count = chan->count;
+    mtx_unlock(&chan->lock);
+    return count;
+}
+
+static void buffer_push(cp_chan_t* chan, const void* elem) {
+    size_t tail = (chan->head + chan->count) % chan->capacity;
+    if(chan->elem_size)
+        memcpy(chan->buffer + tail * chan->elem_size, elem, chan->elem_size);
+    chan->count++;
+}
+
+static void buffer_pop(cp_chan_t* chan, void* elem) {
+    if(elem && chan->elem_size)
+        memcpy(elem, chan->buffer + chan->head * chan->elem_size, chan->elem_size);
+    chan->head = (chan->head + 1) % chan->capacity;
+    chan->count--;
+}
+
+static void copy_elem(cp_chan_t* chan, void* to, const void* from) {
+    if(to && chan->elem_size)
+        memcpy(to, from, chan->elem_size);
+}
+
+// ============================================================================
+// Select
+// ============================================================================
+
+enum {
+    case_blocked,
+    case_done,
+    case_closed
+};
+
+// The channel must be locked. Completes the case if it can proceed without
+// waiting, and returns the waiter it paired with in partner so it can be
+// woken once every lock is dropped.
+static int case_attempt(cp_select_case_t* c, chan_waiter** partner) {
+    cp_chan_t* chan = c->chan;
+    chan_waiter* waiter;
+
+    if(c->op == cp_select_send) {
+        if(chan->closed)
+            return case_closed;
+        if((waiter = queue_claim(&chan->receivers)) != NULL) {
+            copy_elem(chan, waiter->elem, c->elem);
+            waiter->ok = 1;
+            *partner = waiter;
+            return case_done;
+        }
+        if(chan->count < chan->capacity) {
+            buffer_push(chan, c->elem);
+            return case_done;
+        }
+        return case_blocked;
+    }
+
+    if(chan->count > 0) {
+        buffer_pop(chan, c->elem);
+        // A slot opened up, so the oldest blocked sender can go in.
+        if((waiter = queue_claim(&chan->senders)) != NULL) {
+            buffer_push(chan, waiter->elem);
+            waiter->ok = 1;
+            *partner = waiter;
+        }
+        c->ok = 1;
+        return case_done;
+    }
+    if((waiter = queue_claim(&chan->senders)) != NULL) {
+        copy_elem(chan, c->elem, waiter->elem);
+        waiter->ok = 1;
+        *partner = waiter;
+        c->ok = 1;
+        return case_done;
+    }
+    if(chan->closed) {
+        if(c->elem && chan->elem_size)
+            memset(c->elem, 0, chan->elem_size);
+        c->ok = 0;
+        return case_done;
+    }
+    return case_blocked;
+}
+
+// Collects the distinct channels of the cases, sorted by address so every
+// thread locks them in the same order.
+static int select_lock_order(cp_select_case_t* cases, int count, cp_chan_t** order) {
+    int distinct = 0;
+    for(int i = 0; i < count; i++) {
+        cp_chan_t* chan = cases[i].chan;
+        if(!chan)
+            continue;
+
+        int at = distinct;
+        while(at > 0 && order[at - 1] > chan)
+            at--;
+        if(at > 0 && order[at - 1] == chan)
+            continue;
+        memmove(order + at + 1, order + at, sizeof(*order) * (distinct - at));
+        order[at] = chan;
+        distinct++;
+    }
+    return distinct;
+}
+
+static void select_lock(cp_chan_t** order, int distinct) {
+    for(int i = 0; i < distinct; i++)
+        mtx_lock(&order[i]->lock);
+}
+
+static void select_unlock(cp_chan_t** order, int distinct) {
+    for(int i = distinct - 1; i >= 0; i--)
+        mtx_unlock(&order[i]->lock);
+}
+
+static uint32_t select_random(void) {
+    uint32_t x = select_seed;
+    if(x == 0)
+        x = (uint32_t)(uintptr_t)&select_seed | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return select_seed = x;
+}
+
+static int select_run(cp_select_case_t* cases, int count, int* index, const struct timespec* deadline, int blocking) {
+    if(!cases || count < 0 || count > CP_SELECT_MAX_CASES)
+        return thrd_error;
+
+    cp_chan_t* order[CP_SELECT_MAX_CASES];
+    int distinct = select_lock_order(cases, count, order);
+
+    if(distinct == 0) {
+        if(!blocking)
+            return thrd_busy;
+        if(!deadline)
+            return thrd_error;
+        // Nothing can ever be ready, just wait out the deadline.
+        struct timespec now;
+        while(timespec_get(&now, TIME_UTC) && (now.tv_sec < deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec < deadline->tv_nsec))) {
+            struct timespec left = { deadline->tv_sec - now.tv_sec, deadline->tv_nsec - now.tv_nsec };
+            if(left.tv_nsec < 0) {
+                left.tv_sec--;
+                left.tv_nsec += 1000000000;
+            }
+            thrd_sleep(&left, NULL);
+        }
+        return thrd_timedout;
+    }
+
+    // Poll in a random rotation so no case is favoured.
+    int start = count > 1 ? (int)(select_random() % (uint32_t)count) : 0;
+
+    select_lock(order, distinct);
+    for(int n = 0; n < count; n++) {
+        int i = (start + n) % count;
+        if(!cases[i].chan)
+            continue;
+
+        chan_waiter* partner = NULL;
+        int state = case_attempt(cases + i, &partner);
+        if(state == case_blocked)
+            continue;
+
+        select_unlock(order, distinct);
+        if(partner)
+            parker_wake(partner->parker);
+        if(index)
+            *index = i;
+        return state == case_closed ? thrd_error : thrd_success;
+    }
+
+    if(!blocking) {
+        select_unlock(order, distinct);
+        return thrd_busy;
+    }
+
+    chan_parker* parker = parker_get();
+    if(!parker) {
+        select_unlock(order, distinct);
+        return thrd_nomem;
+    }
+    cp_atomic_store32(&parker->fired, 0);
+    parker->woken = 0;
+    parker->winner = -1;
+
+    chan_waiter waiters[CP_SELECT_MAX_CASES];
+    for(int i = 0; i < count; i++) {
+        waiters[i].queue = NULL;
+        if(!cases[i].chan)
+            continue;
+        waiters[i].parker = parker;
+        waiters[i].elem = cases[i].elem;
+        waiters[i].case_index = i;
+        waiters[i].ok = 0;
+        queue_push(cases[i].op == cp_select_send ? &cases[i].chan->senders : &cases[i].chan->receivers, waiters + i);
+    }
+    select_unlock(order, distinct);
+
+    int timed_out = 0;
+    mtx_lock(&parker->lock);
+    while(!parker->woken) {
+        if(!deadline) {
+            cnd_wait(&parker->wake, &parker->lock);
+            continue;
+        }
+        if(cnd_timedwait(&parker->wake, &parker->lock, deadline) != thrd_timedout)
+            continue;
+
+        // Claim our own select so no channel can complete it anymore. If
+        // that fails a channel got there first and is about to wake us, so
+        // wait for it without the expired deadline.
+        int32_t expected = 0;
+        if(cp_atomic_cas32(&parker->fired, &expected, 1)) {
+            timed_out = 1;
+            break;
+        }
+        deadline = NULL;
+    }
+    mtx_unlock(&parker->lock);
+
+    // Take back every waiter the channels didn't already unlink.
+    select_lock(order, distinct);
+    for(int i = 0; i < count; i++) {
+        if(waiters[i].queue)
+            queue_unlink(waiters + i);
+    }
+    select_unlock(order, distinct);
+
+    if(timed_out)
+        return thrd_timedout;
+
+    int winner = parker->winner;
+    if(index)
+        *index = winner;
+    if(cases[winner].op == cp_select_recv) {
+        cases[winner].ok = waiters[winner].ok;
+        return thrd_success;
+    }
+    return waiters[winner].ok ? thrd_success : thrd_error;
+}
+
+int cp_select(cp_select_case_t* cases, int count, int* index, const struct timespec* deadline) {
+    return select_run(cases, count, index, deadline, 1);
+}
+
+int cp_select_try(cp_select_case_t* cases, int count, int* index) {
+    return select_run(cases, count, index, NULL, 0);
+}
+
+// ============================================================================
+// Single Operations
+// ============================================================================
+
+static int chan_send(cp_chan_t* chan, const void* elem, const struct timespec* deadline, int blocking) {
+    if(!chan)
+        return thrd_error;
+
+    cp_select_case_t c = { chan, cp_select_send, (void*)elem, 0 };
+    return select_run(&c, 1, NULL, deadline, blocking);
+}
+
+static int chan_recv(cp_chan_t* chan, void* elem, const struct timespec* deadline, int blocking) {
+    if(!chan)
+        return thrd_error;
+
+    cp_select_case_t c = { chan, cp_select_recv, elem, 0 };
+    int result = select_run(&c, 1, NULL, deadline, blocking);
+    if(result == thrd_success && !c.ok)
+        return thrd_error;
+    return result;
+}
+
+int cp_chan_send(cp_chan_t* chan, const void* elem) {
+    return chan_send(chan, elem, NULL, 1);
+}
+
+int cp_chan_try_send(cp_chan_t* chan, const void* elem) {
+    return chan_send(chan, elem, NULL, 0);
+}
+
+int cp_chan_timedsend(cp_chan_t* chan, const void* elem, const struct timespec* deadline) {
+    return chan_send(chan, elem, deadline, 1);
+}
+
+int cp_chan_recv(cp_chan_t* chan, void* elem) {
+    return chan_recv(chan, elem, NULL, 1);
+}
+
+int cp_chan_try_recv(cp_chan_t* chan, void* elem) {
+    return chan_recv(chan, elem, NULL, 0);
+}
+
+int cp_chan_timedrecv(cp_chan_t* chan, void* elem, const struct timespec* deadline) {
+    return chan_recv(chan, elem, deadline, 1);
+}
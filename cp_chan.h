@@ -0,0 +1,119 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_CHAN_H
+#define CP_THREADS_CP_CHAN_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Channels
+// ============================================================================
+
+// Go style channels carrying fixed size values by copy. With a capacity of
+// 0 every send waits for a receiver and the value is handed over directly;
+// otherwise up to capacity values are buffered.
+//
+// A blocked thread is queued on the channel with a small record pointing
+// at where its value lives, and whoever completes the operation copies the
+// value and wakes exactly that thread. cp_select queues one record per case
+// on every channel involved; the first thread to claim any of them decides
+// the outcome, and the rest are unlinked before cp_select returns.
+//
+// Closing a channel fails pending and future sends. Receives keep returning
+// buffered values, then fail once the buffer is empty.
+
+#define CP_SELECT_MAX_CASES 64
+
+struct ___cp_chan_waiter;
+
+typedef struct ___cp_chan_queue {
+    struct ___cp_chan_waiter* head;
+    struct ___cp_chan_waiter* tail;
+} ___cp_chan_queue;
+
+typedef struct cp_chan_t {
+    mtx_t lock;
+    size_t elem_size;
+    size_t capacity;
+    size_t count;
+    size_t head;
+    unsigned char* buffer;
+    int closed;
+    ___cp_chan_queue senders;
+    ___cp_chan_queue receivers;
+} cp_chan_t;
+
+enum {
+    cp_select_send,
+    cp_select_recv
+};
+
+typedef struct cp_select_case_t {
+    // A NULL channel is never ready, like a nil channel in Go.
+    cp_chan_t* chan;
+    int op;
+    // The value to send, or where to store the received one. A receive can
+    // pass NULL to drop the value.
+    void* elem;
+    // Set by a receive: 1 if a value arrived, 0 if the channel was closed.
+    int ok;
+} cp_select_case_t;
+
+int cp_chan_init(cp_chan_t* chan, size_t elem_size, size_t capacity);
+void cp_chan_destroy(cp_chan_t* chan);
+
+// Returns thrd_error if the channel was already closed.
+int cp_chan_close(cp_chan_t* chan);
+
+// Sends return thrd_error once the channel is closed, and receives once it's
+// closed and drained. The try versions return thrd_busy instead of
+// blocking, and the timed ones thrd_timedout once the TIME_UTC deadline
+// passes.
+int cp_chan_send(cp_chan_t* chan, const void* elem);
+int cp_chan_try_send(cp_chan_t* chan, const void* elem);
+int cp_chan_timedsend(cp_chan_t* chan, const void* elem, const struct timespec* deadline);
+
+int cp_chan_recv(cp_chan_t* chan, void* elem);
+int cp_chan_try_recv(cp_chan_t* chan, void* elem);
+int cp_chan_timedrecv(cp_chan_t* chan, void* elem, const struct timespec* deadline);
+
+// Number of buffered values.
+size_t cp_chan_len(cp_chan_t* chan);
+
+// Waits until one of the cases can proceed, runs it and stores its position
+// in index. If several are ready one is picked at random. A NULL deadline
+// waits forever. Returns thrd_timedout when the deadline passes, and
+// thrd_error with index set when the chosen case is a send on a closed
+// channel.
+int cp_select(cp_select_case_t* cases, int count, int* index, const struct timespec* deadline);
+
+// Like cp_select, but returns thrd_busy when no case is ready right now.
+int cp_select_try(cp_select_case_t* cases, int count, int* index);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cp_combiner.h"
+
+int cp_combiner_init(cp_combiner_t* combiner, void* object, int threads) {
+    if(!combiner || threads <= 0)
+        return thrd_error;
+
+    // Every slot gets its own cache line, so a thread publishing doesn't
+    // disturb its neighbours.
+    void* memory = malloc(sizeof(cp_combiner_slot_t) * threads + CP_CACHE_LINE);
+    if(!memory)
+        return thrd_nomem;
+    uintptr_t aligned = ((uintptr_t)memory + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1);
+    combiner->slots = (cp_combiner_slot_t*)aligned;
+    combiner->slot_memory = memory;
+
+    for(int i = 0; i < threads; i++) {
+        cp_combiner_slot_t* slot = combiner->slots + i;
+        slot->pending = 0;
+        slot->joined = 0;
+        slot->func = NULL;
+        slot->arg = NULL;
+        slot->result = NULL;
+    }
+
+    combiner->lock = 0;
+    combiner->object = object;
+    combiner->capacity = threads;
+    combiner->used = 0;
+    return thrd_success;
+}
+
+void cp_combiner_destroy(cp_combiner_t* combiner) {
+    if(!combiner)
+        return;
+    free(combiner->slot_memory);
+    combiner->slots = NULL;
+    combiner->slot_memory = NULL;
+}
+
+int cp_combiner_join(cp_combiner_t* combiner, cp_combiner_slot_t** slot) {
+    if(!combiner || !slot)
+        return thrd_error;
+
+    for(int i = 0; i < combiner->capacity; i++) {
+        int32_t expected = 0;
+        if(!cp_atomic_cas32(&combiner->slots[i].joined, &expected, 1))
+            continue;
+
+        int32_t used = cp_atomic_load32(&combiner->used);
+        while(used <= i && !cp_atomic_cas32(&combiner->used, &used, i + 1))
+            ;
+        *slot = combiner->slots + i;
+        return thrd_success;
+    }
+    return thrd_busy;
+}
+
+void cp_combiner_leave(cp_combiner_t* combiner, cp_combiner_slot_t* slot) {
+    if(!combiner || !slot)
+        return;
+    cp_atomic_store32(&slot->joined, 0);
+}
+
+// Runs every published operation, going over the slots until a pass finds
+// nothing or the pass limit is reached. Returns with the lock still held.
+static void combine(cp_combiner_t* combiner) {
+    int32_t used = cp_atomic_load32(&combiner->used);
+    for(int pass = 0; pass < CP_COMBINER_PASSES; pass++) {
+        int served = 0;
+        for(int32_t i = 0; i < used; i++) {
+            cp_combiner_slot_t* slot = combiner->slots + i;
+            if(!cp_atomic_load32(&slot->pending))
+                continue;
+            slot->result = slot->func(combiner->object, slot->arg);
+            cp_atomic_store32(&slot->pending, 0);
+            served++;
+        }
+        if(!served)
+            break;
+    }
+}
+
+void* cp_combiner_apply(cp_combiner_t* combiner, cp_combiner_slot_t* slot, cp_combiner_func func, void* arg) {
+    slot->func = func;
+    slot->arg = arg;
+    cp_atomic_store32(&slot->pending, 1);
+
+    // Either some combiner picks the operation up, or the lock comes free
+    // with it still pending and this thread combines. The lock is only
+    // tried when it looks free, so waiters don't keep pulling its line away
+    // from the combiner.
+    int spins = 0;
+    for(;;) {
+        if(!cp_atomic_load32(&slot->pending))
+            return slot->result;
+
+        int32_t expected = 0;
+        if(!cp_atomic_load32(&combiner->lock) && cp_atomic_cas32(&combiner->lock, &expected, 1)) {
+            // Published before the lock was taken, so the first pass
+            // serves it if nobody else has.
+            combine(combiner);
+            cp_atomic_store32(&combiner->lock, 0);
+            return slot->result;
+        }
+
+        if(spins < CP_COMBINER_SPINS) {
+            spins++;
+            cp_cpu_relax();
+        } else {
+            thrd_yield();
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_COMBINER_H
+#define CP_THREADS_CP_COMBINER_H
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Flat Combining
+// ============================================================================
+
+// A lock that delegates instead of handing over. Each thread publishes its
+// operation in its own slot, and whichever thread takes the lock runs every
+// published operation in a batch and writes the results back. The protected
+// object stays in the combining thread's cache for the whole batch instead
+// of moving to every thread that takes a turn, which pays off when a lot of
+// threads hammer a small structure such as a priority queue or free list.
+//
+// Threads join the combiner once to get a slot and pass it to every call.
+// Operations are callbacks taking the object and an argument, and may run
+// on any thread that uses the combiner, so they must not depend on which
+// thread they run on.
+
+// How many times the combiner goes over the slots before letting go of the
+// lock. It stops early after a pass with nothing to do.
+#ifndef CP_COMBINER_PASSES
+#define CP_COMBINER_PASSES 4
+#endif
+
+// How long a thread whose operation is waiting spins before it starts
+// yielding between checks.
+#ifndef CP_COMBINER_SPINS
+#define CP_COMBINER_SPINS 128
+#endif
+
+typedef void* (*cp_combiner_func)(void* object, void* arg);
+
+typedef struct cp_combiner_slot_t {
+    // Non-zero while the operation is waiting for a combiner.
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic32 pending;
+    cp_atomic32 joined;
+    cp_combiner_func func;
+    void* arg;
+    void* result;
+} cp_combiner_slot_t;
+
+typedef struct cp_combiner_t {
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic32 lock;
+    CP_ALIGNAS(CP_CACHE_LINE) void* object;
+    cp_combiner_slot_t* slots;
+    void* slot_memory;
+    int capacity;
+    // One past the highest slot ever joined, which bounds every pass.
+    cp_atomic32 used;
+} cp_combiner_t;
+
+// Creates a combiner for object with room for the given number of threads.
+int cp_combiner_init(cp_combiner_t* combiner, void* object, int threads);
+
+// No operation may be in progress.
+void cp_combiner_destroy(cp_combiner_t* combiner);
+
+// Takes a free slot for the calling thread. Returns thrd_busy if all of
+// them are taken.
+int cp_combiner_join(cp_combiner_t* combiner, cp_combiner_slot_t** slot);
+
+// Gives the slot back.
+void cp_combiner_leave(cp_combiner_t* combiner, cp_combiner_slot_t* slot);
+
+// Runs func(object, arg) under the combiner and returns its result, either
+// on this thread as part of a batch or on whichever thread is combining.
+void* cp_combiner_apply(cp_combiner_t* combiner, cp_combiner_slot_t* slot, cp_combiner_func func, void* arg);
+
+#endif
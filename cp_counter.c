@@ -0,0 +1,160 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_counter.h"
+
+static int64_t counter_now_ms(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Runs on the exiting thread, so nothing else writes the slot anymore.
+static void slot_retire(void* arg) {
+    ___cp_counter_slot* slot = arg;
+    cp_counter_t* counter = slot->counter;
+
+    mtx_lock(&counter->lock);
+    counter->retired += cp_atomic_load64(&slot->value);
+    if(slot->prev)
+        slot->prev->next = slot->next;
+    else
+        counter->slots = slot->next;
+    if(slot->next)
+        slot->next->prev = slot->prev;
+    mtx_unlock(&counter->lock);
+
+    free(slot->block);
+}
+
+int cp_counter_init(cp_counter_t* counter, unsigned approx_ms) {
+    if(!counter)
+        return thrd_error;
+
+    if(tss_create(&counter->key, slot_retire) != thrd_success)
+        return thrd_error;
+    if(mtx_init(&counter->lock, mtx_plain) != thrd_success) {
+        tss_delete(counter->key);
+        return thrd_error;
+    }
+
+    counter->slots = NULL;
+    counter->retired = 0;
+    counter->approx_ms = approx_ms;
+    counter->cached = 0;
+    counter->cached_at = 0;
+    return thrd_success;
+}
+
+void cp_counter_destroy(cp_counter_t* counter) {
+    if(!counter)
+        return;
+
+    // Deleting the key first means no destructor can run for it anymore,
+    // so the slots of threads still alive are ours to free.
+    tss_delete(counter->key);
+    ___cp_counter_slot* slot = counter->slots;
+    while(slot) {
+        ___cp_counter_slot* next = slot->next;
+        free(slot->block);
+        slot = next;
+    }
+    counter->slots = NULL;
+    mtx_destroy(&counter->lock);
+}
+
+int ___cp_counter_add_slow(cp_counter_t* counter, int64_t value) {
+    void* block = malloc(sizeof(___cp_counter_slot) + CP_CACHE_LINE);
+    if(!block) {
+        mtx_lock(&counter->lock);
+        counter->retired += value;
+        mtx_unlock(&counter->lock);
+        return thrd_nomem;
+    }
+
+    uintptr_t aligned = ((uintptr_t)block + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1);
+    ___cp_counter_slot* slot = (___cp_counter_slot*)aligned;
+    slot->block = block;
+    slot->counter = counter;
+    slot->value = value;
+    slot->prev = NULL;
+
+    mtx_lock(&counter->lock);
+    slot->next = counter->slots;
+    if(slot->next)
+        slot->next->prev = slot;
+    counter->slots = slot;
+    mtx_unlock(&counter->lock);
+
+    if(tss_set(counter->key, slot) != thrd_success) {
+        // Keep the value, just without a slot to add to next time.
+        slot_retire(slot);
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+// The counter lock must be held.
+static int64_t counter_sum(cp_counter_t* counter) {
+    int64_t sum = counter->retired;
+    for(___cp_counter_slot* slot = counter->slots; slot; slot = slot->next)
+        sum += cp_atomic_load64(&slot->value);
+    return sum;
+}
+
+int64_t cp_counter_read_exact(cp_counter_t* counter) {
+    if(!counter)
+        return 0;
+
+    mtx_lock(&counter->lock);
+    int64_t sum = counter_sum(counter);
+    mtx_unlock(&counter->lock);
+    return sum;
+}
+
+int64_t cp_counter_read(cp_counter_t* counter) {
+    if(!counter)
+        return 0;
+    if(!counter->approx_ms)
+        return cp_counter_read_exact(counter);
+
+    // The clock is the wall clock, so a cache from the future means it was
+    // set back and the cache's age is unknown. Treat it as expired.
+    int64_t now = counter_now_ms();
+    int64_t cached_at = cp_atomic_load64(&counter->cached_at);
+    if(cached_at && now >= cached_at && now - cached_at < (int64_t)counter->approx_ms)
+        return cp_atomic_load64(&counter->cached);
+
+    // One reader refreshes the cache, the others keep using the old total.
+    // Before the first refresh there is no old total to use.
+    if(mtx_trylock(&counter->lock) != thrd_success)
+        return cached_at ? cp_atomic_load64(&counter->cached) : cp_counter_read_exact(counter);
+    int64_t sum = counter_sum(counter);
+    cp_atomic_store64(&counter->cached, sum);
+    cp_atomic_store64(&counter->cached_at, now);
+    mtx_unlock(&counter->lock);
+    return sum;
+}
@@ -0,0 +1,102 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_COUNTER_H
+#define CP_THREADS_CP_COUNTER_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Sharded Counter
+// ============================================================================
+
+// A statistics counter for hot paths. Every thread that adds to it gets its
+// own slot on its own cache line, found through a TSS key, and only that
+// thread ever writes to it, so on 64-bit targets an add is a plain load and
+// store with no locked instruction and no line shared with other writers.
+//
+// Reads sum the slots under a mutex. The result isn't a snapshot of a single
+// instant, but it never misses a completed add: when a thread exits its slot
+// is folded into the counter before being freed.
+//
+// With approx_ms set, cp_counter_read returns a cached total and only sums
+// the slots again once the cache is older than approx_ms, so code polling a
+// counter doesn't keep pulling every writer's cache line.
+//
+// Each counter uses one TSS key, so they are meant for long lived statistics
+// rather than creating by the thousand. Destroying a counter while other
+// threads still add to it is undefined; threads that merely used it before
+// may exit at any time.
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_counter_slot {
+    cp_atomic64 value;
+    struct ___cp_counter_slot* next;
+    struct ___cp_counter_slot* prev;
+    struct cp_counter_t* counter;
+    void* block;
+} ___cp_counter_slot;
+
+typedef struct cp_counter_t {
+    tss_t key;
+    mtx_t lock;
+    ___cp_counter_slot* slots;
+    // Total of the slots of threads that exited.
+    int64_t retired;
+    unsigned approx_ms;
+    cp_atomic64 cached;
+    cp_atomic64 cached_at;
+} cp_counter_t;
+
+int cp_counter_init(cp_counter_t* counter, unsigned approx_ms);
+void cp_counter_destroy(cp_counter_t* counter);
+
+// Creates the calling thread's slot and adds to it. If the slot can't be
+// set up the value goes to the shared total instead, and the next add
+// tries again.
+int ___cp_counter_add_slow(cp_counter_t* counter, int64_t value);
+
+static __inline void cp_counter_add(cp_counter_t* counter, int64_t value) {
+    ___cp_counter_slot* slot = (___cp_counter_slot*)tss_get(counter->key);
+    if(!slot) {
+        ___cp_counter_add_slow(counter, value);
+        return;
+    }
+    // Only this thread writes the slot, readers just need whole values.
+    cp_atomic_store_plain64(&slot->value, cp_atomic_load64(&slot->value) + value);
+}
+
+static __inline void cp_counter_inc(cp_counter_t* counter) {
+    cp_counter_add(counter, 1);
+}
+
+// The sum of every add so far, or a value at most approx_ms old.
+int64_t cp_counter_read(cp_counter_t* counter);
+
+// Always sums the slots, even in approximate mode.
+int64_t cp_counter_read_exact(cp_counter_t* counter);
+
+#endif
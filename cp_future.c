@@ -0,0 +1,489 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_future.h"
+
+// How often a waiter checks the future before parking.
+#define FUTURE_SPINS 64
+
+struct ___cp_future_callback;
+
+typedef void (*future_callback_fn)(struct ___cp_future* source, struct ___cp_future_callback* callback);
+
+struct ___cp_future_callback {
+    struct ___cp_future_callback* next;
+    future_callback_fn func;
+};
+
+// The shared state. It's always at the start of its allocation, which may
+// carry callbacks or other state after it, so freeing it frees everything.
+struct ___cp_future {
+    cp_atomic32 refs;
+    cp_atomic32 claimed;
+    // Callbacks to run on completion, newest first, or FUTURE_DONE.
+    cp_atomic_ptr callbacks;
+    void* value;
+    int result;
+    // Set once completed: the callbacks still to run, in order, and the
+    // next state in the completing thread's queue.
+    struct ___cp_future_callback* pending;
+    struct ___cp_future* next_pending;
+};
+
+typedef struct ___cp_future future_state;
+typedef struct ___cp_future_callback future_callback;
+
+static char future_done_marker;
+#define FUTURE_DONE ((void*)&future_done_marker)
+
+static int future_state_init(future_state* state, int32_t refs) {
+    state->refs = refs;
+    state->claimed = 0;
+    state->callbacks = NULL;
+    state->value = NULL;
+    state->result = thrd_success;
+    state->pending = NULL;
+    state->next_pending = NULL;
+    return thrd_success;
+}
+
+static void future_release(future_state* state) {
+    if(cp_atomic_fetch_add32(&state->refs, -1) == 1)
+        free(state);
+}
+
+static __inline int future_done(future_state* state) {
+    return cp_atomic_load_ptr(&state->callbacks) == FUTURE_DONE;
+}
+
+// Runs the callback when the state completes, or now if it already has.
+static void future_add_callback(future_state* state, future_callback* callback) {
+    void* head = cp_atomic_load_ptr(&state->callbacks);
+    do {
+        if(head == FUTURE_DONE) {
+            callback->func(state, callback);
+            return;
+        }
+        callback->next = head;
+    } while(!cp_atomic_cas_ptr(&state->callbacks, &head, callback));
+}
+
+// States completed on this thread whose callbacks haven't run yet. A
+// callback that completes another future, as every cp_future_then link
+// does, only queues it here, so a long chain is run by a loop in the
+// outermost future_complete instead of nesting a frame per link.
+static thread_local future_state* completing_head;
+static thread_local future_state* completing_tail;
+static thread_local int completing;
+
+// Only the first caller completes the state. The exchange publishes the
+// value along with the done marker, and hands this thread every callback
+// registered so far.
+static int future_complete(future_state* state, void* value, int result) {
+    int32_t expected = 0;
+    if(!cp_atomic_cas32(&state->claimed, &expected, 1))
+        return thrd_error;
+
+    state->value = value;
+    state->result = result;
+    future_callback* list = cp_atomic_exchange_ptr(&state->callbacks, FUTURE_DONE);
+    if(!list)
+        return thrd_success;
+
+    // Run them in the order they were added.
+    future_callback* ordered = NULL;
+    while(list) {
+        future_callback* next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    // The callbacks may drop the last reference to the state they complete,
+    // so a queued state holds one of its own.
+    cp_atomic_fetch_add32(&state->refs, 1);
+    state->pending = ordered;
+    state->next_pending = NULL;
+    if(completing_tail)
+        completing_tail->next_pending = state;
+    else
+        completing_head = state;
+    completing_tail = state;
+
+    if(completing)
+        return thrd_success;
+
+    completing = 1;
+    while(completing_head) {
+        future_state* current = completing_head;
+        completing_head = current->next_pending;
+        if(!completing_head)
+            completing_tail = NULL;
+
+        future_callback* callback = current->pending;
+        current->pending = NULL;
+        while(callback) {
+            future_callback* next = callback->next;
+            callback->func(current, callback);
+            callback = next;
+        }
+        future_release(current);
+    }
+    completing = 0;
+    return thrd_success;
+}
+
+// ============================================================================
+// Promises
+// ============================================================================
+
+int cp_promise_init(cp_promise_t* promise) {
+    if(!promise)
+        return thrd_error;
+    promise->state = malloc(sizeof(*promise->state));
+    if(!promise->state)
+        return thrd_nomem;
+    return future_state_init(promise->state, 1);
+}
+
+int cp_promise_set(cp_promise_t* promise, void* value) {
+    if(!promise || !promise->state)
+        return thrd_error;
+    return future_complete(promise->state, value, thrd_success);
+}
+
+void cp_promise_destroy(cp_promise_t* promise) {
+    if(!promise || !promise->state)
+        return;
+    future_complete(promise->state, NULL, thrd_error);
+    future_release(promise->state);
+    promise->state = NULL;
+}
+
+int cp_promise_get_future(cp_future_t* future, cp_promise_t* promise) {
+    if(!future || !promise || !promise->state)
+        return thrd_error;
+    cp_atomic_fetch_add32(&promise->state->refs, 1);
+    future->state = promise->state;
+    return thrd_success;
+}
+
+// ============================================================================
+// Futures
+// ============================================================================
+
+int cp_future_share(cp_future_t* copy, cp_future_t* future) {
+    if(!copy || !future || !future->state)
+        return thrd_error;
+    cp_atomic_fetch_add32(&future->state->refs, 1);
+    copy->state = future->state;
+    return thrd_success;
+}
+
+void cp_future_destroy(cp_future_t* future) {
+    if(!future || !future->state)
+        return;
+    future_release(future->state);
+    future->state = NULL;
+}
+
+int cp_future_is_ready(cp_future_t* future) {
+    return future && future->state && future_done(future->state);
+}
+
+// Threads park on their own mutex and condition variable, created on first
+// use and freed when the thread exits.
+typedef struct future_parker {
+    mtx_t lock;
+    cnd_t wake;
+    int woken;
+} future_parker;
+
+static once_flag parker_once = ONCE_FLAG_INIT;
+static tss_t parker_key;
+static int parker_key_valid = 0;
+static thread_local future_parker* current_parker;
+
+static void parker_free(void* arg) {
+    future_parker* parker = arg;
+    cnd_destroy(&parker->wake);
+    mtx_destroy(&parker->lock);
+    free(parker);
+}
+
+static void parker_key_init(void) {
+    parker_key_valid = tss_create(&parker_key, parker_free) == thrd_success;
+}
+
+static future_parker* parker_get(void) {
+    if(current_parker)
+        return current_parker;
+
+    call_once(&parker_once, parker_key_init);
+    if(!parker_key_valid)
+        return NULL;
+    future_parker* parker = malloc(sizeof(*parker));
+    if(!parker)
+        return NULL;
+    if(mtx_init(&parker->lock, mtx_plain) != thrd_success) {
+        free(parker);
+        return NULL;
+    }
+    if(cnd_init(&parker->wake) != thrd_success) {
+        mtx_destroy(&parker->lock);
+        free(parker);
+        return NULL;
+    }
+
+    tss_set(parker_key, parker);
+    current_parker = parker;
+    return parker;
+}
+
+enum {
+    WAITER_WAITING,
+    WAITER_FIRED,
+    WAITER_ABANDONED
+};
+
+// A waiter outlives a timed out wait: it stays on the future's list until
+// the future completes, so it's on the heap and the waiting thread and the
+// list each hold a reference. The parker is only touched by whichever of
+// completion and timeout moves the state out of WAITING first.
+typedef struct future_waiter {
+    future_callback callback;
+    cp_atomic32 refs;
+    cp_atomic32 state;
+    future_parker* parker;
+} future_waiter;
+
+static void waiter_release(future_waiter* waiter) {
+    if(cp_atomic_fetch_add32(&waiter->refs, -1) == 1)
+        free(waiter);
+}
+
+static void waiter_fire(future_state* source, future_callback* callback) {
+    future_waiter* waiter = (future_waiter*)callback;
+    int32_t expected = WAITER_WAITING;
+    if(cp_atomic_cas32(&waiter->state, &expected, WAITER_FIRED)) {
+        future_parker* parker = waiter->parker;
+        mtx_lock(&parker->lock);
+        parker->woken = 1;
+        cnd_signal(&parker->wake);
+        mtx_unlock(&parker->lock);
+    }
+    waiter_release(waiter);
+}
+
+static int future_park(future_state* state, const struct timespec* time_point) {
+    future_parker* parker = parker_get();
+    future_waiter* waiter = malloc(sizeof(*waiter));
+    if(!parker || !waiter) {
+        free(waiter);
+        return thrd_nomem;
+    }
+    waiter->callback.func = waiter_fire;
+    waiter->refs = 2;
+    waiter->state = WAITER_WAITING;
+    waiter->parker = parker;
+
+    // No other waiter can touch the parker now: the last one either fired
+    // and was waited for, or was abandoned.
+    parker->woken = 0;
+    future_add_callback(state, &waiter->callback);
+
+    int result = thrd_success;
+    mtx_lock(&parker->lock);
+    while(!parker->woken) {
+        if(!time_point) {
+            cnd_wait(&parker->wake, &parker->lock);
+            continue;
+        }
+        if(cnd_timedwait(&parker->wake, &parker->lock, time_point) == thrd_timedout) {
+            int32_t expected = WAITER_WAITING;
+            if(cp_atomic_cas32(&waiter->state, &expected, WAITER_ABANDONED)) {
+                result = thrd_timedout;
+                break;
+            }
+            // Completion won the race and is about to wake us.
+            time_point = NULL;
+        }
+    }
+    mtx_unlock(&parker->lock);
+    waiter_release(waiter);
+    return result;
+}
+
+static int future_wait(cp_future_t* future, const struct timespec* time_point, void** value) {
+    if(!future || !future->state)
+        return thrd_error;
+
+    future_state* state = future->state;
+    for(int i = 0; i < FUTURE_SPINS && !future_done(state); i++)
+        cp_cpu_relax();
+
+    if(!future_done(state)) {
+        int result = future_park(state, time_point);
+        if(result != thrd_success)
+            return result;
+    }
+
+    if(value)
+        *value = state->value;
+    return state->result;
+}
+
+int cp_future_wait(cp_future_t* future, void** value) {
+    return future_wait(future, NULL, value);
+}
+
+int cp_future_timedwait(cp_future_t* future, const struct timespec* time_point, void** value) {
+    if(!time_point)
+        return thrd_error;
+    return future_wait(future, time_point, value);
+}
+
+// ============================================================================
+// Continuations
+// ============================================================================
+
+// The continuation's own state, with the callback it registers on the
+// source right behind it. One reference belongs to the result future and
+// one to the pending callback.
+typedef struct future_then {
+    future_state state;
+    future_callback callback;
+    cp_future_fn func;
+    void* arg;
+} future_then;
+
+static void then_fire(future_state* source, future_callback* callback) {
+    future_then* then = (future_then*)((char*)callback - offsetof(future_then, callback));
+    if(source->result == thrd_success)
+        future_complete(&then->state, then->func(source->value, then->arg), thrd_success);
+    else
+        future_complete(&then->state, NULL, source->result);
+    future_release(&then->state);
+}
+
+int cp_future_then(cp_future_t* result, cp_future_t* future, cp_future_fn func, void* arg) {
+    if(!result || !future || !future->state || !func)
+        return thrd_error;
+
+    future_then* then = malloc(sizeof(*then));
+    if(!then)
+        return thrd_nomem;
+    future_state_init(&then->state, 2);
+    then->callback.func = then_fire;
+    then->func = func;
+    then->arg = arg;
+
+    result->state = &then->state;
+    future_add_callback(future->state, &then->callback);
+    return thrd_success;
+}
+
+// ============================================================================
+// Combinators
+// ============================================================================
+
+typedef struct future_join future_join;
+
+typedef struct join_callback {
+    future_callback callback;
+    future_join* join;
+    size_t index;
+} join_callback;
+
+// Shared by cp_when_all and cp_when_any, allocated in one piece with a
+// callback per input. Each callback holds a reference until it has run, so
+// the callbacks of cp_when_any stay valid after the first one completes it.
+struct future_join {
+    future_state state;
+    cp_atomic64 remaining;
+    cp_atomic32 failed;
+    int any;
+    join_callback callbacks[];
+};
+
+static void join_fire(future_state* source, future_callback* callback) {
+    join_callback* entry = (join_callback*)callback;
+    future_join* join = entry->join;
+
+    if(join->any) {
+        future_complete(&join->state, (void*)(uintptr_t)entry->index, source->result);
+    } else {
+        if(source->result != thrd_success)
+            cp_atomic_store32(&join->failed, 1);
+        if(cp_atomic_fetch_add64(&join->remaining, -1) == 1)
+            future_complete(&join->state, NULL, cp_atomic_load32(&join->failed) ? thrd_error : thrd_success);
+    }
+    future_release(&join->state);
+}
+
+static int future_join_create(cp_future_t* result, const cp_future_t* futures, size_t count, int any) {
+    if(!result || (count > 0 && !futures))
+        return thrd_error;
+    for(size_t i = 0; i < count; i++) {
+        if(!futures[i].state)
+            return thrd_error;
+    }
+
+    future_join* join = malloc(sizeof(*join) + sizeof(join->callbacks[0]) * count);
+    if(!join)
+        return thrd_nomem;
+    future_state_init(&join->state, (int32_t)count + 1);
+    join->remaining = (int64_t)count;
+    join->failed = 0;
+    join->any = any;
+    result->state = &join->state;
+
+    if(count == 0) {
+        future_complete(&join->state, NULL, thrd_success);
+        return thrd_success;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        join->callbacks[i].callback.func = join_fire;
+        join->callbacks[i].join = join;
+        join->callbacks[i].index = i;
+    }
+    // Registered only once all are initialized, since any of them may run
+    // (and complete the join) straight away.
+    for(size_t i = 0; i < count; i++)
+        future_add_callback(futures[i].state, &join->callbacks[i].callback);
+    return thrd_success;
+}
+
+int cp_when_all(cp_future_t* result, const cp_future_t* futures, size_t count) {
+    return future_join_create(result, futures, count, 0);
+}
+
+int cp_when_any(cp_future_t* result, const cp_future_t* futures, size_t count) {
+    if(count == 0)
+        return thrd_error;
+    return future_join_create(result, futures, count, 1);
+}
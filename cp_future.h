@@ -0,0 +1,121 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_FUTURE_H
+#define CP_THREADS_CP_FUTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Futures
+// ============================================================================
+
+// One-shot results passed from the thread that produces them to any number
+// of threads that wait for them or chain more work onto them.
+//
+// A promise and its futures share one reference counted state, allocated
+// once by cp_promise_init. The promise completes it exactly once with a
+// void* payload; each cp_future_t is a reference to the same state, taken
+// with cp_promise_get_future or cp_future_share, and released with
+// cp_future_destroy.
+//
+// Completion takes no locks: the payload is stored, the list of callbacks
+// is swapped for a "done" marker and the callbacks that were on it run on
+// the completing thread. Callbacks added afterwards run right away on the
+// thread adding them. Continuations (cp_future_then) and the combinators
+// (cp_when_all, cp_when_any) are such callbacks, so none of them keep a
+// thread blocked. Only cp_future_wait and cp_future_timedwait park.
+//
+// A future completed from inside a callback has its own callbacks queued
+// and run once the current one returns, so a chain of any length completes
+// in constant stack. A callback therefore mustn't wait for a future that it
+// completed itself, directly or further down a chain.
+//
+// Continuations should be short. To do real work, submit a task to a
+// cp_pool_t from the continuation.
+//
+// A promise destroyed without being set completes its futures with
+// thrd_error instead of a value, and so do continuations of such futures.
+
+// Result of a continuation. The value is the payload of the future it was
+// chained onto.
+typedef void* (*cp_future_fn)(void* value, void* arg);
+
+struct ___cp_future;
+
+typedef struct cp_promise_t {
+    struct ___cp_future* state;
+} cp_promise_t;
+
+typedef struct cp_future_t {
+    struct ___cp_future* state;
+} cp_future_t;
+
+int cp_promise_init(cp_promise_t* promise);
+
+// Completes the futures with the value. Returns thrd_error if the promise
+// was already set.
+int cp_promise_set(cp_promise_t* promise, void* value);
+
+// Breaks the promise if it was never set, then drops its reference.
+void cp_promise_destroy(cp_promise_t* promise);
+
+// Takes another reference to the promise's state.
+int cp_promise_get_future(cp_future_t* future, cp_promise_t* promise);
+
+// Takes another reference to the future's state.
+int cp_future_share(cp_future_t* copy, cp_future_t* future);
+
+void cp_future_destroy(cp_future_t* future);
+
+// 1 if the future has completed, with a value or broken.
+int cp_future_is_ready(cp_future_t* future);
+
+// Wait for the future, then return thrd_success and store the payload in
+// value (if not NULL), or thrd_error if the promise was broken.
+// cp_future_timedwait returns thrd_timedout once the deadline (TIME_UTC)
+// passes.
+int cp_future_wait(cp_future_t* future, void** value);
+int cp_future_timedwait(cp_future_t* future, const struct timespec* time_point, void** value);
+
+// Creates a future completed with func(value, arg) once future completes.
+// func runs on the thread that completes future, or right away on this one
+// if it already has.
+int cp_future_then(cp_future_t* result, cp_future_t* future, cp_future_fn func, void* arg);
+
+// Creates a future that completes once every one of the futures has. Its
+// payload is NULL; the individual payloads can be read from the inputs
+// without blocking. It's broken if any input was.
+int cp_when_all(cp_future_t* result, const cp_future_t* futures, size_t count);
+
+// Creates a future that completes as soon as one of the futures does. Its
+// payload is the index of that future, cast to a pointer, and it's broken
+// if that future was.
+int cp_when_any(cp_future_t* result, const cp_future_t* futures, size_t count);
+
+#endif
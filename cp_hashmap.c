@@ -0,0 +1,621 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_hashmap.h"
+
+#define HASHMAP_MIN_SIZE (CP_HASHMAP_STRIPES * 4)
+
+// How many buckets a writer moves to the new table per operation.
+#define HASHMAP_MIGRATE_BATCH 4
+
+// A stripe tries to free its retired entries once this many pile up.
+#define HASHMAP_GARBAGE_BATCH 64
+
+// How long a lookup spins on a bucket being moved before yielding.
+#define HASHMAP_READ_SPINS 64
+
+#define STRIPE_MASK (CP_HASHMAP_STRIPES - 1)
+
+// ============================================================================
+// Epoch Based Reclamation
+// ============================================================================
+
+// Every thread that reads a map owns a record. While reading, the record
+// holds the global epoch it saw on entry. The epoch only moves forward once
+// every active reader has seen the current one, so anything retired at
+// epoch e is unreachable by the time the epoch reaches e + 2.
+//
+// Records are never freed. A thread hands its record back when it exits and
+// the next new thread reuses it.
+
+typedef struct ebr_record {
+    cp_atomic64 state;
+    cp_atomic32 in_use;
+    struct ebr_record* next;
+    char pad[CP_CACHE_LINE];
+} ebr_record;
+
+static cp_atomic64 ebr_epoch = 0;
+static cp_atomic_ptr ebr_records = NULL;
+
+// Readers that couldn't get a record. Reclamation waits while there are any.
+static cp_atomic32 ebr_unregistered = 0;
+
+static once_flag ebr_once = ONCE_FLAG_INIT;
+static tss_t ebr_key;
+static int ebr_key_valid = 0;
+
+static thread_local ebr_record* ebr_self;
+static thread_local int ebr_depth;
+
+static void ebr_release(void* arg) {
+    ebr_record* record = arg;
+    cp_atomic_store64(&record->state, 0);
+    cp_atomic_store32(&record->in_use, 0);
+}
+
+static void ebr_key_init(void) {
+    ebr_key_valid = tss_create(&ebr_key, ebr_release) == thrd_success;
+}
+
+static ebr_record* ebr_acquire(void) {
+    call_once(&ebr_once, ebr_key_init);
+
+    ebr_record* record;
+    for(record = cp_atomic_load_ptr(&ebr_records); record; record = record->next) {
+        int32_t expected = 0;
+        if(cp_atomic_load32(&record->in_use) == 0 && cp_atomic_cas32(&record->in_use, &expected, 1))
+            break;
+    }
+
+    if(!record) {
+        record = malloc(sizeof(*record));
+        if(!record)
+            return NULL;
+        record->state = 0;
+        record->in_use = 1;
+
+        void* head = cp_atomic_load_ptr(&ebr_records);
+        do {
+            record->next = head;
+        } while(!cp_atomic_cas_ptr(&ebr_records, &head, record));
+    }
+
+    if(ebr_key_valid)
+        tss_set(ebr_key, record);
+    return record;
+}
+
+static void ebr_enter(void) {
+    if(ebr_depth++ > 0)
+        return;
+
+    if(!ebr_self)
+        ebr_self = ebr_acquire();
+    if(!ebr_self) {
+        cp_atomic_fetch_add32(&ebr_unregistered, 1);
+        return;
+    }
+
+    // The exchange is a full barrier, so the epoch is published before any
+    // of the reads it protects.
+    int64_t epoch = cp_atomic_load64(&ebr_epoch);
+    cp_atomic_exchange64(&ebr_self->state, (epoch << 1) | 1);
+}
+
+static void ebr_exit(void) {
+    if(--ebr_depth > 0)
+        return;
+
+    if(ebr_self)
+        cp_atomic_store64(&ebr_self->state, 0);
+    else
+        cp_atomic_fetch_add32(&ebr_unregistered, -1);
+}
+
+static int64_t ebr_try_advance(void) {
+    int64_t epoch = cp_atomic_load64(&ebr_epoch);
+    if(cp_atomic_load32(&ebr_unregistered))
+        return epoch;
+
+    for(ebr_record* record = cp_atomic_load_ptr(&ebr_records); record; record = record->next) {
+        int64_t state = cp_atomic_load64(&record->state);
+        if((state & 1) && (state >> 1) != epoch)
+            return epoch;
+    }
+
+    if(cp_atomic_cas64(&ebr_epoch, &epoch, epoch + 1))
+        return epoch + 1;
+    return epoch;
+}
+
+// ============================================================================
+// Map
+// ============================================================================
+
+typedef struct retired {
+    struct retired* next;
+    int64_t epoch;
+    void (*release)(cp_hashmap_t* map, struct retired* item);
+} retired;
+
+typedef struct map_node {
+    retired garbage;
+    cp_atomic_ptr next;
+    uint64_t hash;
+    void* key;
+    void* value;
+} map_node;
+
+typedef struct map_table {
+    retired garbage;
+    size_t size;
+    cp_atomic_ptr next;
+    cp_atomic64 migrate_cursor;
+    cp_atomic64 migrated;
+    cp_atomic_ptr buckets[];
+} map_table;
+
+struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_hashmap_stripe {
+    mtx_t lock;
+    cp_atomic32 seq;
+    cp_atomic64 count;
+    retired* garbage;
+    int garbage_count;
+    int reclaim_at;
+};
+
+typedef struct ___cp_hashmap_stripe map_stripe;
+
+// Left in an old table's bucket once its entries have moved to the new one.
+static char moved_marker;
+#define BUCKET_MOVED ((void*)&moved_marker)
+
+static uint64_t hash_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+    return x;
+}
+
+static __inline uint64_t map_hash(cp_hashmap_t* map, const void* key) {
+    return hash_mix(map->hash ? map->hash(key) : (uint64_t)(uintptr_t)key);
+}
+
+static __inline int map_equal(cp_hashmap_t* map, const void* lhs, const void* rhs) {
+    return map->equal ? map->equal(lhs, rhs) : lhs == rhs;
+}
+
+static __inline map_stripe* map_stripe_of(cp_hashmap_t* map, uint64_t hash) {
+    return map->stripes + (hash & STRIPE_MASK);
+}
+
+static map_table* table_new(size_t size) {
+    map_table* table = malloc(sizeof(*table) + sizeof(cp_atomic_ptr) * size);
+    if(!table)
+        return NULL;
+
+    table->size = size;
+    table->next = NULL;
+    table->migrate_cursor = 0;
+    table->migrated = 0;
+    for(size_t i = 0; i < size; i++)
+        table->buckets[i] = NULL;
+    return table;
+}
+
+static void node_release(cp_hashmap_t* map, retired* item) {
+    map_node* node = (map_node*)item;
+    if(map->free_entry)
+        map->free_entry(node->key, node->value);
+    free(node);
+}
+
+static void table_release(cp_hashmap_t* map, retired* item) {
+    free(item);
+}
+
+static void stripe_reclaim(cp_hashmap_t* map, map_stripe* stripe) {
+    int64_t epoch = ebr_try_advance();
+
+    // Newest first, so everything after the first old enough item is too.
+    retired** link = &stripe->garbage;
+    while(*link && (*link)->epoch + 2 > epoch)
+        link = &(*link)->next;
+
+    retired* item = *link;
+    *link = NULL;
+    while(item) {
+        retired* next = item->next;
+        item->release(map, item);
+        stripe->garbage_count--;
+        item = next;
+    }
+
+    // A reader that stays inside a lookup holds everything back. Waiting
+    // for another batch before trying again keeps retiring O(1) meanwhile.
+    stripe->reclaim_at = stripe->garbage_count + HASHMAP_GARBAGE_BATCH;
+}
+
+// The stripe must be locked.
+static void stripe_retire(cp_hashmap_t* map, map_stripe* stripe, retired* item, void (*release)(cp_hashmap_t*, retired*)) {
+    // The item was unlinked just before. The fence keeps the epoch read from
+    // moving ahead of that.
+    cp_atomic_fence();
+    item->epoch = cp_atomic_load64(&ebr_epoch);
+    item->release = release;
+    item->next = stripe->garbage;
+    stripe->garbage = item;
+    if(++stripe->garbage_count >= stripe->reclaim_at)
+        stripe_reclaim(map, stripe);
+}
+
+// Splits one bucket of a table being resized into its two buckets in the
+// next table. Nodes are relinked rather than copied, so a lookup walking the
+// bucket at the same time may get lost; the sequence bump makes it retry.
+static void table_migrate_bucket(cp_hashmap_t* map, map_table* table, size_t index) {
+    map_table* next = cp_atomic_load_ptr(&table->next);
+    map_stripe* stripe = map->stripes + (index & STRIPE_MASK);
+
+    mtx_lock(&stripe->lock);
+    cp_atomic_fetch_add32(&stripe->seq, 1);
+
+    cp_atomic_ptr low = NULL;
+    cp_atomic_ptr high = NULL;
+    cp_atomic_ptr* low_tail = &low;
+    cp_atomic_ptr* high_tail = &high;
+    map_node* node = cp_atomic_load_ptr(&table->buckets[index]);
+    while(node) {
+        map_node* following = cp_atomic_load_ptr(&node->next);
+        if(node->hash & table->size) {
+            cp_atomic_store_ptr(high_tail, node);
+            high_tail = &node->next;
+        } else {
+            cp_atomic_store_ptr(low_tail, node);
+            low_tail = &node->next;
+        }
+        node = following;
+    }
+    cp_atomic_store_ptr(low_tail, NULL);
+    cp_atomic_store_ptr(high_tail, NULL);
+
+    cp_atomic_store_ptr(&next->buckets[index], low);
+    cp_atomic_store_ptr(&next->buckets[index + table->size], high);
+    cp_atomic_store_ptr(&table->buckets[index], BUCKET_MOVED);
+
+    cp_atomic_fetch_add32(&stripe->seq, 1);
+    mtx_unlock(&stripe->lock);
+}
+
+static void table_help_migrate(cp_hashmap_t* map, map_table* table) {
+    for(int i = 0; i < HASHMAP_MIGRATE_BATCH; i++) {
+        int64_t index = cp_atomic_fetch_add64(&table->migrate_cursor, 1);
+        if(index >= (int64_t)table->size)
+            return;
+
+        table_migrate_bucket(map, table, (size_t)index);
+        if(cp_atomic_fetch_add64(&table->migrated, 1) != (int64_t)table->size - 1)
+            continue;
+
+        // Last bucket moved. Lookups that started on the old table can
+        // still be walking it, so it's retired like a node.
+        cp_atomic_store_ptr(&map->table, cp_atomic_load_ptr(&table->next));
+        map_stripe* stripe = map->stripes;
+        mtx_lock(&stripe->lock);
+        stripe_retire(map, stripe, &table->garbage, table_release);
+        mtx_unlock(&stripe->lock);
+        return;
+    }
+}
+
+static void table_start_resize(cp_hashmap_t* map, map_table* table) {
+    if(cp_atomic_load_ptr(&map->table) != table || cp_atomic_load_ptr(&table->next))
+        return;
+
+    map_table* bigger = table_new(table->size * 2);
+    if(!bigger)
+        return;
+
+    void* expected = NULL;
+    if(!cp_atomic_cas_ptr(&table->next, &expected, bigger))
+        free(bigger);
+}
+
+// The stripe of the hash must be locked. Follows moved buckets to the table
+// that currently holds the key.
+static map_table* table_for_write(cp_hashmap_t* map, uint64_t hash) {
+    map_table* table = cp_atomic_load_ptr(&map->table);
+    while(cp_atomic_load_ptr(&table->buckets[hash & (table->size - 1)]) == BUCKET_MOVED)
+        table = cp_atomic_load_ptr(&table->next);
+    return table;
+}
+
+int cp_hashmap_init(cp_hashmap_t* map,
+                    size_t capacity,
+                    cp_hashmap_hash_fn hash,
+                    cp_hashmap_equal_fn equal,
+                    cp_hashmap_free_fn free_entry) {
+    if(!map)
+        return thrd_error;
+
+    size_t size = HASHMAP_MIN_SIZE;
+    while(size < capacity + capacity / 3)
+        size *= 2;
+
+    map_table* table = table_new(size);
+    if(!table)
+        return thrd_nomem;
+
+    // Over-allocate so every stripe starts on its own cache line.
+    map->stripe_block = malloc(sizeof(map_stripe) * CP_HASHMAP_STRIPES + CP_CACHE_LINE);
+    if(!map->stripe_block) {
+        free(table);
+        return thrd_nomem;
+    }
+    uintptr_t aligned = ((uintptr_t)map->stripe_block + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1);
+    map->stripes = (map_stripe*)aligned;
+
+    for(int i = 0; i < CP_HASHMAP_STRIPES; i++) {
+        map_stripe* stripe = map->stripes + i;
+        if(mtx_init(&stripe->lock, mtx_plain) != thrd_success) {
+            while(i-- > 0)
+                mtx_destroy(&map->stripes[i].lock);
+            free(map->stripe_block);
+            free(table);
+            return thrd_error;
+        }
+        stripe->seq = 0;
+        stripe->count = 0;
+        stripe->garbage = NULL;
+        stripe->garbage_count = 0;
+        stripe->reclaim_at = HASHMAP_GARBAGE_BATCH;
+    }
+
+    map->table = table;
+    map->hash = hash;
+    map->equal = equal;
+    map->free_entry = free_entry;
+    return thrd_success;
+}
+
+static void table_free_nodes(cp_hashmap_t* map, map_table* table) {
+    for(size_t i = 0; i < table->size; i++) {
+        map_node* node = table->buckets[i];
+        if(node == BUCKET_MOVED)
+            continue;
+        while(node) {
+            map_node* next = node->next;
+            node_release(map, &node->garbage);
+            node = next;
+        }
+    }
+}
+
+void cp_hashmap_destroy(cp_hashmap_t* map) {
+    if(!map || !map->stripes)
+        return;
+
+    for(int i = 0; i < CP_HASHMAP_STRIPES; i++) {
+        map_stripe* stripe = map->stripes + i;
+        for(retired* item = stripe->garbage; item;) {
+            retired* next = item->next;
+            item->release(map, item);
+            item = next;
+        }
+        mtx_destroy(&stripe->lock);
+    }
+
+    map_table* table = map->table;
+    map_table* next = table->next;
+    table_free_nodes(map, table);
+    free(table);
+    if(next) {
+        table_free_nodes(map, next);
+        free(next);
+    }
+
+    free(map->stripe_block);
+    map->stripe_block = NULL;
+    map->stripes = NULL;
+    map->table = NULL;
+}
+
+int cp_hashmap_get(cp_hashmap_t* map, const void* key, void** value) {
+    if(!map)
+        return 0;
+
+    uint64_t hash = map_hash(map, key);
+    map_stripe* stripe = map_stripe_of(map, hash);
+    int found = 0;
+
+    ebr_enter();
+    for(int spins = 0;; spins++) {
+        int32_t seq = cp_atomic_load32(&stripe->seq);
+        if(seq & 1) {
+            if(spins < HASHMAP_READ_SPINS)
+                cp_cpu_relax();
+            else
+                thrd_yield();
+            continue;
+        }
+
+        map_table* table = cp_atomic_load_ptr(&map->table);
+        map_node* node = cp_atomic_load_ptr(&table->buckets[hash & (table->size - 1)]);
+        while(node == BUCKET_MOVED) {
+            table = cp_atomic_load_ptr(&table->next);
+            node = cp_atomic_load_ptr(&table->buckets[hash & (table->size - 1)]);
+        }
+
+        for(; node; node = cp_atomic_load_ptr(&node->next)) {
+            if(node->hash == hash && map_equal(map, node->key, key)) {
+                if(value)
+                    *value = node->value;
+                found = 1;
+                break;
+            }
+        }
+
+        // A hit is always right. A miss only counts if no bucket of this
+        // stripe was moved underneath it. The next pointers are acquire
+        // loads, so the sequence can't be read again before them.
+        if(found)
+            break;
+        if(cp_atomic_load32(&stripe->seq) == seq)
+            break;
+    }
+    ebr_exit();
+
+    return found;
+}
+
+static int map_write(cp_hashmap_t* map, void* key, void* value, int replace) {
+    if(!map)
+        return thrd_error;
+
+    map_node* fresh = malloc(sizeof(*fresh));
+    if(!fresh)
+        return thrd_nomem;
+
+    uint64_t hash = map_hash(map, key);
+    fresh->hash = hash;
+    fresh->key = key;
+    fresh->value = value;
+
+    ebr_enter();
+
+    map_table* current = cp_atomic_load_ptr(&map->table);
+    if(cp_atomic_load_ptr(&current->next))
+        table_help_migrate(map, current);
+
+    map_stripe* stripe = map_stripe_of(map, hash);
+    mtx_lock(&stripe->lock);
+
+    map_table* table = table_for_write(map, hash);
+    cp_atomic_ptr* link = &table->buckets[hash & (table->size - 1)];
+    map_node* node;
+    while((node = cp_atomic_load_ptr(link)) != NULL) {
+        if(node->hash == hash && map_equal(map, node->key, key))
+            break;
+        link = &node->next;
+    }
+
+    int result = thrd_success;
+    map_table* grow = NULL;
+    if(node && !replace) {
+        result = thrd_busy;
+    } else if(node) {
+        fresh->next = cp_atomic_load_ptr(&node->next);
+        cp_atomic_store_ptr(link, fresh);
+        stripe_retire(map, stripe, &node->garbage, node_release);
+        fresh = NULL;
+    } else {
+        // New entries go at the head. The node is fully built before the
+        // release store makes it visible to lookups.
+        cp_atomic_ptr* head = &table->buckets[hash & (table->size - 1)];
+        fresh->next = cp_atomic_load_ptr(head);
+        cp_atomic_store_ptr(head, fresh);
+        fresh = NULL;
+
+        int64_t count = cp_atomic_load64(&stripe->count) + 1;
+        cp_atomic_store64(&stripe->count, count);
+        if(!cp_atomic_load_ptr(&table->next) && count * 4 > (int64_t)(table->size / CP_HASHMAP_STRIPES) * 3)
+            grow = table;
+    }
+
+    mtx_unlock(&stripe->lock);
+
+    if(grow)
+        table_start_resize(map, grow);
+    ebr_exit();
+
+    free(fresh);
+    return result;
+}
+
+int cp_hashmap_put(cp_hashmap_t* map, void* key, void* value) {
+    return map_write(map, key, value, 1);
+}
+
+int cp_hashmap_insert(cp_hashmap_t* map, void* key, void* value) {
+    return map_write(map, key, value, 0);
+}
+
+int cp_hashmap_remove(cp_hashmap_t* map, const void* key) {
+    if(!map)
+        return 0;
+
+    uint64_t hash = map_hash(map, key);
+
+    ebr_enter();
+
+    map_table* current = cp_atomic_load_ptr(&map->table);
+    if(cp_atomic_load_ptr(&current->next))
+        table_help_migrate(map, current);
+
+    map_stripe* stripe = map_stripe_of(map, hash);
+    mtx_lock(&stripe->lock);
+
+    map_table* table = table_for_write(map, hash);
+    cp_atomic_ptr* link = &table->buckets[hash & (table->size - 1)];
+    map_node* node;
+    while((node = cp_atomic_load_ptr(link)) != NULL) {
+        if(node->hash == hash && map_equal(map, node->key, key))
+            break;
+        link = &node->next;
+    }
+
+    // Lookups already on the node can keep following its next pointer.
+    if(node) {
+        cp_atomic_store_ptr(link, cp_atomic_load_ptr(&node->next));
+        cp_atomic_store64(&stripe->count, cp_atomic_load64(&stripe->count) - 1);
+        stripe_retire(map, stripe, &node->garbage, node_release);
+    }
+
+    mtx_unlock(&stripe->lock);
+    ebr_exit();
+
+    return node != NULL;
+}
+
+size_t cp_hashmap_size(cp_hashmap_t* map) {
+    if(!map)
+        return 0;
+
+    int64_t total = 0;
+    for(int i = 0; i < CP_HASHMAP_STRIPES; i++)
+        total += cp_atomic_load64(&map->stripes[i].count);
+    return total > 0 ? (size_t)total : 0;
+}
+
+void cp_hashmap_read_begin(void) {
+    ebr_enter();
+}
+
+void cp_hashmap_read_end(void) {
+    ebr_exit();
+}
@@ -0,0 +1,104 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_HASHMAP_H
+#define CP_THREADS_CP_HASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Concurrent Hash Map
+// ============================================================================
+
+// A chained hash map for read-mostly data shared between many threads.
+//
+// Lookups take no locks and write nothing shared. Writers lock one of
+// CP_HASHMAP_STRIPES stripes picked from the key's hash, so writes to
+// different stripes don't contend. When the table gets too full a bigger one
+// is allocated and writers move a few buckets each over to it as they go;
+// lookups check both tables while that happens. Moving a bucket bumps a
+// per-stripe sequence number, and a lookup that missed while the number
+// changed tries again.
+//
+// Removed and replaced entries are handed to free_entry only after every
+// thread that might still be reading them has finished its lookup, using
+// epoch based reclamation shared by all maps. free_entry runs with a stripe
+// locked and must not call back into the map.
+
+#define CP_HASHMAP_STRIPES 64
+
+typedef uint64_t (*cp_hashmap_hash_fn)(const void* key);
+typedef int (*cp_hashmap_equal_fn)(const void* lhs, const void* rhs);
+typedef void (*cp_hashmap_free_fn)(void* key, void* value);
+
+struct ___cp_hashmap_stripe;
+
+typedef struct cp_hashmap_t {
+    cp_atomic_ptr table;
+    struct ___cp_hashmap_stripe* stripes;
+    void* stripe_block;
+    cp_hashmap_hash_fn hash;
+    cp_hashmap_equal_fn equal;
+    cp_hashmap_free_fn free_entry;
+} cp_hashmap_t;
+
+// A NULL hash or equal compares the key pointers themselves, which also
+// works for integer keys cast to void*. capacity is only a hint, 0 picks a
+// small default. free_entry may be NULL.
+int cp_hashmap_init(cp_hashmap_t* map,
+                    size_t capacity,
+                    cp_hashmap_hash_fn hash,
+                    cp_hashmap_equal_fn equal,
+                    cp_hashmap_free_fn free_entry);
+
+// Not thread safe. Every remaining entry is passed to free_entry.
+void cp_hashmap_destroy(cp_hashmap_t* map);
+
+// Returns 1 and stores the value if the key is present, otherwise 0.
+int cp_hashmap_get(cp_hashmap_t* map, const void* key, void** value);
+
+// Adds the key or replaces its entry.
+int cp_hashmap_put(cp_hashmap_t* map, void* key, void* value);
+
+// Adds the key, or returns thrd_busy if it's already present.
+int cp_hashmap_insert(cp_hashmap_t* map, void* key, void* value);
+
+// Returns 1 if the key was present.
+int cp_hashmap_remove(cp_hashmap_t* map, const void* key);
+
+// Only a snapshot, the count may change right after.
+size_t cp_hashmap_size(cp_hashmap_t* map);
+
+// A value returned by cp_hashmap_get can be freed as soon as the lookup
+// returns. Wrapping the lookups and the use of their results in these keeps
+// every entry seen in between alive until cp_hashmap_read_end. They nest,
+// and apply to all maps at once.
+void cp_hashmap_read_begin(void);
+void cp_hashmap_read_end(void);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "cp_lfstack.h"
+
+// Backoff after a failed CAS doubles up to this many spins, then yields.
+#define LFSTACK_MAX_BACKOFF 256
+
+// How long a push waits in the elimination array for a pop to take it.
+#define LFSTACK_ELIMINATION_SPINS 128
+
+typedef struct head_snapshot {
+    cp_lfstack_node_t* top;
+    uint64_t tag;
+} head_snapshot;
+
+#if CP_LFSTACK_DWCAS
+
+// The two halves are read separately. A torn snapshot can't do any harm, the
+// CAS compares both words and simply fails.
+static __inline head_snapshot head_load(cp_lfstack_t* stack) {
+    head_snapshot head;
+#if defined(_MSC_VER)
+    head.tag = stack->head.tag;
+    _ReadWriteBarrier();
+    head.top = stack->head.top;
+    _ReadWriteBarrier();
+#else
+    head.tag = __atomic_load_n(&stack->head.tag, __ATOMIC_ACQUIRE);
+    head.top = __atomic_load_n(&stack->head.top, __ATOMIC_ACQUIRE);
+#endif
+    return head;
+}
+
+// On failure expected is refreshed with the current head.
+static __inline bool head_cas(cp_lfstack_t* stack, head_snapshot* expected, cp_lfstack_node_t* top) {
+#if defined(_MSC_VER)
+    CP_ALIGNAS(16) int64_t compare[2] = { (int64_t)expected->top, (int64_t)expected->tag };
+    bool ok = _InterlockedCompareExchange128((volatile int64_t*)&stack->head, (int64_t)(expected->tag + 1), (int64_t)top, compare);
+    expected->top = (cp_lfstack_node_t*)compare[0];
+    expected->tag = (uint64_t)compare[1];
+    return ok;
+#else
+    bool ok;
+    __asm__ __volatile__(
+        "lock cmpxchg16b %1\n\t"
+        "sete %0"
+        : "=q"(ok), "+m"(stack->head), "+a"(expected->top), "+d"(expected->tag)
+        : "b"(top), "c"(expected->tag + 1)
+        : "memory", "cc");
+    return ok;
+#endif
+}
+
+#else
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define LFSTACK_PTR_BITS 48
+#else
+#define LFSTACK_PTR_BITS 32
+#endif
+
+#define LFSTACK_PTR_MASK ((UINT64_C(1) << LFSTACK_PTR_BITS) - 1)
+
+static __inline int64_t head_pack(cp_lfstack_node_t* top, uint64_t tag) {
+    return (int64_t)(((uint64_t)(uintptr_t)top & LFSTACK_PTR_MASK) | (tag << LFSTACK_PTR_BITS));
+}
+
+static __inline head_snapshot head_unpack(int64_t word) {
+    head_snapshot head;
+    head.top = (cp_lfstack_node_t*)(uintptr_t)((uint64_t)word & LFSTACK_PTR_MASK);
+    head.tag = (uint64_t)word >> LFSTACK_PTR_BITS;
+    return head;
+}
+
+static __inline head_snapshot head_load(cp_lfstack_t* stack) {
+    return head_unpack(cp_atomic_load64(&stack->head));
+}
+
+static __inline bool head_cas(cp_lfstack_t* stack, head_snapshot* expected, cp_lfstack_node_t* top) {
+    int64_t word = head_pack(expected->top, expected->tag);
+    if(cp_atomic_cas64(&stack->head, &word, head_pack(top, expected->tag + 1)))
+        return true;
+    *expected = head_unpack(word);
+    return false;
+}
+
+#endif
+
+// A node can be popped and relinked by another thread while a pop is still
+// reading its next pointer, so both sides go through atomics.
+static __inline cp_lfstack_node_t* node_next(cp_lfstack_node_t* node) {
+    return cp_atomic_load_ptr((cp_atomic_ptr*)&node->next);
+}
+
+static __inline void node_link(cp_lfstack_node_t* node, cp_lfstack_node_t* next) {
+    cp_atomic_store_ptr((cp_atomic_ptr*)&node->next, next);
+}
+
+static void backoff(int* spins) {
+    if(*spins >= LFSTACK_MAX_BACKOFF) {
+        thrd_yield();
+        return;
+    }
+    for(int i = 0; i < *spins; i++)
+        cp_cpu_relax();
+    *spins = *spins ? *spins * 2 : 1;
+}
+
+// ============================================================================
+// Elimination
+// ============================================================================
+
+// A push that lost a race on the head publishes an offer in a random slot
+// and waits a moment. A pop that lost a race takes whatever offer it finds
+// in its own random slot. The offer lives on the pushing thread's stack, so
+// the pusher can't return until it either withdrew the offer or saw it taken.
+
+typedef struct elimination_offer {
+    cp_lfstack_node_t* node;
+    cp_atomic32 taken;
+} elimination_offer;
+
+static thread_local uint32_t elimination_seed;
+
+static cp_atomic_ptr* elimination_slot(cp_lfstack_t* stack) {
+    uint32_t x = elimination_seed;
+    if(x == 0)
+        x = (uint32_t)(uintptr_t)&elimination_seed | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    elimination_seed = x;
+    return stack->elimination + x % CP_LFSTACK_ELIMINATION_SLOTS;
+}
+
+static bool eliminate_push(cp_lfstack_t* stack, cp_lfstack_node_t* node) {
+    cp_atomic_ptr* slot = elimination_slot(stack);
+    elimination_offer offer = { node, 0 };
+
+    void* expected = NULL;
+    if(!cp_atomic_cas_ptr(slot, &expected, &offer))
+        return false;
+
+    for(int i = 0; i < LFSTACK_ELIMINATION_SPINS; i++) {
+        if(cp_atomic_load32(&offer.taken))
+            return true;
+        cp_cpu_relax();
+    }
+
+    expected = &offer;
+    if(cp_atomic_cas_ptr(slot, &expected, NULL))
+        return false;
+
+    // A pop already claimed the offer and is about to read the node.
+    while(!cp_atomic_load32(&offer.taken))
+        cp_cpu_relax();
+    return true;
+}
+
+static cp_lfstack_node_t* eliminate_pop(cp_lfstack_t* stack) {
+    cp_atomic_ptr* slot = elimination_slot(stack);
+    void* expected = cp_atomic_load_ptr(slot);
+    if(!expected || !cp_atomic_cas_ptr(slot, &expected, NULL))
+        return NULL;
+
+    elimination_offer* offer = expected;
+    cp_lfstack_node_t* node = offer->node;
+    cp_atomic_store32(&offer->taken, 1);
+    return node;
+}
+
+// ============================================================================
+// Stack
+// ============================================================================
+
+int cp_lfstack_init(cp_lfstack_t* stack, int flags) {
+    if(!stack || (flags & ~cp_lfstack_elimination))
+        return thrd_error;
+
+#if CP_LFSTACK_DWCAS
+    stack->head.top = NULL;
+    stack->head.tag = 0;
+#else
+    stack->head = 0;
+#endif
+    stack->flags = flags;
+    for(int i = 0; i < CP_LFSTACK_ELIMINATION_SLOTS; i++)
+        stack->elimination[i] = NULL;
+    return thrd_success;
+}
+
+void cp_lfstack_destroy(cp_lfstack_t* stack) {
+    if(!stack)
+        return;
+
+    // The nodes belong to the caller, there is nothing to free.
+#if CP_LFSTACK_DWCAS
+    stack->head.top = NULL;
+#else
+    stack->head = 0;
+#endif
+}
+
+void cp_lfstack_push_list(cp_lfstack_t* stack, cp_lfstack_node_t* first, cp_lfstack_node_t* last) {
+    if(!stack || !first || !last)
+        return;
+
+    int spins = 0;
+    head_snapshot head = head_load(stack);
+    for(;;) {
+        node_link(last, head.top);
+        if(head_cas(stack, &head, first))
+            return;
+        if((stack->flags & cp_lfstack_elimination) && first == last && eliminate_push(stack, first))
+            return;
+        backoff(&spins);
+        head = head_load(stack);
+    }
+}
+
+void cp_lfstack_push(cp_lfstack_t* stack, cp_lfstack_node_t* node) {
+    cp_lfstack_push_list(stack, node, node);
+}
+
+cp_lfstack_node_t* cp_lfstack_pop(cp_lfstack_t* stack) {
+    if(!stack)
+        return NULL;
+
+    int spins = 0;
+    head_snapshot head = head_load(stack);
+    for(;;) {
+        if(!head.top)
+            return NULL;
+        if(head_cas(stack, &head, node_next(head.top)))
+            return head.top;
+        if(stack->flags & cp_lfstack_elimination) {
+            cp_lfstack_node_t* node = eliminate_pop(stack);
+            if(node)
+                return node;
+        }
+        backoff(&spins);
+        head = head_load(stack);
+    }
+}
+
+cp_lfstack_node_t* cp_lfstack_pop_all(cp_lfstack_t* stack) {
+    if(!stack)
+        return NULL;
+
+    head_snapshot head = head_load(stack);
+    while(head.top && !head_cas(stack, &head, NULL))
+        ;
+    return head.top;
+}
+
+int cp_lfstack_empty(cp_lfstack_t* stack) {
+    return !stack || head_load(stack).top == NULL;
+}
@@ -0,0 +1,107 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_LFSTACK_H
+#define CP_THREADS_CP_LFSTACK_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Lock-Free Stack
+// ============================================================================
+
+// An intrusive Treiber stack, mainly meant as a freelist for object pools
+// shared between threads. The head pairs the top pointer with a tag that
+// changes on every update, so a pop that read a stale head can't succeed
+// after the same node was popped and pushed back (the ABA problem).
+//
+// On x86-64 the pointer and a full word tag are swapped together with a
+// double-width CAS (cmpxchg16b). Everywhere else they're packed into a
+// single 64-bit word: a 32-bit tag on 32-bit targets, and a 16-bit tag above
+// the 48 bits of address space used on 64-bit targets.
+//
+// Pop reads the next pointer of a node another thread may have just popped,
+// so nodes must not be returned to the OS while the stack is in use. That's
+// the normal situation for a freelist.
+//
+// With cp_lfstack_elimination a push and a pop that collide on the head can
+// hand the node over directly through a small side array instead of both
+// retrying on the head.
+
+#ifndef CP_LFSTACK_DWCAS
+#if (defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))) || (defined(_MSC_VER) && defined(_M_X64))
+#define CP_LFSTACK_DWCAS 1
+#else
+#define CP_LFSTACK_DWCAS 0
+#endif
+#endif
+
+#define CP_LFSTACK_ELIMINATION_SLOTS 8
+
+enum {
+    cp_lfstack_elimination = 1
+};
+
+typedef struct cp_lfstack_node_t {
+    struct cp_lfstack_node_t* next;
+} cp_lfstack_node_t;
+
+#if CP_LFSTACK_DWCAS
+struct CP_ALIGNAS(16) ___cp_lfstack_head {
+    cp_lfstack_node_t* volatile top;
+    volatile uint64_t tag;
+};
+#endif
+
+typedef struct cp_lfstack_t {
+#if CP_LFSTACK_DWCAS
+    struct ___cp_lfstack_head head;
+#else
+    cp_atomic64 head;
+#endif
+    int flags;
+    cp_atomic_ptr elimination[CP_LFSTACK_ELIMINATION_SLOTS];
+} cp_lfstack_t;
+
+int cp_lfstack_init(cp_lfstack_t* stack, int flags);
+void cp_lfstack_destroy(cp_lfstack_t* stack);
+
+void cp_lfstack_push(cp_lfstack_t* stack, cp_lfstack_node_t* node);
+
+// Pushes a chain of nodes already linked from first to last in one step.
+void cp_lfstack_push_list(cp_lfstack_t* stack, cp_lfstack_node_t* first, cp_lfstack_node_t* last);
+
+// Returns NULL if the stack is empty.
+cp_lfstack_node_t* cp_lfstack_pop(cp_lfstack_t* stack);
+
+// Takes every node in one step and returns them linked in pop order.
+cp_lfstack_node_t* cp_lfstack_pop_all(cp_lfstack_t* stack);
+
+// Only a snapshot, the stack may change right after.
+int cp_lfstack_empty(cp_lfstack_t* stack);
+
+#endif
@@ -0,0 +1,401 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "cp_loop.h"
+
+#define LOOP_MAX_EVENTS 64
+
+struct ___cp_loop_task {
+    struct ___cp_loop_task* next;
+    cp_loop_fn func;
+    void* arg;
+};
+
+// Events from one epoll_wait. next is the first one not dispatched yet.
+struct ___cp_loop_batch {
+    struct epoll_event* events;
+    int next;
+    int size;
+    struct ___cp_loop_batch* outer;
+};
+
+static unsigned long long loop_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ull + (unsigned long long)now.tv_nsec / 1000000ull;
+}
+
+static unsigned loop_to_epoll(unsigned events) {
+    unsigned result = 0;
+    if(events & cp_loop_read)
+        result |= EPOLLIN;
+    if(events & cp_loop_write)
+        result |= EPOLLOUT;
+    return result;
+}
+
+static unsigned loop_from_epoll(unsigned events) {
+    unsigned result = 0;
+    if(events & EPOLLIN)
+        result |= cp_loop_read;
+    if(events & EPOLLOUT)
+        result |= cp_loop_write;
+    if(events & (EPOLLHUP | EPOLLRDHUP))
+        result |= cp_loop_hangup;
+    if(events & EPOLLERR)
+        result |= cp_loop_error;
+    return result;
+}
+
+static int loop_ring_doorbell(cp_loop_t* loop) {
+    uint64_t one = 1;
+    cp_atomic_fetch_add64(&loop->doorbells, 1);
+    // EAGAIN means the counter is saturated, which still wakes the loop.
+    if(write(loop->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        return thrd_error;
+    return thrd_success;
+}
+
+// The timers are kept in a binary min-heap ordered by deadline.
+// Indices stored in the timers are 1-based so a zeroed timer is inactive.
+
+static void timer_heap_set(cp_loop_t* loop, int slot, cp_loop_timer_t* timer) {
+    loop->timers[slot] = timer;
+    timer->index = slot + 1;
+}
+
+static void timer_heap_up(cp_loop_t* loop, int slot) {
+    cp_loop_timer_t* timer = loop->timers[slot];
+    while(slot > 0) {
+        int parent = (slot - 1) / 2;
+        if(loop->timers[parent]->deadline <= timer->deadline)
+            break;
+        timer_heap_set(loop, slot, loop->timers[parent]);
+        slot = parent;
+    }
+    timer_heap_set(loop, slot, timer);
+}
+
+static void timer_heap_down(cp_loop_t* loop, int slot) {
+    cp_loop_timer_t* timer = loop->timers[slot];
+    for(;;) {
+        int child = slot * 2 + 1;
+        if(child >= loop->timer_count)
+            break;
+        if(child + 1 < loop->timer_count && loop->timers[child + 1]->deadline < loop->timers[child]->deadline)
+            child++;
+        if(timer->deadline <= loop->timers[child]->deadline)
+            break;
+        timer_heap_set(loop, slot, loop->timers[child]);
+        slot = child;
+    }
+    timer_heap_set(loop, slot, timer);
+}
+
+static void timer_heap_remove(cp_loop_t* loop, cp_loop_timer_t* timer) {
+    int slot = timer->index - 1;
+    cp_loop_timer_t* last = loop->timers[--loop->timer_count];
+    timer->index = 0;
+    if(last == timer)
+        return;
+    timer_heap_set(loop, slot, last);
+    timer_heap_up(loop, slot);
+    timer_heap_down(loop, last->index - 1);
+}
+
+int cp_loop_init(cp_loop_t* loop) {
+    if(!loop)
+        return thrd_error;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epoll_fd < 0)
+        return thrd_error;
+
+    loop->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(loop->event_fd < 0) {
+        close(loop->epoll_fd);
+        return thrd_error;
+    }
+
+    // The doorbell is the only registration with a NULL data pointer.
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->event_fd, &event) != 0) {
+        close(loop->event_fd);
+        close(loop->epoll_fd);
+        return thrd_error;
+    }
+
+    loop->inbox = NULL;
+    loop->stopped = 0;
+    loop->timers = NULL;
+    loop->timer_count = 0;
+    loop->timer_cap = 0;
+    loop->doorbells = 0;
+    loop->batch = NULL;
+    return thrd_success;
+}
+
+void cp_loop_destroy(cp_loop_t* loop) {
+    if(!loop)
+        return;
+
+    // Callbacks that were never run are dropped.
+    struct ___cp_loop_task* task = cp_atomic_exchange_ptr(&loop->inbox, NULL);
+    while(task) {
+        struct ___cp_loop_task* next = task->next;
+        free(task);
+        task = next;
+    }
+
+    for(int i = 0; i < loop->timer_count; i++)
+        loop->timers[i]->index = 0;
+    free(loop->timers);
+    loop->timers = NULL;
+    loop->timer_count = 0;
+    loop->timer_cap = 0;
+
+    close(loop->event_fd);
+    close(loop->epoll_fd);
+}
+
+int cp_loop_post(cp_loop_t* loop, cp_loop_fn func, void* arg) {
+    if(!loop || !func)
+        return thrd_error;
+
+    struct ___cp_loop_task* task = malloc(sizeof(*task));
+    if(!task)
+        return thrd_nomem;
+    task->func = func;
+    task->arg = arg;
+
+    void* head = cp_atomic_load_ptr(&loop->inbox);
+    do {
+        task->next = head;
+    } while(!cp_atomic_cas_ptr(&loop->inbox, &head, task));
+
+    // Only the post that makes the inbox non-empty has to wake the loop.
+    // Every other post is picked up by the same drain.
+    if(head == NULL)
+        return loop_ring_doorbell(loop);
+    return thrd_success;
+}
+
+int cp_loop_stop(cp_loop_t* loop) {
+    if(!loop)
+        return thrd_error;
+    cp_atomic_store32(&loop->stopped, 1);
+    return loop_ring_doorbell(loop);
+}
+
+static int loop_drain_inbox(cp_loop_t* loop) {
+    struct ___cp_loop_task* task = cp_atomic_exchange_ptr(&loop->inbox, NULL);
+    if(!task)
+        return 0;
+
+    // The inbox is a LIFO, so reverse it to run callbacks in posting order.
+    struct ___cp_loop_task* ordered = NULL;
+    while(task) {
+        struct ___cp_loop_task* next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+
+    int count = 0;
+    while(ordered) {
+        struct ___cp_loop_task* next = ordered->next;
+        ordered->func(ordered->arg);
+        free(ordered);
+        ordered = next;
+        count++;
+    }
+    return count;
+}
+
+static int loop_fire_timers(cp_loop_t* loop) {
+    if(loop->timer_count == 0)
+        return 0;
+
+    unsigned long long now = loop_now_ms();
+    int count = 0;
+    while(loop->timer_count > 0 && loop->timers[0]->deadline <= now) {
+        cp_loop_timer_t* timer = loop->timers[0];
+        timer_heap_remove(loop, timer);
+        timer->func(timer->arg);
+        count++;
+    }
+    return count;
+}
+
+int cp_loop_run_once(cp_loop_t* loop, int timeout_ms) {
+    if(!loop)
+        return -1;
+
+    if(cp_atomic_load_ptr(&loop->inbox) != NULL) {
+        timeout_ms = 0;
+    } else if(loop->timer_count > 0) {
+        unsigned long long now = loop_now_ms();
+        unsigned long long deadline = loop->timers[0]->deadline;
+        int until = deadline <= now ? 0 : (deadline - now > INT_MAX ? INT_MAX : (int)(deadline - now));
+        if(timeout_ms < 0 || until < timeout_ms)
+            timeout_ms = until;
+    }
+
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    int ready = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS, timeout_ms);
+    if(ready < 0 && errno != EINTR)
+        return -1;
+
+    struct ___cp_loop_batch batch = { events, 0, ready, loop->batch };
+    loop->batch = &batch;
+
+    int count = 0;
+    for(int i = 0; i < ready; i++) {
+        cp_loop_watch_t* watch = events[i].data.ptr;
+        batch.next = i + 1;
+        if(watch == NULL) {
+            uint64_t value;
+            // Reset the doorbell. The inbox is drained below either way.
+            while(read(loop->event_fd, &value, sizeof(value)) > 0);
+            continue;
+        }
+        // Unwatched by an earlier callback in this batch, and possibly freed.
+        if(events[i].events == 0)
+            continue;
+        watch->func(watch->fd, loop_from_epoll(events[i].events), watch->arg);
+        count++;
+    }
+
+    loop->batch = batch.outer;
+    count += loop_drain_inbox(loop);
+    count += loop_fire_timers(loop);
+    return count;
+}
+
+int cp_loop_run(cp_loop_t* loop) {
+    if(!loop)
+        return thrd_error;
+
+    while(!cp_atomic_load32(&loop->stopped)) {
+        if(cp_loop_run_once(loop, -1) < 0)
+            return thrd_error;
+    }
+
+    // Leave the loop reusable, and don't lose callbacks posted before the stop.
+    cp_atomic_store32(&loop->stopped, 0);
+    loop_drain_inbox(loop);
+    return thrd_success;
+}
+
+int cp_loop_watch(cp_loop_t* loop, cp_loop_watch_t* watch, int fd, unsigned events, cp_loop_io_fn func, void* arg) {
+    if(!loop || !watch || !func || fd < 0)
+        return thrd_error;
+
+    watch->fd = fd;
+    watch->events = events;
+    watch->func = func;
+    watch->arg = arg;
+
+    struct epoll_event event = { .events = loop_to_epoll(events), .data.ptr = watch };
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        return errno == ENOMEM ? thrd_nomem : thrd_error;
+    return thrd_success;
+}
+
+int cp_loop_watch_modify(cp_loop_t* loop, cp_loop_watch_t* watch, unsigned events) {
+    if(!loop || !watch)
+        return thrd_error;
+
+    struct epoll_event event = { .events = loop_to_epoll(events), .data.ptr = watch };
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event) != 0)
+        return thrd_error;
+    watch->events = events;
+    return thrd_success;
+}
+
+int cp_loop_unwatch(cp_loop_t* loop, cp_loop_watch_t* watch) {
+    if(!loop || !watch)
+        return thrd_error;
+
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL) != 0)
+        return thrd_error;
+
+    // The caller may free the watch as soon as this returns, so any events
+    // for it still waiting to be dispatched must be skipped.
+    for(struct ___cp_loop_batch* batch = loop->batch; batch; batch = batch->outer) {
+        for(int i = batch->next; i < batch->size; i++) {
+            if(batch->events[i].data.ptr == watch)
+                batch->events[i].events = 0;
+        }
+    }
+    return thrd_success;
+}
+
+int cp_loop_timer_start(cp_loop_t* loop, cp_loop_timer_t* timer, unsigned long long ms, cp_loop_fn func, void* arg) {
+    if(!loop || !timer || !func)
+        return thrd_error;
+
+    if(timer->index != 0)
+        timer_heap_remove(loop, timer);
+
+    if(loop->timer_count == loop->timer_cap) {
+        int cap = loop->timer_cap == 0 ? 8 : loop->timer_cap * 2;
+        void* buff = realloc(loop->timers, sizeof(*loop->timers) * cap);
+        if(!buff)
+            return thrd_nomem;
+        loop->timers = buff;
+        loop->timer_cap = cap;
+    }
+
+    timer->deadline = loop_now_ms() + ms;
+    timer->func = func;
+    timer->arg = arg;
+    loop->timers[loop->timer_count] = timer;
+    timer_heap_up(loop, loop->timer_count++);
+    return thrd_success;
+}
+
+int cp_loop_timer_cancel(cp_loop_t* loop, cp_loop_timer_t* timer) {
+    if(!loop || !timer)
+        return thrd_error;
+
+    if(timer->index == 0)
+        return thrd_error;
+    timer_heap_remove(loop, timer);
+    return thrd_success;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_LOOP_H
+#define CP_THREADS_CP_LOOP_H
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Event Loop
+// ============================================================================
+
+// A per-thread event loop that waits on file descriptor readiness, timers
+// and callbacks posted from other threads at the same time.
+//
+// The loop itself is owned by one thread: cp_loop_run, cp_loop_watch,
+// cp_loop_unwatch, cp_loop_timer_start and cp_loop_timer_cancel must only be
+// called from that thread (or from a callback it is running).
+// cp_loop_post and cp_loop_stop are safe to call from any thread.
+//
+// Posted callbacks go through a lock-free inbox and an eventfd doorbell.
+// The doorbell is only rung when a post finds the inbox empty, so any number
+// of posts between two drains cost a single eventfd write.
+//
+// Only available on Linux, since it is built on epoll and eventfd.
+
+#if defined(__linux__)
+
+#define CP_HAVE_LOOP 1
+
+typedef void (*cp_loop_fn)(void* arg);
+typedef void (*cp_loop_io_fn)(int fd, unsigned events, void* arg);
+
+enum {
+    cp_loop_read = 1,
+    cp_loop_write = 2,
+    cp_loop_hangup = 4,
+    cp_loop_error = 8
+};
+
+// Registration for a file descriptor. The memory is owned by the caller and
+// must stay valid until cp_loop_unwatch is called. A callback may unwatch and
+// free any watch, including ones with events pending in the same batch.
+typedef struct cp_loop_watch_t {
+    int fd;
+    unsigned events;
+    cp_loop_io_fn func;
+    void* arg;
+} cp_loop_watch_t;
+
+// One-shot timer. The memory is owned by the caller and must stay valid until
+// the timer fires or is cancelled. A zeroed timer is inactive.
+typedef struct cp_loop_timer_t {
+    unsigned long long deadline;
+    cp_loop_fn func;
+    void* arg;
+    // 1-based position in the loop's timer heap, 0 when inactive.
+    int index;
+} cp_loop_timer_t;
+
+struct ___cp_loop_batch;
+
+typedef struct cp_loop_t {
+    int epoll_fd;
+    int event_fd;
+    cp_atomic_ptr inbox;
+    cp_atomic32 stopped;
+    cp_loop_timer_t** timers;
+    int timer_count;
+    int timer_cap;
+    // Number of times the doorbell has been rung. Useful to check coalescing.
+    cp_atomic64 doorbells;
+    // The events cp_loop_run_once is dispatching, so cp_loop_unwatch can
+    // strike a watch from the rest of the batch.
+    struct ___cp_loop_batch* batch;
+} cp_loop_t;
+
+int cp_loop_init(cp_loop_t* loop);
+void cp_loop_destroy(cp_loop_t* loop);
+
+// Runs until cp_loop_stop is called.
+int cp_loop_run(cp_loop_t* loop);
+
+// Runs a single iteration, waiting at most timeout_ms milliseconds
+// (-1 waits until something happens). Returns the number of callbacks run.
+int cp_loop_run_once(cp_loop_t* loop, int timeout_ms);
+
+int cp_loop_stop(cp_loop_t* loop);
+int cp_loop_post(cp_loop_t* loop, cp_loop_fn func, void* arg);
+
+int cp_loop_watch(cp_loop_t* loop, cp_loop_watch_t* watch, int fd, unsigned events, cp_loop_io_fn func, void* arg);
+int cp_loop_watch_modify(cp_loop_t* loop, cp_loop_watch_t* watch, unsigned events);
+int cp_loop_unwatch(cp_loop_t* loop, cp_loop_watch_t* watch);
+
+int cp_loop_timer_start(cp_loop_t* loop, cp_loop_timer_t* timer, unsigned long long ms, cp_loop_fn func, void* arg);
+int cp_loop_timer_cancel(cp_loop_t* loop, cp_loop_timer_t* timer);
+
+static __inline int cp_loop_timer_active(const cp_loop_timer_t* timer) {
+    return timer->index != 0;
+}
+
+#endif
+
+#endif
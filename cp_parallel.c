@@ -0,0 +1,285 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cp_parallel.h"
+
+// Partials up to this size live on the stack of the splitting thread.
+#define REDUCE_INLINE_SIZE 64
+
+#define SORT_GRAIN 2048
+#define MERGE_GRAIN 4096
+
+static long long parallel_grain(cp_pool_t* pool, long long count, long long grain) {
+    if(grain > 0)
+        return grain;
+    // Aim for a few pieces per thread so stealing has something to balance.
+    grain = count / (8 * (cp_pool_size(pool) + 1));
+    return grain > 0 ? grain : 1;
+}
+
+typedef struct range_job {
+    cp_pool_t* pool;
+    long long grain;
+    cp_range_fn func;
+    cp_reduce_fn reduce;
+    cp_join_fn join;
+    const void* identity;
+    size_t size;
+    void* ctx;
+} range_job;
+
+typedef struct range_part {
+    range_job* job;
+    long long begin;
+    long long end;
+    void* partial;
+} range_part;
+
+static void range_run(void* arg) {
+    range_part* part = arg;
+    range_job* job = part->job;
+    if(part->end - part->begin <= job->grain) {
+        job->func(part->begin, part->end, job->ctx);
+        return;
+    }
+
+    long long mid = part->begin + (part->end - part->begin) / 2;
+    range_part left = { job, part->begin, mid, NULL };
+    range_part right = { job, mid, part->end, NULL };
+    cp_pool_invoke(job->pool, range_run, &left, range_run, &right);
+}
+
+int cp_parallel_for(cp_pool_t* pool, long long begin, long long end, long long grain, cp_range_fn func, void* ctx) {
+    if(!func)
+        return thrd_error;
+    if(!pool && !(pool = cp_pool_default()))
+        return thrd_error;
+    if(end <= begin)
+        return thrd_success;
+
+    range_job job = { pool, parallel_grain(pool, end - begin, grain), func, NULL, NULL, NULL, 0, ctx };
+    range_part root = { &job, begin, end, NULL };
+    range_run(&root);
+    return thrd_success;
+}
+
+static void reduce_run(void* arg) {
+    range_part* part = arg;
+    range_job* job = part->job;
+    if(part->end - part->begin <= job->grain) {
+        job->reduce(part->begin, part->end, part->partial, job->ctx);
+        return;
+    }
+
+    union {
+        long double ld;
+        long long ll;
+        void* ptr;
+        unsigned char bytes[REDUCE_INLINE_SIZE];
+    } storage;
+
+    void* right_partial = job->size <= sizeof(storage) ? storage.bytes : malloc(job->size);
+    if(!right_partial) {
+        // No room for a second partial, so finish this piece serially.
+        job->reduce(part->begin, part->end, part->partial, job->ctx);
+        return;
+    }
+    memcpy(right_partial, job->identity, job->size);
+
+    long long mid = part->begin + (part->end - part->begin) / 2;
+    range_part left = { job, part->begin, mid, part->partial };
+    range_part right = { job, mid, part->end, right_partial };
+    cp_pool_invoke(job->pool, reduce_run, &left, reduce_run, &right);
+
+    job->join(part->partial, right_partial, job->ctx);
+    if(right_partial != storage.bytes)
+        free(right_partial);
+}
+
+int cp_parallel_reduce(cp_pool_t* pool,
+                       long long begin,
+                       long long end,
+                       long long grain,
+                       void* result,
+                       size_t size,
+                       const void* identity,
+                       cp_reduce_fn reduce,
+                       cp_join_fn join,
+                       void* ctx)
+{
+    if(!result || !identity || !reduce || !join || size == 0)
+        return thrd_error;
+    if(!pool && !(pool = cp_pool_default()))
+        return thrd_error;
+    if(end <= begin)
+        return thrd_success;
+
+    range_job job = { pool, parallel_grain(pool, end - begin, grain), NULL, reduce, join, identity, size, ctx };
+    range_part root = { &job, begin, end, result };
+    reduce_run(&root);
+    return thrd_success;
+}
+
+typedef struct sort_job {
+    cp_pool_t* pool;
+    size_t size;
+    int (*compare)(const void*, const void*);
+} sort_job;
+
+typedef struct merge_part {
+    sort_job* job;
+    char* left;
+    size_t left_count;
+    char* right;
+    size_t right_count;
+    char* out;
+} merge_part;
+
+typedef struct sort_part {
+    sort_job* job;
+    char* data;
+    char* temp;
+    size_t count;
+    // Whether the sorted result should end up in data or in temp.
+    int into_data;
+} sort_part;
+
+// First element in [base, base + count) that isn't less than key, or that is
+// greater than key when upper is set.
+static size_t sort_bound(sort_job* job, char* base, size_t count, const void* key, int upper) {
+    size_t low = 0;
+    size_t high = count;
+    while(low < high) {
+        size_t mid = low + (high - low) / 2;
+        int order = job->compare(base + mid * job->size, key);
+        if(upper ? order <= 0 : order < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static void merge_run(void* arg) {
+    merge_part* part = arg;
+    sort_job* job = part->job;
+    size_t size = job->size;
+
+    if(part->left_count + part->right_count <= MERGE_GRAIN) {
+        char* left = part->left;
+        char* left_end = left + part->left_count * size;
+        char* right = part->right;
+        char* right_end = right + part->right_count * size;
+        char* out = part->out;
+        while(left < left_end && right < right_end) {
+            if(job->compare(right, left) < 0) {
+                memcpy(out, right, size);
+                right += size;
+            } else {
+                memcpy(out, left, size);
+                left += size;
+            }
+            out += size;
+        }
+        memcpy(out, left, left_end - left);
+        out += left_end - left;
+        memcpy(out, right, right_end - right);
+        return;
+    }
+
+    // Split the larger run at its middle and find where that element lands in
+    // the other one. Both halves of the output can then be merged separately.
+    size_t left_split, right_split;
+    if(part->left_count >= part->right_count) {
+        left_split = part->left_count / 2;
+        right_split = sort_bound(job, part->right, part->right_count, part->left + left_split * size, 0);
+    } else {
+        right_split = part->right_count / 2;
+        left_split = sort_bound(job, part->left, part->left_count, part->right + right_split * size, 1);
+    }
+
+    merge_part low = {
+        job,
+        part->left, left_split,
+        part->right, right_split,
+        part->out
+    };
+    merge_part high = {
+        job,
+        part->left + left_split * size, part->left_count - left_split,
+        part->right + right_split * size, part->right_count - right_split,
+        part->out + (left_split + right_split) * size
+    };
+    cp_pool_invoke(job->pool, merge_run, &low, merge_run, &high);
+}
+
+static void sort_run(void* arg) {
+    sort_part* part = arg;
+    sort_job* job = part->job;
+    size_t size = job->size;
+
+    if(part->count <= SORT_GRAIN) {
+        qsort(part->data, part->count, size, job->compare);
+        if(!part->into_data)
+            memcpy(part->temp, part->data, part->count * size);
+        return;
+    }
+
+    // Sort both halves into the other buffer, then merge them back.
+    size_t half = part->count / 2;
+    sort_part left = { job, part->data, part->temp, half, !part->into_data };
+    sort_part right = { job, part->data + half * size, part->temp + half * size, part->count - half, !part->into_data };
+    cp_pool_invoke(job->pool, sort_run, &left, sort_run, &right);
+
+    char* from = part->into_data ? part->temp : part->data;
+    char* to = part->into_data ? part->data : part->temp;
+    merge_part merge = { job, from, half, from + half * size, part->count - half, to };
+    merge_run(&merge);
+}
+
+int cp_parallel_sort(cp_pool_t* pool, void* base, size_t count, size_t size, int (*compare)(const void*, const void*)) {
+    if(!base || !compare || size == 0)
+        return thrd_error;
+    if(!pool && !(pool = cp_pool_default()))
+        return thrd_error;
+
+    if(count <= SORT_GRAIN) {
+        qsort(base, count, size, compare);
+        return thrd_success;
+    }
+
+    char* temp = malloc(count * size);
+    if(!temp)
+        return thrd_nomem;
+
+    sort_job job = { pool, size, compare };
+    sort_part root = { &job, base, temp, count, 1 };
+    sort_run(&root);
+
+    free(temp);
+    return thrd_success;
+}
@@ -0,0 +1,72 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_PARALLEL_H
+#define CP_THREADS_CP_PARALLEL_H
+
+#include <stddef.h>
+
+#include "cp_pool.h"
+
+// ============================================================================
+// Parallel Algorithms
+// ============================================================================
+
+// Data-parallel loops on top of a cp_pool_t. Ranges are split in half
+// recursively until they're no bigger than the grain, and the halves are
+// offered to the pool with cp_pool_invoke. Idle workers steal the largest
+// pieces left, which balances skewed work without tuning, and the calling
+// thread works on the range as well.
+//
+// Passing a NULL pool uses cp_pool_default(). A grain of zero or less picks
+// one based on the range and the number of workers.
+
+typedef void (*cp_range_fn)(long long begin, long long end, void* ctx);
+
+// Accumulates the results for [begin, end) into partial.
+typedef void (*cp_reduce_fn)(long long begin, long long end, void* partial, void* ctx);
+
+// Folds from, the partial result for the range just after into's, into into.
+typedef void (*cp_join_fn)(void* into, const void* from, void* ctx);
+
+int cp_parallel_for(cp_pool_t* pool, long long begin, long long end, long long grain, cp_range_fn func, void* ctx);
+
+// result holds the starting value and receives the final one. Every split
+// starts a new partial from identity, and partials are always joined left
+// to right, so join only has to be associative.
+int cp_parallel_reduce(cp_pool_t* pool,
+                       long long begin,
+                       long long end,
+                       long long grain,
+                       void* result,
+                       size_t size,
+                       const void* identity,
+                       cp_reduce_fn reduce,
+                       cp_join_fn join,
+                       void* ctx);
+
+// Merge sort with parallel merges. The sort isn't stable.
+int cp_parallel_sort(cp_pool_t* pool, void* base, size_t count, size_t size, int (*compare)(const void*, const void*));
+
+#endif
@@ -0,0 +1,564 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cp_percpu.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// How a thread updates per-CPU data, settled on its first use.
+enum {
+    PATH_UNKNOWN,
+    // Restartable sequences on the current CPU's copy.
+    PATH_RSEQ,
+    // Atomics on the copy of the CPU the thread was last seen on.
+    PATH_ATOMIC,
+    // Atomics on the shared copy, for threads that can't use restartable
+    // sequences while others do.
+    PATH_SHARED
+};
+
+static thread_local int local_path;
+
+// ============================================================================
+// CPUs
+// ============================================================================
+
+static once_flag count_once = ONCE_FLAG_INIT;
+static int cpu_count;
+
+static void count_init(void) {
+#if defined(__linux__)
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+#elif defined(_MSC_VER)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = (long)info.dwNumberOfProcessors;
+#else
+    long count = 16;
+#endif
+    cpu_count = count > 0 ? (int)count : 1;
+}
+
+int cp_percpu_cpu_count(void) {
+    call_once(&count_once, count_init);
+    return cpu_count;
+}
+
+// Where the fallback looks. Only a hint, anything in range is correct.
+static int cpu_hint(void) {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    if(cpu < 0)
+        cpu = 0;
+#elif defined(_MSC_VER)
+    int cpu = (int)GetCurrentProcessorNumber();
+#else
+    // Spreads threads over the copies by where their TLS lives.
+    static thread_local char marker;
+    int cpu = (int)(((uintptr_t)&marker >> 12) & 0xffff);
+#endif
+    return cpu % cpu_count;
+}
+
+// Cache line aligned storage for one slot per CPU.
+static void* slots_alloc(size_t slot_size, void** memory) {
+    call_once(&count_once, count_init);
+    *memory = calloc(1, slot_size * cpu_count + CP_CACHE_LINE);
+    if(!*memory)
+        return NULL;
+    return (void*)(((uintptr_t)*memory + CP_CACHE_LINE - 1) & ~(uintptr_t)(CP_CACHE_LINE - 1));
+}
+
+// ============================================================================
+// Restartable Sequences
+// ============================================================================
+
+#if CP_PERCPU_RSEQ
+
+// Sits in the 4 bytes before every abort handler. The kernel refuses to
+// jump anywhere else.
+#define RSEQ_SIG 0x53053053
+
+// The start of the kernel's struct rseq, which is all of it that's used.
+typedef struct percpu_rseq {
+    uint32_t cpu_id_start;
+    uint32_t cpu_id;
+    uint64_t rseq_cs;
+    uint32_t flags;
+} __attribute__((aligned(32))) percpu_rseq;
+
+// Set by glibc 2.35 and later. Weak so older versions still link.
+extern const ptrdiff_t __rseq_offset __attribute__((weak));
+extern const unsigned int __rseq_size __attribute__((weak));
+
+static thread_local percpu_rseq own_area;
+static thread_local percpu_rseq* local_area;
+
+static once_flag mode_once = ONCE_FLAG_INIT;
+static int rseq_mode;
+
+// Finds the area glibc registered for the thread, or registers one. There's
+// no unregistering: the kernel only writes the area when returning to the
+// thread, which never happens again once it exits.
+static int rseq_register(void) {
+    if(local_area)
+        return 1;
+
+    percpu_rseq* area = NULL;
+    if(&__rseq_size && __rseq_size > 0) {
+        area = (percpu_rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+    } else {
+#if defined(SYS_rseq)
+        if(syscall(SYS_rseq, &own_area, sizeof(own_area), 0, RSEQ_SIG) == 0)
+            area = &own_area;
+#endif
+    }
+
+    // The kernel sets cpu_id once the area is live.
+    if(!area || (int32_t)cp_atomic_load32((cp_atomic32*)&area->cpu_id) < 0)
+        return 0;
+    local_area = area;
+    return 1;
+}
+
+static void mode_probe(void) {
+    rseq_mode = rseq_register();
+}
+
+#define RSEQ_STR_(x) #x
+#define RSEQ_STR(x) RSEQ_STR_(x)
+
+// Every sequence below has the same shape. Label 3 is the descriptor the
+// kernel reads: where the sequence starts (1), where it has committed (2)
+// and where to go if it's interrupted in between (4). Storing the
+// descriptor in the area arms it, and the first thing the sequence does is
+// make sure the thread is still on the CPU whose copy it's about to touch.
+// The last instruction before 2 is the single store that commits.
+#define RSEQ_TABLE \
+    ".pushsection __rseq_cs, \"aw\"\n\t" \
+    ".balign 32\n\t" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t"
+
+#define RSEQ_START \
+    "leaq 3b(%%rip), %%rax\n\t" \
+    "movq %%rax, %[rseq_cs]\n\t" \
+    "1:\n\t" \
+    "cmpl %[cpu], %[cpu_id]\n\t" \
+    "jnz 4f\n\t"
+
+// The signature is laid out as the operand of a ud1, so disassemblers
+// don't lose track of the instructions around it.
+#define RSEQ_ABORT \
+    ".pushsection __rseq_failure, \"ax\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long " RSEQ_STR(RSEQ_SIG) "\n\t" \
+    "4:\n\t" \
+    "jmp %l[aborted]\n\t" \
+    ".popsection\n\t"
+
+#define RSEQ_AREA_OPERANDS(area, cpu) \
+    [rseq_cs] "m" ((area)->rseq_cs), \
+    [cpu_id] "m" ((area)->cpu_id), \
+    [cpu] "r" (cpu)
+
+// Adds value to *word. Returns 0 if the sequence was interrupted.
+static int rseq_add(percpu_rseq* area, int cpu, cp_atomic64* word, int64_t value) {
+    __asm__ __volatile__ goto(
+        RSEQ_TABLE
+        RSEQ_START
+        "addq %[value], %[word]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT
+        :
+        : RSEQ_AREA_OPERANDS(area, cpu),
+          [word] "m" (*word),
+          [value] "er" (value)
+        : "memory", "cc", "rax"
+        : aborted
+    );
+    return 1;
+aborted:
+    return 0;
+}
+
+// Stores desired in *slot if it holds expected. Returns 1 if it did, 0 if
+// the slot held something else and -1 if the sequence was interrupted.
+static int rseq_cas(percpu_rseq* area, int cpu, cp_atomic_ptr* slot, void* expected, void* desired) {
+    __asm__ __volatile__ goto(
+        RSEQ_TABLE
+        RSEQ_START
+        "cmpq %[slot], %[expected]\n\t"
+        "jnz %l[changed]\n\t"
+        "movq %[desired], %[slot]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT
+        :
+        : RSEQ_AREA_OPERANDS(area, cpu),
+          [slot] "m" (*slot),
+          [expected] "r" (expected),
+          [desired] "r" (desired)
+        : "memory", "cc", "rax"
+        : aborted, changed
+    );
+    return 1;
+aborted:
+    return -1;
+changed:
+    return 0;
+}
+
+// Stores value in *slot and the previous value in *old. Returns 0 if the
+// sequence was interrupted.
+static int rseq_exchange(percpu_rseq* area, int cpu, cp_atomic_ptr* slot, void* value, void** old) {
+    __asm__ __volatile__ goto(
+        RSEQ_TABLE
+        RSEQ_START
+        "movq %[slot], %%rbx\n\t"
+        "movq %%rbx, %[old]\n\t"
+        "movq %[value], %[slot]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT
+        :
+        : RSEQ_AREA_OPERANDS(area, cpu),
+          [slot] "m" (*slot),
+          [old] "m" (*old),
+          [value] "r" (value)
+        : "memory", "cc", "rax", "rbx"
+        : aborted
+    );
+    return 1;
+aborted:
+    return 0;
+}
+
+// Unlinks the first node of the list at *head into *node. Returns 1 if it
+// did, 0 if the list was empty and -1 if the sequence was interrupted.
+// Nobody else can touch the list while the sequence runs, so reading the
+// node's next pointer is safe and there's no ABA problem to guard against.
+static int rseq_pop(percpu_rseq* area, int cpu, cp_atomic_ptr* head, cp_lfstack_node_t** node) {
+    __asm__ __volatile__ goto(
+        RSEQ_TABLE
+        RSEQ_START
+        "movq %[head], %%rbx\n\t"
+        "testq %%rbx, %%rbx\n\t"
+        "jz %l[empty]\n\t"
+        "movq %%rbx, %[node]\n\t"
+        "movq %c[next](%%rbx), %%rbx\n\t"
+        "movq %%rbx, %[head]\n\t"
+        "2:\n\t"
+        RSEQ_ABORT
+        :
+        : RSEQ_AREA_OPERANDS(area, cpu),
+          [head] "m" (*head),
+          [node] "m" (*node),
+          [next] "i" (offsetof(cp_lfstack_node_t, next))
+        : "memory", "cc", "rax", "rbx"
+        : aborted, empty
+    );
+    return 1;
+aborted:
+    return -1;
+empty:
+    return 0;
+}
+
+// The CPU to use for an update, or -1 if it has no copy and the shared one
+// has to do.
+static __inline int rseq_cpu(percpu_rseq* area) {
+    int cpu = (int)cp_atomic_load32((cp_atomic32*)&area->cpu_id_start);
+    return cpu < cpu_count ? cpu : -1;
+}
+
+#endif
+
+static int path_init(void) {
+    call_once(&count_once, count_init);
+#if CP_PERCPU_RSEQ
+    call_once(&mode_once, mode_probe);
+    if(rseq_mode)
+        local_path = rseq_register() ? PATH_RSEQ : PATH_SHARED;
+    else
+        local_path = PATH_ATOMIC;
+#else
+    local_path = PATH_ATOMIC;
+#endif
+    return local_path;
+}
+
+static __inline int thread_path(void) {
+    int path = local_path;
+    return path != PATH_UNKNOWN ? path : path_init();
+}
+
+int cp_percpu_register(void) {
+    return thread_path() == PATH_RSEQ ? thrd_success : thrd_error;
+}
+
+int cp_percpu_current_cpu(void) {
+#if CP_PERCPU_RSEQ
+    if(thread_path() == PATH_RSEQ) {
+        int cpu = rseq_cpu(local_area);
+        if(cpu >= 0)
+            return cpu;
+    }
+#else
+    thread_path();
+#endif
+    return cpu_hint();
+}
+
+// ============================================================================
+// Counters
+// ============================================================================
+
+int cp_percpu_counter_init(cp_percpu_counter_t* counter) {
+    if(!counter)
+        return thrd_error;
+    counter->words = slots_alloc(sizeof(___cp_percpu_word), &counter->memory);
+    if(!counter->words)
+        return thrd_nomem;
+    counter->cpus = cpu_count;
+    counter->shared.value = 0;
+    return thrd_success;
+}
+
+void cp_percpu_counter_destroy(cp_percpu_counter_t* counter) {
+    if(!counter)
+        return;
+    free(counter->memory);
+    counter->words = NULL;
+    counter->memory = NULL;
+}
+
+void cp_percpu_counter_add(cp_percpu_counter_t* counter, int64_t value) {
+    switch(thread_path()) {
+#if CP_PERCPU_RSEQ
+        case PATH_RSEQ:
+            for(;;) {
+                int cpu = rseq_cpu(local_area);
+                if(cpu < 0)
+                    break;
+                if(rseq_add(local_area, cpu, &counter->words[cpu].value, value))
+                    return;
+            }
+            break;
+#endif
+        case PATH_ATOMIC:
+            cp_atomic_fetch_add64(&counter->words[cpu_hint()].value, value);
+            return;
+    }
+    cp_atomic_fetch_add64(&counter->shared.value, value);
+}
+
+int64_t cp_percpu_counter_read(cp_percpu_counter_t* counter) {
+    int64_t total = cp_atomic_load64(&counter->shared.value);
+    for(int i = 0; i < counter->cpus; i++)
+        total += cp_atomic_load64(&counter->words[i].value);
+    return total;
+}
+
+// ============================================================================
+// Freelists
+// ============================================================================
+
+int cp_percpu_list_init(cp_percpu_list_t* list) {
+    if(!list)
+        return thrd_error;
+    list->slots = slots_alloc(sizeof(___cp_percpu_list_slot), &list->memory);
+    if(!list->slots)
+        return thrd_nomem;
+    list->cpus = cpu_count;
+    for(int i = 0; i < list->cpus; i++) {
+        list->slots[i].head = NULL;
+        cp_lfstack_init(&list->slots[i].stack, 0);
+    }
+    cp_lfstack_init(&list->shared, 0);
+    return thrd_success;
+}
+
+void cp_percpu_list_destroy(cp_percpu_list_t* list) {
+    if(!list)
+        return;
+    for(int i = 0; i < list->cpus; i++)
+        cp_lfstack_destroy(&list->slots[i].stack);
+    cp_lfstack_destroy(&list->shared);
+    free(list->memory);
+    list->slots = NULL;
+    list->memory = NULL;
+}
+
+void cp_percpu_list_push(cp_percpu_list_t* list, cp_lfstack_node_t* node) {
+    switch(thread_path()) {
+#if CP_PERCPU_RSEQ
+        case PATH_RSEQ:
+            for(;;) {
+                int cpu = rseq_cpu(local_area);
+                if(cpu < 0)
+                    break;
+                // The node isn't visible until the commit, so linking it
+                // ahead of time is harmless if the sequence restarts.
+                cp_atomic_ptr* head = &list->slots[cpu].head;
+                void* expected = *head;
+                node->next = expected;
+                if(rseq_cas(local_area, cpu, head, expected, node) == 1)
+                    return;
+            }
+            break;
+#endif
+        case PATH_ATOMIC:
+            cp_lfstack_push(&list->slots[cpu_hint()].stack, node);
+            return;
+    }
+    cp_lfstack_push(&list->shared, node);
+}
+
+cp_lfstack_node_t* cp_percpu_list_pop(cp_percpu_list_t* list) {
+    switch(thread_path()) {
+#if CP_PERCPU_RSEQ
+        case PATH_RSEQ:
+            for(;;) {
+                int cpu = rseq_cpu(local_area);
+                if(cpu < 0)
+                    break;
+                cp_lfstack_node_t* node = NULL;
+                int result = rseq_pop(local_area, cpu, &list->slots[cpu].head, &node);
+                if(result == 1)
+                    return node;
+                if(result == 0)
+                    break;
+            }
+            break;
+#endif
+        case PATH_ATOMIC:
+            return cp_lfstack_pop(&list->slots[cpu_hint()].stack);
+    }
+    // Nodes pushed by threads without a copy of their own are only found
+    // here, so threads that do have one look as well once theirs is empty.
+    if(cp_lfstack_empty(&list->shared))
+        return NULL;
+    return cp_lfstack_pop(&list->shared);
+}
+
+cp_lfstack_node_t* cp_percpu_list_drain(cp_percpu_list_t* list) {
+    cp_lfstack_node_t* first = cp_lfstack_pop_all(&list->shared);
+    cp_lfstack_node_t** last = &first;
+    for(int i = 0; i < list->cpus; i++) {
+        while(*last)
+            last = &(*last)->next;
+        *last = list->slots[i].head;
+        list->slots[i].head = NULL;
+        while(*last)
+            last = &(*last)->next;
+        *last = cp_lfstack_pop_all(&list->slots[i].stack);
+    }
+    return first;
+}
+
+// ============================================================================
+// Pointer Slots
+// ============================================================================
+
+int cp_percpu_ptr_init(cp_percpu_ptr_t* ptrs) {
+    if(!ptrs)
+        return thrd_error;
+    ptrs->slots = slots_alloc(sizeof(___cp_percpu_ptr_slot), &ptrs->memory);
+    if(!ptrs->slots)
+        return thrd_nomem;
+    ptrs->cpus = cpu_count;
+    ptrs->shared.value = NULL;
+    return thrd_success;
+}
+
+void cp_percpu_ptr_destroy(cp_percpu_ptr_t* ptrs) {
+    if(!ptrs)
+        return;
+    free(ptrs->memory);
+    ptrs->slots = NULL;
+    ptrs->memory = NULL;
+}
+
+void* cp_percpu_ptr_exchange(cp_percpu_ptr_t* ptrs, void* value) {
+    switch(thread_path()) {
+#if CP_PERCPU_RSEQ
+        case PATH_RSEQ:
+            for(;;) {
+                int cpu = rseq_cpu(local_area);
+                if(cpu < 0)
+                    break;
+                void* old = NULL;
+                if(rseq_exchange(local_area, cpu, &ptrs->slots[cpu].value, value, &old))
+                    return old;
+            }
+            break;
+#endif
+        case PATH_ATOMIC:
+            return cp_atomic_exchange_ptr(&ptrs->slots[cpu_hint()].value, value);
+    }
+    return cp_atomic_exchange_ptr(&ptrs->shared.value, value);
+}
+
+int cp_percpu_ptr_cas(cp_percpu_ptr_t* ptrs, void* expected, void* desired) {
+    switch(thread_path()) {
+#if CP_PERCPU_RSEQ
+        case PATH_RSEQ:
+            for(;;) {
+                int cpu = rseq_cpu(local_area);
+                if(cpu < 0)
+                    break;
+                int result = rseq_cas(local_area, cpu, &ptrs->slots[cpu].value, expected, desired);
+                if(result >= 0)
+                    return result;
+            }
+            break;
+#endif
+        case PATH_ATOMIC:
+            return cp_atomic_cas_ptr(&ptrs->slots[cpu_hint()].value, &expected, desired);
+    }
+    return cp_atomic_cas_ptr(&ptrs->shared.value, &expected, desired);
+}
+
+void cp_percpu_ptr_drain(cp_percpu_ptr_t* ptrs, void (*release)(void* value)) {
+    for(int i = 0; i <= ptrs->cpus; i++) {
+        cp_atomic_ptr* slot = i < ptrs->cpus ? &ptrs->slots[i].value : &ptrs->shared.value;
+        void* value = *slot;
+        *slot = NULL;
+        if(value && release)
+            release(value);
+    }
+}
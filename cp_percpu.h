@@ -0,0 +1,168 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_PERCPU_H
+#define CP_THREADS_CP_PERCPU_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+#include "cp_lfstack.h"
+
+// ============================================================================
+// Per-CPU Data
+// ============================================================================
+
+// Counters, freelists and pointer slots with one copy per CPU instead of
+// one per thread, so the memory doesn't grow with the thread count and a
+// thread that moves to another CPU simply starts using that CPU's copy.
+//
+// On Linux x86-64 every update is a restartable sequence (rseq): a few
+// plain instructions ending in one ordinary store, which the kernel
+// restarts if the thread is preempted, migrated or signalled before that
+// store. Nothing else can run on the CPU in the middle, so the update needs
+// no locked instruction at all. glibc 2.35 and later registers every
+// thread it starts with the kernel; otherwise each thread registers itself
+// the first time it uses this module, or on cp_percpu_register.
+//
+// Without rseq the same operations fall back to atomics on the slot of
+// whichever CPU the thread was last seen on. Which one is used is decided
+// once per process. If rseq works but one thread can't register, that
+// thread uses one shared slot per object with atomics instead, which the
+// others check as well.
+//
+// Lists and pointer slots only ever hand out what the current CPU holds.
+// A node pushed on one CPU stays there until a thread running on that CPU
+// pops it, which suits caches and freelists where any node will do.
+
+#ifndef CP_PERCPU_RSEQ
+#if defined(__linux__) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CP_PERCPU_RSEQ 1
+#else
+#define CP_PERCPU_RSEQ 0
+#endif
+#endif
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_percpu_word {
+    cp_atomic64 value;
+} ___cp_percpu_word;
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_percpu_list_slot {
+    // Used through restartable sequences.
+    cp_atomic_ptr head;
+    // Used by the atomic fallback.
+    cp_lfstack_t stack;
+} ___cp_percpu_list_slot;
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) ___cp_percpu_ptr_slot {
+    cp_atomic_ptr value;
+} ___cp_percpu_ptr_slot;
+
+typedef struct cp_percpu_counter_t {
+    ___cp_percpu_word* words;
+    void* memory;
+    int cpus;
+    ___cp_percpu_word shared;
+} cp_percpu_counter_t;
+
+typedef struct cp_percpu_list_t {
+    ___cp_percpu_list_slot* slots;
+    void* memory;
+    int cpus;
+    cp_lfstack_t shared;
+} cp_percpu_list_t;
+
+typedef struct cp_percpu_ptr_t {
+    ___cp_percpu_ptr_slot* slots;
+    void* memory;
+    int cpus;
+    ___cp_percpu_ptr_slot shared;
+} cp_percpu_ptr_t;
+
+// Registers the calling thread for restartable sequences. Returns
+// thrd_success if its updates go through them and thrd_error if they use
+// atomics. Either way every operation below works.
+int cp_percpu_register(void);
+
+// Number of per-CPU copies each object keeps.
+int cp_percpu_cpu_count(void);
+
+// The CPU the calling thread is running on. It may have moved by the time
+// this returns.
+int cp_percpu_current_cpu(void);
+
+// ============================================================================
+// Counters
+// ============================================================================
+
+int cp_percpu_counter_init(cp_percpu_counter_t* counter);
+void cp_percpu_counter_destroy(cp_percpu_counter_t* counter);
+
+void cp_percpu_counter_add(cp_percpu_counter_t* counter, int64_t value);
+
+// Sums every CPU's copy. Adds that finished before the call are always
+// included.
+int64_t cp_percpu_counter_read(cp_percpu_counter_t* counter);
+
+// ============================================================================
+// Freelists
+// ============================================================================
+
+int cp_percpu_list_init(cp_percpu_list_t* list);
+
+// Nodes still in the list are left alone.
+void cp_percpu_list_destroy(cp_percpu_list_t* list);
+
+// Pushes onto the current CPU's list.
+void cp_percpu_list_push(cp_percpu_list_t* list, cp_lfstack_node_t* node);
+
+// Pops from the current CPU's list, or returns NULL if it's empty.
+cp_lfstack_node_t* cp_percpu_list_pop(cp_percpu_list_t* list);
+
+// Takes every node from every CPU and returns them linked together. No
+// other thread may use the list meanwhile.
+cp_lfstack_node_t* cp_percpu_list_drain(cp_percpu_list_t* list);
+
+// ============================================================================
+// Pointer Slots
+// ============================================================================
+
+// One pointer per CPU, all starting out NULL. Handy as a one object cache
+// in front of something slower.
+int cp_percpu_ptr_init(cp_percpu_ptr_t* ptrs);
+void cp_percpu_ptr_destroy(cp_percpu_ptr_t* ptrs);
+
+// Stores value in the current CPU's slot and returns what it held.
+void* cp_percpu_ptr_exchange(cp_percpu_ptr_t* ptrs, void* value);
+
+// Stores desired in the current CPU's slot if it holds expected. Returns 1
+// if it did.
+int cp_percpu_ptr_cas(cp_percpu_ptr_t* ptrs, void* expected, void* desired);
+
+// Calls release on every pointer left in the slots and clears them. No
+// other thread may use the slots meanwhile.
+void cp_percpu_ptr_drain(cp_percpu_ptr_t* ptrs, void (*release)(void* value));
+
+#endif
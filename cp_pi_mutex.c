@@ -0,0 +1,126 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "cp_pi_mutex.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+thread_local int32_t ___cp_pi_mutex_self;
+
+static once_flag fork_once = ONCE_FLAG_INIT;
+
+// The child of a fork is a new thread with a new id, but it inherits the
+// forking thread's cached one. Locking with that would put a foreign id in
+// the owner word.
+static void pi_mutex_forked(void) {
+    ___cp_pi_mutex_self = 0;
+}
+
+static void pi_mutex_fork_init(void) {
+    pthread_atfork(NULL, NULL, pi_mutex_forked);
+}
+
+int32_t ___cp_pi_mutex_tid(void) {
+    call_once(&fork_once, pi_mutex_fork_init);
+    ___cp_pi_mutex_self = (int32_t)syscall(SYS_gettid);
+    return ___cp_pi_mutex_self;
+}
+
+static long pi_futex(cp_pi_mutex_t* mutex, int op, const struct timespec* timeout) {
+    return syscall(SYS_futex, &mutex->owner, op | FUTEX_PRIVATE_FLAG, 0, timeout, NULL, 0);
+}
+
+int cp_pi_mutex_init(cp_pi_mutex_t* mutex) {
+    if(!mutex)
+        return thrd_error;
+    mutex->owner = 0;
+    return thrd_success;
+}
+
+void cp_pi_mutex_destroy(cp_pi_mutex_t* mutex) {
+}
+
+// The kernel sets the owner word itself: our id once the lock is ours, with
+// FUTEX_WAITERS added while others are queued. FUTEX_LOCK_PI takes an
+// absolute CLOCK_REALTIME deadline, which is what TIME_UTC is.
+int ___cp_pi_mutex_lock_slow(cp_pi_mutex_t* mutex, const struct timespec* time_point) {
+    int32_t self = ___cp_pi_mutex_self_id();
+    if((cp_atomic_load32(&mutex->owner) & FUTEX_TID_MASK) == self)
+        return thrd_error;
+
+    for(;;) {
+        if(pi_futex(mutex, FUTEX_LOCK_PI, time_point) == 0)
+            return thrd_success;
+
+        switch(errno) {
+            case EINTR:
+            case EAGAIN:
+                // Interrupted, or the owner was exiting. Try again.
+                break;
+            case ETIMEDOUT:
+                return thrd_timedout;
+            default:
+                return thrd_error;
+        }
+
+        int32_t expected = 0;
+        if(cp_atomic_cas32(&mutex->owner, &expected, self))
+            return thrd_success;
+    }
+}
+
+int ___cp_pi_mutex_unlock_slow(cp_pi_mutex_t* mutex) {
+    if((cp_atomic_load32(&mutex->owner) & FUTEX_TID_MASK) != ___cp_pi_mutex_self_id())
+        return thrd_error;
+
+    // Hands the lock to the highest priority waiter and drops any boost
+    // this thread got from it.
+    return pi_futex(mutex, FUTEX_UNLOCK_PI, NULL) == 0 ? thrd_success : thrd_error;
+}
+
+#else
+
+int cp_pi_mutex_init(cp_pi_mutex_t* mutex) {
+    if(!mutex)
+        return thrd_error;
+    return mtx_init(&mutex->mutex, mtx_timed);
+}
+
+void cp_pi_mutex_destroy(cp_pi_mutex_t* mutex) {
+    if(!mutex)
+        return;
+    mtx_destroy(&mutex->mutex);
+}
+
+#endif
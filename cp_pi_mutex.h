@@ -0,0 +1,135 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_PI_MUTEX_H
+#define CP_THREADS_CP_PI_MUTEX_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Priority Inheriting Mutex
+// ============================================================================
+
+// A non-recursive mutex for data shared between real-time threads and lower
+// priority ones. While a thread waits for it, the owner runs at the waiter's
+// priority if that's higher than its own. Without that, a thread of medium
+// priority can keep the owner off the CPU for as long as it keeps running,
+// and the high priority waiter waits on both (priority inversion).
+//
+// On Linux the lock word holds the owner's thread id. Uncontended locks and
+// unlocks are a single compare and swap in user space. Contended ones go to
+// the kernel with FUTEX_LOCK_PI and FUTEX_UNLOCK_PI, which boost the owner
+// and queue the waiters by priority.
+//
+// Elsewhere it's an mtx_timed mutex and doesn't inherit priorities.
+// CP_PI_MUTEX_INHERITS says which one was built.
+//
+// Unlocking a mutex owned by another thread fails with thrd_error on Linux.
+// It can't be used with cnd_t.
+
+#if defined(__linux__)
+
+#define CP_PI_MUTEX_INHERITS 1
+
+typedef struct cp_pi_mutex_t {
+    // Owner's thread id, ORed with FUTEX_WAITERS by the kernel while others
+    // wait in it.
+    cp_atomic32 owner;
+} cp_pi_mutex_t;
+
+extern thread_local int32_t ___cp_pi_mutex_self;
+
+int32_t ___cp_pi_mutex_tid(void);
+int ___cp_pi_mutex_lock_slow(cp_pi_mutex_t* mutex, const struct timespec* time_point);
+int ___cp_pi_mutex_unlock_slow(cp_pi_mutex_t* mutex);
+
+static __inline int32_t ___cp_pi_mutex_self_id(void) {
+    int32_t tid = ___cp_pi_mutex_self;
+    return tid ? tid : ___cp_pi_mutex_tid();
+}
+
+static __inline int cp_pi_mutex_lock(cp_pi_mutex_t* mutex) {
+    int32_t expected = 0;
+    if(cp_atomic_cas32(&mutex->owner, &expected, ___cp_pi_mutex_self_id()))
+        return thrd_success;
+    return ___cp_pi_mutex_lock_slow(mutex, NULL);
+}
+
+// The deadline is absolute, against TIME_UTC like mtx_timedlock.
+static __inline int cp_pi_mutex_timedlock(cp_pi_mutex_t* mutex, const struct timespec* time_point) {
+    int32_t expected = 0;
+    if(!time_point)
+        return thrd_error;
+    if(cp_atomic_cas32(&mutex->owner, &expected, ___cp_pi_mutex_self_id()))
+        return thrd_success;
+    return ___cp_pi_mutex_lock_slow(mutex, time_point);
+}
+
+static __inline int cp_pi_mutex_trylock(cp_pi_mutex_t* mutex) {
+    int32_t expected = 0;
+    return cp_atomic_cas32(&mutex->owner, &expected, ___cp_pi_mutex_self_id()) ? thrd_success : thrd_busy;
+}
+
+// If no thread waits the word still holds just our id, otherwise the kernel
+// has to pick the next owner.
+static __inline int cp_pi_mutex_unlock(cp_pi_mutex_t* mutex) {
+    int32_t expected = ___cp_pi_mutex_self_id();
+    if(cp_atomic_cas32(&mutex->owner, &expected, 0))
+        return thrd_success;
+    return ___cp_pi_mutex_unlock_slow(mutex);
+}
+
+#else
+
+#define CP_PI_MUTEX_INHERITS 0
+
+typedef struct cp_pi_mutex_t {
+    mtx_t mutex;
+} cp_pi_mutex_t;
+
+static __inline int cp_pi_mutex_lock(cp_pi_mutex_t* mutex) {
+    return mtx_lock(&mutex->mutex);
+}
+
+static __inline int cp_pi_mutex_timedlock(cp_pi_mutex_t* mutex, const struct timespec* time_point) {
+    return mtx_timedlock(&mutex->mutex, time_point);
+}
+
+static __inline int cp_pi_mutex_trylock(cp_pi_mutex_t* mutex) {
+    return mtx_trylock(&mutex->mutex);
+}
+
+static __inline int cp_pi_mutex_unlock(cp_pi_mutex_t* mutex) {
+    return mtx_unlock(&mutex->mutex);
+}
+
+#endif
+
+int cp_pi_mutex_init(cp_pi_mutex_t* mutex);
+void cp_pi_mutex_destroy(cp_pi_mutex_t* mutex);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_pipeline.h"
+
+// How many times a waiting thread looks for pool work before blocking.
+#define PIPELINE_WAIT_SPINS 64
+
+// An item and the token it holds. stage is the next stage it runs; stage 0
+// means the token is free to run the first stage again.
+struct ___cp_pipeline_item {
+    cp_task_t task;
+    cp_pipeline_t* pipeline;
+    void* data;
+    uint64_t sequence;
+    int stage;
+    // Set when the item was handed a serial stage while it was parked, so
+    // it already owns it when it runs again.
+    int entered;
+    struct ___cp_pipeline_item* next;
+};
+
+struct ___cp_pipeline_stage {
+    int mode;
+    cp_pipeline_fn func;
+    void* arg;
+    // Guards the rest. Parallel stages don't use any of it.
+    mtx_t lock;
+    int busy;
+    uint64_t next_sequence;
+    // Sorted by sequence for in order stages, first come first served for
+    // out of order ones.
+    struct ___cp_pipeline_item* waiting;
+    struct ___cp_pipeline_item* waiting_tail;
+};
+
+typedef struct ___cp_pipeline_item pipeline_item;
+typedef struct ___cp_pipeline_stage pipeline_stage;
+
+static __inline int stage_may_enter(pipeline_stage* stage, pipeline_item* item) {
+    return stage->mode == cp_pipeline_serial_out_of_order || item->sequence == stage->next_sequence;
+}
+
+// Takes the stage for item, or parks the item there and returns 0.
+static int stage_enter(pipeline_stage* stage, pipeline_item* item) {
+    mtx_lock(&stage->lock);
+    if(!stage->busy && stage_may_enter(stage, item)) {
+        stage->busy = 1;
+        mtx_unlock(&stage->lock);
+        return 1;
+    }
+
+    item->next = NULL;
+    if(stage->mode == cp_pipeline_serial_out_of_order) {
+        if(stage->waiting_tail)
+            stage->waiting_tail->next = item;
+        else
+            stage->waiting = item;
+        stage->waiting_tail = item;
+    } else {
+        pipeline_item** link = &stage->waiting;
+        while(*link && (*link)->sequence < item->sequence)
+            link = &(*link)->next;
+        item->next = *link;
+        *link = item;
+    }
+    mtx_unlock(&stage->lock);
+    return 0;
+}
+
+// Releases the stage and returns the parked item that takes it over, if any.
+static pipeline_item* stage_leave(pipeline_stage* stage) {
+    pipeline_item* ready = NULL;
+
+    mtx_lock(&stage->lock);
+    stage->next_sequence++;
+    stage->busy = 0;
+    if(stage->waiting && stage_may_enter(stage, stage->waiting)) {
+        ready = stage->waiting;
+        stage->waiting = ready->next;
+        if(!stage->waiting)
+            stage->waiting_tail = NULL;
+        ready->entered = 1;
+        stage->busy = 1;
+    }
+    mtx_unlock(&stage->lock);
+    return ready;
+}
+
+// Must hold the pipeline lock.
+static void pipeline_release_token(cp_pipeline_t* pipeline, pipeline_item* item) {
+    item->next = pipeline->free_items;
+    pipeline->free_items = item;
+    if(--pipeline->in_flight == 0 && pipeline->input_done) {
+        cp_atomic_store32(&pipeline->running, 0);
+        cnd_broadcast(&pipeline->finished);
+    }
+}
+
+// Runs the first stage with item's token. Returns 0 if the input is
+// exhausted, in which case the token has been given back.
+static int pipeline_input(cp_pipeline_t* pipeline, pipeline_item* item) {
+    pipeline_stage* stage = pipeline->stages[0];
+    void* data = stage->func(NULL, stage->arg);
+    pipeline_item* next = NULL;
+
+    mtx_lock(&pipeline->lock);
+    if(!data) {
+        pipeline->input_done = 1;
+        pipeline->input_active = 0;
+        pipeline_release_token(pipeline, item);
+        mtx_unlock(&pipeline->lock);
+        return 0;
+    }
+
+    item->data = data;
+    item->sequence = pipeline->input_sequence++;
+    item->stage = 1;
+    item->entered = 0;
+
+    // Start on the next item straight away if there's a token for it.
+    // Otherwise the first item to finish picks the input back up.
+    if(pipeline->free_items) {
+        next = pipeline->free_items;
+        pipeline->free_items = next->next;
+        pipeline->in_flight++;
+        next->stage = 0;
+    } else {
+        pipeline->input_active = 0;
+    }
+    mtx_unlock(&pipeline->lock);
+
+    if(next)
+        cp_pool_submit(pipeline->pool, &next->task);
+    return 1;
+}
+
+// Called when item has left the last stage. Returns it if its token should
+// go on to run the first stage.
+static pipeline_item* pipeline_finish(cp_pipeline_t* pipeline, pipeline_item* item) {
+    mtx_lock(&pipeline->lock);
+    if(!pipeline->input_done && !pipeline->input_active) {
+        pipeline->input_active = 1;
+        item->stage = 0;
+    } else {
+        pipeline_release_token(pipeline, item);
+        item = NULL;
+    }
+    mtx_unlock(&pipeline->lock);
+    return item;
+}
+
+static void pipeline_item_run(cp_task_t* task) {
+    pipeline_item* item = (pipeline_item*)task;
+    cp_pipeline_t* pipeline = item->pipeline;
+
+    while(item) {
+        if(item->stage == 0 && !pipeline_input(pipeline, item))
+            return;
+
+        // Carry the item through as many stages as possible on this thread.
+        while(item->stage < pipeline->stage_count) {
+            pipeline_stage* stage = pipeline->stages[item->stage];
+            int serial = stage->mode != cp_pipeline_parallel;
+            if(serial && !item->entered && !stage_enter(stage, item))
+                return;
+            item->entered = 0;
+
+            // Dropped items still pass through the serial stages so the
+            // ones behind them aren't kept waiting for their turn.
+            if(item->data)
+                item->data = stage->func(item->data, stage->arg);
+            item->stage++;
+
+            if(serial) {
+                pipeline_item* ready = stage_leave(stage);
+                if(ready)
+                    cp_pool_submit(pipeline->pool, &ready->task);
+            }
+        }
+
+        item = pipeline_finish(pipeline, item);
+    }
+}
+
+int cp_pipeline_init(cp_pipeline_t* pipeline, cp_pool_t* pool) {
+    if(!pipeline)
+        return thrd_error;
+    if(!pool && !(pool = cp_pool_default()))
+        return thrd_error;
+
+    if(mtx_init(&pipeline->lock, mtx_plain) != thrd_success)
+        return thrd_error;
+    if(cnd_init(&pipeline->finished) != thrd_success) {
+        mtx_destroy(&pipeline->lock);
+        return thrd_error;
+    }
+
+    pipeline->pool = pool;
+    pipeline->stages = NULL;
+    pipeline->stage_count = 0;
+    pipeline->stage_cap = 0;
+    pipeline->running = 0;
+    pipeline->items = NULL;
+    pipeline->free_items = NULL;
+    pipeline->in_flight = 0;
+    pipeline->input_active = 0;
+    pipeline->input_done = 0;
+    pipeline->input_sequence = 0;
+    return thrd_success;
+}
+
+void cp_pipeline_destroy(cp_pipeline_t* pipeline) {
+    if(!pipeline)
+        return;
+
+    for(int i = 0; i < pipeline->stage_count; i++) {
+        mtx_destroy(&pipeline->stages[i]->lock);
+        free(pipeline->stages[i]);
+    }
+    free(pipeline->stages);
+    pipeline->stages = NULL;
+    pipeline->stage_count = 0;
+    pipeline->stage_cap = 0;
+    cnd_destroy(&pipeline->finished);
+    mtx_destroy(&pipeline->lock);
+}
+
+int cp_pipeline_add_stage(cp_pipeline_t* pipeline, int mode, cp_pipeline_fn func, void* arg) {
+    if(!pipeline || !func)
+        return thrd_error;
+    if(mode != cp_pipeline_parallel
+        && mode != cp_pipeline_serial_in_order
+        && mode != cp_pipeline_serial_out_of_order)
+    {
+        return thrd_error;
+    }
+    if(cp_atomic_load32(&pipeline->running))
+        return thrd_busy;
+
+    if(pipeline->stage_count == pipeline->stage_cap) {
+        int cap = pipeline->stage_cap == 0 ? 8 : pipeline->stage_cap * 2;
+        void* buff = realloc(pipeline->stages, sizeof(*pipeline->stages) * cap);
+        if(!buff)
+            return thrd_nomem;
+        pipeline->stages = buff;
+        pipeline->stage_cap = cap;
+    }
+
+    // Stages are allocated one by one so their locks never move.
+    pipeline_stage* stage = malloc(sizeof(*stage));
+    if(!stage)
+        return thrd_nomem;
+    if(mtx_init(&stage->lock, mtx_plain) != thrd_success) {
+        free(stage);
+        return thrd_error;
+    }
+
+    // The first stage is always serial, and ordered by definition.
+    stage->mode = pipeline->stage_count == 0 ? cp_pipeline_serial_in_order : mode;
+    stage->func = func;
+    stage->arg = arg;
+    stage->busy = 0;
+    stage->next_sequence = 0;
+    stage->waiting = NULL;
+    stage->waiting_tail = NULL;
+
+    pipeline->stages[pipeline->stage_count++] = stage;
+    return thrd_success;
+}
+
+int cp_pipeline_run(cp_pipeline_t* pipeline, int tokens) {
+    if(!pipeline || tokens <= 0 || pipeline->stage_count == 0)
+        return thrd_error;
+
+    int32_t expected = 0;
+    if(!cp_atomic_cas32(&pipeline->running, &expected, 1))
+        return thrd_busy;
+
+    pipeline_item* items = malloc(sizeof(*items) * tokens);
+    if(!items) {
+        cp_atomic_store32(&pipeline->running, 0);
+        return thrd_nomem;
+    }
+
+    for(int i = 1; i < pipeline->stage_count; i++) {
+        pipeline->stages[i]->busy = 0;
+        pipeline->stages[i]->next_sequence = 0;
+    }
+
+    pipeline->free_items = NULL;
+    for(int i = tokens - 1; i >= 0; i--) {
+        items[i].task.func = pipeline_item_run;
+        items[i].task.next = NULL;
+        items[i].pipeline = pipeline;
+        items[i].data = NULL;
+        items[i].sequence = 0;
+        items[i].stage = 0;
+        items[i].entered = 0;
+        items[i].next = pipeline->free_items;
+        pipeline->free_items = items + i;
+    }
+
+    // The first token starts the input. Nothing else runs yet, so the
+    // bookkeeping doesn't need the lock.
+    pipeline->items = items;
+    pipeline->free_items = items[0].next;
+    pipeline->in_flight = 1;
+    pipeline->input_active = 1;
+    pipeline->input_done = 0;
+    pipeline->input_sequence = 0;
+    cp_pool_submit(pipeline->pool, &items[0].task);
+
+    int idle = 0;
+    while(cp_atomic_load32(&pipeline->running)) {
+        if(cp_pool_try_run(pipeline->pool)) {
+            idle = 0;
+        } else if(++idle < PIPELINE_WAIT_SPINS) {
+            thrd_yield();
+        } else {
+            mtx_lock(&pipeline->lock);
+            while(cp_atomic_load32(&pipeline->running))
+                cnd_wait(&pipeline->finished, &pipeline->lock);
+            mtx_unlock(&pipeline->lock);
+        }
+    }
+
+    // The last item clears running while holding the lock. Taking it here
+    // makes sure it's done with the pipeline before the items are freed.
+    mtx_lock(&pipeline->lock);
+    mtx_unlock(&pipeline->lock);
+
+    pipeline->items = NULL;
+    pipeline->free_items = NULL;
+    free(items);
+    return thrd_success;
+}
@@ -0,0 +1,103 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_PIPELINE_H
+#define CP_THREADS_CP_PIPELINE_H
+
+#include <stdint.h>
+
+#include "cp_pool.h"
+
+// ============================================================================
+// Pipeline
+// ============================================================================
+
+// A linear chain of stages run on a cp_pool_t, with the number of items in
+// flight capped by a token count so memory stays bounded however uneven the
+// stages are.
+//
+// The first stage produces items: it's called with a NULL item and returns
+// the next one, or NULL once the input is exhausted. Every later stage takes
+// an item and returns the one to hand on; returning NULL drops it, and later
+// stages never see it. Stages are one of:
+//
+//  - parallel: any number of items at once.
+//  - serial in order: one item at a time, in the order the first stage
+//    produced them.
+//  - serial out of order: one item at a time, in whatever order they come.
+//
+// A worker carries its item through consecutive stages while it can, so
+// the item stays in one cache. When it reaches a serial stage that's busy,
+// or that's waiting for an earlier item, the item is parked there and the
+// worker moves on. Whoever leaves the stage hands it straight to the next
+// parked item that may enter. Nothing blocks a thread waiting for a stage.
+//
+// Every item holds a token from the moment the first stage produces it
+// until it leaves the last one. The first stage only runs while a token is
+// free. It's serial whatever mode it's given.
+//
+// Adding stages isn't thread safe and can't happen while the pipeline runs.
+
+typedef void* (*cp_pipeline_fn)(void* item, void* arg);
+
+enum {
+    cp_pipeline_parallel,
+    cp_pipeline_serial_in_order,
+    cp_pipeline_serial_out_of_order
+};
+
+struct ___cp_pipeline_stage;
+struct ___cp_pipeline_item;
+
+typedef struct cp_pipeline_t {
+    cp_pool_t* pool;
+    struct ___cp_pipeline_stage** stages;
+    int stage_count;
+    int stage_cap;
+    // Guards the tokens and the first stage's bookkeeping.
+    mtx_t lock;
+    cnd_t finished;
+    cp_atomic32 running;
+    struct ___cp_pipeline_item* items;
+    struct ___cp_pipeline_item* free_items;
+    int in_flight;
+    int input_active;
+    int input_done;
+    uint64_t input_sequence;
+} cp_pipeline_t;
+
+// A NULL pool uses cp_pool_default().
+int cp_pipeline_init(cp_pipeline_t* pipeline, cp_pool_t* pool);
+void cp_pipeline_destroy(cp_pipeline_t* pipeline);
+
+// Appends a stage with one of the modes above.
+int cp_pipeline_add_stage(cp_pipeline_t* pipeline, int mode, cp_pipeline_fn func, void* arg);
+
+// Runs until the first stage runs out of input and every item has left the
+// pipeline, with at most tokens items in flight. The calling thread runs
+// pool work while it waits. Returns thrd_busy if the pipeline is already
+// running, and thrd_error if it has no stages.
+int cp_pipeline_run(cp_pipeline_t* pipeline, int tokens);
+
+#endif
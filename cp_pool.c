@@ -0,0 +1,460 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
+#include "cp_pool.h"
+
+#if !defined(_MSC_VER)
+#include <unistd.h>
+#endif
+
+// Must be a power of two. Pushing onto a full deque runs the task inline.
+#define POOL_DEQUE_SIZE 1024
+#define POOL_DEQUE_MASK (POOL_DEQUE_SIZE - 1)
+
+// How many times an idle worker looks for work before parking.
+#define POOL_IDLE_SPINS 64
+
+// A work-stealing deque (Chase-Lev with a fixed buffer) plus the bookkeeping
+// for whoever currently owns it. top and bottom get their own cache lines,
+// since thieves hammer one and the owner the other.
+struct ___cp_pool_slot {
+    cp_atomic64 top;
+    char top_pad[CP_CACHE_LINE - sizeof(cp_atomic64)];
+    cp_atomic64 bottom;
+    char bottom_pad[CP_CACHE_LINE - sizeof(cp_atomic64)];
+    cp_pool_t* pool;
+    int index;
+    cp_atomic32 owned;
+    unsigned rng;
+    cp_atomic_ptr buffer[POOL_DEQUE_SIZE];
+};
+
+typedef struct ___cp_pool_slot pool_slot;
+
+// The deque the current thread pushes onto, if any.
+static thread_local pool_slot* current_slot = NULL;
+static thread_local unsigned helper_rng = 0;
+static thread_local int draining_submits = 0;
+
+static int pool_cpu_count(void) {
+#if defined(_MSC_VER)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static unsigned pool_next_random(unsigned* state) {
+    unsigned x = *state;
+    if(x == 0)
+        x = (unsigned)(size_t)state | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int deque_push(pool_slot* slot, cp_task_t* task) {
+    int64_t b = cp_atomic_load64(&slot->bottom);
+    int64_t t = cp_atomic_load64(&slot->top);
+    if(b - t >= POOL_DEQUE_SIZE)
+        return 0;
+    cp_atomic_store_ptr(&slot->buffer[b & POOL_DEQUE_MASK], task);
+    cp_atomic_store64(&slot->bottom, b + 1);
+    return 1;
+}
+
+static cp_task_t* deque_pop(pool_slot* slot) {
+    int64_t b = cp_atomic_load64(&slot->bottom) - 1;
+    // Publishing the new bottom has to be ordered before reading top,
+    // which the exchange guarantees.
+    cp_atomic_exchange64(&slot->bottom, b);
+    int64_t t = cp_atomic_load64(&slot->top);
+    if(t > b) {
+        cp_atomic_store64(&slot->bottom, b + 1);
+        return NULL;
+    }
+
+    cp_task_t* task = cp_atomic_load_ptr(&slot->buffer[b & POOL_DEQUE_MASK]);
+    if(t == b) {
+        // Last item, so race any thieves for it.
+        if(!cp_atomic_cas64(&slot->top, &t, t + 1))
+            task = NULL;
+        cp_atomic_store64(&slot->bottom, b + 1);
+    }
+    return task;
+}
+
+static cp_task_t* deque_steal(pool_slot* slot) {
+    int64_t t = cp_atomic_load64(&slot->top);
+    cp_atomic_fence();
+    int64_t b = cp_atomic_load64(&slot->bottom);
+    if(t >= b)
+        return NULL;
+
+    cp_task_t* task = cp_atomic_load_ptr(&slot->buffer[t & POOL_DEQUE_MASK]);
+    if(!cp_atomic_cas64(&slot->top, &t, t + 1))
+        return NULL;
+    return task;
+}
+
+static int deque_empty(pool_slot* slot) {
+    return cp_atomic_load64(&slot->top) >= cp_atomic_load64(&slot->bottom);
+}
+
+static int pool_has_work(cp_pool_t* pool) {
+    if(cp_atomic_load32(&pool->injected) > 0)
+        return 1;
+    for(int i = 0; i < pool->slot_count; i++) {
+        if(!deque_empty(pool->slots + i))
+            return 1;
+    }
+    return 0;
+}
+
+// Wakes one parked worker if there are any. Callers have just published
+// work, and the fence keeps that store from passing the sleepers check.
+static void pool_notify(cp_pool_t* pool) {
+    cp_atomic_fence();
+    if(cp_atomic_load32(&pool->sleepers) > 0) {
+        mtx_lock(&pool->lock);
+        cnd_signal(&pool->wake);
+        mtx_unlock(&pool->lock);
+    }
+}
+
+static cp_task_t* pool_take_injected(cp_pool_t* pool) {
+    if(cp_atomic_load32(&pool->injected) == 0)
+        return NULL;
+
+    mtx_lock(&pool->lock);
+    cp_task_t* task = pool->inject_head;
+    if(task) {
+        pool->inject_head = task->next;
+        if(!pool->inject_head)
+            pool->inject_tail = NULL;
+        cp_atomic_fetch_add32(&pool->injected, -1);
+    }
+    mtx_unlock(&pool->lock);
+    return task;
+}
+
+static cp_task_t* pool_find_work(cp_pool_t* pool, pool_slot* self) {
+    cp_task_t* task;
+    if(self && (task = deque_pop(self)))
+        return task;
+
+    // Start at a random victim so thieves don't all pile onto the same one.
+    unsigned start = pool_next_random(self ? &self->rng : &helper_rng) % (unsigned)pool->slot_count;
+    for(int i = 0; i < pool->slot_count; i++) {
+        pool_slot* victim = pool->slots + (start + i) % pool->slot_count;
+        if(victim == self)
+            continue;
+        if((task = deque_steal(victim)))
+            return task;
+    }
+
+    return pool_take_injected(pool);
+}
+
+static void pool_park(cp_pool_t* pool) {
+    mtx_lock(&pool->lock);
+    cp_atomic_fetch_add32(&pool->sleepers, 1);
+    if(!cp_atomic_load32(&pool->stopping) && !pool_has_work(pool))
+        cnd_wait(&pool->wake, &pool->lock);
+    cp_atomic_fetch_add32(&pool->sleepers, -1);
+    mtx_unlock(&pool->lock);
+}
+
+static int pool_worker(void* arg) {
+    pool_slot* self = arg;
+    cp_pool_t* pool = self->pool;
+    current_slot = self;
+
+    int idle = 0;
+    while(!cp_atomic_load32(&pool->stopping)) {
+        cp_task_t* task = pool_find_work(pool, self);
+        if(task) {
+            task->func(task);
+            idle = 0;
+            continue;
+        }
+
+        if(++idle < POOL_IDLE_SPINS / 2) {
+            cp_cpu_relax();
+        } else if(idle < POOL_IDLE_SPINS) {
+            thrd_yield();
+        } else {
+            pool_park(pool);
+            idle = 0;
+        }
+    }
+
+    current_slot = NULL;
+    return 0;
+}
+
+static void pool_help_until(cp_pool_t* pool, pool_slot* self, cp_atomic32* flag) {
+    int idle = 0;
+    while(!cp_atomic_load32(flag)) {
+        cp_task_t* task = pool_find_work(pool, self);
+        if(task) {
+            task->func(task);
+            idle = 0;
+        } else if(++idle < POOL_IDLE_SPINS) {
+            cp_cpu_relax();
+        } else {
+            thrd_yield();
+        }
+    }
+}
+
+int cp_pool_init(cp_pool_t* pool, int threads) {
+    if(!pool)
+        return thrd_error;
+
+    if(threads < 0)
+        threads = pool_cpu_count() - 1;
+
+    pool->thread_count = 0;
+    pool->slot_count = threads + CP_POOL_EXTERNAL_SLOTS;
+    pool->inject_head = NULL;
+    pool->inject_tail = NULL;
+    pool->injected = 0;
+    pool->sleepers = 0;
+    pool->stopping = 0;
+
+    pool->slots = calloc(pool->slot_count, sizeof(*pool->slots));
+    if(!pool->slots)
+        return thrd_nomem;
+    pool->threads = threads > 0 ? malloc(sizeof(*pool->threads) * threads) : NULL;
+    if(threads > 0 && !pool->threads) {
+        free(pool->slots);
+        return thrd_nomem;
+    }
+
+    if(mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+        free(pool->threads);
+        free(pool->slots);
+        return thrd_error;
+    }
+    if(cnd_init(&pool->wake) != thrd_success) {
+        mtx_destroy(&pool->lock);
+        free(pool->threads);
+        free(pool->slots);
+        return thrd_error;
+    }
+
+    for(int i = 0; i < pool->slot_count; i++) {
+        pool->slots[i].pool = pool;
+        pool->slots[i].index = i;
+        pool->slots[i].rng = (unsigned)i * 2654435761u + 1;
+        // Worker deques are owned by their thread for the pool's lifetime.
+        pool->slots[i].owned = i < threads;
+    }
+
+    for(int i = 0; i < threads; i++) {
+        int result = thrd_create(pool->threads + i, pool_worker, pool->slots + i);
+        if(result != thrd_success) {
+            cp_pool_destroy(pool);
+            return result;
+        }
+        pool->thread_count++;
+    }
+
+    return thrd_success;
+}
+
+void cp_pool_destroy(cp_pool_t* pool) {
+    if(!pool || !pool->slots)
+        return;
+
+    mtx_lock(&pool->lock);
+    cp_atomic_store32(&pool->stopping, 1);
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+
+    for(int i = 0; i < pool->thread_count; i++)
+        thrd_join(pool->threads[i], NULL);
+
+    cnd_destroy(&pool->wake);
+    mtx_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->slots);
+    pool->threads = NULL;
+    pool->slots = NULL;
+    pool->thread_count = 0;
+    pool->slot_count = 0;
+}
+
+static cp_pool_t default_pool;
+static cp_pool_t* default_pool_ptr;
+static once_flag default_pool_flag = ONCE_FLAG_INIT;
+
+// If the workers can't be started, a pool without any still runs work on
+// the threads that submit it.
+static void default_pool_init(void) {
+    if(cp_pool_init(&default_pool, -1) == thrd_success || cp_pool_init(&default_pool, 0) == thrd_success)
+        default_pool_ptr = &default_pool;
+}
+
+cp_pool_t* cp_pool_default(void) {
+    call_once(&default_pool_flag, default_pool_init);
+    return default_pool_ptr;
+}
+
+int cp_pool_submit(cp_pool_t* pool, cp_task_t* task) {
+    if(!pool || !task || !task->func)
+        return thrd_error;
+
+    // Workers keep their own submissions local. Everyone else goes through
+    // the shared queue so borrowed deques are always empty when returned.
+    pool_slot* self = current_slot;
+    if(self && self->pool == pool && self->index < pool->thread_count && deque_push(self, task)) {
+        pool_notify(pool);
+        return thrd_success;
+    }
+
+    task->next = NULL;
+    mtx_lock(&pool->lock);
+    if(pool->inject_tail)
+        pool->inject_tail->next = task;
+    else
+        pool->inject_head = task;
+    pool->inject_tail = task;
+    cp_atomic_fetch_add32(&pool->injected, 1);
+    if(cp_atomic_load32(&pool->sleepers) > 0)
+        cnd_signal(&pool->wake);
+    mtx_unlock(&pool->lock);
+
+    // Without workers the submission would never run, so the outermost
+    // submit drains the queue. Submits made by those tasks only queue,
+    // which keeps the stack from growing with the depth of the work.
+    if(pool->thread_count == 0 && !draining_submits) {
+        draining_submits = 1;
+        while((task = pool_take_injected(pool)))
+            task->func(task);
+        draining_submits = 0;
+    }
+    return thrd_success;
+}
+
+typedef struct pool_join {
+    cp_task_t task;
+    void (*func)(void*);
+    void* arg;
+    cp_atomic32 done;
+} pool_join;
+
+static void pool_join_run(cp_task_t* task) {
+    pool_join* join = (pool_join*)task;
+    join->func(join->arg);
+    cp_atomic_store32(&join->done, 1);
+}
+
+static void pool_invoke_on(cp_pool_t* pool, pool_slot* self, void (*first)(void*), void* first_arg, void (*second)(void*), void* second_arg) {
+    pool_join join = { { pool_join_run, NULL }, second, second_arg, 0 };
+    if(!deque_push(self, &join.task)) {
+        first(first_arg);
+        second(second_arg);
+        return;
+    }
+    pool_notify(pool);
+
+    first(first_arg);
+
+    // Everything pushed after the join has been consumed by now, so the
+    // bottom of the deque is either the join or it was stolen.
+    cp_task_t* task;
+    while((task = deque_pop(self))) {
+        if(task == &join.task) {
+            second(second_arg);
+            return;
+        }
+        task->func(task);
+    }
+
+    pool_help_until(pool, self, &join.done);
+}
+
+static pool_slot* pool_claim_external(cp_pool_t* pool) {
+    for(int i = pool->thread_count; i < pool->slot_count; i++) {
+        int32_t expected = 0;
+        if(cp_atomic_load32(&pool->slots[i].owned) == 0 && cp_atomic_cas32(&pool->slots[i].owned, &expected, 1))
+            return pool->slots + i;
+    }
+    return NULL;
+}
+
+void cp_pool_invoke(cp_pool_t* pool, void (*first)(void*), void* first_arg, void (*second)(void*), void* second_arg) {
+    pool_slot* self = current_slot;
+    if(self && self->pool == pool) {
+        pool_invoke_on(pool, self, first, first_arg, second, second_arg);
+        return;
+    }
+
+    // Not one of this pool's threads, so borrow a deque for the call.
+    // If they're all taken just run both halves here.
+    pool_slot* slot = pool_claim_external(pool);
+    if(!slot) {
+        first(first_arg);
+        second(second_arg);
+        return;
+    }
+
+    current_slot = slot;
+    pool_invoke_on(pool, slot, first, first_arg, second, second_arg);
+    current_slot = self;
+    cp_atomic_store32(&slot->owned, 0);
+}
+
+void cp_pool_help_until(cp_pool_t* pool, cp_atomic32* flag) {
+    if(!pool || !flag)
+        return;
+
+    pool_slot* self = current_slot;
+    pool_help_until(pool, self && self->pool == pool ? self : NULL, flag);
+}
+
+int cp_pool_try_run(cp_pool_t* pool) {
+    if(!pool)
+        return 0;
+
+    pool_slot* self = current_slot;
+    cp_task_t* task = pool_find_work(pool, self && self->pool == pool ? self : NULL);
+    if(!task)
+        return 0;
+    task->func(task);
+    return 1;
+}
@@ -0,0 +1,104 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_POOL_H
+#define CP_THREADS_CP_POOL_H
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Worker Pool
+// ============================================================================
+
+// A set of persistent worker threads that share work by stealing.
+// Every worker owns a deque: it pushes and pops work at the bottom, and idle
+// workers steal from the top of someone else's. Threads that aren't workers
+// (like the one calling cp_parallel_for) borrow one of a few extra deques for
+// the duration of the call, so they can split work and help run it too.
+//
+// Workers that find nothing to do spin briefly, then park on a condition
+// variable until more work is pushed.
+
+#define CP_POOL_EXTERNAL_SLOTS 8
+
+// A unit of work. Usually embedded at the start of a larger struct that
+// holds the actual arguments.
+typedef struct cp_task_t {
+    void (*func)(struct cp_task_t* task);
+    struct cp_task_t* next;
+} cp_task_t;
+
+struct ___cp_pool_slot;
+
+typedef struct cp_pool_t {
+    struct ___cp_pool_slot* slots;
+    thrd_t* threads;
+    int thread_count;
+    int slot_count;
+    mtx_t lock;
+    cnd_t wake;
+    cp_task_t* inject_head;
+    cp_task_t* inject_tail;
+    cp_atomic32 injected;
+    cp_atomic32 sleepers;
+    cp_atomic32 stopping;
+} cp_pool_t;
+
+// Starts the given number of worker threads. A negative count uses one less
+// than the number of CPUs, since callers help run their own work.
+// A pool with zero workers runs everything on the calling threads.
+int cp_pool_init(cp_pool_t* pool, int threads);
+
+// Stops and joins the workers. Tasks that were submitted but never started
+// are not run.
+void cp_pool_destroy(cp_pool_t* pool);
+
+// Returns a pool shared by the whole process, created on first use. Falls
+// back to a pool without workers if they can't be started, and returns NULL
+// if even that fails.
+cp_pool_t* cp_pool_default(void);
+
+static __inline int cp_pool_size(const cp_pool_t* pool) {
+    return pool->thread_count;
+}
+
+// Queues a task to run on the pool without waiting for it.
+// The task memory must stay valid until its function starts.
+int cp_pool_submit(cp_pool_t* pool, cp_task_t* task);
+
+// Runs both functions, possibly in parallel, and returns once both are done.
+// The second function is offered to the other threads while the caller runs
+// the first; if nobody took it, the caller runs it as well. While waiting on
+// a stolen function the caller runs other pool work instead of blocking.
+void cp_pool_invoke(cp_pool_t* pool, void (*first)(void*), void* first_arg, void (*second)(void*), void* second_arg);
+
+// Runs pool work on the calling thread until *flag becomes non-zero.
+void cp_pool_help_until(cp_pool_t* pool, cp_atomic32* flag);
+
+// Runs one pending task on the calling thread if there is one.
+// Returns 1 if a task was run and 0 otherwise.
+int cp_pool_try_run(cp_pool_t* pool);
+
+#endif
@@ -0,0 +1,265 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cp_ring.h"
+#include "cp_atomic_wait.h"
+
+// How many times a waiter checks before yielding or parking.
+#define RING_SPINS 256
+
+int cp_ring_init(cp_ring_t* ring, size_t elem_size, size_t capacity, int producers, int wait) {
+    if(!ring || elem_size == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return thrd_error;
+    if(producers != CP_RING_SINGLE_PRODUCER && producers != CP_RING_MULTI_PRODUCER)
+        return thrd_error;
+    if(wait != CP_RING_BUSY_SPIN && wait != CP_RING_YIELD && wait != CP_RING_PARK)
+        return thrd_error;
+
+    ring->buffer = malloc(elem_size * capacity);
+    if(!ring->buffer)
+        return thrd_nomem;
+
+    ring->published = NULL;
+    if(producers == CP_RING_MULTI_PRODUCER) {
+        ring->published = malloc(sizeof(*ring->published) * capacity);
+        if(!ring->published) {
+            free(ring->buffer);
+            ring->buffer = NULL;
+            return thrd_nomem;
+        }
+        // No slot has been published in lap 0 yet.
+        for(size_t i = 0; i < capacity; i++)
+            ring->published[i] = -1;
+    }
+
+    ring->elem_size = elem_size;
+    ring->capacity = (int64_t)capacity;
+    ring->shift = 0;
+    while(((size_t)1 << ring->shift) < capacity)
+        ring->shift++;
+    ring->producers = producers;
+    ring->wait = wait;
+    ring->consumer_count = 0;
+    ring->claimed = 0;
+    ring->gate = 0;
+    ring->cursor = 0;
+    ring->parked = 0;
+    ring->progress = 0;
+    ring->closed = 0;
+    return thrd_success;
+}
+
+void cp_ring_destroy(cp_ring_t* ring) {
+    if(!ring)
+        return;
+    free((void*)ring->published);
+    free(ring->buffer);
+    ring->published = NULL;
+    ring->buffer = NULL;
+}
+
+int cp_ring_consumer_init(cp_ring_consumer_t* consumer, cp_ring_t* ring, cp_ring_consumer_t* const* dependencies, size_t count) {
+    if(!consumer || !ring || count > CP_RING_MAX_DEPENDENCIES || (count > 0 && !dependencies))
+        return thrd_error;
+    if(ring->consumer_count == CP_RING_MAX_CONSUMERS)
+        return thrd_error;
+
+    consumer->sequence = 0;
+    consumer->ring = ring;
+    for(size_t i = 0; i < count; i++) {
+        if(!dependencies[i] || dependencies[i]->ring != ring)
+            return thrd_error;
+        consumer->dependencies[i] = dependencies[i];
+    }
+    consumer->dependency_count = count;
+    ring->consumers[ring->consumer_count++] = consumer;
+    return thrd_success;
+}
+
+// ============================================================================
+// Waiting
+// ============================================================================
+
+// Wakes parked threads after the caller moved a cursor. A thread counts
+// itself as parked before it checks the cursors for the last time, and the
+// fence here orders the cursor store before reading that count, so either
+// it sees the new cursor or this sees it parked.
+static void ring_signal(cp_ring_t* ring) {
+    if(ring->wait != CP_RING_PARK)
+        return;
+    cp_atomic_fence();
+    if(cp_atomic_load32(&ring->parked)) {
+        cp_atomic_fetch_add32(&ring->progress, 1);
+        cp_atomic_notify_all32(&ring->progress);
+    }
+}
+
+static void ring_wait_until(cp_ring_t* ring, bool (*ready)(void*), void* arg) {
+    for(int spins = 0; !ready(arg); spins++) {
+        if(ring->wait == CP_RING_BUSY_SPIN || spins < RING_SPINS) {
+            cp_cpu_relax();
+        } else if(ring->wait == CP_RING_YIELD) {
+            thrd_yield();
+        } else {
+            cp_atomic_fetch_add32(&ring->parked, 1);
+            int32_t seen = cp_atomic_load32(&ring->progress);
+            if(!ready(arg))
+                cp_atomic_wait32(&ring->progress, seen, NULL);
+            cp_atomic_fetch_add32(&ring->parked, -1);
+        }
+    }
+}
+
+// ============================================================================
+// Producers
+// ============================================================================
+
+typedef struct claim_wait {
+    cp_ring_t* ring;
+    // The slots are free once every consumer has released this sequence.
+    int64_t wrap;
+} claim_wait;
+
+static bool claim_ready(void* arg) {
+    claim_wait* wait = arg;
+    cp_ring_t* ring = wait->ring;
+    int64_t gate = wait->wrap;
+    for(size_t i = 0; i < ring->consumer_count; i++) {
+        int64_t sequence = cp_atomic_load64(&ring->consumers[i]->sequence);
+        if(sequence < gate)
+            gate = sequence;
+    }
+    cp_atomic_store64(&ring->gate, gate);
+    return gate >= wait->wrap;
+}
+
+int64_t cp_ring_claim(cp_ring_t* ring, size_t count) {
+    if(count == 0 || (int64_t)count > ring->capacity)
+        return -1;
+
+    int64_t first;
+    if(ring->producers == CP_RING_SINGLE_PRODUCER) {
+        first = ring->claimed;
+        cp_atomic_store64(&ring->claimed, first + (int64_t)count);
+    } else {
+        first = cp_atomic_fetch_add64(&ring->claimed, (int64_t)count);
+    }
+
+    // The gate is only refreshed when the cached one is too far behind.
+    claim_wait wait = { ring, first + (int64_t)count - ring->capacity };
+    if(wait.wrap > cp_atomic_load64(&ring->gate))
+        ring_wait_until(ring, claim_ready, &wait);
+    return first;
+}
+
+void cp_ring_publish(cp_ring_t* ring, int64_t first, size_t count) {
+    int64_t end = first + (int64_t)count;
+    if(ring->producers == CP_RING_SINGLE_PRODUCER) {
+        cp_atomic_store64(&ring->cursor, end);
+    } else {
+        int64_t mask = ring->capacity - 1;
+        for(int64_t sequence = first; sequence < end; sequence++)
+            cp_atomic_store32(ring->published + (sequence & mask), (int32_t)(sequence >> ring->shift));
+    }
+    ring_signal(ring);
+}
+
+void cp_ring_put(cp_ring_t* ring, const void* elem) {
+    int64_t sequence = cp_ring_claim(ring, 1);
+    memcpy(cp_ring_slot(ring, sequence), elem, ring->elem_size);
+    cp_ring_publish(ring, sequence, 1);
+}
+
+void cp_ring_close(cp_ring_t* ring) {
+    cp_atomic_store32(&ring->closed, 1);
+    if(ring->wait == CP_RING_PARK) {
+        cp_atomic_fetch_add32(&ring->progress, 1);
+        cp_atomic_notify_all32(&ring->progress);
+    }
+}
+
+// ============================================================================
+// Consumers
+// ============================================================================
+
+// The end of the run of published events starting at next.
+static int64_t published_end(cp_ring_t* ring, int64_t next) {
+    if(ring->producers == CP_RING_SINGLE_PRODUCER)
+        return cp_atomic_load64(&ring->cursor);
+
+    int64_t claimed = cp_atomic_load64(&ring->claimed);
+    int64_t mask = ring->capacity - 1;
+    int64_t end = next;
+    while(end < claimed && cp_atomic_load32(ring->published + (end & mask)) == (int32_t)(end >> ring->shift))
+        end++;
+    return end;
+}
+
+// The end of the run of events the consumer may read.
+static int64_t consumer_limit(cp_ring_consumer_t* consumer, int64_t next) {
+    int64_t limit = published_end(consumer->ring, next);
+    for(size_t i = 0; i < consumer->dependency_count; i++) {
+        int64_t sequence = cp_atomic_load64(&consumer->dependencies[i]->sequence);
+        if(sequence < limit)
+            limit = sequence;
+    }
+    return limit;
+}
+
+size_t cp_ring_poll(cp_ring_consumer_t* consumer, int64_t* first) {
+    int64_t next = consumer->sequence;
+    *first = next;
+    return (size_t)(consumer_limit(consumer, next) - next);
+}
+
+typedef struct consume_wait {
+    cp_ring_consumer_t* consumer;
+    int64_t first;
+    size_t count;
+} consume_wait;
+
+static bool consume_ready(void* arg) {
+    consume_wait* wait = arg;
+    // Publishes before the close are visible once it is. The consumer is
+    // done when it has caught up with them, not just with its dependencies.
+    int closed = cp_atomic_load32(&wait->consumer->ring->closed);
+    wait->count = cp_ring_poll(wait->consumer, &wait->first);
+    return wait->count > 0 || (closed && published_end(wait->consumer->ring, wait->first) == wait->first);
+}
+
+size_t cp_ring_wait(cp_ring_consumer_t* consumer, int64_t* first) {
+    consume_wait wait = { consumer, 0, 0 };
+    ring_wait_until(consumer->ring, consume_ready, &wait);
+    *first = wait.first;
+    return wait.count;
+}
+
+void cp_ring_release(cp_ring_consumer_t* consumer, size_t count) {
+    cp_atomic_store64(&consumer->sequence, consumer->sequence + (int64_t)count);
+    ring_signal(consumer->ring);
+}
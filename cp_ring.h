@@ -0,0 +1,160 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_RING_H
+#define CP_THREADS_CP_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Multicast Ring
+// ============================================================================
+
+// A Disruptor style ring that delivers every event to every consumer, in
+// order, without copying it once per consumer.
+//
+// The ring is one preallocated array of fixed size slots. Producers claim
+// sequence numbers, fill the slots in place and publish them. Each consumer
+// has its own cursor, the next sequence it will read, and may depend on
+// other consumers, in which case it only sees events they have released.
+// That builds pipelines and diamonds on one ring, for example a journal and
+// a replicator reading each event in parallel, and the business logic only
+// once both are done with it.
+//
+// A producer can't claim a slot until every consumer has released the
+// event that was in it, so the slowest consumer sets the pace.
+//
+// With CP_RING_SINGLE_PRODUCER a claim is a plain increment and publishing
+// stores one cursor. CP_RING_MULTI_PRODUCER claims with an atomic add and
+// marks each slot published, since producers can finish out of order.
+// Consumers see the longest run of published events after their cursor.
+//
+// cp_ring_wait returns every event available at once, so a consumer that
+// falls behind catches up in batches and pays for the synchronization once
+// per batch. Anything waiting, producers for space or consumers for events,
+// does so by the ring's wait strategy:
+//
+// * CP_RING_BUSY_SPIN - spins on the cursors. Lowest latency, burns a core
+//   per waiting thread.
+// * CP_RING_YIELD - spins briefly, then yields between checks.
+// * CP_RING_PARK - spins briefly, then sleeps with cp_atomic_wait. Producers
+//   and consumers only notify when a thread is asleep.
+//
+// Every consumer has to be added before the first claim, and the ring and
+// its consumers must outlive every thread using them.
+
+#define CP_RING_MAX_CONSUMERS 32
+#define CP_RING_MAX_DEPENDENCIES 8
+
+enum {
+    CP_RING_SINGLE_PRODUCER,
+    CP_RING_MULTI_PRODUCER
+};
+
+enum {
+    CP_RING_BUSY_SPIN,
+    CP_RING_YIELD,
+    CP_RING_PARK
+};
+
+typedef struct cp_ring_t cp_ring_t;
+
+typedef struct CP_ALIGNAS(CP_CACHE_LINE) cp_ring_consumer_t {
+    // Every event before this one has been released.
+    cp_atomic64 sequence;
+    cp_ring_t* ring;
+    struct cp_ring_consumer_t* dependencies[CP_RING_MAX_DEPENDENCIES];
+    size_t dependency_count;
+} cp_ring_consumer_t;
+
+struct cp_ring_t {
+    // Fixed after cp_ring_init and the consumers are added.
+    unsigned char* buffer;
+    size_t elem_size;
+    int64_t capacity;
+    int shift;
+    int producers;
+    int wait;
+    // Multiple producers only: the lap each slot was last published in.
+    cp_atomic32* published;
+    cp_ring_consumer_t* consumers[CP_RING_MAX_CONSUMERS];
+    size_t consumer_count;
+
+    // The next sequence to claim, and the lowest consumer cursor producers
+    // last saw.
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic64 claimed;
+    cp_atomic64 gate;
+
+    // Single producer only: every event before this one is published.
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic64 cursor;
+
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic32 parked;
+    cp_atomic32 progress;
+    cp_atomic32 closed;
+};
+
+// The capacity has to be a power of two.
+int cp_ring_init(cp_ring_t* ring, size_t elem_size, size_t capacity, int producers, int wait);
+void cp_ring_destroy(cp_ring_t* ring);
+
+// Adds a consumer that sees events once each of the dependencies has
+// released them. Returns thrd_error once CP_RING_MAX_CONSUMERS are added.
+int cp_ring_consumer_init(cp_ring_consumer_t* consumer, cp_ring_t* ring, cp_ring_consumer_t* const* dependencies, size_t count);
+
+// The slot holding an event.
+static __inline void* cp_ring_slot(cp_ring_t* ring, int64_t sequence) {
+    return ring->buffer + (size_t)(sequence & (ring->capacity - 1)) * ring->elem_size;
+}
+
+// Claims count slots, at most the capacity, waiting for the consumers to
+// free them, and returns the sequence of the first one.
+int64_t cp_ring_claim(cp_ring_t* ring, size_t count);
+
+// Hands claimed and filled slots to the consumers.
+void cp_ring_publish(cp_ring_t* ring, int64_t first, size_t count);
+
+// Claims one slot, copies the value into it and publishes it.
+void cp_ring_put(cp_ring_t* ring, const void* elem);
+
+// Wakes consumers waiting on an empty ring. Once they have consumed what's
+// left, cp_ring_wait returns 0. Call it after the last publish.
+void cp_ring_close(cp_ring_t* ring);
+
+// Waits until at least one event is available to the consumer and returns
+// how many are, starting at the sequence stored in first. Returns 0 once
+// the ring is closed and there's nothing left.
+size_t cp_ring_wait(cp_ring_consumer_t* consumer, int64_t* first);
+
+// Like cp_ring_wait, but returns 0 right away when nothing is available.
+size_t cp_ring_poll(cp_ring_consumer_t* consumer, int64_t* first);
+
+// Gives back the next count events to the producers and the consumers that
+// depend on this one.
+void cp_ring_release(cp_ring_consumer_t* consumer, size_t count);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
+#include "cp_stack_arena.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+typedef struct ___cp_stack_slot {
+    thrd_t thread;
+    thrd_start_t func;
+    void* arg;
+    int running;
+    struct ___cp_stack_slot* next_free;
+} stack_slot;
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+#if defined(__linux__)
+
+// The guard region sits below the stack it protects, since stacks grow down.
+static unsigned char* slot_stack(cp_stack_arena_t* arena, stack_slot* slot) {
+    size_t index = (size_t)(slot - arena->slots);
+    return arena->base + index * (arena->guard_size + arena->stack_size) + arena->guard_size;
+}
+
+static int arena_map(cp_stack_arena_t* arena) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t stack_size = arena->stack_size < (size_t)PTHREAD_STACK_MIN ? (size_t)PTHREAD_STACK_MIN : arena->stack_size;
+    size_t unit = (arena->flags & CP_STACK_HUGE_PAGES) ? HUGE_PAGE_SIZE : page;
+    arena->stack_size = round_up(stack_size, unit);
+    arena->guard_size = unit;
+
+    // Huge pages need every stack to start on a 2 MiB boundary, so the
+    // mapping gets one unit of slack to align it.
+    size_t slot_size = arena->guard_size + arena->stack_size;
+    size_t size = slot_size * arena->count + ((arena->flags & CP_STACK_HUGE_PAGES) ? unit : 0);
+    unsigned char* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(mapping == MAP_FAILED)
+        return thrd_nomem;
+
+    arena->mapping = mapping;
+    arena->mapped_size = size;
+    arena->base = (unsigned char*)round_up((uintptr_t)mapping, unit);
+
+    for(size_t i = 0; i < arena->count; i++) {
+        unsigned char* guard = arena->base + i * slot_size;
+        if(mprotect(guard, arena->guard_size, PROT_NONE) != 0) {
+            munmap(mapping, size);
+            return thrd_error;
+        }
+        unsigned char* stack = guard + arena->guard_size;
+        if(arena->flags & CP_STACK_HUGE_PAGES)
+            madvise(stack, arena->stack_size, MADV_HUGEPAGE);
+        if(arena->flags & CP_STACK_PREFAULT) {
+            for(size_t offset = 0; offset < arena->stack_size; offset += page)
+                ((volatile unsigned char*)stack)[offset] = 0;
+        }
+    }
+    return thrd_success;
+}
+
+static void arena_unmap(cp_stack_arena_t* arena) {
+    munmap(arena->mapping, arena->mapped_size);
+}
+
+static void* slot_start(void* arg) {
+    stack_slot* slot = arg;
+    // The same conversion glibc's own C11 threads use, so thrd_join and
+    // thrd_exit work on these threads as on any other.
+    return (void*)(uintptr_t)slot->func(slot->arg);
+}
+
+static int slot_create(cp_stack_arena_t* arena, stack_slot* slot) {
+    pthread_attr_t attr;
+    if(pthread_attr_init(&attr) != 0)
+        return thrd_error;
+
+    int result = thrd_error;
+    if(pthread_attr_setstack(&attr, slot_stack(arena, slot), arena->stack_size) == 0) {
+        pthread_t thread;
+        int error = pthread_create(&thread, &attr, slot_start, slot);
+        if(error == 0) {
+            slot->thread = thread;
+            result = thrd_success;
+        } else {
+            result = error == EAGAIN ? thrd_nomem : thrd_error;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return result;
+}
+
+static size_t arena_resident(cp_stack_arena_t* arena) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = arena->stack_size / page;
+    unsigned char* vector = malloc(pages);
+    if(!vector)
+        return 0;
+
+    size_t resident = 0;
+    for(size_t i = 0; i < arena->count; i++) {
+        if(mincore(slot_stack(arena, arena->slots + i), arena->stack_size, vector) != 0)
+            continue;
+        for(size_t p = 0; p < pages; p++)
+            resident += (vector[p] & 1) ? page : 0;
+    }
+    free(vector);
+    return resident;
+}
+
+#else
+
+static int arena_map(cp_stack_arena_t* arena) {
+    arena->mapping = NULL;
+    arena->mapped_size = 0;
+    arena->base = NULL;
+    arena->guard_size = 0;
+    return thrd_success;
+}
+
+static void arena_unmap(cp_stack_arena_t* arena) {
+}
+
+static int slot_create(cp_stack_arena_t* arena, stack_slot* slot) {
+    return thrd_create(&slot->thread, slot->func, slot->arg);
+}
+
+static size_t arena_resident(cp_stack_arena_t* arena) {
+    return 0;
+}
+
+#endif
+
+int cp_stack_arena_init(cp_stack_arena_t* arena, size_t count, size_t stack_size, int flags) {
+    if(!arena || count == 0 || stack_size == 0)
+        return thrd_error;
+
+    arena->slots = calloc(count, sizeof(*arena->slots));
+    if(!arena->slots)
+        return thrd_nomem;
+    if(mtx_init(&arena->lock, mtx_plain) != thrd_success) {
+        free(arena->slots);
+        return thrd_error;
+    }
+
+    arena->count = count;
+    arena->stack_size = stack_size;
+    arena->flags = flags;
+    int result = arena_map(arena);
+    if(result != thrd_success) {
+        mtx_destroy(&arena->lock);
+        free(arena->slots);
+        return result;
+    }
+
+    arena->free_slots = NULL;
+    for(size_t i = count; i > 0; i--) {
+        arena->slots[i - 1].next_free = arena->free_slots;
+        arena->free_slots = arena->slots + i - 1;
+    }
+    arena->in_use = 0;
+    arena->peak_in_use = 0;
+    arena->created = 0;
+    arena->exhausted = 0;
+    return thrd_success;
+}
+
+void cp_stack_arena_destroy(cp_stack_arena_t* arena) {
+    if(!arena || !arena->slots)
+        return;
+    arena_unmap(arena);
+    mtx_destroy(&arena->lock);
+    free(arena->slots);
+    arena->slots = NULL;
+}
+
+int cp_stack_arena_create(cp_stack_arena_t* arena, thrd_t* thr, thrd_start_t func, void* arg) {
+    if(!arena || !thr || !func)
+        return thrd_error;
+
+    mtx_lock(&arena->lock);
+    stack_slot* slot = arena->free_slots;
+    if(!slot) {
+        arena->exhausted++;
+        mtx_unlock(&arena->lock);
+        return thrd_nomem;
+    }
+    arena->free_slots = slot->next_free;
+    if(++arena->in_use > arena->peak_in_use)
+        arena->peak_in_use = arena->in_use;
+    mtx_unlock(&arena->lock);
+
+    slot->func = func;
+    slot->arg = arg;
+    int result = slot_create(arena, slot);
+
+    mtx_lock(&arena->lock);
+    if(result == thrd_success) {
+        slot->running = 1;
+        arena->created++;
+        *thr = slot->thread;
+    } else {
+        slot->next_free = arena->free_slots;
+        arena->free_slots = slot;
+        arena->in_use--;
+    }
+    mtx_unlock(&arena->lock);
+    return result;
+}
+
+int cp_stack_arena_join(cp_stack_arena_t* arena, thrd_t thr, int* res) {
+    if(!arena)
+        return thrd_error;
+
+    int result = thrd_join(thr, res);
+    if(result != thrd_success)
+        return result;
+
+    // The stack is only free once the thread is gone, which is now.
+    mtx_lock(&arena->lock);
+    for(size_t i = 0; i < arena->count; i++) {
+        stack_slot* slot = arena->slots + i;
+        if(slot->running && thrd_equal(slot->thread, thr)) {
+            slot->running = 0;
+            slot->next_free = arena->free_slots;
+            arena->free_slots = slot;
+            arena->in_use--;
+            break;
+        }
+    }
+    mtx_unlock(&arena->lock);
+    return thrd_success;
+}
+
+int cp_stack_arena_stats(cp_stack_arena_t* arena, cp_stack_arena_stats_t* stats) {
+    if(!arena || !stats)
+        return thrd_error;
+
+    mtx_lock(&arena->lock);
+    stats->stacks = arena->count;
+    stats->stack_size = arena->stack_size;
+    stats->guard_size = arena->guard_size;
+    stats->in_use = arena->in_use;
+    stats->peak_in_use = arena->peak_in_use;
+    stats->created = arena->created;
+    stats->exhausted = arena->exhausted;
+    mtx_unlock(&arena->lock);
+
+    stats->resident_bytes = arena_resident(arena);
+    return thrd_success;
+}
@@ -0,0 +1,118 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_STACK_ARENA_H
+#define CP_THREADS_CP_STACK_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpthreads.h"
+
+// ============================================================================
+// Stack Arena
+// ============================================================================
+
+// Thread stacks drawn from one preallocated mapping instead of a fresh one
+// per thread, for programs that start threads often or keep thousands of
+// them.
+//
+// The arena reserves count stacks up front, each with a guard region below
+// it that faults on overflow. cp_stack_arena_create starts a thread on a
+// free stack, and cp_stack_arena_join joins it and returns the stack to the
+// arena, so the next thread reuses memory that's already mapped and, after
+// the first use, already faulted in.
+//
+// Flags:
+//
+// * CP_STACK_PREFAULT - touches every stack page at init, so no thread ever
+//   takes a page fault on its stack.
+// * CP_STACK_HUGE_PAGES - rounds stacks and guards to 2 MiB and asks for
+//   transparent huge pages, which cuts TLB misses with many threads. Only
+//   pays off for large stacks, and only if the kernel has THP enabled for
+//   madvise.
+//
+// Threads from an arena must be joined through it, not detached, and the
+// arena destroyed only after all of them are joined. Starting a thread
+// when every stack is in use returns thrd_nomem.
+//
+// Stacks come from the arena on Linux, through pthread_attr_setstack.
+// Elsewhere threads get ordinary stacks from thrd_create and the arena only
+// counts them. CP_STACK_ARENA_NATIVE says which one was built.
+
+#if defined(__linux__)
+#define CP_STACK_ARENA_NATIVE 1
+#else
+#define CP_STACK_ARENA_NATIVE 0
+#endif
+
+enum {
+    CP_STACK_PREFAULT = 1,
+    CP_STACK_HUGE_PAGES = 2
+};
+
+struct ___cp_stack_slot;
+
+typedef struct cp_stack_arena_t {
+    mtx_t lock;
+    void* mapping;
+    size_t mapped_size;
+    // The first guard region, aligned within the mapping.
+    unsigned char* base;
+    size_t count;
+    size_t stack_size;
+    size_t guard_size;
+    int flags;
+    struct ___cp_stack_slot* slots;
+    struct ___cp_stack_slot* free_slots;
+    size_t in_use;
+    size_t peak_in_use;
+    uint64_t created;
+    uint64_t exhausted;
+} cp_stack_arena_t;
+
+typedef struct cp_stack_arena_stats_t {
+    size_t stacks;
+    size_t stack_size;
+    size_t guard_size;
+    size_t in_use;
+    size_t peak_in_use;
+    // Threads started, and starts refused because every stack was in use.
+    uint64_t created;
+    uint64_t exhausted;
+    // Bytes of the arena's stacks in memory right now, or 0 if unknown.
+    size_t resident_bytes;
+} cp_stack_arena_stats_t;
+
+// The stack size is rounded up to whole pages. It has to leave room for the
+// thread's TLS, which glibc places at the top of the stack.
+int cp_stack_arena_init(cp_stack_arena_t* arena, size_t count, size_t stack_size, int flags);
+void cp_stack_arena_destroy(cp_stack_arena_t* arena);
+
+int cp_stack_arena_create(cp_stack_arena_t* arena, thrd_t* thr, thrd_start_t func, void* arg);
+int cp_stack_arena_join(cp_stack_arena_t* arena, thrd_t thr, int* res);
+
+int cp_stack_arena_stats(cp_stack_arena_t* arena, cp_stack_arena_stats_t* stats);
+
+#endif
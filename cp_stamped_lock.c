@@ -0,0 +1,187 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "cp_stamped_lock.h"
+
+// How many failed attempts a blocking lock spins through before parking.
+#define STAMPED_SPINS 64
+
+#define STAMP_MASK (CP_STAMP_WRITER | CP_STAMP_VERSION)
+
+static __inline int can_read(int64_t state) {
+    return !(state & (CP_STAMP_WRITER | CP_STAMP_WRITER_PENDING)) && (state & CP_STAMP_READERS) != CP_STAMP_READERS;
+}
+
+static __inline int can_write(int64_t state) {
+    return !(state & (CP_STAMP_WRITER | CP_STAMP_READERS));
+}
+
+static void lock_wake(cp_stamped_lock_t* lock) {
+    mtx_lock(&lock->mutex);
+    int64_t state = cp_atomic_load64(&lock->state);
+    while((state & CP_STAMP_PARKED) && !cp_atomic_cas64(&lock->state, &state, state & ~CP_STAMP_PARKED))
+        ;
+    cnd_broadcast(&lock->wake);
+    mtx_unlock(&lock->mutex);
+}
+
+// Sleeps until the lock may be available for the given mode. The parked
+// flag is set with the mutex held, and every unlock that sees it takes the
+// mutex before broadcasting, so a wake up can't slip in between the check
+// and the wait. A waiting writer also sets the pending flag, which keeps new
+// readers out until it got its turn.
+static void lock_park(cp_stamped_lock_t* lock, int writer) {
+    mtx_lock(&lock->mutex);
+    for(;;) {
+        int64_t state = cp_atomic_load64(&lock->state);
+        if(writer ? can_write(state) : can_read(state))
+            break;
+
+        int64_t flags = CP_STAMP_PARKED | (writer ? CP_STAMP_WRITER_PENDING : 0);
+        if((state & flags) != flags && !cp_atomic_cas64(&lock->state, &state, state | flags))
+            continue;
+        cnd_wait(&lock->wake, &lock->mutex);
+    }
+    mtx_unlock(&lock->mutex);
+}
+
+int cp_stamped_lock_init(cp_stamped_lock_t* lock) {
+    if(!lock)
+        return thrd_error;
+
+    if(mtx_init(&lock->mutex, mtx_plain) != thrd_success)
+        return thrd_error;
+    if(cnd_init(&lock->wake) != thrd_success) {
+        mtx_destroy(&lock->mutex);
+        return thrd_error;
+    }
+
+    // Starting at version 1 keeps every stamp nonzero.
+    lock->state = (int64_t)1 << 17;
+    return thrd_success;
+}
+
+void cp_stamped_lock_destroy(cp_stamped_lock_t* lock) {
+    if(!lock)
+        return;
+
+    cnd_destroy(&lock->wake);
+    mtx_destroy(&lock->mutex);
+}
+
+cp_stamp_t cp_stamped_lock_try_read(cp_stamped_lock_t* lock) {
+    int64_t state = cp_atomic_load64(&lock->state);
+    while(can_read(state)) {
+        if(cp_atomic_cas64(&lock->state, &state, state + 1))
+            return (state + 1) & (CP_STAMP_READERS | STAMP_MASK);
+    }
+    return 0;
+}
+
+cp_stamp_t cp_stamped_lock_read(cp_stamped_lock_t* lock) {
+    for(;;) {
+        for(int i = 0; i < STAMPED_SPINS; i++) {
+            cp_stamp_t stamp = cp_stamped_lock_try_read(lock);
+            if(stamp)
+                return stamp;
+            cp_cpu_relax();
+        }
+        lock_park(lock, 0);
+    }
+}
+
+void cp_stamped_lock_read_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp) {
+    int64_t old = cp_atomic_fetch_add64(&lock->state, -1);
+
+    // Only the last reader out, or one freeing a slot when the count was
+    // full, lets a parked thread make progress.
+    int64_t readers = old & CP_STAMP_READERS;
+    if((old & CP_STAMP_PARKED) && (readers == 1 || readers == CP_STAMP_READERS))
+        lock_wake(lock);
+}
+
+cp_stamp_t cp_stamped_lock_try_write(cp_stamped_lock_t* lock) {
+    int64_t state = cp_atomic_load64(&lock->state);
+    while(can_write(state)) {
+        int64_t next = (state | CP_STAMP_WRITER) & ~CP_STAMP_WRITER_PENDING;
+        if(cp_atomic_cas64(&lock->state, &state, next))
+            return next & STAMP_MASK;
+    }
+    return 0;
+}
+
+cp_stamp_t cp_stamped_lock_write(cp_stamped_lock_t* lock) {
+    for(;;) {
+        for(int i = 0; i < STAMPED_SPINS; i++) {
+            cp_stamp_t stamp = cp_stamped_lock_try_write(lock);
+            if(stamp)
+                return stamp;
+            cp_cpu_relax();
+        }
+        lock_park(lock, 1);
+    }
+}
+
+void cp_stamped_lock_write_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp) {
+    int64_t old = cp_atomic_fetch_add64(&lock->state, CP_STAMP_WRITER);
+    if(old & CP_STAMP_PARKED)
+        lock_wake(lock);
+}
+
+cp_stamp_t cp_stamped_lock_try_convert_to_write(cp_stamped_lock_t* lock, cp_stamp_t stamp) {
+    if(!lock || !stamp)
+        return 0;
+
+    int64_t state = cp_atomic_load64(&lock->state);
+    if(stamp & CP_STAMP_WRITER)
+        return (state & STAMP_MASK) == (stamp & STAMP_MASK) ? stamp : 0;
+
+    for(;;) {
+        if((state & STAMP_MASK) != (stamp & STAMP_MASK))
+            return 0;
+
+        int64_t next;
+        if(stamp & CP_STAMP_READERS) {
+            // Our own read lock has to be the only one.
+            if((state & CP_STAMP_READERS) != 1)
+                return 0;
+            next = state - 1 + CP_STAMP_WRITER;
+        } else {
+            if(state & CP_STAMP_READERS)
+                return 0;
+            next = state + CP_STAMP_WRITER;
+        }
+
+        next &= ~CP_STAMP_WRITER_PENDING;
+        if(cp_atomic_cas64(&lock->state, &state, next))
+            return next & STAMP_MASK;
+    }
+}
+
+void cp_stamped_lock_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp) {
+    if(stamp & CP_STAMP_WRITER)
+        cp_stamped_lock_write_unlock(lock, stamp);
+    else
+        cp_stamped_lock_read_unlock(lock, stamp);
+}
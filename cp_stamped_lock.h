@@ -0,0 +1,111 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_STAMPED_LOCK_H
+#define CP_THREADS_CP_STAMPED_LOCK_H
+
+#include <stdint.h>
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+
+// ============================================================================
+// Stamped Lock
+// ============================================================================
+
+// A reader/writer lock with a third, optimistic read mode, for small records
+// that are read far more often than they change.
+//
+// An optimistic read takes a stamp, copies the data it needs and then checks
+// the stamp is still valid. Neither step writes to memory, so any number of
+// readers can do this without the lock's cache line bouncing between cores.
+// If a writer got in between, the copy may be torn and has to be thrown away;
+// the usual pattern is to retry once with a real read lock.
+//
+//     cp_stamp_t stamp = cp_stamped_lock_optimistic(&lock);
+//     Point copy = point;
+//     if(!cp_stamped_lock_validate(&lock, stamp)) {
+//         stamp = cp_stamped_lock_read(&lock);
+//         copy = point;
+//         cp_stamped_lock_read_unlock(&lock, stamp);
+//     }
+//
+// Read and write locks work as usual, and aren't reentrant. A writer that
+// has to wait blocks new readers so it can't be starved.
+//
+// All stamps are nonzero, the try functions return 0 when they fail.
+
+typedef int64_t cp_stamp_t;
+
+// State layout: reader count, then the parked and writer pending flags, then
+// the writer bit. Write unlock adds the writer bit again, which clears it and
+// carries into the version above.
+#define CP_STAMP_READERS ((int64_t)0x3fff)
+#define CP_STAMP_WRITER_PENDING ((int64_t)1 << 14)
+#define CP_STAMP_PARKED ((int64_t)1 << 15)
+#define CP_STAMP_WRITER ((int64_t)1 << 16)
+#define CP_STAMP_VERSION (~(((int64_t)1 << 17) - 1))
+
+typedef struct cp_stamped_lock_t {
+    cp_atomic64 state;
+    mtx_t mutex;
+    cnd_t wake;
+} cp_stamped_lock_t;
+
+int cp_stamped_lock_init(cp_stamped_lock_t* lock);
+void cp_stamped_lock_destroy(cp_stamped_lock_t* lock);
+
+// Returns 0 if a writer holds the lock.
+static __inline cp_stamp_t cp_stamped_lock_optimistic(cp_stamped_lock_t* lock) {
+    int64_t state = cp_atomic_load64(&lock->state);
+    return (state & CP_STAMP_WRITER) ? 0 : (state & (CP_STAMP_WRITER | CP_STAMP_VERSION));
+}
+
+// Returns 1 if no writer has held the lock since the stamp was taken. Read,
+// write and converted stamps stay valid for as long as they're held.
+static __inline int cp_stamped_lock_validate(cp_stamped_lock_t* lock, cp_stamp_t stamp) {
+    // The reads being validated have to happen before the state is read again.
+    cp_atomic_fence_acquire();
+    int64_t mask = CP_STAMP_WRITER | CP_STAMP_VERSION;
+    return stamp != 0 && (stamp & mask) == (cp_atomic_load64(&lock->state) & mask);
+}
+
+cp_stamp_t cp_stamped_lock_read(cp_stamped_lock_t* lock);
+cp_stamp_t cp_stamped_lock_try_read(cp_stamped_lock_t* lock);
+void cp_stamped_lock_read_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp);
+
+cp_stamp_t cp_stamped_lock_write(cp_stamped_lock_t* lock);
+cp_stamp_t cp_stamped_lock_try_write(cp_stamped_lock_t* lock);
+void cp_stamped_lock_write_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp);
+
+// Turns an optimistic, read or write stamp into a write lock without
+// letting go first. Fails if another thread holds a read or write lock, or
+// if an optimistic stamp is no longer valid. A read lock is still held when
+// this fails.
+cp_stamp_t cp_stamped_lock_try_convert_to_write(cp_stamped_lock_t* lock, cp_stamp_t stamp);
+
+// Releases a read or write lock given its stamp.
+void cp_stamped_lock_unlock(cp_stamped_lock_t* lock, cp_stamp_t stamp);
+
+#endif
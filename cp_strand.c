@@ -0,0 +1,183 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stddef.h>
+
+#include "cp_strand.h"
+
+// Tasks a pool worker runs before handing the strand back to the pool, so
+// one busy strand doesn't keep a worker from everything else.
+#define STRAND_BATCH 64
+
+// The strands the calling thread is running tasks of, innermost first. A
+// task that posts to another idle strand runs it nested inside its own.
+typedef struct strand_frame {
+    cp_strand_t* strand;
+    struct strand_frame* outer;
+} strand_frame;
+
+static thread_local strand_frame* current_frame;
+
+static void strand_drain(cp_task_t* task);
+
+int cp_strand_init(cp_strand_t* strand, cp_pool_t* pool) {
+    if(!strand)
+        return thrd_error;
+
+    strand->stub.func = NULL;
+    strand->stub.next = NULL;
+    strand->head = &strand->stub;
+    strand->tail = &strand->stub;
+    strand->count = 0;
+    strand->pool = pool;
+    strand->drain.func = strand_drain;
+    strand->drain.next = NULL;
+    return thrd_success;
+}
+
+void cp_strand_destroy(cp_strand_t* strand) {
+}
+
+// ============================================================================
+// Queue
+// ============================================================================
+
+// An intrusive MPSC queue. Pushing swaps the head and then links the old
+// head to the new task, so the only thing producers ever contend on is the
+// one exchange.
+static void strand_push(cp_strand_t* strand, cp_strand_task_t* task) {
+    cp_atomic_store_ptr(&task->next, NULL);
+    cp_strand_task_t* prev = cp_atomic_exchange_ptr(&strand->head, task);
+    cp_atomic_store_ptr(&prev->next, task);
+}
+
+// Takes the oldest task. Only the owner calls this, and only for tasks it
+// has counted, so a task is always there. At worst its push has swapped the
+// head and not linked it yet, which is the next thing the pusher does.
+static cp_strand_task_t* strand_pop(cp_strand_t* strand) {
+    for(;;) {
+        cp_strand_task_t* tail = strand->tail;
+        cp_strand_task_t* next = cp_atomic_load_ptr(&tail->next);
+        if(tail == &strand->stub) {
+            if(!next) {
+                cp_cpu_relax();
+                continue;
+            }
+            strand->tail = next;
+            tail = next;
+            next = cp_atomic_load_ptr(&tail->next);
+        }
+
+        if(next) {
+            strand->tail = next;
+            return tail;
+        }
+
+        // The last task can't be taken while it's the only link to the head,
+        // so the stub goes behind it.
+        if(tail == cp_atomic_load_ptr(&strand->head)) {
+            strand_push(strand, &strand->stub);
+            next = cp_atomic_load_ptr(&tail->next);
+            if(next) {
+                strand->tail = next;
+                return tail;
+            }
+        }
+        cp_cpu_relax();
+    }
+}
+
+// ============================================================================
+// Running
+// ============================================================================
+
+// Runs tasks as the owner until the count drops to zero, giving up ownership,
+// or until budget tasks have run if it isn't zero. Returns 1 if the caller
+// still owns the strand.
+static int strand_run(cp_strand_t* strand, int32_t budget) {
+    strand_frame frame = { strand, current_frame };
+    current_frame = &frame;
+
+    int32_t pending = cp_atomic_load32(&strand->count);
+    int32_t total = 0;
+    int owned = 1;
+    for(;;) {
+        int32_t batch = pending;
+        if(budget && batch > budget - total)
+            batch = budget - total;
+        for(int32_t i = 0; i < batch; i++) {
+            cp_strand_task_t* task = strand_pop(strand);
+            task->func(task);
+        }
+
+        // Posts made meanwhile are already counted and become part of the
+        // next batch.
+        pending = cp_atomic_fetch_add32(&strand->count, -batch) - batch;
+        if(pending == 0) {
+            owned = 0;
+            break;
+        }
+        total += batch;
+        if(budget && total >= budget)
+            break;
+    }
+
+    current_frame = frame.outer;
+    return owned;
+}
+
+static void strand_drain(cp_task_t* task) {
+    cp_strand_t* strand = (cp_strand_t*)((char*)task - offsetof(cp_strand_t, drain));
+    // If the pool won't take the strand back, nobody else will run it.
+    if(strand_run(strand, STRAND_BATCH) && cp_pool_submit(strand->pool, &strand->drain) != thrd_success)
+        strand_run(strand, 0);
+}
+
+int cp_strand_post(cp_strand_t* strand, cp_strand_task_t* task) {
+    if(!strand || !task || !task->func)
+        return thrd_error;
+
+    // The push comes first, so every task the owner counts has at least
+    // taken its place in the queue.
+    strand_push(strand, task);
+    if(cp_atomic_fetch_add32(&strand->count, 1) != 0)
+        return thrd_success;
+
+    // Only the owner submits the drain task, so it's never queued twice.
+    // When the pool refuses it, the tasks still have to run, so they run
+    // here and the caller hears why.
+    int result = thrd_success;
+    if(strand->pool && (result = cp_pool_submit(strand->pool, &strand->drain)) == thrd_success)
+        return thrd_success;
+    strand_run(strand, 0);
+    return result;
+}
+
+int cp_strand_running_in_this_thread(cp_strand_t* strand) {
+    for(strand_frame* frame = current_frame; frame; frame = frame->outer) {
+        if(frame->strand == strand)
+            return 1;
+    }
+    return 0;
+}
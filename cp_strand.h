@@ -0,0 +1,85 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_STRAND_H
+#define CP_THREADS_CP_STRAND_H
+
+#include "cpthreads.h"
+#include "cp_atomic.h"
+#include "cp_pool.h"
+
+// ============================================================================
+// Strands
+// ============================================================================
+
+// Serializes callbacks without a lock. Tasks posted to the same strand run
+// one at a time, in the order they were posted, and each one sees everything
+// the ones before it did.
+//
+// Posting pushes onto a lock-free queue and bumps the strand's task count.
+// Whoever takes the count from zero owns the strand and runs tasks until it
+// drops back to zero. Everyone else returns straight away, so no poster ever
+// waits for another to get serialization. Without a pool the owner is the
+// posting thread, which runs the tasks before cp_strand_post returns. With
+// one, the owner hands the strand to a worker instead and tasks always run
+// there, a batch at a time so other strands get their turn.
+//
+// Tasks posted from inside a running task are queued behind it and never
+// run nested.
+
+// A unit of work for a strand. Usually embedded at the start of a larger
+// struct that holds the actual arguments.
+typedef struct cp_strand_task_t {
+    void (*func)(struct cp_strand_task_t* task);
+    cp_atomic_ptr next;
+} cp_strand_task_t;
+
+typedef struct cp_strand_t {
+    // Producers push at the head and the owner pops from the tail.
+    CP_ALIGNAS(CP_CACHE_LINE) cp_atomic_ptr head;
+    // Tasks posted and not finished yet. Taking it from zero makes the
+    // caller the owner.
+    cp_atomic32 count;
+    CP_ALIGNAS(CP_CACHE_LINE) cp_strand_task_t* tail;
+    cp_strand_task_t stub;
+    cp_pool_t* pool;
+    cp_task_t drain;
+} cp_strand_t;
+
+// Tasks run on pool if it isn't NULL, and on the posting threads otherwise.
+int cp_strand_init(cp_strand_t* strand, cp_pool_t* pool);
+
+// The strand must be idle.
+void cp_strand_destroy(cp_strand_t* strand);
+
+// Queues a task on the strand, running it and whatever is queued behind it
+// when the strand was idle and has no pool. The task memory must stay valid
+// until its function starts. If the pool fails to take the strand, the
+// tasks run on the posting thread instead and the pool's error is returned.
+int cp_strand_post(cp_strand_t* strand, cp_strand_task_t* task);
+
+// Returns 1 if the calling thread is running a task of the strand.
+int cp_strand_running_in_this_thread(cp_strand_t* strand);
+
+#endif
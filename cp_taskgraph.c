@@ -0,0 +1,268 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_taskgraph.h"
+
+// How many times a waiting thread looks for pool work before blocking.
+#define GRAPH_WAIT_SPINS 64
+
+struct ___cp_taskgraph_node {
+    cp_task_t task;
+    cp_taskgraph_t* graph;
+    cp_taskgraph_fn func;
+    void* arg;
+    int* successors;
+    int successor_count;
+    int successor_cap;
+    int predecessor_count;
+    cp_atomic32 pending;
+};
+
+typedef struct ___cp_taskgraph_node graph_node;
+
+static void graph_finish_one(cp_taskgraph_t* graph) {
+    if(cp_atomic_fetch_add32(&graph->remaining, -1) != 1)
+        return;
+
+    mtx_lock(&graph->lock);
+    cp_atomic_store32(&graph->running, 0);
+    cnd_broadcast(&graph->finished);
+    mtx_unlock(&graph->lock);
+}
+
+static void graph_node_run(cp_task_t* task) {
+    graph_node* node = (graph_node*)task;
+    cp_taskgraph_t* graph = node->graph;
+
+    while(node) {
+        node->func(node->arg);
+
+        // Keep the first successor that became ready and run it on this
+        // thread next. Only the rest go through the pool.
+        graph_node* next = NULL;
+        for(int i = 0; i < node->successor_count; i++) {
+            graph_node* successor = graph->nodes + node->successors[i];
+            if(cp_atomic_fetch_add32(&successor->pending, -1) != 1)
+                continue;
+            if(!next)
+                next = successor;
+            else
+                cp_pool_submit(graph->pool, &successor->task);
+        }
+
+        graph_finish_one(graph);
+        node = next;
+    }
+}
+
+// Kahn's algorithm. Only runs the first time a graph is run after it changes.
+static int graph_validate(cp_taskgraph_t* graph) {
+    int count = graph->node_count;
+    if(count == 0)
+        return thrd_success;
+
+    int* scratch = malloc(sizeof(*scratch) * count * 2);
+    if(!scratch)
+        return thrd_nomem;
+    int* degree = scratch;
+    int* queue = scratch + count;
+    int head = 0, tail = 0;
+
+    for(int i = 0; i < count; i++) {
+        degree[i] = graph->nodes[i].predecessor_count;
+        if(degree[i] == 0)
+            queue[tail++] = i;
+    }
+
+    while(head < tail) {
+        graph_node* node = graph->nodes + queue[head++];
+        for(int i = 0; i < node->successor_count; i++) {
+            if(--degree[node->successors[i]] == 0)
+                queue[tail++] = node->successors[i];
+        }
+    }
+
+    free(scratch);
+    return tail == count ? thrd_success : thrd_error;
+}
+
+int cp_taskgraph_init(cp_taskgraph_t* graph, cp_pool_t* pool) {
+    if(!graph)
+        return thrd_error;
+    if(!pool && !(pool = cp_pool_default()))
+        return thrd_error;
+
+    if(mtx_init(&graph->lock, mtx_plain) != thrd_success)
+        return thrd_error;
+    if(cnd_init(&graph->finished) != thrd_success) {
+        mtx_destroy(&graph->lock);
+        return thrd_error;
+    }
+
+    graph->pool = pool;
+    graph->nodes = NULL;
+    graph->node_count = 0;
+    graph->node_cap = 0;
+    graph->validated = 1;
+    graph->remaining = 0;
+    graph->running = 0;
+    return thrd_success;
+}
+
+void cp_taskgraph_destroy(cp_taskgraph_t* graph) {
+    if(!graph)
+        return;
+
+    for(int i = 0; i < graph->node_count; i++)
+        free(graph->nodes[i].successors);
+    free(graph->nodes);
+    graph->nodes = NULL;
+    graph->node_count = 0;
+    graph->node_cap = 0;
+    cnd_destroy(&graph->finished);
+    mtx_destroy(&graph->lock);
+}
+
+int cp_taskgraph_add(cp_taskgraph_t* graph, int* task_id, cp_taskgraph_fn func, void* arg) {
+    if(!graph || !func)
+        return thrd_error;
+    if(cp_atomic_load32(&graph->running))
+        return thrd_busy;
+
+    if(graph->node_count == graph->node_cap) {
+        int cap = graph->node_cap == 0 ? 16 : graph->node_cap * 2;
+        void* buff = realloc(graph->nodes, sizeof(*graph->nodes) * cap);
+        if(!buff)
+            return thrd_nomem;
+        graph->nodes = buff;
+        graph->node_cap = cap;
+    }
+
+    graph_node* node = graph->nodes + graph->node_count;
+    node->task.func = graph_node_run;
+    node->task.next = NULL;
+    node->graph = graph;
+    node->func = func;
+    node->arg = arg;
+    node->successors = NULL;
+    node->successor_count = 0;
+    node->successor_cap = 0;
+    node->predecessor_count = 0;
+    node->pending = 0;
+
+    if(task_id)
+        *task_id = graph->node_count;
+    graph->node_count++;
+    return thrd_success;
+}
+
+int cp_taskgraph_precede(cp_taskgraph_t* graph, int before, int after) {
+    if(!graph || before == after)
+        return thrd_error;
+    if(before < 0 || before >= graph->node_count || after < 0 || after >= graph->node_count)
+        return thrd_error;
+    if(cp_atomic_load32(&graph->running))
+        return thrd_busy;
+
+    graph_node* node = graph->nodes + before;
+    if(node->successor_count == node->successor_cap) {
+        int cap = node->successor_cap == 0 ? 4 : node->successor_cap * 2;
+        void* buff = realloc(node->successors, sizeof(*node->successors) * cap);
+        if(!buff)
+            return thrd_nomem;
+        node->successors = buff;
+        node->successor_cap = cap;
+    }
+
+    node->successors[node->successor_count++] = after;
+    graph->nodes[after].predecessor_count++;
+    graph->validated = 0;
+    return thrd_success;
+}
+
+int cp_taskgraph_run(cp_taskgraph_t* graph) {
+    if(!graph)
+        return thrd_error;
+
+    int32_t expected = 0;
+    if(!cp_atomic_cas32(&graph->running, &expected, 1))
+        return thrd_busy;
+
+    if(!graph->validated) {
+        int result = graph_validate(graph);
+        if(result != thrd_success) {
+            cp_atomic_store32(&graph->running, 0);
+            return result;
+        }
+        graph->validated = 1;
+    }
+
+    if(graph->node_count == 0) {
+        mtx_lock(&graph->lock);
+        cp_atomic_store32(&graph->running, 0);
+        mtx_unlock(&graph->lock);
+        return thrd_success;
+    }
+
+    // Every counter has to be reset before the first root can finish
+    // and start decrementing them.
+    cp_atomic_store32(&graph->remaining, graph->node_count);
+    for(int i = 0; i < graph->node_count; i++)
+        cp_atomic_store32(&graph->nodes[i].pending, graph->nodes[i].predecessor_count);
+
+    for(int i = 0; i < graph->node_count; i++) {
+        if(graph->nodes[i].predecessor_count == 0)
+            cp_pool_submit(graph->pool, &graph->nodes[i].task);
+    }
+
+    return thrd_success;
+}
+
+int cp_taskgraph_wait(cp_taskgraph_t* graph) {
+    if(!graph)
+        return thrd_error;
+
+    int idle = 0;
+    while(cp_atomic_load32(&graph->running)) {
+        if(cp_pool_try_run(graph->pool)) {
+            idle = 0;
+        } else if(++idle < GRAPH_WAIT_SPINS) {
+            thrd_yield();
+        } else {
+            mtx_lock(&graph->lock);
+            while(cp_atomic_load32(&graph->running))
+                cnd_wait(&graph->finished, &graph->lock);
+            mtx_unlock(&graph->lock);
+        }
+    }
+
+    // The last task clears running while holding the lock. Taking it here
+    // makes sure that task is done with the graph before the caller can
+    // destroy it.
+    mtx_lock(&graph->lock);
+    mtx_unlock(&graph->lock);
+    return thrd_success;
+}
@@ -0,0 +1,86 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_TASKGRAPH_H
+#define CP_THREADS_CP_TASKGRAPH_H
+
+#include "cp_pool.h"
+
+// ============================================================================
+// Task Graph
+// ============================================================================
+
+// A DAG of tasks run on a cp_pool_t. Each task keeps an atomic count of
+// unfinished predecessors; the task that brings a successor's count to zero
+// runs it straight away as a continuation, and any other successors that
+// became ready are submitted to the pool. Nothing blocks a thread waiting
+// for a dependency.
+//
+// Building the graph (cp_taskgraph_add, cp_taskgraph_precede) isn't thread
+// safe and can't happen while it runs. Once built, a graph can be run any
+// number of times without allocating.
+
+typedef void (*cp_taskgraph_fn)(void* arg);
+
+struct ___cp_taskgraph_node;
+
+typedef struct cp_taskgraph_t {
+    cp_pool_t* pool;
+    struct ___cp_taskgraph_node* nodes;
+    int node_count;
+    int node_cap;
+    int validated;
+    cp_atomic32 remaining;
+    cp_atomic32 running;
+    mtx_t lock;
+    cnd_t finished;
+} cp_taskgraph_t;
+
+// A NULL pool uses cp_pool_default().
+int cp_taskgraph_init(cp_taskgraph_t* graph, cp_pool_t* pool);
+void cp_taskgraph_destroy(cp_taskgraph_t* graph);
+
+// Adds a task and stores its id in task_id.
+int cp_taskgraph_add(cp_taskgraph_t* graph, int* task_id, cp_taskgraph_fn func, void* arg);
+
+// Makes after wait for before to finish.
+int cp_taskgraph_precede(cp_taskgraph_t* graph, int before, int after);
+
+// Starts every task without predecessors and returns without waiting.
+// Returns thrd_busy if the previous run hasn't finished, and thrd_error if
+// the graph has a cycle.
+int cp_taskgraph_run(cp_taskgraph_t* graph);
+
+// Waits for the current run to finish, running pool work on the calling
+// thread while there is any.
+int cp_taskgraph_wait(cp_taskgraph_t* graph);
+
+static __inline int cp_taskgraph_run_and_wait(cp_taskgraph_t* graph) {
+    int result = cp_taskgraph_run(graph);
+    if(result != thrd_success)
+        return result;
+    return cp_taskgraph_wait(graph);
+}
+
+#endif
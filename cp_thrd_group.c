@@ -0,0 +1,233 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cp_thrd_group.h"
+
+typedef struct ___cp_thrd_member {
+    cp_thrd_group_t* group;
+    thrd_t thread;
+    thrd_start_t func;
+    void* arg;
+    // 0 while running, otherwise the order it finished in.
+    uint64_t finished;
+    // Set while a cp_thrd_group_join waits on it, so nothing else joins and
+    // frees it underneath that join.
+    bool claimed;
+    struct ___cp_thrd_member* next;
+} member;
+
+static once_flag member_once = ONCE_FLAG_INIT;
+static tss_t member_key;
+static int member_key_valid = 0;
+
+// Runs as the thread exits, whether it returned or called thrd_exit.
+static void member_exit(void* arg) {
+    member* self = arg;
+    cp_thrd_group_t* group = self->group;
+    mtx_lock(&group->lock);
+    self->finished = ++group->finish_count;
+    cnd_broadcast(&group->finished);
+    mtx_unlock(&group->lock);
+}
+
+static void member_key_init(void) {
+    member_key_valid = tss_create(&member_key, member_exit) == thrd_success;
+}
+
+static int member_start(void* arg) {
+    member* self = arg;
+    tss_set(member_key, self);
+    return self->func(self->arg);
+}
+
+int cp_thrd_group_init(cp_thrd_group_t* group) {
+    if(!group)
+        return thrd_error;
+
+    call_once(&member_once, member_key_init);
+    if(!member_key_valid)
+        return thrd_error;
+
+    if(mtx_init(&group->lock, mtx_plain) != thrd_success)
+        return thrd_error;
+    if(cnd_init(&group->finished) != thrd_success) {
+        mtx_destroy(&group->lock);
+        return thrd_error;
+    }
+    group->members = NULL;
+    group->count = 0;
+    group->finish_count = 0;
+    return thrd_success;
+}
+
+void cp_thrd_group_destroy(cp_thrd_group_t* group) {
+    if(!group)
+        return;
+    cp_thrd_group_join_all(group, NULL);
+    cnd_destroy(&group->finished);
+    mtx_destroy(&group->lock);
+}
+
+int cp_thrd_group_create(cp_thrd_group_t* group, thrd_t* thr, thrd_start_t func, void* arg) {
+    if(!group || !thr || !func)
+        return thrd_error;
+
+    member* fresh = malloc(sizeof(*fresh));
+    if(!fresh)
+        return thrd_nomem;
+    fresh->group = group;
+    fresh->func = func;
+    fresh->arg = arg;
+    fresh->finished = 0;
+    fresh->claimed = false;
+
+    // Holding the lock keeps joiners from seeing the member before its
+    // handle is set, even if the thread finishes right away.
+    mtx_lock(&group->lock);
+    int result = thrd_create(&fresh->thread, member_start, fresh);
+    if(result == thrd_success) {
+        fresh->next = group->members;
+        group->members = fresh;
+        group->count++;
+        *thr = fresh->thread;
+    }
+    mtx_unlock(&group->lock);
+
+    if(result != thrd_success)
+        free(fresh);
+    return result;
+}
+
+size_t cp_thrd_group_size(cp_thrd_group_t* group) {
+    if(!group)
+        return 0;
+    mtx_lock(&group->lock);
+    size_t count = group->count;
+    mtx_unlock(&group->lock);
+    return count;
+}
+
+// Sleeps until a member finishes. The group lock must be held.
+static int group_wait(cp_thrd_group_t* group, const struct timespec* deadline) {
+    if(!deadline)
+        return cnd_wait(&group->finished, &group->lock);
+    return cnd_timedwait(&group->finished, &group->lock, deadline);
+}
+
+// Takes a finished member out of the group and joins it. The thread has
+// reported its exit, so the join only waits for it to finish leaving. The
+// group lock must be held, and is released.
+static int group_collect(cp_thrd_group_t* group, member* target, int* res) {
+    for(member** link = &group->members; *link; link = &(*link)->next) {
+        if(*link == target) {
+            *link = target->next;
+            break;
+        }
+    }
+    group->count--;
+    mtx_unlock(&group->lock);
+
+    int result = thrd_join(target->thread, res);
+    free(target);
+    return result;
+}
+
+int cp_thrd_group_join(cp_thrd_group_t* group, thrd_t thr, int* res, const struct timespec* deadline) {
+    if(!group)
+        return thrd_error;
+
+    mtx_lock(&group->lock);
+    member* target = group->members;
+    while(target && !thrd_equal(target->thread, thr))
+        target = target->next;
+    if(!target || target->claimed) {
+        mtx_unlock(&group->lock);
+        return thrd_error;
+    }
+
+    target->claimed = true;
+    while(!target->finished) {
+        if(group_wait(group, deadline) == thrd_timedout && !target->finished) {
+            target->claimed = false;
+            mtx_unlock(&group->lock);
+            return thrd_timedout;
+        }
+    }
+    return group_collect(group, target, res);
+}
+
+int cp_thrd_group_join_any(cp_thrd_group_t* group, thrd_t* thr, int* res, const struct timespec* deadline) {
+    if(!group || !thr)
+        return thrd_error;
+
+    mtx_lock(&group->lock);
+    for(;;) {
+        // Members claimed by a cp_thrd_group_join belong to it.
+        bool unclaimed = false;
+        member* first = NULL;
+        for(member* current = group->members; current; current = current->next) {
+            if(current->claimed)
+                continue;
+            unclaimed = true;
+            if(current->finished && (!first || current->finished < first->finished))
+                first = current;
+        }
+        if(!unclaimed) {
+            mtx_unlock(&group->lock);
+            return thrd_error;
+        }
+        if(first) {
+            *thr = first->thread;
+            return group_collect(group, first, res);
+        }
+
+        if(group_wait(group, deadline) == thrd_timedout) {
+            // Something may have finished right at the deadline.
+            bool done = false;
+            for(member* current = group->members; current && !done; current = current->next)
+                done = current->finished != 0 && !current->claimed;
+            if(!done) {
+                mtx_unlock(&group->lock);
+                return thrd_timedout;
+            }
+        }
+    }
+}
+
+int cp_thrd_group_join_all(cp_thrd_group_t* group, const struct timespec* deadline) {
+    if(!group)
+        return thrd_error;
+
+    for(;;) {
+        thrd_t thread;
+        int result = cp_thrd_group_join_any(group, &thread, NULL, deadline);
+        if(result == thrd_error && cp_thrd_group_size(group) == 0)
+            return thrd_success;
+        if(result != thrd_success)
+            return result;
+    }
+}
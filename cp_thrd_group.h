@@ -0,0 +1,90 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_THRD_GROUP_H
+#define CP_THREADS_CP_THRD_GROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cpthreads.h"
+
+// ============================================================================
+// Thread Groups
+// ============================================================================
+
+// Threads started together and joined in whatever order they finish, with
+// deadlines on every join.
+//
+// Each thread of a group reports its exit to the group under a mutex and
+// wakes the joiners waiting on the group's condition variable, so joins
+// sleep until something finishes instead of polling. The join itself only
+// happens once the thread has reported, and takes no longer than the
+// thread needs to leave.
+//
+// Exits through thrd_exit are reported as well. Threads of a group must
+// only be joined through it. Destroying a group joins every thread still in
+// it.
+
+struct ___cp_thrd_member;
+
+typedef struct cp_thrd_group_t {
+    mtx_t lock;
+    cnd_t finished;
+    // Threads not joined yet, newest first.
+    struct ___cp_thrd_member* members;
+    size_t count;
+    // Stamps members in the order they finish.
+    uint64_t finish_count;
+} cp_thrd_group_t;
+
+int cp_thrd_group_init(cp_thrd_group_t* group);
+void cp_thrd_group_destroy(cp_thrd_group_t* group);
+
+// Starts a thread in the group.
+int cp_thrd_group_create(cp_thrd_group_t* group, thrd_t* thr, thrd_start_t func, void* arg);
+
+// Number of threads started and not joined yet.
+size_t cp_thrd_group_size(cp_thrd_group_t* group);
+
+// The deadlines below are absolute, against TIME_UTC, and NULL waits
+// forever. Once one passes they return thrd_timedout and leave unfinished
+// threads in the group.
+
+// Joins one thread of the group. Returns thrd_error if it isn't in it, or
+// if another cp_thrd_group_join is already waiting for it. While it waits,
+// the thread is left to it and the joins below skip it.
+int cp_thrd_group_join(cp_thrd_group_t* group, thrd_t thr, int* res, const struct timespec* deadline);
+
+// Joins whichever thread of the group finished first and stores it in thr.
+// Returns thrd_error if the group is empty, or every thread left is being
+// waited for by cp_thrd_group_join.
+int cp_thrd_group_join_any(cp_thrd_group_t* group, thrd_t* thr, int* res, const struct timespec* deadline);
+
+// Joins every thread in the group. Threads that finish before the deadline
+// are joined even if others don't.
+int cp_thrd_group_join_all(cp_thrd_group_t* group, const struct timespec* deadline);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cp_thrd_stats.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+// ============================================================================
+// Registry
+// ============================================================================
+
+typedef struct thrd_entry {
+    struct thrd_entry* next;
+    struct thrd_entry* prev;
+    cp_thrd_info_t info;
+} thrd_entry;
+
+static once_flag registry_once = ONCE_FLAG_INIT;
+static mtx_t registry_lock;
+static tss_t registry_key;
+static int registry_valid = 0;
+static thrd_entry* registry;
+static size_t registry_count;
+static thread_local thrd_entry* local_entry;
+
+// The TSS destructor, which takes exiting threads out of the registry.
+static void entry_remove(void* arg) {
+    thrd_entry* entry = arg;
+    mtx_lock(&registry_lock);
+    if(entry->prev)
+        entry->prev->next = entry->next;
+    else
+        registry = entry->next;
+    if(entry->next)
+        entry->next->prev = entry->prev;
+    registry_count--;
+    mtx_unlock(&registry_lock);
+
+#if defined(_MSC_VER)
+    CloseHandle(entry->info.thread.handle);
+#endif
+    free(entry);
+}
+
+static void registry_init(void) {
+    if(mtx_init(&registry_lock, mtx_plain) != thrd_success)
+        return;
+    if(tss_create(&registry_key, entry_remove) != thrd_success) {
+        mtx_destroy(&registry_lock);
+        return;
+    }
+    registry_valid = 1;
+}
+
+// Fills in what other threads need to find and inspect the calling thread.
+// thrd_current only gives a handle that means "this thread" on Windows, so
+// it's replaced by a real one.
+static int entry_identify(cp_thrd_info_t* info) {
+#if defined(_MSC_VER)
+    HANDLE handle;
+    if(!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &handle, 0, FALSE, DUPLICATE_SAME_ACCESS))
+        return thrd_error;
+    info->thread.handle = handle;
+    info->os_id = (long)GetCurrentThreadId();
+#elif defined(__linux__)
+    info->thread = thrd_current();
+    info->os_id = (long)syscall(SYS_gettid);
+#else
+    info->thread = thrd_current();
+    info->os_id = -1;
+#endif
+    return thrd_success;
+}
+
+int cp_thrd_register(const char* name) {
+    if(!name)
+        return thrd_error;
+
+    call_once(&registry_once, registry_init);
+    if(!registry_valid)
+        return thrd_error;
+
+    if(!local_entry) {
+        thrd_entry* entry = calloc(1, sizeof(*entry));
+        if(!entry)
+            return thrd_nomem;
+        if(entry_identify(&entry->info) != thrd_success) {
+            free(entry);
+            return thrd_error;
+        }
+        if(tss_set(registry_key, entry) != thrd_success) {
+#if defined(_MSC_VER)
+            CloseHandle(entry->info.thread.handle);
+#endif
+            free(entry);
+            return thrd_error;
+        }
+
+        mtx_lock(&registry_lock);
+        entry->next = registry;
+        if(registry)
+            registry->prev = entry;
+        registry = entry;
+        registry_count++;
+        mtx_unlock(&registry_lock);
+        local_entry = entry;
+    }
+
+    // Renamed under the lock, so listing never copies half a name.
+    mtx_lock(&registry_lock);
+    snprintf(local_entry->info.name, CP_THRD_NAME_SIZE, "%s", name);
+    mtx_unlock(&registry_lock);
+
+#if defined(__linux__)
+    // The kernel takes at most 15 characters.
+    char short_name[16];
+    snprintf(short_name, sizeof(short_name), "%s", name);
+    pthread_setname_np(pthread_self(), short_name);
+#endif
+    return thrd_success;
+}
+
+void cp_thrd_unregister(void) {
+    if(!local_entry)
+        return;
+    tss_set(registry_key, NULL);
+    entry_remove(local_entry);
+    local_entry = NULL;
+}
+
+size_t cp_thrd_list(cp_thrd_info_t* threads, size_t capacity) {
+    call_once(&registry_once, registry_init);
+    if(!registry_valid)
+        return 0;
+
+    mtx_lock(&registry_lock);
+    size_t count = 0;
+    for(thrd_entry* entry = registry; entry && count < capacity; entry = entry->next)
+        threads[count++] = entry->info;
+    count = registry_count;
+    mtx_unlock(&registry_lock);
+    return count;
+}
+
+typedef struct named_start {
+    thrd_start_t func;
+    void* arg;
+    char name[CP_THRD_NAME_SIZE];
+} named_start;
+
+static int named_thread(void* arg) {
+    named_start start = *(named_start*)arg;
+    free(arg);
+    cp_thrd_register(start.name);
+    return start.func(start.arg);
+}
+
+int cp_thrd_create_named(thrd_t* thr, thrd_start_t func, void* arg, const char* name) {
+    if(!thr || !func || !name)
+        return thrd_error;
+
+    named_start* start = malloc(sizeof(*start));
+    if(!start)
+        return thrd_nomem;
+    start->func = func;
+    start->arg = arg;
+    snprintf(start->name, CP_THRD_NAME_SIZE, "%s", name);
+
+    int result = thrd_create(thr, named_thread, start);
+    if(result != thrd_success)
+        free(start);
+    return result;
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+static void stats_unknown(cp_thrd_stats_t* stats) {
+    stats->cpu_ns = -1;
+    stats->user_ns = -1;
+    stats->system_ns = -1;
+    stats->voluntary_switches = -1;
+    stats->involuntary_switches = -1;
+    stats->last_cpu = -1;
+}
+
+#if defined(__linux__)
+
+static int64_t timeval_ns(struct timeval time) {
+    return (int64_t)time.tv_sec * 1000000000 + (int64_t)time.tv_usec * 1000;
+}
+
+static int self_stats(cp_thrd_stats_t* stats) {
+    struct timespec cpu;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0)
+        stats->cpu_ns = (int64_t)cpu.tv_sec * 1000000000 + cpu.tv_nsec;
+
+    struct rusage usage;
+    if(getrusage(RUSAGE_THREAD, &usage) == 0) {
+        stats->user_ns = timeval_ns(usage.ru_utime);
+        stats->system_ns = timeval_ns(usage.ru_stime);
+        stats->voluntary_switches = usage.ru_nvcsw;
+        stats->involuntary_switches = usage.ru_nivcsw;
+    }
+    stats->last_cpu = sched_getcpu();
+    return thrd_success;
+}
+
+static long registered_os_id(thrd_t thread) {
+    call_once(&registry_once, registry_init);
+    if(!registry_valid)
+        return -1;
+
+    long os_id = -1;
+    mtx_lock(&registry_lock);
+    for(thrd_entry* entry = registry; entry; entry = entry->next) {
+        if(thrd_equal(entry->info.thread, thread)) {
+            os_id = entry->info.os_id;
+            break;
+        }
+    }
+    mtx_unlock(&registry_lock);
+    return os_id;
+}
+
+// Times and the last CPU come from stat, in clock ticks, and context
+// switches from status.
+static void proc_stats(cp_thrd_stats_t* stats, long os_id) {
+    char path[64];
+    char buffer[1024];
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/stat", os_id);
+    FILE* file = fopen(path, "r");
+    if(!file)
+        return;
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[length] = 0;
+
+    // The name in parentheses may contain spaces, so fields are counted from
+    // the last ')', which ends field 2.
+    char* rest = strrchr(buffer, ')');
+    if(rest) {
+        int64_t tick_ns = 1000000000 / sysconf(_SC_CLK_TCK);
+        int field = 2;
+        char* save;
+        for(char* token = strtok_r(rest + 1, " ", &save); token; token = strtok_r(NULL, " ", &save)) {
+            field++;
+            if(field == 14) {
+                stats->user_ns = strtoll(token, NULL, 10) * tick_ns;
+            } else if(field == 15) {
+                stats->system_ns = strtoll(token, NULL, 10) * tick_ns;
+            } else if(field == 39) {
+                stats->last_cpu = atoi(token);
+                break;
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/status", os_id);
+    file = fopen(path, "r");
+    if(!file)
+        return;
+    long long value;
+    while(fgets(buffer, sizeof(buffer), file)) {
+        if(sscanf(buffer, "voluntary_ctxt_switches: %lld", &value) == 1)
+            stats->voluntary_switches = value;
+        else if(sscanf(buffer, "nonvoluntary_ctxt_switches: %lld", &value) == 1)
+            stats->involuntary_switches = value;
+    }
+    fclose(file);
+}
+
+int cp_thrd_stats(cp_thrd_stats_t* stats, thrd_t thread) {
+    if(!stats)
+        return thrd_error;
+    stats_unknown(stats);
+
+    if(thrd_equal(thread, thrd_current()))
+        return self_stats(stats);
+
+    // thrd_t is a pthread_t underneath, and this works for any thread.
+    clockid_t clock;
+    struct timespec cpu;
+    if(pthread_getcpuclockid((pthread_t)thread, &clock) != 0 || clock_gettime(clock, &cpu) != 0)
+        return thrd_error;
+    stats->cpu_ns = (int64_t)cpu.tv_sec * 1000000000 + cpu.tv_nsec;
+
+    long os_id = registered_os_id(thread);
+    if(os_id > 0)
+        proc_stats(stats, os_id);
+    return thrd_success;
+}
+
+#elif defined(_MSC_VER)
+
+static int64_t filetime_ns(FILETIME time) {
+    return ((int64_t)time.dwHighDateTime << 32 | time.dwLowDateTime) * 100;
+}
+
+int cp_thrd_stats(cp_thrd_stats_t* stats, thrd_t thread) {
+    if(!stats)
+        return thrd_error;
+    stats_unknown(stats);
+
+    FILETIME created, exited, kernel, user;
+    if(!GetThreadTimes(thread.handle, &created, &exited, &kernel, &user))
+        return thrd_error;
+    stats->user_ns = filetime_ns(user);
+    stats->system_ns = filetime_ns(kernel);
+    stats->cpu_ns = stats->user_ns + stats->system_ns;
+
+    if(GetThreadId(thread.handle) == GetCurrentThreadId())
+        stats->last_cpu = (int)GetCurrentProcessorNumber();
+    return thrd_success;
+}
+
+#else
+
+int cp_thrd_stats(cp_thrd_stats_t* stats, thrd_t thread) {
+    if(!stats)
+        return thrd_error;
+    stats_unknown(stats);
+
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec cpu;
+    if(thrd_equal(thread, thrd_current()) && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+        stats->cpu_ns = (int64_t)cpu.tv_sec * 1000000000 + cpu.tv_nsec;
+        return thrd_success;
+    }
+#endif
+    return thrd_error;
+}
+
+#endif
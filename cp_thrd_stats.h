@@ -0,0 +1,96 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_THRD_STATS_H
+#define CP_THREADS_CP_THRD_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpthreads.h"
+
+// ============================================================================
+// Thread Statistics
+// ============================================================================
+
+// CPU time and scheduling counters of single threads, to attribute cost to
+// workers without an external profiler, plus a registry of named threads to
+// enumerate them.
+//
+// Threads join the registry by calling cp_thrd_register from the thread
+// itself, or by being started with cp_thrd_create_named, and leave it when
+// they exit. Listing copies the registry under one mutex and touches
+// nothing else, so sampling every registered thread once a second costs
+// that plus one cp_thrd_stats call per thread.
+//
+// What's available depends on the platform. Fields that couldn't be read
+// are -1.
+//
+//   Linux: everything for the calling thread and registered threads. For
+//   other threads only cpu_ns, through pthread_getcpuclockid; the rest is
+//   read from /proc/self/task/<tid>, which needs the thread id.
+//
+//   Windows: user and system time for any thread, and the last CPU for the
+//   calling thread. Windows doesn't count context switches per thread.
+
+#define CP_THRD_NAME_SIZE 32
+
+typedef struct cp_thrd_stats_t {
+    // User plus system time, at the best resolution available.
+    int64_t cpu_ns;
+    int64_t user_ns;
+    int64_t system_ns;
+    int64_t voluntary_switches;
+    int64_t involuntary_switches;
+    // The CPU the thread last ran on.
+    int last_cpu;
+} cp_thrd_stats_t;
+
+typedef struct cp_thrd_info_t {
+    // Only valid while the thread is running.
+    thrd_t thread;
+    // The operating system's id for the thread.
+    long os_id;
+    char name[CP_THRD_NAME_SIZE];
+} cp_thrd_info_t;
+
+int cp_thrd_stats(cp_thrd_stats_t* stats, thrd_t thread);
+
+// Adds the calling thread to the registry, or renames it if it's already
+// there. Names longer than CP_THRD_NAME_SIZE - 1 are cut short. On Linux the
+// name is also given to the kernel, so tools like top show it.
+int cp_thrd_register(const char* name);
+
+// Removes the calling thread. Threads are removed when they exit anyway.
+void cp_thrd_unregister(void);
+
+// thrd_create, with the new thread registered under the name before func
+// runs.
+int cp_thrd_create_named(thrd_t* thr, thrd_start_t func, void* arg, const char* name);
+
+// Copies up to capacity registered threads into threads and returns how
+// many are registered, which can be more than capacity.
+size_t cp_thrd_list(cp_thrd_info_t* threads, size_t capacity);
+
+#endif
@@ -0,0 +1,362 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "cp_timer.h"
+
+#define WHEEL_MASK (CP_TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_RANGE (1ull << (CP_TIMER_WHEEL_BITS * CP_TIMER_WHEEL_LEVELS))
+
+enum {
+    DRIVER_STOPPED,
+    DRIVER_RUNNING,
+    DRIVER_IDLE,
+    DRIVER_STOPPING
+};
+
+static unsigned long long wheel_elapsed_ms(cp_timer_wheel_t* wheel) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    long long ms = (long long)(now.tv_sec - wheel->epoch.tv_sec) * 1000 + (now.tv_nsec - wheel->epoch.tv_nsec) / 1000000;
+    return ms < 0 ? 0 : (unsigned long long)ms;
+}
+
+static void wheel_unlink(cp_timer_t* timer) {
+    *timer->pprev = timer->next;
+    if(timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// Picks the level by how far away the deadline is, and the slot by the
+// deadline's bits at that level. A timer only moves down a level when the
+// slot it lives in is cascaded.
+static void wheel_link(cp_timer_wheel_t* wheel, cp_timer_t* timer) {
+    unsigned long long expires = timer->expires;
+    unsigned long long delta;
+    if(expires < wheel->current) {
+        expires = wheel->current;
+        delta = 0;
+    } else {
+        delta = expires - wheel->current;
+        if(delta >= WHEEL_RANGE) {
+            // Clamp deadlines past the top level. They get re-linked each
+            // time the top slot is cascaded until they come into range.
+            delta = WHEEL_RANGE - 1;
+            expires = wheel->current + delta;
+        }
+    }
+
+    int level = 0;
+    while(delta >= (1ull << (CP_TIMER_WHEEL_BITS * (level + 1))))
+        level++;
+
+    cp_timer_t** slot = &wheel->slots[level][(expires >> (CP_TIMER_WHEEL_BITS * level)) & WHEEL_MASK];
+    timer->next = *slot;
+    if(timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+static int wheel_cascade(cp_timer_wheel_t* wheel, int level) {
+    int index = (int)((wheel->current >> (CP_TIMER_WHEEL_BITS * level)) & WHEEL_MASK);
+    cp_timer_t* timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while(timer) {
+        cp_timer_t* next = timer->next;
+        wheel_link(wheel, timer);
+        timer = next;
+    }
+    return index;
+}
+
+static int wheel_push_expired(cp_timer_wheel_t* wheel, int count, cp_timer_t* timer) {
+    if(count == wheel->expired_cap) {
+        int cap = wheel->expired_cap == 0 ? 64 : wheel->expired_cap * 2;
+        void* buff = realloc(wheel->expired, sizeof(*wheel->expired) * cap);
+        if(!buff)
+            return 0;
+        wheel->expired = buff;
+        wheel->expired_cap = cap;
+    }
+    wheel->expired[count] = timer;
+    return 1;
+}
+
+static void wheel_default_dispatch(cp_timer_t** timers, int count, void* ctx) {
+    for(int i = 0; i < count; i++)
+        timers[i]->func(timers[i]->arg);
+}
+
+int cp_timer_wheel_init(cp_timer_wheel_t* wheel, unsigned tick_ms) {
+    if(!wheel || tick_ms == 0)
+        return thrd_error;
+
+    if(mtx_init(&wheel->lock, mtx_plain) != thrd_success)
+        return thrd_error;
+    if(cnd_init(&wheel->driver_cond) != thrd_success) {
+        mtx_destroy(&wheel->lock);
+        return thrd_error;
+    }
+
+    for(int level = 0; level < CP_TIMER_WHEEL_LEVELS; level++) {
+        for(int i = 0; i < CP_TIMER_WHEEL_SLOTS; i++)
+            wheel->slots[level][i] = NULL;
+    }
+    wheel->current = 0;
+    wheel->pending = 0;
+    wheel->tick_ms = tick_ms;
+    wheel->dispatch = wheel_default_dispatch;
+    wheel->dispatch_ctx = NULL;
+    wheel->expired = NULL;
+    wheel->expired_cap = 0;
+    wheel->driver_state = DRIVER_STOPPED;
+    timespec_get(&wheel->epoch, TIME_UTC);
+    return thrd_success;
+}
+
+void cp_timer_wheel_destroy(cp_timer_wheel_t* wheel) {
+    if(!wheel)
+        return;
+
+    cp_timer_wheel_stop(wheel);
+
+    // Leave any timers that never fired in a consistent, non-pending state.
+    for(int level = 0; level < CP_TIMER_WHEEL_LEVELS; level++) {
+        for(int i = 0; i < CP_TIMER_WHEEL_SLOTS; i++) {
+            while(wheel->slots[level][i])
+                wheel_unlink(wheel->slots[level][i]);
+        }
+    }
+
+    free(wheel->expired);
+    wheel->expired = NULL;
+    wheel->expired_cap = 0;
+    cnd_destroy(&wheel->driver_cond);
+    mtx_destroy(&wheel->lock);
+}
+
+int cp_timer_wheel_schedule(cp_timer_wheel_t* wheel, cp_timer_t* timer, unsigned long long ms, cp_timer_fn func, void* arg) {
+    if(!wheel || !timer || !func)
+        return thrd_error;
+
+    unsigned long long ticks = (ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if(ticks == 0)
+        ticks = 1;
+
+    mtx_lock(&wheel->lock);
+
+    // An idle driver stops ticking, so catch the wheel up to the clock
+    // before measuring the deadline from it. There are no timers to move.
+    if(wheel->driver_state == DRIVER_IDLE) {
+        unsigned long long now = wheel_elapsed_ms(wheel) / wheel->tick_ms;
+        if(now > wheel->current)
+            wheel->current = now;
+        wheel->driver_state = DRIVER_RUNNING;
+        cnd_signal(&wheel->driver_cond);
+    }
+
+    if(timer->pprev)
+        wheel_unlink(timer);
+    else
+        wheel->pending++;
+
+    timer->func = func;
+    timer->arg = arg;
+    // current is the next tick to be processed, so a one tick timer
+    // expires on that tick.
+    timer->expires = wheel->current + ticks - 1;
+    wheel_link(wheel, timer);
+
+    mtx_unlock(&wheel->lock);
+    return thrd_success;
+}
+
+int cp_timer_wheel_cancel(cp_timer_wheel_t* wheel, cp_timer_t* timer) {
+    if(!wheel || !timer)
+        return thrd_error;
+
+    mtx_lock(&wheel->lock);
+    if(!timer->pprev) {
+        mtx_unlock(&wheel->lock);
+        return thrd_error;
+    }
+    wheel_unlink(timer);
+    wheel->pending--;
+    mtx_unlock(&wheel->lock);
+    return thrd_success;
+}
+
+int cp_timer_wheel_advance(cp_timer_wheel_t* wheel, unsigned long long ticks) {
+    if(!wheel)
+        return -1;
+
+    int count = 0;
+    mtx_lock(&wheel->lock);
+
+    while(ticks > 0) {
+        // Nothing to expire or cascade, so skip the rest in one step.
+        if(wheel->pending == 0) {
+            wheel->current += ticks;
+            break;
+        }
+
+        int index = (int)(wheel->current & WHEEL_MASK);
+        if(index == 0) {
+            for(int level = 1; level < CP_TIMER_WHEEL_LEVELS; level++) {
+                if(wheel_cascade(wheel, level) != 0)
+                    break;
+            }
+        }
+
+        cp_timer_t* timer = wheel->slots[0][index];
+        while(timer) {
+            cp_timer_t* next = timer->next;
+            if(!wheel_push_expired(wheel, count, timer))
+                break;
+            wheel_unlink(timer);
+            wheel->pending--;
+            count++;
+            timer = next;
+        }
+
+        // Out of memory for the batch. Whatever is left in the slot
+        // is dispatched by the next advance.
+        if(timer)
+            break;
+
+        wheel->current++;
+        ticks--;
+    }
+
+    cp_timer_batch_fn dispatch = wheel->dispatch;
+    void* ctx = wheel->dispatch_ctx;
+    mtx_unlock(&wheel->lock);
+
+    // Only one thread advances the wheel, so the batch buffer is safe to
+    // read without the lock.
+    if(count > 0)
+        dispatch(wheel->expired, count, ctx);
+    return count;
+}
+
+void cp_timer_wheel_set_dispatch(cp_timer_wheel_t* wheel, cp_timer_batch_fn dispatch, void* ctx) {
+    if(!wheel)
+        return;
+
+    mtx_lock(&wheel->lock);
+    wheel->dispatch = dispatch ? dispatch : wheel_default_dispatch;
+    wheel->dispatch_ctx = dispatch ? ctx : NULL;
+    mtx_unlock(&wheel->lock);
+}
+
+static int wheel_driver(void* arg) {
+    cp_timer_wheel_t* wheel = arg;
+
+    mtx_lock(&wheel->lock);
+    while(wheel->driver_state != DRIVER_STOPPING) {
+        if(wheel->pending == 0) {
+            wheel->driver_state = DRIVER_IDLE;
+            while(wheel->driver_state == DRIVER_IDLE)
+                cnd_wait(&wheel->driver_cond, &wheel->lock);
+            continue;
+        }
+
+        // Sleep until the start of the next tick relative to the epoch,
+        // so time spent dispatching doesn't make the wheel drift.
+        unsigned long long wake_ms = (wheel->current + 1) * wheel->tick_ms;
+        struct timespec wake = wheel->epoch;
+        wake.tv_sec += (time_t)(wake_ms / 1000);
+        wake.tv_nsec += (long)(wake_ms % 1000) * 1000000L;
+        if(wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        cnd_timedwait(&wheel->driver_cond, &wheel->lock, &wake);
+        if(wheel->driver_state == DRIVER_STOPPING)
+            break;
+
+        // Only process the ticks that are completely over.
+        unsigned long long now = wheel_elapsed_ms(wheel) / wheel->tick_ms;
+        if(now <= wheel->current)
+            continue;
+        unsigned long long ticks = now - wheel->current;
+
+        mtx_unlock(&wheel->lock);
+        cp_timer_wheel_advance(wheel, ticks);
+        mtx_lock(&wheel->lock);
+    }
+    mtx_unlock(&wheel->lock);
+    return 0;
+}
+
+int cp_timer_wheel_start(cp_timer_wheel_t* wheel) {
+    if(!wheel)
+        return thrd_error;
+
+    mtx_lock(&wheel->lock);
+    if(wheel->driver_state != DRIVER_STOPPED) {
+        mtx_unlock(&wheel->lock);
+        return thrd_busy;
+    }
+
+    // Line the wheel up with the clock the driver is going to follow.
+    unsigned long long now = wheel_elapsed_ms(wheel) / wheel->tick_ms;
+    if(now > wheel->current) {
+        mtx_unlock(&wheel->lock);
+        cp_timer_wheel_advance(wheel, now - wheel->current);
+        mtx_lock(&wheel->lock);
+    }
+
+    wheel->driver_state = DRIVER_RUNNING;
+    int result = thrd_create(&wheel->driver, wheel_driver, wheel);
+    if(result != thrd_success)
+        wheel->driver_state = DRIVER_STOPPED;
+    mtx_unlock(&wheel->lock);
+    return result;
+}
+
+int cp_timer_wheel_stop(cp_timer_wheel_t* wheel) {
+    if(!wheel)
+        return thrd_error;
+
+    mtx_lock(&wheel->lock);
+    if(wheel->driver_state == DRIVER_STOPPED || wheel->driver_state == DRIVER_STOPPING) {
+        mtx_unlock(&wheel->lock);
+        return thrd_success;
+    }
+    wheel->driver_state = DRIVER_STOPPING;
+    cnd_signal(&wheel->driver_cond);
+    mtx_unlock(&wheel->lock);
+
+    int result = thrd_join(wheel->driver, NULL);
+
+    mtx_lock(&wheel->lock);
+    wheel->driver_state = DRIVER_STOPPED;
+    mtx_unlock(&wheel->lock);
+    return result;
+}
@@ -0,0 +1,111 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_TIMER_H
+#define CP_THREADS_CP_TIMER_H
+
+#include "cpthreads.h"
+
+// ============================================================================
+// Timer Wheel
+// ============================================================================
+
+// A hierarchical timing wheel for large numbers of timeouts that are
+// usually cancelled before they fire. Scheduling and cancelling a timer are
+// O(1) and don't park a thread or create a kernel timer.
+//
+// The wheel is driven either by its own driver thread (cp_timer_wheel_start)
+// or by any external tick source calling cp_timer_wheel_advance. Only one
+// thread may advance the wheel at a time. Scheduling and cancelling are safe
+// from any thread, including from inside a timer callback.
+//
+// Expired timers are collected while holding the wheel lock and dispatched
+// as a batch after the lock is released.
+
+#define CP_TIMER_WHEEL_BITS 6
+#define CP_TIMER_WHEEL_SLOTS (1 << CP_TIMER_WHEEL_BITS)
+#define CP_TIMER_WHEEL_LEVELS 5
+
+typedef void (*cp_timer_fn)(void* arg);
+
+// The memory is owned by the caller and must stay valid until the timer
+// fires or is cancelled. A zeroed timer is not pending.
+typedef struct cp_timer_t {
+    struct cp_timer_t* next;
+    struct cp_timer_t** pprev;
+    unsigned long long expires;
+    cp_timer_fn func;
+    void* arg;
+} cp_timer_t;
+
+// Receives every timer that expired during one advance. The default
+// dispatcher calls each timer's function in expiry order.
+typedef void (*cp_timer_batch_fn)(cp_timer_t** timers, int count, void* ctx);
+
+typedef struct cp_timer_wheel_t {
+    mtx_t lock;
+    cnd_t driver_cond;
+    cp_timer_t* slots[CP_TIMER_WHEEL_LEVELS][CP_TIMER_WHEEL_SLOTS];
+    // The next tick to be processed.
+    unsigned long long current;
+    unsigned long long pending;
+    unsigned tick_ms;
+    cp_timer_batch_fn dispatch;
+    void* dispatch_ctx;
+    cp_timer_t** expired;
+    int expired_cap;
+    struct timespec epoch;
+    thrd_t driver;
+    int driver_state;
+} cp_timer_wheel_t;
+
+int cp_timer_wheel_init(cp_timer_wheel_t* wheel, unsigned tick_ms);
+void cp_timer_wheel_destroy(cp_timer_wheel_t* wheel);
+
+// Fires the timer once ms milliseconds, rounded up to whole ticks, have been
+// advanced. The tick in progress counts as the first one, so with the driver
+// thread a timer can fire up to one tick early.
+// Scheduling a pending timer moves it to the new deadline.
+int cp_timer_wheel_schedule(cp_timer_wheel_t* wheel, cp_timer_t* timer, unsigned long long ms, cp_timer_fn func, void* arg);
+
+// Returns thrd_error if the timer wasn't pending, which means it already
+// fired or is about to be dispatched.
+int cp_timer_wheel_cancel(cp_timer_wheel_t* wheel, cp_timer_t* timer);
+
+// Moves the wheel forward by the given number of ticks and dispatches every
+// timer that expired. Returns the number of timers dispatched.
+int cp_timer_wheel_advance(cp_timer_wheel_t* wheel, unsigned long long ticks);
+
+void cp_timer_wheel_set_dispatch(cp_timer_wheel_t* wheel, cp_timer_batch_fn dispatch, void* ctx);
+
+// Starts a thread that advances the wheel once every tick_ms.
+// While no timers are pending the driver sleeps until one is scheduled.
+int cp_timer_wheel_start(cp_timer_wheel_t* wheel);
+int cp_timer_wheel_stop(cp_timer_wheel_t* wheel);
+
+static __inline int cp_timer_pending(const cp_timer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+#endif
@@ -0,0 +1,426 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define CP_TRACE_IMPLEMENTATION
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cp_trace.h"
+#include "cp_atomic.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_DEFAULT_EVENTS 65536
+#define TRACE_NAME_SIZE 32
+
+// Calibrating the counter against the clock needs a little time between
+// the two readings to be accurate.
+#define TRACE_CALIBRATION_NS 10000000
+
+enum {
+    trace_thread_start,
+    trace_thread_exit,
+    trace_thread_create,
+    trace_mutex_wait,
+    trace_mutex_acquired,
+    trace_cond_wait,
+    trace_cond_wake,
+    trace_sleep,
+    trace_sleep_end
+};
+
+// How each event type shows up in the exported JSON. Waits are begin/end
+// pairs so they draw as spans.
+static const struct {
+    const char* name;
+    const char* phase;
+    const char* object;
+} trace_kinds[] = {
+    { "thrd_start", "i", NULL },
+    { "thrd_exit", "i", NULL },
+    { "thrd_create", "i", NULL },
+    { "mtx_lock", "B", "mutex" },
+    { "mtx_lock", "E", "mutex" },
+    { "cnd_wait", "B", "cond" },
+    { "cnd_wait", "E", "cond" },
+    { "thrd_sleep", "B", NULL },
+    { "thrd_sleep", "E", NULL }
+};
+
+typedef struct trace_event {
+    uint64_t ticks;
+    const void* object;
+    int32_t type;
+    int32_t result;
+} trace_event;
+
+// Only the owning thread writes events and head; head is published after
+// the event so an exporter never reads a half written one that it thinks
+// is complete.
+typedef struct trace_buffer {
+    struct trace_buffer* next;
+    cp_atomic64 head;
+    uint64_t mask;
+    int tid;
+    char name[TRACE_NAME_SIZE];
+    trace_event events[];
+} trace_buffer;
+
+static once_flag trace_once = ONCE_FLAG_INIT;
+static mtx_t trace_lock;
+static cp_atomic32 trace_on;
+// Bumped by cp_trace_clear so threads drop their pointers to freed buffers.
+static cp_atomic32 trace_generation;
+static trace_buffer* trace_buffers;
+static uint64_t trace_capacity;
+static int trace_next_tid;
+static uint64_t trace_start_ticks;
+static int64_t trace_start_ns;
+
+static thread_local trace_buffer* local_buffer;
+static thread_local int32_t local_generation;
+static thread_local char local_name[TRACE_NAME_SIZE];
+
+static __inline uint64_t trace_ticks(void) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static int64_t trace_now_ns(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void trace_init(void) {
+    mtx_init(&trace_lock, mtx_plain);
+}
+
+static trace_buffer* buffer_create(void) {
+    trace_buffer* buffer = malloc(sizeof(*buffer) + sizeof(trace_event) * trace_capacity);
+    if(!buffer)
+        return NULL;
+
+    buffer->head = 0;
+    buffer->mask = trace_capacity - 1;
+    memcpy(buffer->name, local_name, TRACE_NAME_SIZE);
+
+    mtx_lock(&trace_lock);
+    buffer->tid = ++trace_next_tid;
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+    mtx_unlock(&trace_lock);
+    return buffer;
+}
+
+static trace_buffer* buffer_get(void) {
+    int32_t generation = cp_atomic_load32(&trace_generation);
+    if(local_buffer && local_generation == generation)
+        return local_buffer;
+
+    local_buffer = buffer_create();
+    local_generation = generation;
+    return local_buffer;
+}
+
+static void trace_record(int32_t type, const void* object, int32_t result) {
+    trace_buffer* buffer = buffer_get();
+    if(!buffer)
+        return;
+
+    uint64_t head = (uint64_t)cp_atomic_load64(&buffer->head);
+    trace_event* event = buffer->events + (head & buffer->mask);
+    event->ticks = trace_ticks();
+    event->object = object;
+    event->type = type;
+    event->result = result;
+    // Only this thread writes head, so publishing needs no locked instruction.
+    cp_atomic_store_plain64(&buffer->head, (int64_t)(head + 1));
+}
+
+static __inline int trace_enabled(void) {
+    return cp_atomic_load32(&trace_on);
+}
+
+// ============================================================================
+// Control
+// ============================================================================
+
+int cp_trace_start(size_t events_per_thread) {
+    call_once(&trace_once, trace_init);
+
+    mtx_lock(&trace_lock);
+    if(cp_atomic_load32(&trace_on)) {
+        mtx_unlock(&trace_lock);
+        return thrd_error;
+    }
+
+    // Buffers already handed out keep their size, the capacity is only
+    // changed once nobody holds one.
+    if(!trace_buffers || !trace_capacity) {
+        uint64_t capacity = 1;
+        if(!events_per_thread)
+            events_per_thread = TRACE_DEFAULT_EVENTS;
+        while(capacity < events_per_thread)
+            capacity <<= 1;
+        trace_capacity = capacity;
+    }
+    if(!trace_start_ns) {
+        trace_start_ticks = trace_ticks();
+        trace_start_ns = trace_now_ns();
+    }
+    cp_atomic_store32(&trace_on, 1);
+    mtx_unlock(&trace_lock);
+    return thrd_success;
+}
+
+void cp_trace_stop(void) {
+    cp_atomic_store32(&trace_on, 0);
+}
+
+void cp_trace_clear(void) {
+    call_once(&trace_once, trace_init);
+
+    mtx_lock(&trace_lock);
+    trace_buffer* buffer = trace_buffers;
+    trace_buffers = NULL;
+    trace_next_tid = 0;
+    trace_start_ns = 0;
+    cp_atomic_fetch_add32(&trace_generation, 1);
+    mtx_unlock(&trace_lock);
+
+    while(buffer) {
+        trace_buffer* next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+}
+
+void cp_trace_set_thread_name(const char* name) {
+    if(!name)
+        name = "";
+    strncpy(local_name, name, TRACE_NAME_SIZE - 1);
+    local_name[TRACE_NAME_SIZE - 1] = 0;
+
+    // A buffer created before the name was set is renamed under the lock,
+    // since an export may be reading it.
+    int32_t generation = cp_atomic_load32(&trace_generation);
+    if(local_buffer && local_generation == generation) {
+        mtx_lock(&trace_lock);
+        memcpy(local_buffer->name, local_name, TRACE_NAME_SIZE);
+        mtx_unlock(&trace_lock);
+    }
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+static void export_name(FILE* out, const char* name) {
+    for(; *name; name++) {
+        if(*name == '"' || *name == '\\')
+            fputc('\\', out);
+        if((unsigned char)*name >= 0x20)
+            fputc(*name, out);
+    }
+}
+
+static int export_buffer(FILE* out, trace_buffer* buffer, double ns_per_tick, int first) {
+    fprintf(out, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",", buffer->tid);
+    if(buffer->name[0])
+        export_name(out, buffer->name);
+    else
+        fprintf(out, "thread %d", buffer->tid);
+    fprintf(out, "\"}}");
+
+    uint64_t head = (uint64_t)cp_atomic_load64(&buffer->head);
+    uint64_t capacity = buffer->mask + 1;
+    uint64_t start = head > capacity ? head - capacity : 0;
+
+    for(uint64_t i = start; i < head; i++) {
+        trace_event event = buffer->events[i & buffer->mask];
+        double us = (double)(int64_t)(event.ticks - trace_start_ticks) * ns_per_tick / 1000.0;
+        const char* name = trace_kinds[event.type].name;
+        const char* phase = trace_kinds[event.type].phase;
+        const char* object = trace_kinds[event.type].object;
+
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", name, phase, us, buffer->tid);
+        if(phase[0] == 'i')
+            fprintf(out, ",\"s\":\"t\"");
+        fprintf(out, ",\"args\":{");
+        if(object)
+            fprintf(out, "\"%s\":\"%p\",", object, event.object);
+        fprintf(out, "\"result\":%d}}", (int)event.result);
+    }
+
+    return ferror(out) ? thrd_error : thrd_success;
+}
+
+int cp_trace_export_chrome(FILE* out) {
+    if(!out)
+        return thrd_error;
+    call_once(&trace_once, trace_init);
+
+    mtx_lock(&trace_lock);
+    int64_t elapsed = trace_now_ns() - trace_start_ns;
+    if(trace_start_ns && elapsed < TRACE_CALIBRATION_NS) {
+        mtx_unlock(&trace_lock);
+        struct timespec wait = { 0, (long)(TRACE_CALIBRATION_NS - elapsed) };
+        thrd_sleep(&wait, NULL);
+        mtx_lock(&trace_lock);
+    }
+
+    uint64_t ticks = trace_ticks();
+    elapsed = trace_now_ns() - trace_start_ns;
+    double ns_per_tick = 1.0;
+    if(trace_start_ns && ticks > trace_start_ticks && elapsed > 0)
+        ns_per_tick = (double)elapsed / (double)(ticks - trace_start_ticks);
+
+    int result = thrd_success;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    int first = 1;
+    for(trace_buffer* buffer = trace_buffers; buffer && result == thrd_success; buffer = buffer->next) {
+        result = export_buffer(out, buffer, ns_per_tick, first);
+        first = 0;
+    }
+    fprintf(out, "\n]}\n");
+    mtx_unlock(&trace_lock);
+
+    if(fflush(out) != 0)
+        return thrd_error;
+    return result;
+}
+
+// ============================================================================
+// Wrappers
+// ============================================================================
+
+typedef struct trace_start_state {
+    thrd_start_t func;
+    void* arg;
+} trace_start_state;
+
+static int trace_thread_main(void* arg) {
+    trace_start_state state = *(trace_start_state*)arg;
+    free(arg);
+
+    if(trace_enabled())
+        trace_record(trace_thread_start, NULL, 0);
+    int result = state.func(state.arg);
+    if(trace_enabled())
+        trace_record(trace_thread_exit, NULL, result);
+    return result;
+}
+
+int cp_trace_thrd_create(thrd_t* thr, thrd_start_t func, void* arg) {
+    trace_start_state* state = malloc(sizeof(*state));
+    if(!state)
+        return thrd_nomem;
+    state->func = func;
+    state->arg = arg;
+
+    if(trace_enabled())
+        trace_record(trace_thread_create, NULL, 0);
+    int result = thrd_create(thr, trace_thread_main, state);
+    if(result != thrd_success)
+        free(state);
+    return result;
+}
+
+void cp_trace_thrd_exit(int res) {
+    if(trace_enabled())
+        trace_record(trace_thread_exit, NULL, res);
+    thrd_exit(res);
+}
+
+int cp_trace_thrd_sleep(const struct timespec* duration, struct timespec* remaining) {
+    if(!trace_enabled())
+        return thrd_sleep(duration, remaining);
+
+    trace_record(trace_sleep, NULL, 0);
+    int result = thrd_sleep(duration, remaining);
+    trace_record(trace_sleep_end, NULL, result);
+    return result;
+}
+
+int cp_trace_mtx_lock(mtx_t* mutex) {
+    if(!trace_enabled())
+        return mtx_lock(mutex);
+    if(mtx_trylock(mutex) == thrd_success)
+        return thrd_success;
+
+    trace_record(trace_mutex_wait, mutex, 0);
+    int result = mtx_lock(mutex);
+    trace_record(trace_mutex_acquired, mutex, result);
+    return result;
+}
+
+int cp_trace_mtx_timedlock(mtx_t* mutex, const struct timespec* time_point) {
+    if(!trace_enabled())
+        return mtx_timedlock(mutex, time_point);
+    if(mtx_trylock(mutex) == thrd_success)
+        return thrd_success;
+
+    trace_record(trace_mutex_wait, mutex, 0);
+    int result = mtx_timedlock(mutex, time_point);
+    trace_record(trace_mutex_acquired, mutex, result);
+    return result;
+}
+
+int cp_trace_cnd_wait(cnd_t* cond, mtx_t* mutex) {
+    if(!trace_enabled())
+        return cnd_wait(cond, mutex);
+
+    trace_record(trace_cond_wait, cond, 0);
+    int result = cnd_wait(cond, mutex);
+    trace_record(trace_cond_wake, cond, result);
+    return result;
+}
+
+int cp_trace_cnd_timedwait(cnd_t* cond, mtx_t* mutex, const struct timespec* time_point) {
+    if(!trace_enabled())
+        return cnd_timedwait(cond, mutex, time_point);
+
+    trace_record(trace_cond_wait, cond, 0);
+    int result = cnd_timedwait(cond, mutex, time_point);
+    trace_record(trace_cond_wake, cond, result);
+    return result;
+}
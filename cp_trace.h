@@ -0,0 +1,107 @@
+/*
+    MIT License
+
+    Copyright (c) 2019 Precisamento
+    
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef CP_THREADS_CP_TRACE_H
+#define CP_THREADS_CP_TRACE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "cpthreads.h"
+
+// ============================================================================
+// Tracing
+// ============================================================================
+
+// Records which thread waited on which mutex or condition variable, and for
+// how long, so latency spikes can be looked at on a timeline.
+//
+// Compiling with CP_TRACE defined (or configuring meson with -Dtrace=true)
+// routes thrd_create, thrd_exit, thrd_sleep, mtx_lock, mtx_timedlock,
+// cnd_wait and cnd_timedwait through the wrappers below. Nothing is recorded
+// until cp_trace_start is called; until then each wrapper costs one load.
+//
+// Every thread records into its own ring buffer, so an event is a timestamp
+// counter read and a few stores with no synchronization. When a buffer is
+// full the oldest events are overwritten. Locks only show up when they are
+// contended: a wrapper first tries the lock and only records a wait if that
+// fails.
+//
+// cp_trace_export_chrome writes everything recorded so far as Chrome trace
+// event JSON, which chrome://tracing and Perfetto can open.
+//
+// Buffers of threads that exited are kept, so their events can still be
+// exported, until cp_trace_clear.
+
+// Enables recording, with room for the given number of events per thread,
+// rounded up to a power of two. 0 picks a default of 64k. Returns thrd_error
+// if tracing is already running.
+int cp_trace_start(size_t events_per_thread);
+
+// Disables recording. What was recorded stays available for export.
+void cp_trace_stop(void);
+
+// Frees every buffer. Must only be called while stopped and once no thread
+// can still be in the middle of recording an event.
+void cp_trace_clear(void);
+
+// Writes the recorded events of every thread, including ones that exited.
+// Best called while stopped; events recorded during the export may be missed.
+int cp_trace_export_chrome(FILE* out);
+
+// Names the calling thread on the timeline. Only the first 31 bytes are kept.
+void cp_trace_set_thread_name(const char* name);
+
+#if defined(_MSC_VER)
+#define ___CP_TRACE_NORETURN __declspec(noreturn)
+#else
+#define ___CP_TRACE_NORETURN _Noreturn
+#endif
+
+int cp_trace_thrd_create(thrd_t* thr, thrd_start_t func, void* arg);
+___CP_TRACE_NORETURN void cp_trace_thrd_exit(int res);
+int cp_trace_thrd_sleep(const struct timespec* duration, struct timespec* remaining);
+int cp_trace_mtx_lock(mtx_t* mutex);
+int cp_trace_mtx_timedlock(mtx_t* mutex, const struct timespec* time_point);
+int cp_trace_cnd_wait(cnd_t* cond, mtx_t* mutex);
+int cp_trace_cnd_timedwait(cnd_t* cond, mtx_t* mutex, const struct timespec* time_point);
+
+#if defined(CP_TRACE) && !defined(CP_TRACE_IMPLEMENTATION)
+
+#define thrd_create(thr, func, arg) cp_trace_thrd_create(thr, func, arg)
+#define thrd_exit(res) cp_trace_thrd_exit(res)
+#define thrd_sleep(duration, remaining) cp_trace_thrd_sleep(duration, remaining)
+#define mtx_lock(mutex) cp_trace_mtx_lock(mutex)
+#define mtx_timedlock(mutex, time_point) cp_trace_mtx_timedlock(mutex, time_point)
+#define cnd_wait(cond, mutex) cp_trace_cnd_wait(cond, mutex)
+#define cnd_timedwait(cond, mutex, time_point) cp_trace_cnd_timedwait(cond, mutex, time_point)
+
+// The typed fast paths would bypass the wrappers, so they go through them too.
+#define cp_mtx_plain_lock(mutex) cp_trace_mtx_lock(mutex)
+#define cp_mtx_recursive_lock(mutex) cp_trace_mtx_lock(mutex)
+
+#endif
+
+#endif
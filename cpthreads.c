@@ -24,8 +24,13 @@
 
 #ifdef _MSC_VER
 
+// The functions below are the ones tracing wraps.
+#define CP_TRACE_IMPLEMENTATION
+
 #include "cpthreads.h"
 
+#include <string.h>
+
 // Variables for Thread Specific Storage
 static tss_dtor_t* destructor_stack = NULL;
 static int destructor_stack_count = 0;
@@ -53,6 +58,20 @@ static void timespec_subtract(const struct timespec* left, const struct timespec
     *result = temp;
 }
 
+// Milliseconds from now until the absolute TIME_UTC deadline, rounded up so
+// a wait doesn't end early. A deadline that has passed gives 0, which still
+// makes one attempt.
+static DWORD timespec_ms_until(const struct timespec* time_point) {
+    struct timespec remaining;
+    timespec_get(&remaining, TIME_UTC);
+    timespec_subtract(time_point, &remaining, &remaining);
+
+    if(remaining.tv_sec < 0)
+        return 0;
+    long long ms = (long long)remaining.tv_sec * 1000 + (remaining.tv_nsec + 999999) / 1000000;
+    return ms >= INFINITE ? INFINITE - 1 : (DWORD)ms;
+}
+
 struct ___cp_thrd_state {
     thrd_start_t func;
     void* arg;
@@ -164,6 +183,9 @@ int mtx_init(mtx_t* mutex, int type) {
                 mutex->type = 0;
                 return thrd_error;
             }
+            mutex->handoff_head = NULL;
+            mutex->handoff_tail = NULL;
+            InitializeSRWLock(&mutex->handoff_lock);
             break;
         case mtx_plain | mtx_recursive:
             InitializeCriticalSection(&mutex->section);
@@ -187,11 +209,9 @@ int mtx_lock(mtx_t* mutex) {
 
     switch(mutex->type) {
         case mtx_plain:
-            AcquireSRWLockExclusive(&mutex->lock);
-            break;
+            return cp_mtx_plain_lock(mutex);
         case mtx_plain | mtx_recursive:
-            EnterCriticalSection(&mutex->section);
-            break;
+            return cp_mtx_recursive_lock(mutex);
         case mtx_timed:
         case mtx_timed | mtx_recursive:
             if(!mutex->handle)
@@ -212,14 +232,7 @@ int mtx_timedlock(mtx_t* mutex, const struct timespec* time_point) {
     if(!mutex || (mutex->type & mtx_timed) != mtx_timed || !mutex->handle)
         return thrd_error;
 
-    struct timespec current;
-    timespec_get(&current, TIME_UTC);
-    timespec_subtract(&current, time_point, &current);
-
-    if(current.tv_sec < 0)
-        return thrd_timedout;
-
-    DWORD ms = (DWORD) (current.tv_sec * 1000 + current.tv_nsec / 1000000);
+    DWORD ms = timespec_ms_until(time_point);
     switch(WaitForSingleObject(mutex->handle, ms)) {
         case WAIT_ABANDONED:
         case WAIT_OBJECT_0:
@@ -237,13 +250,9 @@ int mtx_trylock(mtx_t* mutex) {
 
     switch(mutex->type) {
         case mtx_plain:
-            if(!TryAcquireSRWLockExclusive(&mutex->lock))
-                return thrd_busy;
-            break;
+            return cp_mtx_plain_trylock(mutex);
         case mtx_plain | mtx_recursive:
-            if(!TryEnterCriticalSection(&mutex->section))
-                return thrd_busy;
-            break;
+            return cp_mtx_recursive_trylock(mutex);
         case mtx_timed:
         case mtx_timed | mtx_recursive:
             if(!mutex->handle)
@@ -262,21 +271,57 @@ int mtx_trylock(mtx_t* mutex) {
     return thrd_success;
 }
 
+// A waiter on a semaphore based condition. It lives on the waiting thread's
+// stack, and its state says who last released its semaphore.
+struct ___cp_cnd_waiter {
+    HANDLE semaphore;
+    mtx_t* mutex;
+    struct ___cp_cnd_waiter* next;
+    int state;
+};
+
+enum {
+    CONDITION_WAITER_QUEUED,   // On the condition
+    CONDITION_WAITER_SIGNALED, // Woken, has to lock the mutex itself
+    CONDITION_WAITER_MORPHED,  // Moved onto the mutex by cnd_broadcast
+    CONDITION_WAITER_OWNER     // Handed the mutex by whoever unlocked it
+};
+
+// Unlocks an mtx_timed mutex. If cnd_broadcast moved waiters onto it, the
+// first one is woken already owning the mutex, so the semaphore is never
+// released for other threads to race it for.
+static BOOL timed_mutex_release(mtx_t* mutex) {
+    AcquireSRWLockExclusive(&mutex->handoff_lock);
+    struct ___cp_cnd_waiter* waiter = mutex->handoff_head;
+    if(!waiter) {
+        // Released with the lock held, so a broadcast that finds the queue
+        // empty afterwards will also find the mutex free.
+        BOOL result = ReleaseSemaphore(mutex->handle, 1, NULL);
+        ReleaseSRWLockExclusive(&mutex->handoff_lock);
+        return result;
+    }
+
+    mutex->handoff_head = waiter->next;
+    if(!mutex->handoff_head)
+        mutex->handoff_tail = NULL;
+    waiter->state = CONDITION_WAITER_OWNER;
+    ReleaseSRWLockExclusive(&mutex->handoff_lock);
+    return ReleaseSemaphore(waiter->semaphore, 1, NULL);
+}
+
 int mtx_unlock(mtx_t* mutex) {
     if(!mutex)
         return thrd_error;
 
     switch(mutex->type) {
         case mtx_plain:
-            ReleaseSRWLockExclusive(&mutex->lock);
-            break;
+            return cp_mtx_plain_unlock(mutex);
         case mtx_plain | mtx_recursive:
-            LeaveCriticalSection(&mutex->section);
-            break;
+            return cp_mtx_recursive_unlock(mutex);
         case mtx_timed:
             if(!mutex->handle)
                 return thrd_error;
-            if(!ReleaseSemaphore(mutex->handle, 1, NULL))
+            if(!timed_mutex_release(mutex))
                 return thrd_error;
             break;
         case mtx_timed | mtx_recursive:
@@ -321,7 +366,7 @@ int cnd_init(cnd_t* cond) {
         return thrd_error;
     InitializeCriticalSection(&cond->queue_lock);
     InitializeConditionVariable(&cond->variable);
-    cond->handles = NULL;
+    cond->waiters = NULL;
     cond->queue = 0;
     cond->shift = CONDITION_NO_WAITERS;
     cond->handle_count = 0;
@@ -339,16 +384,45 @@ int cnd_signal(cnd_t* cond) {
     if(cond->shift == CONDITION_NO_WAITERS)
         goto end;
 
-    if((cond->queue & (1 << cond->shift--)) == CONDITION_USE_VARIABLE)
+    if((cond->queue & (1ull << cond->shift--)) == CONDITION_USE_VARIABLE)
         WakeConditionVariable(&cond->variable);
-    else
-        result = ReleaseSemaphore(cond->handles[--cond->handle_count], 1, NULL);
+    else {
+        struct ___cp_cnd_waiter* waiter = cond->waiters[--cond->handle_count];
+        waiter->state = CONDITION_WAITER_SIGNALED;
+        result = ReleaseSemaphore(waiter->semaphore, 1, NULL);
+    }
 
     end:
         LeaveCriticalSection(&cond->queue_lock);
         return result ? thrd_success : thrd_error;
 }
 
+// Moves every semaphore waiter onto their mtx_timed mutex without waking
+// them (wait morphing). Each unlock of the mutex then wakes exactly one of
+// them, already owning it, instead of all of them waking at once and all but
+// one going straight back to sleep on the mutex.
+static BOOL cnd_morph(cnd_t* cond, mtx_t* mutex) {
+    for(int i = 0; i < cond->handle_count; i++) {
+        cond->waiters[i]->state = CONDITION_WAITER_MORPHED;
+        cond->waiters[i]->next = i + 1 < cond->handle_count ? cond->waiters[i + 1] : NULL;
+    }
+
+    AcquireSRWLockExclusive(&mutex->handoff_lock);
+    if(mutex->handoff_tail)
+        mutex->handoff_tail->next = cond->waiters[0];
+    else
+        mutex->handoff_head = cond->waiters[0];
+    mutex->handoff_tail = cond->waiters[cond->handle_count - 1];
+    ReleaseSRWLockExclusive(&mutex->handoff_lock);
+    cond->handle_count = 0;
+
+    // If nobody holds the mutex there's no unlock coming to hand it over,
+    // so take it and hand it to the first waiter here.
+    if(WaitForSingleObject(mutex->handle, 0) == WAIT_OBJECT_0)
+        return timed_mutex_release(mutex);
+    return TRUE;
+}
+
 int cnd_broadcast(cnd_t* cond) {
     if(!cond)
         return thrd_error;
@@ -361,12 +435,17 @@ int cnd_broadcast(cnd_t* cond) {
 
     WakeAllConditionVariable(&cond->variable);
 
-    if(cond->handle_count > 0) {
-        BOOLEAN success = TRUE;
-        while(cond->handle_count > 0) {
-            if(!ReleaseSemaphore(cond->handles[--cond->handle_count], 1, NULL) && result)
-                result = FALSE;
-        }
+    // Every thread waiting on a condition at once has to use the same mutex.
+    if(cond->handle_count > 0 && cond->waiters[0]->mutex->type == mtx_timed)
+        result = cnd_morph(cond, cond->waiters[0]->mutex);
+
+    // Recursive timed mutexes belong to the thread that locked them, so they
+    // can't be handed over and their waiters lock them after waking.
+    while(cond->handle_count > 0) {
+        struct ___cp_cnd_waiter* waiter = cond->waiters[--cond->handle_count];
+        waiter->state = CONDITION_WAITER_SIGNALED;
+        if(!ReleaseSemaphore(waiter->semaphore, 1, NULL))
+            result = FALSE;
     }
 
     cond->shift = CONDITION_NO_WAITERS;
@@ -376,6 +455,37 @@ int cnd_broadcast(cnd_t* cond) {
         return result ? thrd_success : thrd_error;
 }
 
+// Removes a waiter that timed out from the queue. Semaphore waiters are
+// pushed onto the array and the queue together, so the waiter at index i
+// owns the i-th set bit.
+static void cnd_unlink(cnd_t* cond, struct ___cp_cnd_waiter* waiter) {
+    int index = 0;
+    while(cond->waiters[index] != waiter)
+        index++;
+
+    int bit = -1;
+    for(int seen = -1; seen < index;) {
+        if(cond->queue & (1ull << ++bit))
+            seen++;
+    }
+
+    memmove(cond->waiters + index,
+            cond->waiters + index + 1,
+            sizeof(*cond->waiters) * (cond->handle_count - index - 1));
+    cond->handle_count--;
+
+    unsigned long long below = cond->queue & ((1ull << bit) - 1);
+    unsigned long long above = bit == 63 ? 0 : (cond->queue >> (bit + 1)) << bit;
+    cond->queue = below | above;
+    cond->shift--;
+}
+
+static int cnd_sleep_result(BOOL woken) {
+    if(woken)
+        return thrd_success;
+    return GetLastError() == ERROR_TIMEOUT ? thrd_timedout : thrd_error;
+}
+
 static int cnd_wait_ms(cnd_t* cond, mtx_t* mutex, DWORD ms) {
     if(!cond || !mutex)
         return thrd_error;
@@ -386,17 +496,17 @@ static int cnd_wait_ms(cnd_t* cond, mtx_t* mutex, DWORD ms) {
         return thrd_error;
     }
 
-    cond->shift++;
-
     switch(mutex->type) {
         case mtx_plain:
+            cond->shift++;
             cond->queue &= ~(1ull << cond->shift);
             LeaveCriticalSection(&cond->queue_lock);
-            return SleepConditionVariableSRW(&cond->variable, &mutex->lock, ms, 0) ? thrd_success : thrd_error;
+            return cnd_sleep_result(SleepConditionVariableSRW(&cond->variable, &mutex->lock, ms, 0));
         case mtx_plain | mtx_recursive:
+            cond->shift++;
             cond->queue &= ~(1ull << cond->shift);
             LeaveCriticalSection(&cond->queue_lock);
-            return SleepConditionVariableCS(&cond->variable, &mutex->section, ms) ? thrd_success : thrd_error;
+            return cnd_sleep_result(SleepConditionVariableCS(&cond->variable, &mutex->section, ms));
         case mtx_timed:
         case mtx_timed | mtx_recursive:
             if(!mutex->handle) {
@@ -405,49 +515,56 @@ static int cnd_wait_ms(cnd_t* cond, mtx_t* mutex, DWORD ms) {
             }
 
             if(cond->handle_count == cond->handle_cap) {
-                if(cond->handle_cap == 0) {
-                    cond->handle_cap = 4;
-                    cond->handles = malloc(sizeof(*cond->handles) * 4);
-                    if(!cond->handles) {
-                        LeaveCriticalSection(&cond->queue_lock);
-                        return thrd_error;
-                    }
-                } else {
-                    cond->handle_cap *= 1.5f;
-                    void* buff = realloc(cond->handles, sizeof(*cond->handles) * cond->handle_cap);
-                    if(!buff) {
-                        LeaveCriticalSection(&cond->queue_lock);
-                        return thrd_error;
-                    }
-                    cond->handles = buff;
+                int capacity = cond->handle_cap == 0 ? 4 : cond->handle_cap * 3 / 2;
+                void* buff = realloc(cond->waiters, sizeof(*cond->waiters) * capacity);
+                if(!buff) {
+                    LeaveCriticalSection(&cond->queue_lock);
+                    return thrd_error;
                 }
+                cond->waiters = buff;
+                cond->handle_cap = capacity;
             }
 
-            cond->queue |= (1ull << cond->shift);
-            HANDLE sem = CreateSemaphore(NULL, 0, 1, NULL);
-            cond->handles[cond->handle_count++] = sem;
-            if(sem == NULL ||
-                !(mutex->type  == mtx_timed ? ReleaseSemaphore(mutex->handle, 1, NULL) : 
-                                              ReleaseMutex(mutex->handle))) 
-            {
-                cond->handle_count--;
+            struct ___cp_cnd_waiter waiter = { CreateSemaphore(NULL, 0, 1, NULL), mutex, NULL, CONDITION_WAITER_QUEUED };
+            if(waiter.semaphore == NULL) {
+                LeaveCriticalSection(&cond->queue_lock);
+                return thrd_error;
+            }
+
+            if(!(mutex->type == mtx_timed ? timed_mutex_release(mutex) : ReleaseMutex(mutex->handle))) {
+                LeaveCriticalSection(&cond->queue_lock);
+                CloseHandle(waiter.semaphore);
                 return thrd_error;
             }
+
+            cond->shift++;
+            cond->queue |= (1ull << cond->shift);
+            cond->waiters[cond->handle_count++] = &waiter;
             LeaveCriticalSection(&cond->queue_lock);
-            int result;
-            switch(WaitForSingleObject(sem, ms)) {
-                case WAIT_ABANDONED:
-                case WAIT_OBJECT_0:
-                    result = thrd_success;
-                    break;
-                default:
-                    result = thrd_error;
-                    break;
+
+            int result = thrd_success;
+            DWORD wait = WaitForSingleObject(waiter.semaphore, ms);
+            if(wait != WAIT_OBJECT_0) {
+                EnterCriticalSection(&cond->queue_lock);
+                if(waiter.state == CONDITION_WAITER_QUEUED) {
+                    cnd_unlink(cond, &waiter);
+                    waiter.state = CONDITION_WAITER_SIGNALED;
+                    LeaveCriticalSection(&cond->queue_lock);
+                    result = wait == WAIT_TIMEOUT ? thrd_timedout : thrd_error;
+                } else {
+                    // Woken between the timeout and taking the lock, so the
+                    // semaphore is released or about to be.
+                    LeaveCriticalSection(&cond->queue_lock);
+                    WaitForSingleObject(waiter.semaphore, INFINITE);
+                }
             }
-            CloseHandle(sem);
-            WaitForSingleObject(&mutex->handle, INFINITE);
+
+            CloseHandle(waiter.semaphore);
+            if(waiter.state != CONDITION_WAITER_OWNER)
+                WaitForSingleObject(mutex->handle, INFINITE);
             return result;
         default:
+            LeaveCriticalSection(&cond->queue_lock);
             return thrd_error;
     }
 }
@@ -460,14 +577,7 @@ int cnd_timedwait(cnd_t* cond, mtx_t* mutex, const struct timespec* time_point)
     if(!time_point)
         return thrd_error;
 
-    struct timespec current;
-    timespec_get(&current, TIME_UTC);
-    timespec_subtract(&current, time_point, &current);
-
-    if(current.tv_sec < 0)
-        return thrd_timedout;
-
-    DWORD ms = (DWORD) (current.tv_sec * 1000 + current.tv_nsec / 1000000);
+    DWORD ms = timespec_ms_until(time_point);
     return cnd_wait_ms(cond, mutex, ms);
 }
 
@@ -476,9 +586,9 @@ void cnd_destroy(cnd_t* cond) {
         return;
 
     DeleteCriticalSection(&cond->queue_lock);
-    while(cond->handle_count > 0)
-        CloseHandle(cond->handles[--cond->handle_count]);
-    free(cond->handles);
+    free(cond->waiters);
+    cond->waiters = NULL;
+    cond->handle_count = 0;
 }
 
 static once_flag destructor_stack_flag = ONCE_FLAG_INIT;
@@ -88,9 +88,19 @@ enum {
     mtx_timed = 4
 };
 
+struct ___cp_cnd_waiter;
+
 typedef struct mtx_t {
     union {
-        HANDLE handle;
+        struct {
+            HANDLE handle;
+            // Condition waiters moved here by cnd_broadcast. mtx_unlock hands
+            // the mutex straight to the first one instead of releasing it.
+            // Only used by mtx_timed mutexes.
+            struct ___cp_cnd_waiter* handoff_head;
+            struct ___cp_cnd_waiter* handoff_tail;
+            SRWLOCK handoff_lock;
+        };
         CRITICAL_SECTION section;
         SRWLOCK lock;
     };
@@ -106,6 +116,38 @@ int mtx_trylock(mtx_t* mutex);
 int mtx_unlock(mtx_t* mutex);
 void mtx_destroy(mtx_t* mutex);
 
+// Variants for call sites that know the type of their mutex. They skip the
+// dispatch on mutex->type and compile down to the Windows lock call itself.
+// Using them on a mutex of another type is undefined.
+static __inline int cp_mtx_plain_lock(mtx_t* mutex) {
+    AcquireSRWLockExclusive(&mutex->lock);
+    return thrd_success;
+}
+
+static __inline int cp_mtx_plain_trylock(mtx_t* mutex) {
+    return TryAcquireSRWLockExclusive(&mutex->lock) ? thrd_success : thrd_busy;
+}
+
+static __inline int cp_mtx_plain_unlock(mtx_t* mutex) {
+    ReleaseSRWLockExclusive(&mutex->lock);
+    return thrd_success;
+}
+
+// For mutexes created with mtx_plain | mtx_recursive.
+static __inline int cp_mtx_recursive_lock(mtx_t* mutex) {
+    EnterCriticalSection(&mutex->section);
+    return thrd_success;
+}
+
+static __inline int cp_mtx_recursive_trylock(mtx_t* mutex) {
+    return TryEnterCriticalSection(&mutex->section) ? thrd_success : thrd_busy;
+}
+
+static __inline int cp_mtx_recursive_unlock(mtx_t* mutex) {
+    LeaveCriticalSection(&mutex->section);
+    return thrd_success;
+}
+
 typedef volatile LONG once_flag;
 
 #define ONCE_FLAG_INIT 0
@@ -122,7 +164,7 @@ static __inline void call_once(once_flag* flag, void(*func)(void)) {
 typedef struct cnd_t {
     CRITICAL_SECTION queue_lock;
     CONDITION_VARIABLE variable;
-    HANDLE* handles;
+    struct ___cp_cnd_waiter** waiters;
     unsigned long long queue;
     int shift;
     int handle_count;
@@ -167,8 +209,39 @@ static __inline int tss_set(tss_t tss_key, void* val) {
 
 #include <threads.h>
 
+// The native mutex functions don't dispatch on a type we control, so the
+// typed variants are the same calls. They exist so code can use them on
+// every platform.
+static __inline int cp_mtx_plain_lock(mtx_t* mutex) {
+    return mtx_lock(mutex);
+}
+
+static __inline int cp_mtx_plain_trylock(mtx_t* mutex) {
+    return mtx_trylock(mutex);
+}
+
+static __inline int cp_mtx_plain_unlock(mtx_t* mutex) {
+    return mtx_unlock(mutex);
+}
+
+static __inline int cp_mtx_recursive_lock(mtx_t* mutex) {
+    return mtx_lock(mutex);
+}
+
+static __inline int cp_mtx_recursive_trylock(mtx_t* mutex) {
+    return mtx_trylock(mutex);
+}
+
+static __inline int cp_mtx_recursive_unlock(mtx_t* mutex) {
+    return mtx_unlock(mutex);
+}
+
 #else
 #error Must be able to use C99 or Windows Threads
 #endif
 
+#if defined(CP_TRACE)
+#include "cp_trace.h"
+#endif
+
 #endif
\ No newline at end of file
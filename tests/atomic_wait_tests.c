@@ -0,0 +1,252 @@
+#include <check.h>
+
+#include <stdio.h>
+
+// Every wait goes to sleep, so the tests hit the window between checking
+// the word and sleeping as often as possible.
+#define CP_ATOMIC_WAIT_SPINS 0
+
+#include "../cpthreads.h"
+#include "../cp_atomic_wait.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void atomic_wait_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static struct timespec deadline_in(int ms) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+static long long elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (now.tv_sec - start->tv_sec) * 1000ll + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+START_TEST(wait_returns_when_word_differs) {
+    cp_atomic32 word32 = 1;
+    cp_atomic64 word64 = 1ll << 40;
+    assert_thrd(cp_atomic_wait32(&word32, 0, NULL));
+    // Only the low half matches.
+    assert_thrd(cp_atomic_wait64(&word64, 0, NULL));
+    ck_assert(cp_atomic_wait32(NULL, 0, NULL) == thrd_error);
+}
+END_TEST
+
+START_TEST(timed_wait_times_out) {
+    cp_atomic32 word32 = 0;
+    cp_atomic64 word64 = 0;
+    struct timespec start;
+
+    timespec_get(&start, TIME_UTC);
+    struct timespec deadline = deadline_in(50);
+    ck_assert(cp_atomic_wait32(&word32, 0, &deadline) == thrd_timedout);
+    ck_assert(elapsed_ms(&start) >= 45);
+
+    timespec_get(&start, TIME_UTC);
+    deadline = deadline_in(50);
+    ck_assert(cp_atomic_wait64(&word64, 0, &deadline) == thrd_timedout);
+    ck_assert(elapsed_ms(&start) >= 45);
+
+    // A deadline in the past still returns.
+    deadline = deadline_in(0);
+    deadline.tv_sec--;
+    ck_assert(cp_atomic_wait32(&word32, 0, &deadline) == thrd_timedout);
+    ck_assert(cp_atomic_wait64(&word64, 0, &deadline) == thrd_timedout);
+}
+END_TEST
+
+typedef struct Flag {
+    cp_atomic32 word32;
+    cp_atomic64 word64;
+    cp_atomic32 woken;
+} Flag;
+
+static int wait_for_flag32(Flag* flag) {
+    while(cp_atomic_load32(&flag->word32) == 0)
+        cp_atomic_wait32(&flag->word32, 0, NULL);
+    cp_atomic_fetch_add32(&flag->woken, 1);
+    return 1;
+}
+
+static int wait_for_flag64(Flag* flag) {
+    while(cp_atomic_load64(&flag->word64) == 0)
+        cp_atomic_wait64(&flag->word64, 0, NULL);
+    cp_atomic_fetch_add32(&flag->woken, 1);
+    return 1;
+}
+
+#define WAITERS 8
+
+START_TEST(notify_all_wakes_every_waiter) {
+    int (*waiters[])(Flag*) = { wait_for_flag32, wait_for_flag64 };
+
+    for(int width = 0; width < 2; width++) {
+        Flag flag = { 0, 0, 0 };
+        thrd_t threads[WAITERS];
+        for(int i = 0; i < WAITERS; i++)
+            assert_thrd(thrd_create(threads + i, (int(*)(void*))waiters[width], &flag));
+        thrd_sleep(&ms2ts(50), NULL);
+        ck_assert(cp_atomic_load32(&flag.woken) == 0);
+
+        if(width == 0) {
+            cp_atomic_store32(&flag.word32, 1);
+            cp_atomic_notify_all32(&flag.word32);
+        } else {
+            cp_atomic_store64(&flag.word64, 1);
+            cp_atomic_notify_all64(&flag.word64);
+        }
+
+        for(int i = 0; i < WAITERS; i++) {
+            int result;
+            thrd_join(threads[i], &result);
+            ck_assert(result == 1);
+        }
+        ck_assert(flag.woken == WAITERS);
+    }
+}
+END_TEST
+
+#define PING_PONGS 20000
+
+typedef struct Turn {
+    cp_atomic32 turn32;
+    cp_atomic64 turn64;
+} Turn;
+
+// Two threads take turns, each setting the word to the other's value and
+// notifying just before the other goes to sleep. A notify lost between a
+// waiter's check and its sleep leaves both threads waiting for good.
+static int ping_pong32(Turn* turn, int32_t self) {
+    for(int i = 0; i < PING_PONGS; i++) {
+        int32_t current;
+        while((current = cp_atomic_load32(&turn->turn32)) != self)
+            cp_atomic_wait32(&turn->turn32, current, NULL);
+        cp_atomic_store32(&turn->turn32, !self);
+        cp_atomic_notify_one32(&turn->turn32);
+    }
+    return 1;
+}
+
+static int ping_pong64(Turn* turn, int64_t self) {
+    for(int i = 0; i < PING_PONGS; i++) {
+        int64_t current;
+        while((current = cp_atomic_load64(&turn->turn64)) != self)
+            cp_atomic_wait64(&turn->turn64, current, NULL);
+        cp_atomic_store64(&turn->turn64, !self);
+        cp_atomic_notify_one64(&turn->turn64);
+    }
+    return 1;
+}
+
+static int pong32(Turn* turn) {
+    return ping_pong32(turn, 1);
+}
+
+static int pong64(Turn* turn) {
+    return ping_pong64(turn, 1);
+}
+
+START_TEST(ping_pong_loses_no_wakeups) {
+    Turn turn = { 0, 0 };
+    thrd_t thread;
+    int result;
+
+    assert_thrd(thrd_create(&thread, (int(*)(void*))pong32, &turn));
+    ck_assert(ping_pong32(&turn, 0) == 1);
+    thrd_join(thread, &result);
+    ck_assert(result == 1);
+
+    assert_thrd(thrd_create(&thread, (int(*)(void*))pong64, &turn));
+    ck_assert(ping_pong64(&turn, 0) == 1);
+    thrd_join(thread, &result);
+    ck_assert(result == 1);
+}
+END_TEST
+
+#define WORDS 64
+#define ROUNDS 200
+
+typedef struct Counters {
+    cp_atomic64 words[WORDS];
+} Counters;
+
+typedef struct Slot {
+    Counters* counters;
+    int index;
+} Slot;
+
+// Waits for its own word to count up while other threads wait on words
+// that land in the same buckets of the wait table.
+static int count_up(Slot* slot) {
+    cp_atomic64* word = slot->counters->words + slot->index;
+    for(int64_t seen = 0; seen < ROUNDS; ) {
+        int64_t current = cp_atomic_load64(word);
+        if(current == seen) {
+            cp_atomic_wait64(word, current, NULL);
+            continue;
+        }
+        seen = current;
+    }
+    return 1;
+}
+
+START_TEST(notify_wakes_the_right_address) {
+    static Counters counters;
+    thrd_t threads[WORDS];
+    Slot slots[WORDS];
+
+    for(int i = 0; i < WORDS; i++) {
+        counters.words[i] = 0;
+        slots[i] = (Slot){ &counters, i };
+        assert_thrd(thrd_create(threads + i, (int(*)(void*))count_up, slots + i));
+    }
+    for(int round = 0; round < ROUNDS; round++) {
+        for(int i = 0; i < WORDS; i++) {
+            cp_atomic_fetch_add64(counters.words + i, 1);
+            cp_atomic_notify_one64(counters.words + i);
+        }
+        if(round % 16 == 0)
+            thrd_yield();
+    }
+    for(int i = 0; i < WORDS; i++) {
+        int result;
+        thrd_join(threads[i], &result);
+        ck_assert(result == 1);
+    }
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Atomic Wait Tests");
+    TCase* tc = tcase_create("Atomic Wait Tests");
+
+    tcase_add_checked_fixture(tc, atomic_wait_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, wait_returns_when_word_differs);
+    tcase_add_test(tc, timed_wait_times_out);
+    tcase_add_test(tc, notify_all_wakes_every_waiter);
+    tcase_add_test(tc, ping_pong_loses_no_wakeups);
+    tcase_add_test(tc, notify_wakes_the_right_address);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
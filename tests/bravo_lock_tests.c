@@ -0,0 +1,186 @@
+#include <check.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_bravo_lock.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void bravo_lock_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+typedef struct Shared {
+    cp_bravo_lock_t lock;
+    cp_atomic32 readers_in;
+    cp_atomic32 writer_done;
+    int first;
+    int second;
+    bool torn;
+} Shared;
+
+static int hold_read_lock(Shared* shared) {
+    cp_bravo_read_lock(&shared->lock);
+    cp_atomic_store32(&shared->readers_in, 1);
+    thrd_sleep(&ms2ts(100), NULL);
+    // The writer must not have got in while this was held.
+    if(cp_atomic_load32(&shared->writer_done))
+        shared->torn = true;
+    cp_bravo_read_unlock(&shared->lock);
+    return 1;
+}
+
+static int take_write_lock(Shared* shared) {
+    cp_bravo_write_lock(&shared->lock);
+    cp_atomic_store32(&shared->writer_done, 1);
+    cp_bravo_write_unlock(&shared->lock);
+    return 1;
+}
+
+START_TEST(writer_waits_for_biased_reader) {
+    Shared shared = { 0 };
+    thrd_t reader, writer;
+    int result;
+    assert_thrd(cp_bravo_lock_init(&shared.lock));
+    ck_assert(cp_atomic_load32(&shared.lock.bias));
+
+    assert_thrd(thrd_create(&reader, (int(*)(void*))hold_read_lock, &shared));
+    while(!cp_atomic_load32(&shared.readers_in))
+        thrd_yield();
+    assert_thrd(thrd_create(&writer, (int(*)(void*))take_write_lock, &shared));
+
+    thrd_join(reader, &result);
+    ck_assert(result == 1);
+    thrd_join(writer, &result);
+    ck_assert(result == 1);
+    ck_assert(!shared.torn);
+    ck_assert(shared.writer_done);
+
+    cp_bravo_lock_destroy(&shared.lock);
+}
+END_TEST
+
+START_TEST(write_revokes_bias_until_readers_return) {
+    cp_bravo_lock_t lock;
+    assert_thrd(cp_bravo_lock_init(&lock));
+
+    cp_bravo_read_lock(&lock);
+    cp_bravo_read_unlock(&lock);
+    cp_bravo_write_lock(&lock);
+    ck_assert(!cp_atomic_load32(&lock.bias));
+    cp_bravo_write_unlock(&lock);
+
+    // The first reader after the inhibit window turns it back on.
+    thrd_sleep(&ms2ts(50), NULL);
+    cp_bravo_read_lock(&lock);
+    cp_bravo_read_unlock(&lock);
+    ck_assert(cp_atomic_load32(&lock.bias));
+
+    cp_bravo_read_lock(&lock);
+    cp_bravo_read_unlock(&lock);
+    cp_bravo_write_lock(&lock);
+    cp_bravo_write_unlock(&lock);
+    cp_bravo_lock_destroy(&lock);
+}
+END_TEST
+
+START_TEST(nested_reads_of_two_locks) {
+    cp_bravo_lock_t first, second;
+    assert_thrd(cp_bravo_lock_init(&first));
+    assert_thrd(cp_bravo_lock_init(&second));
+
+    // The second read can't use the slot and goes through the stamped lock.
+    cp_bravo_read_lock(&first);
+    cp_bravo_read_lock(&second);
+    ck_assert(cp_stamped_lock_try_write(&second.lock) == 0);
+    cp_bravo_read_unlock(&second);
+    cp_bravo_read_unlock(&first);
+
+    // Both are free again.
+    cp_bravo_write_lock(&first);
+    cp_bravo_write_lock(&second);
+    cp_bravo_write_unlock(&second);
+    cp_bravo_write_unlock(&first);
+
+    cp_bravo_lock_destroy(&second);
+    cp_bravo_lock_destroy(&first);
+}
+END_TEST
+
+#define READERS 8
+#define READS 20000
+#define WRITES 2000
+
+static int check_pairs(Shared* shared) {
+    for(int i = 0; i < READS; i++) {
+        cp_bravo_read_lock(&shared->lock);
+        int first = shared->first;
+        if(i % 64 == 0)
+            thrd_yield();
+        if(first != shared->second)
+            shared->torn = true;
+        cp_bravo_read_unlock(&shared->lock);
+    }
+    return 1;
+}
+
+static int write_pairs(Shared* shared) {
+    for(int i = 0; i < WRITES; i++) {
+        cp_bravo_write_lock(&shared->lock);
+        shared->first++;
+        if(i % 16 == 0)
+            thrd_yield();
+        shared->second++;
+        cp_bravo_write_unlock(&shared->lock);
+    }
+    return 1;
+}
+
+START_TEST(readers_never_see_a_partial_write) {
+    static Shared shared;
+    thrd_t readers[READERS], writer;
+    int result;
+    shared = (Shared){ 0 };
+    assert_thrd(cp_bravo_lock_init(&shared.lock));
+
+    for(int i = 0; i < READERS; i++)
+        assert_thrd(thrd_create(readers + i, (int(*)(void*))check_pairs, &shared));
+    assert_thrd(thrd_create(&writer, (int(*)(void*))write_pairs, &shared));
+
+    for(int i = 0; i < READERS; i++) {
+        thrd_join(readers[i], &result);
+        ck_assert(result == 1);
+    }
+    thrd_join(writer, &result);
+    ck_assert(result == 1);
+    ck_assert(!shared.torn);
+    ck_assert(shared.first == WRITES && shared.second == WRITES);
+
+    cp_bravo_lock_destroy(&shared.lock);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Reader Biased Lock Tests");
+    TCase* tc = tcase_create("Reader Biased Lock Tests");
+
+    tcase_add_checked_fixture(tc, bravo_lock_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, writer_waits_for_biased_reader);
+    tcase_add_test(tc, write_revokes_bias_until_readers_return);
+    tcase_add_test(tc, nested_reads_of_two_locks);
+    tcase_add_test(tc, readers_never_see_a_partial_write);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
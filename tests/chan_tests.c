@@ -0,0 +1,406 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_chan.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void chan_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static struct timespec deadline_in_ms(int ms) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+#define RENDEZVOUS_VALUES 1000
+
+static int send_sequence(void* arg) {
+    cp_chan_t* chan = arg;
+    for(int i = 0; i < RENDEZVOUS_VALUES; i++) {
+        if(cp_chan_send(chan, &i) != thrd_success)
+            return thrd_error;
+    }
+    return thrd_success;
+}
+
+START_TEST(chan_unbuffered_hands_values_over_in_order) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 0));
+
+    // Nobody is receiving, so a send can't complete.
+    int value = 7;
+    ck_assert(cp_chan_try_send(&chan, &value) == thrd_busy);
+    ck_assert(cp_chan_try_recv(&chan, &value) == thrd_busy);
+
+    thrd_t sender;
+    assert_thrd(thrd_create(&sender, send_sequence, &chan));
+    for(int i = 0; i < RENDEZVOUS_VALUES; i++) {
+        assert_thrd(cp_chan_recv(&chan, &value));
+        ck_assert_int_eq(value, i);
+        ck_assert(cp_chan_len(&chan) == 0);
+    }
+
+    int result;
+    assert_thrd(thrd_join(sender, &result));
+    assert_thrd(result);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+START_TEST(chan_buffered_holds_up_to_capacity) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 3));
+
+    for(int i = 0; i < 3; i++)
+        assert_thrd(cp_chan_try_send(&chan, &i));
+    int value = 3;
+    ck_assert(cp_chan_try_send(&chan, &value) == thrd_busy);
+    ck_assert(cp_chan_len(&chan) == 3);
+
+    struct timespec deadline = deadline_in_ms(20);
+    ck_assert(cp_chan_timedsend(&chan, &value, &deadline) == thrd_timedout);
+
+    // Wrap around the ring a few times.
+    for(int i = 0; i < 10; i++) {
+        assert_thrd(cp_chan_recv(&chan, &value));
+        ck_assert_int_eq(value, i);
+        int next = i + 3;
+        assert_thrd(cp_chan_try_send(&chan, &next));
+    }
+    ck_assert(cp_chan_len(&chan) == 3);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+static int fill_and_send(void* arg) {
+    cp_chan_t* chan = arg;
+    // The buffer holds two, so the last sends block until the reader drains.
+    for(int i = 0; i < 6; i++) {
+        if(cp_chan_send(chan, &i) != thrd_success)
+            return thrd_error;
+    }
+    return thrd_success;
+}
+
+START_TEST(chan_blocked_senders_refill_the_buffer) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 2));
+
+    thrd_t sender;
+    assert_thrd(thrd_create(&sender, fill_and_send, &chan));
+    thrd_sleep(&ms2ts(20), NULL);
+
+    for(int i = 0; i < 6; i++) {
+        int value;
+        assert_thrd(cp_chan_recv(&chan, &value));
+        ck_assert_int_eq(value, i);
+    }
+
+    int result;
+    assert_thrd(thrd_join(sender, &result));
+    assert_thrd(result);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+static int recv_until_closed(void* arg) {
+    cp_chan_t* chan = arg;
+    int value;
+    int received = 0;
+    while(cp_chan_recv(chan, &value) == thrd_success)
+        received++;
+    return received;
+}
+
+START_TEST(chan_close_drains_then_fails) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 4));
+
+    for(int i = 0; i < 3; i++)
+        assert_thrd(cp_chan_send(&chan, &i));
+    assert_thrd(cp_chan_close(&chan));
+    ck_assert(cp_chan_close(&chan) == thrd_error);
+
+    int value = 9;
+    ck_assert(cp_chan_send(&chan, &value) == thrd_error);
+    ck_assert(cp_chan_try_send(&chan, &value) == thrd_error);
+
+    // Buffered values still come out, then receives fail with a zeroed value.
+    for(int i = 0; i < 3; i++) {
+        assert_thrd(cp_chan_recv(&chan, &value));
+        ck_assert_int_eq(value, i);
+    }
+    value = 9;
+    ck_assert(cp_chan_recv(&chan, &value) == thrd_error);
+    ck_assert_int_eq(value, 0);
+    ck_assert(cp_chan_try_recv(&chan, &value) == thrd_error);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+START_TEST(chan_close_wakes_blocked_receivers) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 0));
+
+    thrd_t receivers[4];
+    for(int i = 0; i < 4; i++)
+        assert_thrd(thrd_create(receivers + i, recv_until_closed, &chan));
+    thrd_sleep(&ms2ts(20), NULL);
+
+    for(int i = 0; i < 10; i++)
+        assert_thrd(cp_chan_send(&chan, &i));
+    assert_thrd(cp_chan_close(&chan));
+
+    int total = 0;
+    for(int i = 0; i < 4; i++) {
+        int received;
+        assert_thrd(thrd_join(receivers[i], &received));
+        total += received;
+    }
+    ck_assert_int_eq(total, 10);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+START_TEST(chan_timed_recv_times_out) {
+    cp_chan_t chan;
+    assert_thrd(cp_chan_init(&chan, sizeof(int), 0));
+
+    struct timespec before;
+    timespec_get(&before, TIME_UTC);
+    struct timespec deadline = deadline_in_ms(50);
+    int value;
+    ck_assert(cp_chan_timedrecv(&chan, &value, &deadline) == thrd_timedout);
+
+    struct timespec after;
+    timespec_get(&after, TIME_UTC);
+    long long waited_ms = (after.tv_sec - before.tv_sec) * 1000ll + (after.tv_nsec - before.tv_nsec) / 1000000;
+    ck_assert(waited_ms >= 40);
+
+    // The timed out waiter must be gone, or this send would pair with it.
+    value = 1;
+    ck_assert(cp_chan_try_send(&chan, &value) == thrd_busy);
+    cp_chan_destroy(&chan);
+}
+END_TEST
+
+START_TEST(select_picks_a_ready_case) {
+    cp_chan_t a, b, c;
+    assert_thrd(cp_chan_init(&a, sizeof(int), 1));
+    assert_thrd(cp_chan_init(&b, sizeof(int), 1));
+    assert_thrd(cp_chan_init(&c, sizeof(int), 1));
+
+    int value = 42;
+    assert_thrd(cp_chan_send(&b, &value));
+
+    int from_a = 0, from_b = 0, to_c = 5;
+    cp_select_case_t cases[] = {
+        { &a, cp_select_recv, &from_a, 0 },
+        { &b, cp_select_recv, &from_b, 0 },
+        { NULL, cp_select_recv, NULL, 0 },
+    };
+    int index = -1;
+    assert_thrd(cp_select(cases, 3, &index, NULL));
+    ck_assert_int_eq(index, 1);
+    ck_assert_int_eq(from_b, 42);
+    ck_assert_int_eq(cases[1].ok, 1);
+
+    ck_assert(cp_select_try(cases, 3, &index) == thrd_busy);
+
+    // Sends and receives can be mixed; c has room so only the send is ready.
+    cp_select_case_t mixed[] = {
+        { &a, cp_select_recv, &from_a, 0 },
+        { &c, cp_select_send, &to_c, 0 },
+    };
+    assert_thrd(cp_select_try(mixed, 2, &index));
+    ck_assert_int_eq(index, 1);
+    assert_thrd(cp_chan_recv(&c, &value));
+    ck_assert_int_eq(value, 5);
+
+    // A closed channel is always ready to receive from.
+    assert_thrd(cp_chan_close(&a));
+    assert_thrd(cp_select(cases, 2, &index, NULL));
+    ck_assert_int_eq(index, 0);
+    ck_assert_int_eq(cases[0].ok, 0);
+
+    // And a send on it is an error that still reports its case.
+    cp_select_case_t closed_send[] = { { &a, cp_select_send, &to_c, 0 } };
+    index = -1;
+    ck_assert(cp_select(closed_send, 1, &index, NULL) == thrd_error);
+    ck_assert_int_eq(index, 0);
+
+    cp_chan_destroy(&a);
+    cp_chan_destroy(&b);
+    cp_chan_destroy(&c);
+}
+END_TEST
+
+START_TEST(select_times_out_and_unregisters) {
+    cp_chan_t a, b;
+    assert_thrd(cp_chan_init(&a, sizeof(int), 0));
+    assert_thrd(cp_chan_init(&b, sizeof(int), 0));
+
+    int value;
+    cp_select_case_t cases[] = {
+        { &a, cp_select_recv, &value, 0 },
+        { &b, cp_select_recv, &value, 0 },
+    };
+    struct timespec deadline = deadline_in_ms(30);
+    int index = -1;
+    ck_assert(cp_select(cases, 2, &index, &deadline) == thrd_timedout);
+
+    value = 1;
+    ck_assert(cp_chan_try_send(&a, &value) == thrd_busy);
+    ck_assert(cp_chan_try_send(&b, &value) == thrd_busy);
+
+    // Only nil channels: nothing can ever happen.
+    cp_select_case_t nil[] = { { NULL, cp_select_recv, &value, 0 } };
+    deadline = deadline_in_ms(10);
+    ck_assert(cp_select(nil, 1, &index, &deadline) == thrd_timedout);
+    ck_assert(cp_select(nil, 1, &index, NULL) == thrd_error);
+
+    cp_chan_destroy(&a);
+    cp_chan_destroy(&b);
+}
+END_TEST
+
+#define SELECT_CHANNELS 4
+#define SELECT_PRODUCERS 4
+#define SELECT_VALUES 5000
+
+typedef struct Producer {
+    cp_chan_t* chan;
+    int base;
+} Producer;
+
+static int produce(void* arg) {
+    Producer* producer = arg;
+    for(int i = 0; i < SELECT_VALUES; i++) {
+        int value = producer->base + i;
+        if(cp_chan_send(producer->chan, &value) != thrd_success)
+            return thrd_error;
+    }
+    return thrd_success;
+}
+
+typedef struct Consumer {
+    cp_chan_t* chans;
+    unsigned char* seen;
+    int received;
+} Consumer;
+
+// Selects over every channel until all of them are closed.
+static int consume(void* arg) {
+    Consumer* consumer = arg;
+    int values[SELECT_CHANNELS];
+    cp_select_case_t cases[SELECT_CHANNELS];
+    for(int i = 0; i < SELECT_CHANNELS; i++)
+        cases[i] = (cp_select_case_t){ consumer->chans + i, cp_select_recv, values + i, 0 };
+
+    int open = SELECT_CHANNELS;
+    while(open > 0) {
+        int index;
+        if(cp_select(cases, SELECT_CHANNELS, &index, NULL) != thrd_success)
+            return thrd_error;
+        if(!cases[index].ok) {
+            cases[index].chan = NULL;
+            open--;
+            continue;
+        }
+
+        consumer->seen[values[index]]++;
+        consumer->received++;
+    }
+    return thrd_success;
+}
+
+START_TEST(select_delivers_each_value_exactly_once) {
+    cp_chan_t chans[SELECT_CHANNELS];
+    for(int i = 0; i < SELECT_CHANNELS; i++)
+        assert_thrd(cp_chan_init(chans + i, sizeof(int), i % 2 ? 8 : 0));
+
+    int total = SELECT_PRODUCERS * SELECT_VALUES;
+    Consumer consumers[3];
+    for(int i = 0; i < 3; i++)
+        consumers[i] = (Consumer){ chans, calloc(total, 1), 0 };
+
+    thrd_t consumer_threads[3];
+    for(int i = 0; i < 3; i++)
+        assert_thrd(thrd_create(consumer_threads + i, consume, consumers + i));
+
+    Producer producers[SELECT_PRODUCERS];
+    thrd_t producer_threads[SELECT_PRODUCERS];
+    for(int i = 0; i < SELECT_PRODUCERS; i++) {
+        producers[i] = (Producer){ chans + i % SELECT_CHANNELS, i * SELECT_VALUES };
+        assert_thrd(thrd_create(producer_threads + i, produce, producers + i));
+    }
+
+    int result;
+    for(int i = 0; i < SELECT_PRODUCERS; i++) {
+        assert_thrd(thrd_join(producer_threads[i], &result));
+        assert_thrd(result);
+    }
+    for(int i = 0; i < SELECT_CHANNELS; i++)
+        assert_thrd(cp_chan_close(chans + i));
+
+    int received = 0;
+    for(int i = 0; i < 3; i++) {
+        assert_thrd(thrd_join(consumer_threads[i], &result));
+        assert_thrd(result);
+        received += consumers[i].received;
+    }
+    ck_assert_int_eq(received, total);
+
+    // Every value reached exactly one consumer.
+    for(int value = 0; value < total; value++) {
+        int count = 0;
+        for(int i = 0; i < 3; i++)
+            count += consumers[i].seen[value];
+        ck_assert_int_eq(count, 1);
+    }
+
+    for(int i = 0; i < 3; i++)
+        free(consumers[i].seen);
+    for(int i = 0; i < SELECT_CHANNELS; i++)
+        cp_chan_destroy(chans + i);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Channel Tests");
+    TCase* tc = tcase_create("Channel Tests");
+
+    tcase_add_checked_fixture(tc, chan_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, chan_unbuffered_hands_values_over_in_order);
+    tcase_add_test(tc, chan_buffered_holds_up_to_capacity);
+    tcase_add_test(tc, chan_blocked_senders_refill_the_buffer);
+    tcase_add_test(tc, chan_close_drains_then_fails);
+    tcase_add_test(tc, chan_close_wakes_blocked_receivers);
+    tcase_add_test(tc, chan_timed_recv_times_out);
+    tcase_add_test(tc, select_picks_a_ready_case);
+    tcase_add_test(tc, select_times_out_and_unregisters);
+    tcase_add_test(tc, select_delivers_each_value_exactly_once);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
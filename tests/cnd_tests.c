@@ -118,6 +118,118 @@ START_TEST(multiple_waiters_wait_for_broadcaster) {
 }
 END_TEST
 
+#define BROADCAST_WAITERS 16
+
+typedef struct Herd {
+    mtx_t* mutex;
+    cnd_t* cond;
+    int waiting;
+    int woken;
+    int inside;
+    bool overlapped;
+    bool done;
+} Herd;
+
+static int herd_waiter(Herd* herd) {
+    mtx_lock(herd->mutex);
+    herd->waiting++;
+    while(!herd->done)
+        cnd_wait(herd->cond, herd->mutex);
+
+    // Each waiter has to come back holding the mutex on its own.
+    if(herd->inside)
+        herd->overlapped = true;
+    herd->inside = 1;
+    thrd_yield();
+    herd->inside = 0;
+    herd->woken++;
+    mtx_unlock(herd->mutex);
+    return 1;
+}
+
+START_TEST(broadcast_wakes_every_waiter_holding_the_mutex) {
+    mtx_t mutexes[MUTEX_TYPES];
+    initialize_mutexes(mutexes);
+
+    for(int i = 0; i < MUTEX_TYPES; i++) {
+        thrd_t threads[BROADCAST_WAITERS];
+        cnd_t cond;
+        assert_thrd(cnd_init(&cond));
+        Herd herd = { mutexes + i, &cond, 0, 0, 0, false, false };
+        for(int j = 0; j < BROADCAST_WAITERS; j++)
+            assert_thrd(thrd_create(threads + j, (int(*)(void*))herd_waiter, (void*)&herd));
+
+        bool all_waiting = false;
+        while(!all_waiting) {
+            thrd_yield();
+            mtx_lock(herd.mutex);
+            all_waiting = herd.waiting == BROADCAST_WAITERS;
+            mtx_unlock(herd.mutex);
+        }
+
+        mtx_lock(herd.mutex);
+        herd.done = true;
+        assert_thrd(cnd_broadcast(&cond));
+        mtx_unlock(herd.mutex);
+
+        for(int j = 0; j < BROADCAST_WAITERS; j++) {
+            int result;
+            thrd_join(threads[j], &result);
+            ck_assert(result == 1);
+        }
+        ck_assert(herd.woken == BROADCAST_WAITERS);
+        ck_assert(!herd.overlapped);
+        cnd_destroy(&cond);
+    }
+
+    free_mutexes(mutexes);
+}
+END_TEST
+
+START_TEST(timed_out_waiter_does_not_take_later_signal) {
+    mtx_t mutexes[MUTEX_TYPES];
+    initialize_mutexes(mutexes);
+
+    for(int i = 0; i < MUTEX_TYPES; i++) {
+        thrd_t thread;
+        int result;
+        cnd_t cond;
+        assert_thrd(cnd_init(&cond));
+        Lock lock = { mutexes + i, &cond, false };
+        assert_thrd(thrd_create(&thread, (int(*)(void*))waiter, (void*)&lock));
+        thrd_sleep(&ms2ts(100), NULL);
+
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_nsec += 50000000;
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        // Times out holding the mutex again, and leaves the waiter above as
+        // the only one a signal can go to. It must really have queued and
+        // waited out the deadline rather than giving up straight away.
+        struct timespec start, end;
+        mtx_lock(lock.mutex);
+        timespec_get(&start, TIME_UTC);
+        ck_assert(cnd_timedwait(&cond, lock.mutex, &deadline) == thrd_timedout);
+        timespec_get(&end, TIME_UTC);
+        long long waited_ms = (end.tv_sec - start.tv_sec) * 1000LL + (end.tv_nsec - start.tv_nsec) / 1000000;
+        ck_assert(waited_ms >= 40 && waited_ms < 1000);
+        lock.done = true;
+        assert_thrd(cnd_signal(&cond));
+        assert_thrd(mtx_unlock(lock.mutex));
+
+        thrd_join(thread, &result);
+        ck_assert(result == 1);
+        cnd_destroy(&cond);
+    }
+
+    free_mutexes(mutexes);
+}
+END_TEST
+
 int main(void) {
     Suite* s = suite_create("Condition Tests");
     TCase* tc = tcase_create("Condition Tests");
@@ -127,6 +239,8 @@ int main(void) {
     tcase_add_test(tc, waiter_waits_for_signaler);
     tcase_add_test(tc, single_waiter_waits_for_broadcaster);
     tcase_add_test(tc, multiple_waiters_wait_for_broadcaster);
+    tcase_add_test(tc, broadcast_wakes_every_waiter_holding_the_mutex);
+    tcase_add_test(tc, timed_out_waiter_does_not_take_later_signal);
 
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,146 @@
+#include <check.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_combiner.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void combiner_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+#define THREADS 8
+#define OPS 20000
+
+// Only ever touched through the combiner. inside catches two operations
+// running at once.
+typedef struct Counter {
+    cp_atomic32 inside;
+    int overlaps;
+    intptr_t value;
+} Counter;
+
+static void* add(void* object, void* arg) {
+    Counter* counter = object;
+    if(cp_atomic_exchange32(&counter->inside, 1) != 0)
+        counter->overlaps++;
+    counter->value += (intptr_t)arg;
+    intptr_t value = counter->value;
+    // Gives other threads a chance to publish and pile up behind this one.
+    if(value % 64 == 0)
+        thrd_yield();
+    cp_atomic_store32(&counter->inside, 0);
+    return (void*)value;
+}
+
+START_TEST(apply_returns_the_result) {
+    Counter counter = { 0, 0, 0 };
+    cp_combiner_t combiner;
+    cp_combiner_slot_t* slot;
+    assert_thrd(cp_combiner_init(&combiner, &counter, 2));
+    assert_thrd(cp_combiner_join(&combiner, &slot));
+
+    ck_assert((intptr_t)cp_combiner_apply(&combiner, slot, add, (void*)5) == 5);
+    ck_assert((intptr_t)cp_combiner_apply(&combiner, slot, add, (void*)3) == 8);
+    ck_assert(counter.value == 8);
+
+    cp_combiner_leave(&combiner, slot);
+    cp_combiner_destroy(&combiner);
+}
+END_TEST
+
+START_TEST(join_fails_once_slots_run_out) {
+    Counter counter = { 0, 0, 0 };
+    cp_combiner_t combiner;
+    cp_combiner_slot_t* slots[3];
+    assert_thrd(cp_combiner_init(&combiner, &counter, 2));
+
+    assert_thrd(cp_combiner_join(&combiner, slots + 0));
+    assert_thrd(cp_combiner_join(&combiner, slots + 1));
+    ck_assert(slots[0] != slots[1]);
+    ck_assert(cp_combiner_join(&combiner, slots + 2) == thrd_busy);
+
+    // A slot given back can be joined again.
+    cp_combiner_leave(&combiner, slots[0]);
+    assert_thrd(cp_combiner_join(&combiner, slots + 2));
+    ck_assert(slots[2] == slots[0]);
+
+    ck_assert(cp_combiner_init(&combiner, &counter, 0) == thrd_error);
+    cp_combiner_destroy(&combiner);
+}
+END_TEST
+
+typedef struct Worker {
+    cp_combiner_t* combiner;
+    unsigned char* seen;
+} Worker;
+
+static int add_ones(Worker* worker) {
+    cp_combiner_slot_t* slot;
+    if(cp_combiner_join(worker->combiner, &slot) != thrd_success)
+        return 1;
+
+    // Every add returns a different total, so each one lands on its own
+    // entry and a lost or doubled update leaves a hole.
+    for(int i = 0; i < OPS; i++) {
+        intptr_t total = (intptr_t)cp_combiner_apply(worker->combiner, slot, add, (void*)1);
+        worker->seen[total - 1]++;
+    }
+    cp_combiner_leave(worker->combiner, slot);
+    return 0;
+}
+
+START_TEST(operations_from_many_threads_run_one_at_a_time) {
+    Counter counter = { 0, 0, 0 };
+    cp_combiner_t combiner;
+    thrd_t threads[THREADS];
+    Worker workers[THREADS];
+    unsigned char* seen = calloc(THREADS * OPS, 1);
+    assert_thrd(cp_combiner_init(&combiner, &counter, THREADS));
+
+    for(int i = 0; i < THREADS; i++) {
+        workers[i] = (Worker){ &combiner, seen };
+        assert_thrd(thrd_create(threads + i, (thrd_start_t)add_ones, workers + i));
+    }
+    for(int i = 0; i < THREADS; i++) {
+        int result;
+        assert_thrd(thrd_join(threads[i], &result));
+        ck_assert(result == 0);
+    }
+
+    ck_assert(counter.value == THREADS * OPS);
+    ck_assert(counter.overlaps == 0);
+    for(int i = 0; i < THREADS * OPS; i++)
+        ck_assert(seen[i] == 1);
+
+    free(seen);
+    cp_combiner_destroy(&combiner);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Combiner Tests");
+    TCase* tc = tcase_create("Combiner Tests");
+
+    tcase_add_checked_fixture(tc, combiner_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, apply_returns_the_result);
+    tcase_add_test(tc, join_fails_once_slots_run_out);
+    tcase_add_test(tc, operations_from_many_threads_run_one_at_a_time);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_counter.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void counter_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+START_TEST(counter_adds_on_one_thread) {
+    cp_counter_t counter;
+    assert_thrd(cp_counter_init(&counter, 0));
+    ck_assert(cp_counter_read(&counter) == 0);
+
+    cp_counter_inc(&counter);
+    cp_counter_add(&counter, 41);
+    cp_counter_add(&counter, -2);
+    ck_assert(cp_counter_read(&counter) == 40);
+    ck_assert(cp_counter_read_exact(&counter) == 40);
+
+    cp_counter_destroy(&counter);
+}
+END_TEST
+
+#define ADDS_PER_THREAD 100000
+#define ADDING_THREADS 8
+
+static cp_counter_t shared;
+
+static int add_and_exit(void* arg) {
+    for(int i = 0; i < ADDS_PER_THREAD; i++)
+        cp_counter_inc(&shared);
+    return 0;
+}
+
+START_TEST(counter_folds_exiting_threads) {
+    assert_thrd(cp_counter_init(&shared, 0));
+
+    // Several rounds, so slots are created and retired over and over.
+    for(int round = 1; round <= 3; round++) {
+        thrd_t threads[ADDING_THREADS];
+        for(int i = 0; i < ADDING_THREADS; i++)
+            assert_thrd(thrd_create(threads + i, add_and_exit, NULL));
+        for(int i = 0; i < ADDING_THREADS; i++)
+            assert_thrd(thrd_join(threads[i], NULL));
+
+        ck_assert(shared.slots == NULL);
+        ck_assert(cp_counter_read(&shared) == (int64_t)round * ADDING_THREADS * ADDS_PER_THREAD);
+    }
+
+    cp_counter_destroy(&shared);
+}
+END_TEST
+
+static cp_atomic32 writers_done;
+
+static int add_then_signal(void* arg) {
+    add_and_exit(arg);
+    cp_atomic_fetch_add32(&writers_done, 1);
+    return 0;
+}
+
+START_TEST(counter_reads_never_go_backwards) {
+    assert_thrd(cp_counter_init(&shared, 0));
+    writers_done = 0;
+
+    thrd_t threads[4];
+    for(int i = 0; i < 4; i++)
+        assert_thrd(thrd_create(threads + i, add_then_signal, NULL));
+
+    int64_t last = 0;
+    while(cp_atomic_load32(&writers_done) < 4) {
+        int64_t now = cp_counter_read(&shared);
+        ck_assert(now >= last);
+        last = now;
+        thrd_yield();
+    }
+    for(int i = 0; i < 4; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+    ck_assert(cp_counter_read(&shared) == 4 * ADDS_PER_THREAD);
+
+    cp_counter_destroy(&shared);
+}
+END_TEST
+
+START_TEST(counter_approximate_reads_are_cached) {
+    cp_counter_t counter;
+    assert_thrd(cp_counter_init(&counter, 100));
+
+    cp_counter_add(&counter, 5);
+    ck_assert(cp_counter_read(&counter) == 5);
+
+    // Within the window the old total comes back.
+    cp_counter_add(&counter, 5);
+    ck_assert(cp_counter_read(&counter) == 5);
+    ck_assert(cp_counter_read_exact(&counter) == 10);
+
+    thrd_sleep(&ms2ts(150), NULL);
+    ck_assert(cp_counter_read(&counter) == 10);
+
+    cp_counter_destroy(&counter);
+}
+END_TEST
+
+static cp_atomic32 may_exit;
+
+static int add_and_linger(void* arg) {
+    cp_counter_add(arg, 3);
+    cp_atomic_fetch_add32(&writers_done, 1);
+    while(!cp_atomic_load32(&may_exit))
+        thrd_yield();
+    return 0;
+}
+
+START_TEST(counter_destroy_before_threads_exit) {
+    cp_counter_t* counter = malloc(sizeof(*counter));
+    assert_thrd(cp_counter_init(counter, 0));
+    writers_done = 0;
+    may_exit = 0;
+
+    thrd_t threads[3];
+    for(int i = 0; i < 3; i++)
+        assert_thrd(thrd_create(threads + i, add_and_linger, counter));
+    while(cp_atomic_load32(&writers_done) < 3)
+        thrd_yield();
+    ck_assert(cp_counter_read(counter) == 9);
+
+    // The threads outlive the counter; their exit must not touch it.
+    cp_counter_destroy(counter);
+    free(counter);
+    cp_atomic_store32(&may_exit, 1);
+    for(int i = 0; i < 3; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Counter Tests");
+    TCase* tc = tcase_create("Counter Tests");
+
+    tcase_add_checked_fixture(tc, counter_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, counter_adds_on_one_thread);
+    tcase_add_test(tc, counter_folds_exiting_threads);
+    tcase_add_test(tc, counter_reads_never_go_backwards);
+    tcase_add_test(tc, counter_approximate_reads_are_cached);
+    tcase_add_test(tc, counter_destroy_before_threads_exit);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
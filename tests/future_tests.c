@@ -0,0 +1,365 @@
+#include <check.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_future.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void future_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static int value_of(int i) {
+    return i * 3 + 1;
+}
+
+typedef struct Delayed {
+    cp_promise_t* promise;
+    void* value;
+    int delay_ms;
+} Delayed;
+
+static int set_after(Delayed* delayed) {
+    thrd_sleep(&ms2ts(delayed->delay_ms), NULL);
+    return cp_promise_set(delayed->promise, delayed->value);
+}
+
+static void* add_one(void* value, void* arg) {
+    return (void*)((uintptr_t)value + 1);
+}
+
+static void* record_arg(void* value, void* arg) {
+    *(void**)arg = value;
+    return arg;
+}
+
+START_TEST(set_value_is_seen_by_every_future) {
+    cp_promise_t promise;
+    cp_future_t first, second;
+    void* value = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(&first, &promise));
+    assert_thrd(cp_future_share(&second, &first));
+
+    ck_assert(!cp_future_is_ready(&first));
+    assert_thrd(cp_promise_set(&promise, (void*)(uintptr_t)42));
+    ck_assert(cp_promise_set(&promise, NULL) == thrd_error);
+    ck_assert(cp_future_is_ready(&second));
+
+    assert_thrd(cp_future_wait(&first, &value));
+    ck_assert((uintptr_t)value == 42);
+    assert_thrd(cp_future_wait(&second, &value));
+    ck_assert((uintptr_t)value == 42);
+
+    // The futures keep the state alive after the promise is gone.
+    cp_promise_destroy(&promise);
+    assert_thrd(cp_future_wait(&first, &value));
+    ck_assert((uintptr_t)value == 42);
+    cp_future_destroy(&first);
+    cp_future_destroy(&second);
+}
+END_TEST
+
+START_TEST(wait_blocks_until_another_thread_sets_value) {
+    cp_promise_t promise;
+    cp_future_t future;
+    thrd_t thread;
+    int result;
+    void* value = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(&future, &promise));
+
+    Delayed delayed = { &promise, (void*)(uintptr_t)7, 100 };
+    assert_thrd(thrd_create(&thread, (int(*)(void*))set_after, &delayed));
+    assert_thrd(cp_future_wait(&future, &value));
+    ck_assert((uintptr_t)value == 7);
+
+    thrd_join(thread, &result);
+    ck_assert(result == thrd_success);
+    cp_future_destroy(&future);
+    cp_promise_destroy(&promise);
+}
+END_TEST
+
+START_TEST(timedwait_times_out_then_sees_value) {
+    cp_promise_t promise;
+    cp_future_t future;
+    void* value = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(&future, &promise));
+
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += 50000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    ck_assert(cp_future_timedwait(&future, &deadline, &value) == thrd_timedout);
+
+    // The waiter left behind by the timeout is still on the list when the
+    // promise is set, and must not wake this thread's next wait early.
+    assert_thrd(cp_promise_set(&promise, (void*)(uintptr_t)5));
+    assert_thrd(cp_future_timedwait(&future, &deadline, &value));
+    ck_assert((uintptr_t)value == 5);
+
+    cp_future_destroy(&future);
+    cp_promise_destroy(&promise);
+}
+END_TEST
+
+START_TEST(broken_promise_breaks_futures_and_continuations) {
+    cp_promise_t promise;
+    cp_future_t future, next;
+    void* value = NULL;
+    void* seen = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(&future, &promise));
+    assert_thrd(cp_future_then(&next, &future, record_arg, &seen));
+
+    cp_promise_destroy(&promise);
+    ck_assert(cp_future_wait(&future, &value) == thrd_error);
+    ck_assert(cp_future_wait(&next, &value) == thrd_error);
+    ck_assert(seen == NULL);
+
+    cp_future_destroy(&next);
+    cp_future_destroy(&future);
+}
+END_TEST
+
+#define CHAIN_LENGTH 100
+
+START_TEST(then_chain_runs_in_order) {
+    cp_promise_t promise;
+    cp_future_t futures[CHAIN_LENGTH + 1];
+    void* value = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(futures, &promise));
+
+    // Half the chain is built before the value is set, half after.
+    for(int i = 0; i < CHAIN_LENGTH / 2; i++)
+        assert_thrd(cp_future_then(futures + i + 1, futures + i, add_one, NULL));
+    assert_thrd(cp_promise_set(&promise, (void*)(uintptr_t)0));
+    for(int i = CHAIN_LENGTH / 2; i < CHAIN_LENGTH; i++)
+        assert_thrd(cp_future_then(futures + i + 1, futures + i, add_one, NULL));
+
+    assert_thrd(cp_future_wait(futures + CHAIN_LENGTH, &value));
+    ck_assert((uintptr_t)value == CHAIN_LENGTH);
+
+    for(int i = 0; i <= CHAIN_LENGTH; i++)
+        cp_future_destroy(futures + i);
+    cp_promise_destroy(&promise);
+}
+END_TEST
+
+#define DEEP_CHAIN 1000000
+
+// Completing the head runs every link. That has to take constant stack,
+// however long the chain.
+START_TEST(deep_then_chain_completes) {
+    cp_promise_t promise;
+    cp_future_t head, tail;
+    void* value = NULL;
+    assert_thrd(cp_promise_init(&promise));
+    assert_thrd(cp_promise_get_future(&head, &promise));
+
+    tail = head;
+    for(int i = 0; i < DEEP_CHAIN; i++) {
+        cp_future_t next;
+        assert_thrd(cp_future_then(&next, &tail, add_one, NULL));
+        cp_future_destroy(&tail);
+        tail = next;
+    }
+
+    assert_thrd(cp_promise_set(&promise, (void*)(uintptr_t)0));
+    assert_thrd(cp_future_wait(&tail, &value));
+    ck_assert((uintptr_t)value == DEEP_CHAIN);
+
+    cp_future_destroy(&tail);
+    cp_promise_destroy(&promise);
+}
+END_TEST
+
+#define FAN_OUT 64
+#define SETTERS 4
+
+typedef struct Setters {
+    cp_promise_t* promises;
+    int first;
+} Setters;
+
+static int set_every_fourth(Setters* setters) {
+    for(int i = setters->first; i < FAN_OUT; i += SETTERS) {
+        if(cp_promise_set(setters->promises + i, (void*)(uintptr_t)value_of(i)) != thrd_success)
+            return 0;
+    }
+    return 1;
+}
+
+START_TEST(when_all_completes_after_every_input) {
+    cp_promise_t promises[FAN_OUT];
+    cp_future_t futures[FAN_OUT];
+    cp_future_t all;
+    thrd_t threads[SETTERS];
+    Setters setters[SETTERS];
+    void* value = NULL;
+
+    for(int i = 0; i < FAN_OUT; i++) {
+        assert_thrd(cp_promise_init(promises + i));
+        assert_thrd(cp_promise_get_future(futures + i, promises + i));
+    }
+    assert_thrd(cp_when_all(&all, futures, FAN_OUT));
+    ck_assert(!cp_future_is_ready(&all));
+
+    for(int i = 0; i < SETTERS; i++) {
+        setters[i] = (Setters){ promises, i };
+        assert_thrd(thrd_create(threads + i, (int(*)(void*))set_every_fourth, setters + i));
+    }
+    assert_thrd(cp_future_wait(&all, NULL));
+
+    for(int i = 0; i < FAN_OUT; i++) {
+        ck_assert(cp_future_is_ready(futures + i));
+        assert_thrd(cp_future_wait(futures + i, &value));
+        ck_assert((uintptr_t)value == (uintptr_t)value_of(i));
+    }
+    for(int i = 0; i < SETTERS; i++) {
+        int result;
+        thrd_join(threads[i], &result);
+        ck_assert(result == 1);
+    }
+
+    cp_future_destroy(&all);
+    for(int i = 0; i < FAN_OUT; i++) {
+        cp_future_destroy(futures + i);
+        cp_promise_destroy(promises + i);
+    }
+
+    assert_thrd(cp_when_all(&all, NULL, 0));
+    ck_assert(cp_future_is_ready(&all));
+    cp_future_destroy(&all);
+}
+END_TEST
+
+START_TEST(when_all_is_broken_by_one_broken_input) {
+    cp_promise_t promises[3];
+    cp_future_t futures[3];
+    cp_future_t all;
+
+    for(int i = 0; i < 3; i++) {
+        assert_thrd(cp_promise_init(promises + i));
+        assert_thrd(cp_promise_get_future(futures + i, promises + i));
+    }
+    assert_thrd(cp_when_all(&all, futures, 3));
+
+    assert_thrd(cp_promise_set(promises, NULL));
+    cp_promise_destroy(promises + 1);
+    ck_assert(!cp_future_is_ready(&all));
+    assert_thrd(cp_promise_set(promises + 2, NULL));
+    ck_assert(cp_future_wait(&all, NULL) == thrd_error);
+
+    cp_future_destroy(&all);
+    for(int i = 0; i < 3; i++)
+        cp_future_destroy(futures + i);
+    cp_promise_destroy(promises);
+    cp_promise_destroy(promises + 2);
+}
+END_TEST
+
+START_TEST(when_any_reports_first_completed_index) {
+    cp_promise_t promises[FAN_OUT];
+    cp_future_t futures[FAN_OUT];
+    cp_future_t any;
+    thrd_t thread;
+    int result;
+    void* value = NULL;
+
+    for(int i = 0; i < FAN_OUT; i++) {
+        assert_thrd(cp_promise_init(promises + i));
+        assert_thrd(cp_promise_get_future(futures + i, promises + i));
+    }
+    assert_thrd(cp_when_any(&any, futures, FAN_OUT));
+
+    Delayed delayed = { promises + 37, NULL, 50 };
+    assert_thrd(thrd_create(&thread, (int(*)(void*))set_after, &delayed));
+    assert_thrd(cp_future_wait(&any, &value));
+    ck_assert((uintptr_t)value == 37);
+    thrd_join(thread, &result);
+    ck_assert(result == thrd_success);
+
+    // Later completions leave it alone.
+    assert_thrd(cp_promise_set(promises + 3, NULL));
+    assert_thrd(cp_future_wait(&any, &value));
+    ck_assert((uintptr_t)value == 37);
+
+    // The rest of its callbacks are still on the remaining inputs, and the
+    // state has to outlive them.
+    cp_future_destroy(&any);
+    for(int i = 0; i < FAN_OUT; i++) {
+        cp_future_destroy(futures + i);
+        cp_promise_destroy(promises + i);
+    }
+
+    ck_assert(cp_when_any(&any, NULL, 0) == thrd_error);
+}
+END_TEST
+
+static int wait_for(cp_future_t* future) {
+    return cp_future_wait(future, NULL);
+}
+
+START_TEST(many_waiters_wake_on_one_set) {
+    thrd_t threads[SETTERS];
+
+    for(int round = 0; round < 100; round++) {
+        cp_promise_t promise;
+        cp_future_t waiting[SETTERS];
+        assert_thrd(cp_promise_init(&promise));
+        for(int i = 0; i < SETTERS; i++) {
+            assert_thrd(cp_promise_get_future(waiting + i, &promise));
+            assert_thrd(thrd_create(threads + i, (int(*)(void*))wait_for, waiting + i));
+        }
+        if(round % 2)
+            thrd_yield();
+        assert_thrd(cp_promise_set(&promise, NULL));
+        for(int i = 0; i < SETTERS; i++) {
+            int result;
+            thrd_join(threads[i], &result);
+            ck_assert(result == thrd_success);
+            cp_future_destroy(waiting + i);
+        }
+        cp_promise_destroy(&promise);
+    }
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Future Tests");
+    TCase* tc = tcase_create("Future Tests");
+
+    tcase_add_checked_fixture(tc, future_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, set_value_is_seen_by_every_future);
+    tcase_add_test(tc, wait_blocks_until_another_thread_sets_value);
+    tcase_add_test(tc, timedwait_times_out_then_sees_value);
+    tcase_add_test(tc, broken_promise_breaks_futures_and_continuations);
+    tcase_add_test(tc, then_chain_runs_in_order);
+    tcase_add_test(tc, deep_then_chain_completes);
+    tcase_add_test(tc, when_all_completes_after_every_input);
+    tcase_add_test(tc, when_all_is_broken_by_one_broken_input);
+    tcase_add_test(tc, when_any_reports_first_completed_index);
+    tcase_add_test(tc, many_waiters_wake_on_one_set);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,258 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_hashmap.h"
+#include "test_utils.h"
+
+#define KEY(i) ((void*)(uintptr_t)(i))
+
+static int test_num = 0;
+static cp_atomic32 freed_entries;
+
+static void hashmap_test_start(void) {
+    printf("Test number %d\n", test_num++);
+    freed_entries = 0;
+}
+
+static void count_free(void* key, void* value) {
+    cp_atomic_fetch_add32(&freed_entries, 1);
+}
+
+START_TEST(hashmap_put_get_remove) {
+    cp_hashmap_t map;
+    assert_thrd(cp_hashmap_init(&map, 0, NULL, NULL, count_free));
+
+    void* value = NULL;
+    ck_assert(!cp_hashmap_get(&map, KEY(1), &value));
+
+    assert_thrd(cp_hashmap_put(&map, KEY(1), KEY(100)));
+    assert_thrd(cp_hashmap_put(&map, KEY(2), KEY(200)));
+    ck_assert(cp_hashmap_size(&map) == 2);
+    ck_assert(cp_hashmap_get(&map, KEY(1), &value) && value == KEY(100));
+    ck_assert(cp_hashmap_get(&map, KEY(2), &value) && value == KEY(200));
+
+    // put replaces, insert doesn't.
+    assert_thrd(cp_hashmap_put(&map, KEY(1), KEY(101)));
+    ck_assert(cp_hashmap_insert(&map, KEY(1), KEY(102)) == thrd_busy);
+    ck_assert(cp_hashmap_get(&map, KEY(1), &value) && value == KEY(101));
+    ck_assert(cp_hashmap_size(&map) == 2);
+
+    ck_assert(cp_hashmap_remove(&map, KEY(1)));
+    ck_assert(!cp_hashmap_remove(&map, KEY(1)));
+    ck_assert(!cp_hashmap_get(&map, KEY(1), &value));
+    ck_assert(cp_hashmap_size(&map) == 1);
+
+    // The replaced and removed entries, then the one left over.
+    cp_hashmap_destroy(&map);
+    ck_assert(freed_entries == 3);
+}
+END_TEST
+
+static uint64_t string_hash(const void* key) {
+    uint64_t hash = 1469598103934665603ull;
+    for(const char* c = key; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+    return hash;
+}
+
+static int string_equal(const void* lhs, const void* rhs) {
+    return strcmp(lhs, rhs) == 0;
+}
+
+START_TEST(hashmap_custom_keys) {
+    cp_hashmap_t map;
+    assert_thrd(cp_hashmap_init(&map, 0, string_hash, string_equal, NULL));
+
+    char first[] = "alpha";
+    char second[] = "beta";
+    assert_thrd(cp_hashmap_put(&map, first, KEY(1)));
+    assert_thrd(cp_hashmap_put(&map, second, KEY(2)));
+
+    // A different pointer to an equal string finds the entry.
+    char lookup[] = "alpha";
+    void* value = NULL;
+    ck_assert(cp_hashmap_get(&map, lookup, &value) && value == KEY(1));
+    ck_assert(!cp_hashmap_get(&map, "gamma", &value));
+
+    cp_hashmap_destroy(&map);
+}
+END_TEST
+
+START_TEST(hashmap_grows_without_losing_keys) {
+    cp_hashmap_t map;
+    assert_thrd(cp_hashmap_init(&map, 0, NULL, NULL, count_free));
+
+    for(uintptr_t i = 1; i <= 100000; i++) {
+        assert_thrd(cp_hashmap_put(&map, KEY(i), KEY(i * 2)));
+        // Spot check an early key while the table is being resized.
+        void* value = NULL;
+        ck_assert(cp_hashmap_get(&map, KEY(1), &value) && value == KEY(2));
+    }
+    ck_assert(cp_hashmap_size(&map) == 100000);
+
+    for(uintptr_t i = 1; i <= 100000; i++) {
+        void* value = NULL;
+        ck_assert(cp_hashmap_get(&map, KEY(i), &value) && value == KEY(i * 2));
+    }
+
+    for(uintptr_t i = 1; i <= 100000; i += 2)
+        ck_assert(cp_hashmap_remove(&map, KEY(i)));
+    ck_assert(cp_hashmap_size(&map) == 50000);
+
+    cp_hashmap_destroy(&map);
+    ck_assert(freed_entries == 100000);
+}
+END_TEST
+
+#define STABLE_KEYS 1000
+#define CHURN_KEYS 20000
+#define CHURN_WRITERS 3
+#define CHURN_READERS 3
+
+typedef struct Churn {
+    cp_hashmap_t* map;
+    int writer;
+    cp_atomic32* done;
+    cp_atomic32* misses;
+} Churn;
+
+// Stable keys are never touched after setup, so a reader must always find
+// them, even while writers push the map through several resizes.
+static int churn_reader(void* arg) {
+    Churn* churn = arg;
+    while(!cp_atomic_load32(churn->done)) {
+        for(uintptr_t i = 1; i <= STABLE_KEYS; i++) {
+            void* value = NULL;
+            if(!cp_hashmap_get(churn->map, KEY(i), &value) || value != KEY(i))
+                cp_atomic_fetch_add32(churn->misses, 1);
+        }
+    }
+    return 0;
+}
+
+static int churn_writer(void* arg) {
+    Churn* churn = arg;
+    uintptr_t base = 1000000 * (uintptr_t)(churn->writer + 1);
+    for(int round = 0; round < 3; round++) {
+        for(uintptr_t i = 0; i < CHURN_KEYS; i++)
+            cp_hashmap_put(churn->map, KEY(base + i), KEY(i));
+        for(uintptr_t i = 0; i < CHURN_KEYS; i++) {
+            if(!cp_hashmap_remove(churn->map, KEY(base + i)))
+                cp_atomic_fetch_add32(churn->misses, 1);
+        }
+    }
+    return 0;
+}
+
+START_TEST(hashmap_concurrent_churn) {
+    cp_hashmap_t map;
+    assert_thrd(cp_hashmap_init(&map, 0, NULL, NULL, count_free));
+    for(uintptr_t i = 1; i <= STABLE_KEYS; i++)
+        assert_thrd(cp_hashmap_put(&map, KEY(i), KEY(i)));
+
+    cp_atomic32 done = 0;
+    cp_atomic32 misses = 0;
+    Churn readers[CHURN_READERS];
+    Churn writers[CHURN_WRITERS];
+    thrd_t reader_threads[CHURN_READERS];
+    thrd_t writer_threads[CHURN_WRITERS];
+
+    for(int i = 0; i < CHURN_READERS; i++) {
+        readers[i] = (Churn){ &map, 0, &done, &misses };
+        assert_thrd(thrd_create(reader_threads + i, churn_reader, readers + i));
+    }
+    for(int i = 0; i < CHURN_WRITERS; i++) {
+        writers[i] = (Churn){ &map, i, &done, &misses };
+        assert_thrd(thrd_create(writer_threads + i, churn_writer, writers + i));
+    }
+
+    for(int i = 0; i < CHURN_WRITERS; i++)
+        assert_thrd(thrd_join(writer_threads[i], NULL));
+    cp_atomic_store32(&done, 1);
+    for(int i = 0; i < CHURN_READERS; i++)
+        assert_thrd(thrd_join(reader_threads[i], NULL));
+
+    ck_assert(misses == 0);
+    ck_assert(cp_hashmap_size(&map) == STABLE_KEYS);
+
+    // Every entry ever added is freed exactly once.
+    cp_hashmap_destroy(&map);
+    ck_assert(freed_entries == STABLE_KEYS + CHURN_WRITERS * 3 * CHURN_KEYS);
+}
+END_TEST
+
+typedef struct Boxed {
+    cp_atomic32 alive;
+} Boxed;
+
+static void free_boxed(void* key, void* value) {
+    Boxed* box = value;
+    cp_atomic_store32(&box->alive, 0);
+}
+
+static Boxed boxes[2000];
+
+static int replace_run(void* arg) {
+    cp_hashmap_t* map = arg;
+    for(int i = 0; i < 2000; i++) {
+        cp_atomic_store32(&boxes[i].alive, 1);
+        cp_hashmap_put(map, KEY(7), boxes + i);
+        thrd_yield();
+    }
+    return 0;
+}
+
+START_TEST(hashmap_read_section_keeps_values_alive) {
+    cp_hashmap_t map;
+    assert_thrd(cp_hashmap_init(&map, 0, NULL, NULL, free_boxed));
+
+    Boxed first = { 1 };
+    assert_thrd(cp_hashmap_put(&map, KEY(7), &first));
+
+    thrd_t writer;
+    assert_thrd(thrd_create(&writer, replace_run, &map));
+
+    // Values seen inside a read section can't be released until it ends.
+    int stale = 0;
+    for(int i = 0; i < 200; i++) {
+        cp_hashmap_read_begin();
+        void* value = NULL;
+        ck_assert(cp_hashmap_get(&map, KEY(7), &value));
+        thrd_yield();
+        if(!cp_atomic_load32(&((Boxed*)value)->alive))
+            stale++;
+        cp_hashmap_read_end();
+    }
+
+    assert_thrd(thrd_join(writer, NULL));
+    ck_assert(stale == 0);
+    cp_hashmap_destroy(&map);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Hash Map Tests");
+    TCase* tc = tcase_create("Hash Map Tests");
+
+    tcase_add_checked_fixture(tc, hashmap_test_start, NULL);
+    tcase_set_timeout(tc, 60);
+
+    tcase_add_test(tc, hashmap_put_get_remove);
+    tcase_add_test(tc, hashmap_custom_keys);
+    tcase_add_test(tc, hashmap_grows_without_losing_keys);
+    tcase_add_test(tc, hashmap_concurrent_churn);
+    tcase_add_test(tc, hashmap_read_section_keeps_values_alive);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,247 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_lfstack.h"
+#include "test_utils.h"
+
+#define STRESS_THREADS 8
+#define STRESS_NODES 64
+#define STRESS_ROUNDS 50000
+
+static int test_num = 0;
+
+static void lfstack_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+typedef struct Item {
+    cp_lfstack_node_t node;
+    int id;
+    cp_atomic32 held;
+} Item;
+
+START_TEST(lfstack_is_lifo) {
+    cp_lfstack_t stack;
+    assert_thrd(cp_lfstack_init(&stack, 0));
+    ck_assert(cp_lfstack_empty(&stack));
+    ck_assert(cp_lfstack_pop(&stack) == NULL);
+
+    Item items[10];
+    for(int i = 0; i < 10; i++) {
+        items[i].id = i;
+        cp_lfstack_push(&stack, &items[i].node);
+    }
+    ck_assert(!cp_lfstack_empty(&stack));
+
+    for(int i = 9; i >= 0; i--) {
+        Item* item = (Item*)cp_lfstack_pop(&stack);
+        ck_assert(item && item->id == i);
+    }
+    ck_assert(cp_lfstack_pop(&stack) == NULL);
+
+    cp_lfstack_destroy(&stack);
+}
+END_TEST
+
+START_TEST(lfstack_pop_all_and_push_list) {
+    cp_lfstack_t stack;
+    assert_thrd(cp_lfstack_init(&stack, 0));
+    ck_assert(cp_lfstack_pop_all(&stack) == NULL);
+
+    Item items[5];
+    for(int i = 0; i < 5; i++) {
+        items[i].id = i;
+        cp_lfstack_push(&stack, &items[i].node);
+    }
+
+    cp_lfstack_node_t* list = cp_lfstack_pop_all(&stack);
+    ck_assert(cp_lfstack_empty(&stack));
+    int expected = 4;
+    cp_lfstack_node_t* last = NULL;
+    for(cp_lfstack_node_t* node = list; node; node = node->next) {
+        ck_assert(((Item*)node)->id == expected--);
+        last = node;
+    }
+    ck_assert(expected == -1);
+
+    // Putting the chain back keeps its order.
+    cp_lfstack_push_list(&stack, list, last);
+    for(int i = 4; i >= 0; i--)
+        ck_assert(((Item*)cp_lfstack_pop(&stack))->id == i);
+
+    ck_assert(cp_lfstack_init(&stack, 0x100) == thrd_error);
+    cp_lfstack_destroy(&stack);
+}
+END_TEST
+
+typedef struct Stress {
+    cp_lfstack_t* stack;
+    cp_atomic32 failures;
+} Stress;
+
+// Pops a few nodes, checks nobody else holds them, and pushes them back.
+// Any ABA slip shows up as a node handed out twice.
+static int stress_run(void* arg) {
+    Stress* stress = arg;
+    Item* held[4];
+
+    for(int round = 0; round < STRESS_ROUNDS; round++) {
+        int count = 0;
+        int want = 1 + round % 4;
+        while(count < want) {
+            Item* item = (Item*)cp_lfstack_pop(stress->stack);
+            if(!item)
+                break;
+            if(cp_atomic_exchange32(&item->held, 1) != 0)
+                cp_atomic_fetch_add32(&stress->failures, 1);
+            held[count++] = item;
+        }
+        while(count > 0) {
+            Item* item = held[--count];
+            cp_atomic_store32(&item->held, 0);
+            cp_lfstack_push(stress->stack, &item->node);
+        }
+    }
+    return 0;
+}
+
+static void run_stress(int flags) {
+    cp_lfstack_t stack;
+    assert_thrd(cp_lfstack_init(&stack, flags));
+
+    Item items[STRESS_NODES];
+    for(int i = 0; i < STRESS_NODES; i++) {
+        items[i].id = i;
+        items[i].held = 0;
+        cp_lfstack_push(&stack, &items[i].node);
+    }
+
+    Stress stress = { &stack, 0 };
+    thrd_t threads[STRESS_THREADS];
+    for(int i = 0; i < STRESS_THREADS; i++)
+        assert_thrd(thrd_create(threads + i, stress_run, &stress));
+    for(int i = 0; i < STRESS_THREADS; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    ck_assert(stress.failures == 0);
+
+    // Every node is back exactly once.
+    int seen[STRESS_NODES] = { 0 };
+    int total = 0;
+    for(cp_lfstack_node_t* node = cp_lfstack_pop_all(&stack); node; node = node->next) {
+        seen[((Item*)node)->id]++;
+        total++;
+    }
+    ck_assert(total == STRESS_NODES);
+    for(int i = 0; i < STRESS_NODES; i++)
+        ck_assert(seen[i] == 1);
+
+    cp_lfstack_destroy(&stack);
+}
+
+START_TEST(lfstack_stress_no_duplicates) {
+    run_stress(0);
+}
+END_TEST
+
+START_TEST(lfstack_stress_with_elimination) {
+    run_stress(cp_lfstack_elimination);
+}
+END_TEST
+
+#define TRANSFER_PER_PRODUCER 20000
+
+typedef struct Transfer {
+    cp_lfstack_t* stack;
+    Item* items;
+    cp_atomic32 producers_left;
+    cp_atomic32 received;
+    cp_atomic32 seen[2 * TRANSFER_PER_PRODUCER];
+} Transfer;
+
+typedef struct Producer {
+    Transfer* transfer;
+    int base;
+} Producer;
+
+static int transfer_producer(void* arg) {
+    Producer* producer = arg;
+    Transfer* transfer = producer->transfer;
+    for(int i = 0; i < TRANSFER_PER_PRODUCER; i++)
+        cp_lfstack_push(transfer->stack, &transfer->items[producer->base + i].node);
+    cp_atomic_fetch_add32(&transfer->producers_left, -1);
+    return 0;
+}
+
+static int transfer_consumer(void* arg) {
+    Transfer* transfer = arg;
+    for(;;) {
+        Item* item = (Item*)cp_lfstack_pop(transfer->stack);
+        if(item) {
+            cp_atomic_fetch_add32(&transfer->seen[item->id], 1);
+            cp_atomic_fetch_add32(&transfer->received, 1);
+        } else if(cp_atomic_load32(&transfer->producers_left) == 0 && cp_lfstack_empty(transfer->stack)) {
+            return 0;
+        } else {
+            thrd_yield();
+        }
+    }
+}
+
+START_TEST(lfstack_transfers_every_node_once) {
+    cp_lfstack_t stack;
+    assert_thrd(cp_lfstack_init(&stack, cp_lfstack_elimination));
+
+    Transfer* transfer = calloc(1, sizeof(*transfer));
+    ck_assert(transfer);
+    transfer->stack = &stack;
+    transfer->items = malloc(sizeof(Item) * 2 * TRANSFER_PER_PRODUCER);
+    ck_assert(transfer->items);
+    for(int i = 0; i < 2 * TRANSFER_PER_PRODUCER; i++)
+        transfer->items[i].id = i;
+    transfer->producers_left = 2;
+
+    Producer producers[2] = { { transfer, 0 }, { transfer, TRANSFER_PER_PRODUCER } };
+    thrd_t threads[4];
+    assert_thrd(thrd_create(threads + 0, transfer_producer, producers + 0));
+    assert_thrd(thrd_create(threads + 1, transfer_producer, producers + 1));
+    assert_thrd(thrd_create(threads + 2, transfer_consumer, transfer));
+    assert_thrd(thrd_create(threads + 3, transfer_consumer, transfer));
+    for(int i = 0; i < 4; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    ck_assert(transfer->received == 2 * TRANSFER_PER_PRODUCER);
+    for(int i = 0; i < 2 * TRANSFER_PER_PRODUCER; i++)
+        ck_assert(transfer->seen[i] == 1);
+
+    free(transfer->items);
+    free(transfer);
+    cp_lfstack_destroy(&stack);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Lock-Free Stack Tests");
+    TCase* tc = tcase_create("Lock-Free Stack Tests");
+
+    tcase_add_checked_fixture(tc, lfstack_test_start, NULL);
+    tcase_set_timeout(tc, 60);
+
+    tcase_add_test(tc, lfstack_is_lifo);
+    tcase_add_test(tc, lfstack_pop_all_and_push_list);
+    tcase_add_test(tc, lfstack_stress_no_duplicates);
+    tcase_add_test(tc, lfstack_stress_with_elimination);
+    tcase_add_test(tc, lfstack_transfers_every_node_once);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../cpthreads.h"
+#include "../cp_loop.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void loop_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static void count_call(void* arg) {
+    (*(int*)arg)++;
+}
+
+static void stop_call(void* arg) {
+    cp_loop_stop(arg);
+}
+
+typedef struct Poster {
+    cp_loop_t* loop;
+    int count;
+    int* counter;
+} Poster;
+
+static int poster(void* arg) {
+    Poster* p = arg;
+    for(int i = 0; i < p->count; i++) {
+        if(cp_loop_post(p->loop, count_call, p->counter) != thrd_success)
+            return 0;
+    }
+    cp_loop_post(p->loop, stop_call, p->loop);
+    return 1;
+}
+
+static int record[8];
+static int record_count = 0;
+
+static void record_call(void* arg) {
+    record[record_count++] = (int)(intptr_t)arg;
+}
+
+START_TEST(loop_post_runs_on_loop_thread) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    int counter = 0;
+    Poster p = { &loop, 1000, &counter };
+    thrd_t thread;
+    int result;
+    assert_thrd(thrd_create(&thread, poster, &p));
+    assert_thrd(cp_loop_run(&loop));
+    assert_thrd(thrd_join(thread, &result));
+
+    ck_assert(result == 1);
+    ck_assert(counter == 1000);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+START_TEST(loop_post_runs_in_order) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    record_count = 0;
+    for(int i = 0; i < 5; i++)
+        assert_thrd(cp_loop_post(&loop, record_call, (void*)(intptr_t)i));
+    ck_assert(cp_loop_run_once(&loop, 0) == 5);
+
+    ck_assert(record_count == 5);
+    for(int i = 0; i < 5; i++)
+        ck_assert(record[i] == i);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+START_TEST(loop_posts_coalesce_wakeups) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    int counter = 0;
+    for(int i = 0; i < 100; i++)
+        assert_thrd(cp_loop_post(&loop, count_call, &counter));
+    ck_assert(loop.doorbells == 1);
+
+    cp_loop_run_once(&loop, 0);
+    ck_assert(counter == 100);
+
+    assert_thrd(cp_loop_post(&loop, count_call, &counter));
+    ck_assert(loop.doorbells == 2);
+    cp_loop_run_once(&loop, 0);
+    ck_assert(counter == 101);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+typedef struct Reader {
+    char buffer[16];
+    int length;
+    unsigned events;
+} Reader;
+
+static void read_ready(int fd, unsigned events, void* arg) {
+    Reader* reader = arg;
+    reader->events = events;
+    reader->length = (int)read(fd, reader->buffer, sizeof(reader->buffer));
+}
+
+static int delayed_write(void* arg) {
+    thrd_sleep(&ms2ts(100), NULL);
+    return write(*(int*)arg, "ping", 4) == 4;
+}
+
+START_TEST(loop_watch_pipe_readable) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    int fds[2];
+    ck_assert(pipe(fds) == 0);
+
+    Reader reader = { { 0 }, 0, 0 };
+    cp_loop_watch_t watch;
+    assert_thrd(cp_loop_watch(&loop, &watch, fds[0], cp_loop_read, read_ready, &reader));
+
+    thrd_t thread;
+    int result;
+    assert_thrd(thrd_create(&thread, delayed_write, &fds[1]));
+    ck_assert(cp_loop_run_once(&loop, 5000) == 1);
+    assert_thrd(thrd_join(thread, &result));
+
+    ck_assert(result == 1);
+    ck_assert(reader.length == 4);
+    ck_assert(memcmp(reader.buffer, "ping", 4) == 0);
+    ck_assert(reader.events & cp_loop_read);
+
+    assert_thrd(cp_loop_unwatch(&loop, &watch));
+    close(fds[0]);
+    close(fds[1]);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+// Whichever watch fires first unwatches and frees the other one, even
+// though its event is already in the same batch.
+typedef struct Pair {
+    cp_loop_t* loop;
+    cp_loop_watch_t* watches[2];
+    int calls;
+} Pair;
+
+static void unwatch_other(int fd, unsigned events, void* arg) {
+    Pair* pair = arg;
+    pair->calls++;
+    for(int i = 0; i < 2; i++) {
+        if(pair->watches[i] && pair->watches[i]->fd != fd) {
+            assert_thrd(cp_loop_unwatch(pair->loop, pair->watches[i]));
+            free(pair->watches[i]);
+            pair->watches[i] = NULL;
+        }
+    }
+}
+
+START_TEST(loop_unwatch_skips_rest_of_batch) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    int fds[2][2];
+    Pair pair = { &loop, { NULL, NULL }, 0 };
+    for(int i = 0; i < 2; i++) {
+        ck_assert(pipe(fds[i]) == 0);
+        ck_assert(write(fds[i][1], "ping", 4) == 4);
+        pair.watches[i] = malloc(sizeof(cp_loop_watch_t));
+        assert_thrd(cp_loop_watch(&loop, pair.watches[i], fds[i][0], cp_loop_read, unwatch_other, &pair));
+    }
+
+    ck_assert(cp_loop_run_once(&loop, 1000) == 1);
+    ck_assert(pair.calls == 1);
+
+    for(int i = 0; i < 2; i++) {
+        if(pair.watches[i]) {
+            assert_thrd(cp_loop_unwatch(&loop, pair.watches[i]));
+            free(pair.watches[i]);
+        }
+        close(fds[i][0]);
+        close(fds[i][1]);
+    }
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+START_TEST(loop_watch_socket_and_post) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    int fds[2];
+    ck_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    Reader reader = { { 0 }, 0, 0 };
+    cp_loop_watch_t watch;
+    assert_thrd(cp_loop_watch(&loop, &watch, fds[0], cp_loop_read, read_ready, &reader));
+
+    int counter = 0;
+    assert_thrd(cp_loop_post(&loop, count_call, &counter));
+    ck_assert(write(fds[1], "pong", 4) == 4);
+
+    int handled = 0;
+    while(handled < 2)
+        handled += cp_loop_run_once(&loop, 1000);
+
+    ck_assert(counter == 1);
+    ck_assert(reader.length == 4);
+
+    close(fds[1]);
+    cp_loop_run_once(&loop, 1000);
+    ck_assert(reader.length == 0);
+
+    assert_thrd(cp_loop_unwatch(&loop, &watch));
+    close(fds[0]);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+START_TEST(loop_timers_fire_in_deadline_order) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    cp_loop_timer_t timers[3] = { 0 };
+    record_count = 0;
+    assert_thrd(cp_loop_timer_start(&loop, timers + 0, 60, record_call, (void*)(intptr_t)2));
+    assert_thrd(cp_loop_timer_start(&loop, timers + 1, 20, record_call, (void*)(intptr_t)0));
+    assert_thrd(cp_loop_timer_start(&loop, timers + 2, 40, record_call, (void*)(intptr_t)1));
+
+    while(record_count < 3)
+        cp_loop_run_once(&loop, -1);
+
+    for(int i = 0; i < 3; i++) {
+        ck_assert(record[i] == i);
+        ck_assert(!cp_loop_timer_active(timers + i));
+    }
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+START_TEST(loop_timer_cancel) {
+    cp_loop_t loop;
+    assert_thrd(cp_loop_init(&loop));
+
+    cp_loop_timer_t cancelled = { 0 }, fired = { 0 };
+    int counter = 0;
+    assert_thrd(cp_loop_timer_start(&loop, &cancelled, 10, count_call, &counter));
+    assert_thrd(cp_loop_timer_start(&loop, &fired, 50, count_call, &counter));
+    ck_assert(cp_loop_timer_active(&cancelled));
+    assert_thrd(cp_loop_timer_cancel(&loop, &cancelled));
+    ck_assert(!cp_loop_timer_active(&cancelled));
+    ck_assert(cp_loop_timer_cancel(&loop, &cancelled) == thrd_error);
+
+    while(cp_loop_timer_active(&fired))
+        cp_loop_run_once(&loop, -1);
+
+    ck_assert(counter == 1);
+    cp_loop_destroy(&loop);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Loop Tests");
+    TCase* tc = tcase_create("Loop Tests");
+
+    tcase_add_checked_fixture(tc, loop_test_start, NULL);
+
+    tcase_add_test(tc, loop_post_runs_on_loop_thread);
+    tcase_add_test(tc, loop_post_runs_in_order);
+    tcase_add_test(tc, loop_posts_coalesce_wakeups);
+    tcase_add_test(tc, loop_watch_pipe_readable);
+    tcase_add_test(tc, loop_unwatch_skips_rest_of_batch);
+    tcase_add_test(tc, loop_watch_socket_and_post);
+    tcase_add_test(tc, loop_timers_fire_in_deadline_order);
+    tcase_add_test(tc, loop_timer_cancel);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
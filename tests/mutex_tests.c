@@ -173,6 +173,49 @@ START_TEST(mtx_try_lock_second_fails) {
 }
 END_TEST
 
+static int typed_try_lock_test(void* arg) {
+    mtx_t* mutex = arg;
+    int result = cp_mtx_plain_trylock(mutex);
+    if(result == thrd_success)
+        cp_mtx_plain_unlock(mutex);
+    return result;
+}
+
+START_TEST(mtx_typed_variants_match_generic) {
+    mtx_t plain, recursive;
+    assert_thrd(mtx_init(&plain, mtx_plain));
+    assert_thrd(mtx_init(&recursive, mtx_plain | mtx_recursive));
+
+    // Locked through the typed path, seen as held by the generic one.
+    assert_thrd(cp_mtx_plain_lock(&plain));
+    thrd_t thread;
+    int result;
+    assert_thrd(thrd_create(&thread, try_lock_test, &plain));
+    assert_thrd(thrd_join(thread, &result));
+    ck_assert(result == thrd_busy);
+    assert_thrd(cp_mtx_plain_unlock(&plain));
+
+    // And the other way around.
+    assert_thrd(mtx_lock(&plain));
+    assert_thrd(thrd_create(&thread, typed_try_lock_test, &plain));
+    assert_thrd(thrd_join(thread, &result));
+    ck_assert(result == thrd_busy);
+    assert_thrd(mtx_unlock(&plain));
+    assert_thrd(cp_mtx_plain_trylock(&plain));
+    assert_thrd(cp_mtx_plain_unlock(&plain));
+
+    assert_thrd(cp_mtx_recursive_lock(&recursive));
+    assert_thrd(cp_mtx_recursive_trylock(&recursive));
+    assert_thrd(mtx_lock(&recursive));
+    assert_thrd(mtx_unlock(&recursive));
+    assert_thrd(cp_mtx_recursive_unlock(&recursive));
+    assert_thrd(cp_mtx_recursive_unlock(&recursive));
+
+    mtx_destroy(&recursive);
+    mtx_destroy(&plain);
+}
+END_TEST
+
 int main(void) {
     Suite* s = suite_create("Mutex Tests");
     TCase* tc = tcase_create("Mutex Tests");
@@ -187,6 +230,7 @@ int main(void) {
     tcase_add_test(tc, mtx_double_lock_non_blocking);
     tcase_add_test(tc, mtx_timed_lock_second_times_out);
     tcase_add_test(tc, mtx_try_lock_second_fails);
+    tcase_add_test(tc, mtx_typed_variants_match_generic);
 
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,237 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_parallel.h"
+#include "test_utils.h"
+
+#define POOL_THREADS 3
+
+static int test_num = 0;
+static cp_pool_t pool;
+
+static void parallel_test_start(void) {
+    printf("Test number %d\n", test_num++);
+    assert_thrd(cp_pool_init(&pool, POOL_THREADS));
+}
+
+static void parallel_test_end(void) {
+    cp_pool_destroy(&pool);
+}
+
+static void mark_range(long long begin, long long end, void* ctx) {
+    cp_atomic32* marks = ctx;
+    for(long long i = begin; i < end; i++)
+        cp_atomic_fetch_add32(marks + i, 1);
+}
+
+START_TEST(parallel_for_visits_each_index_once) {
+    int count = 100000;
+    cp_atomic32* marks = calloc(count, sizeof(*marks));
+    assert_thrd(cp_parallel_for(&pool, 0, count, 64, mark_range, (void*)marks));
+    for(int i = 0; i < count; i++)
+        ck_assert(marks[i] == 1);
+    free((void*)marks);
+}
+END_TEST
+
+START_TEST(parallel_for_handles_offsets_and_empty_ranges) {
+    cp_atomic32 marks[100] = { 0 };
+    assert_thrd(cp_parallel_for(&pool, 37, 91, 1, mark_range, (void*)marks));
+    assert_thrd(cp_parallel_for(&pool, 50, 50, 1, mark_range, (void*)marks));
+    assert_thrd(cp_parallel_for(&pool, 60, 10, 1, mark_range, (void*)marks));
+    for(int i = 0; i < 100; i++)
+        ck_assert(marks[i] == (i >= 37 && i < 91));
+}
+END_TEST
+
+typedef struct Nested {
+    cp_pool_t* pool;
+    cp_atomic32* marks;
+} Nested;
+
+static void nested_rows(long long begin, long long end, void* ctx) {
+    Nested* nested = ctx;
+    for(long long row = begin; row < end; row++)
+        cp_parallel_for(nested->pool, row * 100, row * 100 + 100, 10, mark_range, (void*)nested->marks);
+}
+
+START_TEST(parallel_for_nests) {
+    cp_atomic32* marks = calloc(100 * 100, sizeof(*marks));
+    Nested nested = { &pool, marks };
+    assert_thrd(cp_parallel_for(&pool, 0, 100, 1, nested_rows, &nested));
+    for(int i = 0; i < 100 * 100; i++)
+        ck_assert(marks[i] == 1);
+    free((void*)marks);
+}
+END_TEST
+
+START_TEST(parallel_for_without_workers) {
+    cp_pool_t serial;
+    assert_thrd(cp_pool_init(&serial, 0));
+    cp_atomic32 marks[1000] = { 0 };
+    assert_thrd(cp_parallel_for(&serial, 0, 1000, 7, mark_range, (void*)marks));
+    for(int i = 0; i < 1000; i++)
+        ck_assert(marks[i] == 1);
+    cp_pool_destroy(&serial);
+}
+END_TEST
+
+static void sum_range(long long begin, long long end, void* partial, void* ctx) {
+    long long* sum = partial;
+    for(long long i = begin; i < end; i++)
+        *sum += i;
+}
+
+static void sum_join(void* into, const void* from, void* ctx) {
+    *(long long*)into += *(const long long*)from;
+}
+
+START_TEST(parallel_reduce_sums) {
+    long long sum = 5;
+    long long zero = 0;
+    assert_thrd(cp_parallel_reduce(&pool, 0, 1000000, 1000, &sum, sizeof(sum), &zero, sum_range, sum_join, NULL));
+    ck_assert(sum == 5 + 999999LL * 1000000LL / 2);
+}
+END_TEST
+
+// Tracks the covered interval, so joining out of order or with a gap
+// is detected. Large enough to need heap partials.
+typedef struct Span {
+    long long first;
+    long long last;
+    int ok;
+    char padding[100];
+} Span;
+
+static void span_range(long long begin, long long end, void* partial, void* ctx) {
+    Span* span = partial;
+    if(span->first < 0)
+        span->first = begin;
+    else if(span->last + 1 != begin)
+        span->ok = 0;
+    span->last = end - 1;
+}
+
+static void span_join(void* into, const void* from, void* ctx) {
+    Span* left = into;
+    const Span* right = from;
+    if(right->first < 0)
+        return;
+    if(left->first < 0) {
+        *left = *right;
+        return;
+    }
+    left->ok = left->ok && right->ok && left->last + 1 == right->first;
+    left->last = right->last;
+}
+
+START_TEST(parallel_reduce_joins_in_order) {
+    Span identity = { -1, -1, 1, { 0 } };
+    Span result = identity;
+    assert_thrd(cp_parallel_reduce(&pool, 10, 50000, 3, &result, sizeof(result), &identity, span_range, span_join, NULL));
+    ck_assert(result.ok);
+    ck_assert(result.first == 10);
+    ck_assert(result.last == 49999);
+}
+END_TEST
+
+static int compare_ints(const void* lhs, const void* rhs) {
+    int a = *(const int*)lhs;
+    int b = *(const int*)rhs;
+    return a < b ? -1 : a > b;
+}
+
+START_TEST(parallel_sort_matches_qsort) {
+    int sizes[] = { 0, 1, 100, 2049, 100000 };
+    for(int s = 0; s < 5; s++) {
+        int count = sizes[s];
+        int* values = malloc(sizeof(*values) * (count + 1));
+        int* expected = malloc(sizeof(*expected) * (count + 1));
+        srand(count);
+        for(int i = 0; i < count; i++)
+            values[i] = expected[i] = rand() % 1000;
+        qsort(expected, count, sizeof(*expected), compare_ints);
+        assert_thrd(cp_parallel_sort(&pool, values, count, sizeof(*values), compare_ints));
+        for(int i = 0; i < count; i++)
+            ck_assert(values[i] == expected[i]);
+        free(values);
+        free(expected);
+    }
+}
+END_TEST
+
+typedef struct Record {
+    long long key;
+    long long payload[2];
+} Record;
+
+static int compare_records(const void* lhs, const void* rhs) {
+    const Record* a = lhs;
+    const Record* b = rhs;
+    return a->key < b->key ? -1 : a->key > b->key;
+}
+
+START_TEST(parallel_sort_wide_elements) {
+    int count = 50000;
+    Record* records = malloc(sizeof(*records) * count);
+    for(int i = 0; i < count; i++)
+        records[i] = (Record){ (i * 7919LL) % count, { i, -i } };
+    assert_thrd(cp_parallel_sort(&pool, records, count, sizeof(*records), compare_records));
+    for(int i = 0; i < count; i++) {
+        ck_assert(records[i].key == i);
+        ck_assert(records[i].payload[0] == -records[i].payload[1]);
+    }
+    free(records);
+}
+END_TEST
+
+typedef struct Counted {
+    cp_task_t task;
+    cp_atomic32* counter;
+} Counted;
+
+static void counted_run(cp_task_t* task) {
+    cp_atomic_fetch_add32(((Counted*)task)->counter, 1);
+}
+
+START_TEST(pool_submit_runs_tasks) {
+    cp_atomic32 counter = 0;
+    Counted tasks[500];
+    for(int i = 0; i < 500; i++) {
+        tasks[i] = (Counted){ { counted_run, NULL }, &counter };
+        assert_thrd(cp_pool_submit(&pool, &tasks[i].task));
+    }
+    while(cp_atomic_load32(&counter) < 500)
+        thrd_yield();
+    ck_assert(counter == 500);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Parallel Tests");
+    TCase* tc = tcase_create("Parallel Tests");
+
+    tcase_add_checked_fixture(tc, parallel_test_start, parallel_test_end);
+
+    tcase_add_test(tc, parallel_for_visits_each_index_once);
+    tcase_add_test(tc, parallel_for_handles_offsets_and_empty_ranges);
+    tcase_add_test(tc, parallel_for_nests);
+    tcase_add_test(tc, parallel_for_without_workers);
+    tcase_add_test(tc, parallel_reduce_sums);
+    tcase_add_test(tc, parallel_reduce_joins_in_order);
+    tcase_add_test(tc, parallel_sort_matches_qsort);
+    tcase_add_test(tc, parallel_sort_wide_elements);
+    tcase_add_test(tc, pool_submit_runs_tasks);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
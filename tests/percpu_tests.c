@@ -0,0 +1,247 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_percpu.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void percpu_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+#define THREADS 8
+#define ROUNDS 50000
+
+START_TEST(current_cpu_is_in_range) {
+    // Registration can fail where rseq isn't supported, and everything
+    // still works, so only the result's range is checked.
+    int result = cp_percpu_register();
+    ck_assert(result == thrd_success || result == thrd_error);
+
+    int cpu = cp_percpu_current_cpu();
+    ck_assert(cp_percpu_cpu_count() > 0);
+    ck_assert(cpu >= 0 && cpu < cp_percpu_cpu_count());
+}
+END_TEST
+
+static int add_to_counter(cp_percpu_counter_t* counter) {
+    for(int i = 0; i < ROUNDS; i++) {
+        cp_percpu_counter_add(counter, 3);
+        cp_percpu_counter_add(counter, -1);
+        // Moves threads around so adds land on more than one CPU.
+        if(i % 1000 == 0)
+            thrd_yield();
+    }
+    return 0;
+}
+
+START_TEST(counter_adds_from_many_threads) {
+    cp_percpu_counter_t counter;
+    thrd_t threads[THREADS];
+    assert_thrd(cp_percpu_counter_init(&counter));
+    ck_assert(cp_percpu_counter_read(&counter) == 0);
+
+    for(int i = 0; i < THREADS; i++)
+        assert_thrd(thrd_create(threads + i, (thrd_start_t)add_to_counter, &counter));
+    for(int i = 0; i < THREADS; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    ck_assert(cp_percpu_counter_read(&counter) == (int64_t)THREADS * ROUNDS * 2);
+    cp_percpu_counter_destroy(&counter);
+}
+END_TEST
+
+#define NODES_PER_THREAD 64
+
+// owned flips to 1 whenever a thread takes the node out of the list, so a
+// node handed out twice is caught.
+typedef struct Node {
+    cp_lfstack_node_t node;
+    cp_atomic32 owned;
+} Node;
+
+typedef struct ListWorker {
+    cp_percpu_list_t* list;
+    Node* nodes;
+    cp_atomic32* duplicates;
+} ListWorker;
+
+static int churn_list(ListWorker* worker) {
+    Node* held[NODES_PER_THREAD];
+    int count = NODES_PER_THREAD;
+    for(int i = 0; i < NODES_PER_THREAD; i++) {
+        held[i] = worker->nodes + i;
+        held[i]->owned = 1;
+    }
+
+    for(int i = 0; i < ROUNDS; i++) {
+        if(count > 0 && (i & 1)) {
+            Node* node = held[--count];
+            cp_atomic_store32(&node->owned, 0);
+            cp_percpu_list_push(worker->list, &node->node);
+        } else {
+            Node* node = (Node*)cp_percpu_list_pop(worker->list);
+            if(node) {
+                if(cp_atomic_exchange32(&node->owned, 1) != 0)
+                    cp_atomic_fetch_add32(worker->duplicates, 1);
+                if(count < NODES_PER_THREAD) {
+                    held[count++] = node;
+                } else {
+                    cp_atomic_store32(&node->owned, 0);
+                    cp_percpu_list_push(worker->list, &node->node);
+                }
+            }
+        }
+        if(i % 1000 == 0)
+            thrd_yield();
+    }
+
+    while(count > 0) {
+        Node* node = held[--count];
+        cp_atomic_store32(&node->owned, 0);
+        cp_percpu_list_push(worker->list, &node->node);
+    }
+    return 0;
+}
+
+START_TEST(list_hands_each_node_out_once) {
+    cp_percpu_list_t list;
+    thrd_t threads[THREADS];
+    ListWorker workers[THREADS];
+    cp_atomic32 duplicates = 0;
+    Node* nodes = calloc(THREADS * NODES_PER_THREAD, sizeof(Node));
+    assert_thrd(cp_percpu_list_init(&list));
+
+    for(int i = 0; i < THREADS; i++) {
+        workers[i] = (ListWorker){ &list, nodes + i * NODES_PER_THREAD, &duplicates };
+        assert_thrd(thrd_create(threads + i, (thrd_start_t)churn_list, workers + i));
+    }
+    for(int i = 0; i < THREADS; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+    ck_assert(duplicates == 0);
+
+    // Every node went back in, and each is there exactly once.
+    int count = 0;
+    for(cp_lfstack_node_t* node = cp_percpu_list_drain(&list); node; node = node->next) {
+        Node* entry = (Node*)node;
+        ck_assert(entry->owned == 0);
+        entry->owned = 1;
+        count++;
+    }
+    ck_assert(count == THREADS * NODES_PER_THREAD);
+    ck_assert(cp_percpu_list_drain(&list) == NULL);
+
+    cp_percpu_list_destroy(&list);
+    free(nodes);
+}
+END_TEST
+
+typedef struct Token {
+    cp_atomic32 held;
+} Token;
+
+typedef struct PtrWorker {
+    cp_percpu_ptr_t* ptrs;
+    Token* token;
+    cp_atomic32* duplicates;
+} PtrWorker;
+
+static void take(PtrWorker* worker, Token* token) {
+    if(token && cp_atomic_exchange32(&token->held, 1) != 0)
+        cp_atomic_fetch_add32(worker->duplicates, 1);
+}
+
+static void give(Token* token) {
+    if(token)
+        cp_atomic_store32(&token->held, 0);
+}
+
+// Passes tokens through the slots. Each one must always be held by exactly
+// one thread or sit in exactly one slot.
+static int pass_tokens(PtrWorker* worker) {
+    Token* mine = worker->token;
+    take(worker, mine);
+    for(int i = 0; i < ROUNDS; i++) {
+        if(i & 1) {
+            give(mine);
+            mine = cp_percpu_ptr_exchange(worker->ptrs, mine);
+            take(worker, mine);
+        } else if(mine) {
+            give(mine);
+            if(cp_percpu_ptr_cas(worker->ptrs, NULL, mine))
+                mine = NULL;
+            else
+                take(worker, mine);
+        }
+        if(i % 1000 == 0)
+            thrd_yield();
+    }
+    worker->token = mine;
+    give(mine);
+    return 0;
+}
+
+static int released = 0;
+
+static void count_release(void* value) {
+    released++;
+}
+
+START_TEST(pointer_slots_never_duplicate_or_lose_values) {
+    cp_percpu_ptr_t ptrs;
+    thrd_t threads[THREADS];
+    PtrWorker workers[THREADS];
+    Token tokens[THREADS] = { 0 };
+    cp_atomic32 duplicates = 0;
+    assert_thrd(cp_percpu_ptr_init(&ptrs));
+
+    for(int i = 0; i < THREADS; i++) {
+        workers[i] = (PtrWorker){ &ptrs, tokens + i, &duplicates };
+        assert_thrd(thrd_create(threads + i, (thrd_start_t)pass_tokens, workers + i));
+    }
+    int held = 0;
+    for(int i = 0; i < THREADS; i++) {
+        assert_thrd(thrd_join(threads[i], NULL));
+        if(workers[i].token)
+            held++;
+    }
+    ck_assert(duplicates == 0);
+
+    released = 0;
+    cp_percpu_ptr_drain(&ptrs, count_release);
+    ck_assert(held + released == THREADS);
+
+    // Draining cleared them.
+    released = 0;
+    cp_percpu_ptr_drain(&ptrs, count_release);
+    ck_assert(released == 0);
+    cp_percpu_ptr_destroy(&ptrs);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Per-CPU Tests");
+    TCase* tc = tcase_create("Per-CPU Tests");
+
+    tcase_add_checked_fixture(tc, percpu_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, current_cpu_is_in_range);
+    tcase_add_test(tc, counter_adds_from_many_threads);
+    tcase_add_test(tc, list_hands_each_node_out_once);
+    tcase_add_test(tc, pointer_slots_never_duplicate_or_lose_values);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
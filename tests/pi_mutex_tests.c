@@ -0,0 +1,264 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_pi_mutex.h"
+#include "test_utils.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#endif
+
+static int test_num = 0;
+
+static void pi_mutex_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static cp_pi_mutex_t mutex;
+static cp_atomic32 holding;
+static cp_atomic32 release;
+
+static int hold_until_released(void* arg) {
+    cp_pi_mutex_lock(&mutex);
+    cp_atomic_store32(&holding, 1);
+    while(!cp_atomic_load32(&release))
+        thrd_yield();
+    cp_pi_mutex_unlock(&mutex);
+    return 0;
+}
+
+START_TEST(pi_mutex_excludes_other_threads) {
+    assert_thrd(cp_pi_mutex_init(&mutex));
+    holding = 0;
+    release = 0;
+
+    thrd_t thread;
+    assert_thrd(thrd_create(&thread, hold_until_released, NULL));
+    while(!cp_atomic_load32(&holding))
+        thrd_yield();
+
+    ck_assert(cp_pi_mutex_trylock(&mutex) == thrd_busy);
+#if CP_PI_MUTEX_INHERITS
+    ck_assert(cp_pi_mutex_unlock(&mutex) == thrd_error);
+#endif
+
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += 20000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    ck_assert(cp_pi_mutex_timedlock(&mutex, &deadline) == thrd_timedout);
+
+    cp_atomic_store32(&release, 1);
+    assert_thrd(cp_pi_mutex_lock(&mutex));
+    assert_thrd(cp_pi_mutex_unlock(&mutex));
+    assert_thrd(thrd_join(thread, NULL));
+
+    assert_thrd(cp_pi_mutex_trylock(&mutex));
+    assert_thrd(cp_pi_mutex_unlock(&mutex));
+    cp_pi_mutex_destroy(&mutex);
+}
+END_TEST
+
+#define CONTENDING_THREADS 4
+#define INCREMENTS 50000
+
+static long long counter;
+
+static int increment(void* arg) {
+    for(int i = 0; i < INCREMENTS; i++) {
+        cp_pi_mutex_lock(&mutex);
+        counter++;
+        cp_pi_mutex_unlock(&mutex);
+    }
+    return 0;
+}
+
+START_TEST(pi_mutex_counts_under_contention) {
+    assert_thrd(cp_pi_mutex_init(&mutex));
+    counter = 0;
+
+    thrd_t threads[CONTENDING_THREADS];
+    for(int i = 0; i < CONTENDING_THREADS; i++)
+        assert_thrd(thrd_create(threads + i, increment, NULL));
+    for(int i = 0; i < CONTENDING_THREADS; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    ck_assert(counter == (long long)CONTENDING_THREADS * INCREMENTS);
+    ck_assert(cp_pi_mutex_trylock(&mutex) == thrd_success);
+    cp_pi_mutex_unlock(&mutex);
+    cp_pi_mutex_destroy(&mutex);
+}
+END_TEST
+
+#if defined(__linux__)
+
+// Classic inversion on one CPU: a low priority thread holds the mutex, a
+// medium priority thread spins, and a high priority thread wants the mutex.
+// With inheritance the holder runs at high priority, finishes its short
+// critical section and the high priority thread gets in long before the
+// medium one stops spinning.
+#define LOW_HOLD_MS 30
+#define MEDIUM_SPIN_MS 600
+#define HIGH_MAX_WAIT_MS 250
+
+static cp_atomic32 medium_running;
+
+static unsigned long long now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ull + (unsigned long long)now.tv_nsec / 1000000ull;
+}
+
+static int run_fifo(int priority) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    if(sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        return errno;
+    struct sched_param param = { .sched_priority = priority };
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+static void spin_for(unsigned long long ms) {
+    unsigned long long end = now_ms() + ms;
+    while(now_ms() < end)
+        ;
+}
+
+static int low_priority(void* arg) {
+    run_fifo(10);
+    cp_pi_mutex_lock(&mutex);
+    cp_atomic_store32(&holding, 1);
+    spin_for(LOW_HOLD_MS);
+    cp_pi_mutex_unlock(&mutex);
+    return 0;
+}
+
+static int medium_priority(void* arg) {
+    run_fifo(20);
+    cp_atomic_store32(&medium_running, 1);
+    spin_for(MEDIUM_SPIN_MS);
+    return 0;
+}
+
+START_TEST(pi_mutex_bounds_priority_inversion) {
+    // The test thread is the high priority one.
+    int error = run_fifo(30);
+    if(error != 0) {
+        printf("Skipping, SCHED_FIFO not permitted (%d)\n", error);
+        return;
+    }
+
+    assert_thrd(cp_pi_mutex_init(&mutex));
+    holding = 0;
+    medium_running = 0;
+
+    thrd_t low, medium;
+    assert_thrd(thrd_create(&low, low_priority, NULL));
+    while(!cp_atomic_load32(&holding))
+        thrd_sleep(&ms2ts(1), NULL);
+    assert_thrd(thrd_create(&medium, medium_priority, NULL));
+    while(!cp_atomic_load32(&medium_running))
+        thrd_sleep(&ms2ts(1), NULL);
+
+    unsigned long long start = now_ms();
+    assert_thrd(cp_pi_mutex_lock(&mutex));
+    unsigned long long waited = now_ms() - start;
+    assert_thrd(cp_pi_mutex_unlock(&mutex));
+
+    assert_thrd(thrd_join(low, NULL));
+    assert_thrd(thrd_join(medium, NULL));
+    cp_pi_mutex_destroy(&mutex);
+
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    printf("High priority thread waited %llu ms\n", waited);
+    ck_assert(waited < HIGH_MAX_WAIT_MS);
+}
+END_TEST
+
+static int lock_once(void* arg) {
+    int result = cp_pi_mutex_lock(&mutex);
+    if(result == thrd_success)
+        cp_pi_mutex_unlock(&mutex);
+    return result;
+}
+
+// The forked child must lock with its own thread id, not the one its
+// parent thread had cached, or other threads in the child can't queue on
+// the lock.
+static int child_after_fork(void) {
+    if(cp_pi_mutex_lock(&mutex) != thrd_success)
+        return 1;
+    if(cp_atomic_load32(&mutex.owner) != (int32_t)syscall(SYS_gettid))
+        return 2;
+
+    thrd_t thread;
+    int result;
+    if(thrd_create(&thread, lock_once, NULL) != thrd_success)
+        return 3;
+    thrd_sleep(&ms2ts(50), NULL);
+    cp_pi_mutex_unlock(&mutex);
+    thrd_join(thread, &result);
+    return result == thrd_success ? 0 : 4;
+}
+
+START_TEST(pi_mutex_works_after_fork) {
+    assert_thrd(cp_pi_mutex_init(&mutex));
+    assert_thrd(cp_pi_mutex_lock(&mutex));
+    assert_thrd(cp_pi_mutex_unlock(&mutex));
+
+    pid_t child = fork();
+    ck_assert(child >= 0);
+    if(child == 0)
+        _exit(child_after_fork());
+
+    int status;
+    ck_assert(waitpid(child, &status, 0) == child);
+    ck_assert(WIFEXITED(status));
+    ck_assert_int_eq(WEXITSTATUS(status), 0);
+    cp_pi_mutex_destroy(&mutex);
+}
+END_TEST
+
+#endif
+
+int main(void) {
+    Suite* s = suite_create("Priority Inheriting Mutex Tests");
+    TCase* tc = tcase_create("Priority Inheriting Mutex Tests");
+
+    tcase_add_checked_fixture(tc, pi_mutex_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, pi_mutex_excludes_other_threads);
+    tcase_add_test(tc, pi_mutex_counts_under_contention);
+#if defined(__linux__)
+    tcase_add_test(tc, pi_mutex_bounds_priority_inversion);
+    tcase_add_test(tc, pi_mutex_works_after_fork);
+#endif
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,269 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_pipeline.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+static cp_pool_t pool;
+
+static void pipeline_test_start(void) {
+    printf("Test number %d\n", test_num++);
+    assert_thrd(cp_pool_init(&pool, 3));
+}
+
+static void pipeline_test_end(void) {
+    cp_pool_destroy(&pool);
+}
+
+#define ITEMS 5000
+
+// Items are indices into values. The source counts how many are in flight
+// and the sink checks the order they come out in.
+typedef struct Job {
+    int values[ITEMS];
+    int count;
+    int produced;
+    cp_atomic32 in_flight;
+    cp_atomic32 max_in_flight;
+    cp_atomic32 inside;
+    cp_atomic32 overlaps;
+    int consumed[ITEMS];
+    int consumed_count;
+} Job;
+
+static Job* job_create(int count) {
+    Job* job = calloc(1, sizeof(*job));
+    job->count = count;
+    for(int i = 0; i < count; i++)
+        job->values[i] = i;
+    return job;
+}
+
+static void* source(void* item, void* arg) {
+    Job* job = arg;
+    if(job->produced == job->count)
+        return NULL;
+
+    int32_t now = cp_atomic_fetch_add32(&job->in_flight, 1) + 1;
+    int32_t max = cp_atomic_load32(&job->max_in_flight);
+    while(now > max && !cp_atomic_cas32(&job->max_in_flight, &max, now))
+        ;
+    return job->values + job->produced++;
+}
+
+// Takes longer on some items than others so they overtake each other.
+static void* shuffle(void* item, void* arg) {
+    int value = *(int*)item;
+    for(int i = 0; i < (value * 7919) % 13; i++)
+        thrd_yield();
+    return item;
+}
+
+static void* drop_even(void* item, void* arg) {
+    return *(int*)item % 2 == 0 ? NULL : item;
+}
+
+// Any stage marked serial must never see two items at once.
+static void* serial_check(void* item, void* arg) {
+    Job* job = arg;
+    if(cp_atomic_exchange32(&job->inside, 1) != 0)
+        cp_atomic_fetch_add32(&job->overlaps, 1);
+    thrd_yield();
+    cp_atomic_store32(&job->inside, 0);
+    return item;
+}
+
+static void* sink(void* item, void* arg) {
+    Job* job = arg;
+    job->consumed[job->consumed_count++] = *(int*)item;
+    cp_atomic_fetch_add32(&job->in_flight, -1);
+    return item;
+}
+
+START_TEST(pipeline_keeps_order_through_parallel_stages) {
+    cp_pipeline_t pipeline;
+    Job* job = job_create(ITEMS);
+    assert_thrd(cp_pipeline_init(&pipeline, &pool));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, source, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, sink, job));
+
+    assert_thrd(cp_pipeline_run(&pipeline, 16));
+
+    ck_assert(job->consumed_count == ITEMS);
+    for(int i = 0; i < ITEMS; i++)
+        ck_assert(job->consumed[i] == i);
+
+    cp_pipeline_destroy(&pipeline);
+    free(job);
+}
+END_TEST
+
+START_TEST(pipeline_tokens_bound_items_in_flight) {
+    cp_pipeline_t pipeline;
+    Job* job = job_create(ITEMS);
+    assert_thrd(cp_pipeline_init(&pipeline, &pool));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, source, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_out_of_order, sink, job));
+
+    for(int tokens = 1; tokens <= 4; tokens++) {
+        job->produced = 0;
+        job->consumed_count = 0;
+        job->max_in_flight = 0;
+        assert_thrd(cp_pipeline_run(&pipeline, tokens));
+        ck_assert(job->consumed_count == ITEMS);
+        ck_assert(job->in_flight == 0);
+        ck_assert(job->max_in_flight >= 1 && job->max_in_flight <= tokens);
+    }
+
+    cp_pipeline_destroy(&pipeline);
+    free(job);
+}
+END_TEST
+
+START_TEST(pipeline_out_of_order_stage_is_serial) {
+    cp_pipeline_t pipeline;
+    Job* job = job_create(ITEMS);
+    assert_thrd(cp_pipeline_init(&pipeline, &pool));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, source, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_out_of_order, serial_check, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_out_of_order, sink, job));
+
+    assert_thrd(cp_pipeline_run(&pipeline, 32));
+
+    ck_assert(job->overlaps == 0);
+    ck_assert(job->consumed_count == ITEMS);
+
+    // Every item came out exactly once, in some order.
+    char* seen = calloc(ITEMS, 1);
+    for(int i = 0; i < ITEMS; i++) {
+        ck_assert(!seen[job->consumed[i]]);
+        seen[job->consumed[i]] = 1;
+    }
+    free(seen);
+
+    cp_pipeline_destroy(&pipeline);
+    free(job);
+}
+END_TEST
+
+START_TEST(pipeline_dropped_items_skip_later_stages) {
+    cp_pipeline_t pipeline;
+    Job* job = job_create(ITEMS);
+    assert_thrd(cp_pipeline_init(&pipeline, &pool));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, source, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, drop_even, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, sink, job));
+
+    assert_thrd(cp_pipeline_run(&pipeline, 8));
+
+    // Dropped items never reached the sink, so their count is still held.
+    ck_assert(job->consumed_count == ITEMS / 2);
+    ck_assert(job->in_flight == ITEMS / 2);
+    for(int i = 0; i < ITEMS / 2; i++)
+        ck_assert(job->consumed[i] == i * 2 + 1);
+
+    cp_pipeline_destroy(&pipeline);
+    free(job);
+}
+END_TEST
+
+START_TEST(pipeline_runs_on_pool_without_workers) {
+    cp_pool_t inline_pool;
+    cp_pipeline_t pipeline;
+    Job* job = job_create(ITEMS);
+    assert_thrd(cp_pool_init(&inline_pool, 0));
+    assert_thrd(cp_pipeline_init(&pipeline, &inline_pool));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, source, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, job));
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_serial_in_order, sink, job));
+
+    assert_thrd(cp_pipeline_run(&pipeline, 4));
+
+    ck_assert(job->consumed_count == ITEMS);
+    for(int i = 0; i < ITEMS; i++)
+        ck_assert(job->consumed[i] == i);
+
+    cp_pipeline_destroy(&pipeline);
+    cp_pool_destroy(&inline_pool);
+    free(job);
+}
+END_TEST
+
+static void* slow_source(void* item, void* arg) {
+    int* remaining = arg;
+    if(*remaining == 0)
+        return NULL;
+    (*remaining)--;
+    thrd_sleep(&ms2ts(50), NULL);
+    return remaining;
+}
+
+typedef struct Runner {
+    cp_pipeline_t* pipeline;
+    int result;
+} Runner;
+
+static int run_pipeline(Runner* runner) {
+    runner->result = cp_pipeline_run(runner->pipeline, 2);
+    return 0;
+}
+
+START_TEST(pipeline_rejects_bad_configurations) {
+    cp_pipeline_t pipeline;
+    assert_thrd(cp_pipeline_init(&pipeline, &pool));
+
+    ck_assert(cp_pipeline_run(&pipeline, 4) == thrd_error);
+    ck_assert(cp_pipeline_add_stage(&pipeline, 42, slow_source, NULL) == thrd_error);
+    ck_assert(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, NULL, NULL) == thrd_error);
+
+    int remaining = 4;
+    assert_thrd(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, slow_source, &remaining));
+    ck_assert(cp_pipeline_run(&pipeline, 0) == thrd_error);
+
+    Runner runner = { &pipeline, -1 };
+    thrd_t thread;
+    assert_thrd(thrd_create(&thread, (thrd_start_t)run_pipeline, &runner));
+    while(!cp_atomic_load32(&pipeline.running))
+        thrd_yield();
+    ck_assert(cp_pipeline_run(&pipeline, 2) == thrd_busy);
+    ck_assert(cp_pipeline_add_stage(&pipeline, cp_pipeline_parallel, shuffle, NULL) == thrd_busy);
+    assert_thrd(thrd_join(thread, NULL));
+    assert_thrd(runner.result);
+    ck_assert(remaining == 0);
+
+    cp_pipeline_destroy(&pipeline);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Pipeline Tests");
+    TCase* tc = tcase_create("Pipeline Tests");
+
+    tcase_add_checked_fixture(tc, pipeline_test_start, pipeline_test_end);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, pipeline_keeps_order_through_parallel_stages);
+    tcase_add_test(tc, pipeline_tokens_bound_items_in_flight);
+    tcase_add_test(tc, pipeline_out_of_order_stage_is_serial);
+    tcase_add_test(tc, pipeline_dropped_items_skip_later_stages);
+    tcase_add_test(tc, pipeline_runs_on_pool_without_workers);
+    tcase_add_test(tc, pipeline_rejects_bad_configurations);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
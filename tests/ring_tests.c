@@ -0,0 +1,282 @@
+#include <check.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_ring.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void ring_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+typedef struct Event {
+    int64_t value;
+    int producer;
+    int journaled;
+    int replicated;
+} Event;
+
+#define CAPACITY 64
+#define EVENTS 100000
+
+typedef struct Stage {
+    cp_ring_consumer_t* consumer;
+    int kind;
+    int64_t seen;
+    bool out_of_order;
+    bool missed_dependency;
+} Stage;
+
+enum {
+    STAGE_JOURNAL,
+    STAGE_REPLICATE,
+    STAGE_LOGIC
+};
+
+static int run_stage(Stage* stage) {
+    cp_ring_t* ring = stage->consumer->ring;
+    int64_t first;
+    size_t count;
+    while((count = cp_ring_wait(stage->consumer, &first)) > 0) {
+        for(size_t i = 0; i < count; i++) {
+            Event* event = cp_ring_slot(ring, first + (int64_t)i);
+            if(event->value != stage->seen)
+                stage->out_of_order = true;
+            stage->seen++;
+            if(stage->kind == STAGE_JOURNAL)
+                event->journaled = 1;
+            else if(stage->kind == STAGE_REPLICATE)
+                event->replicated = 1;
+            else if(!event->journaled || !event->replicated)
+                stage->missed_dependency = true;
+        }
+        cp_ring_release(stage->consumer, count);
+    }
+    return 1;
+}
+
+static void run_diamond(int wait, int64_t events) {
+    cp_ring_t ring;
+    cp_ring_consumer_t journal, replicate, logic;
+    assert_thrd(cp_ring_init(&ring, sizeof(Event), CAPACITY, CP_RING_SINGLE_PRODUCER, wait));
+    assert_thrd(cp_ring_consumer_init(&journal, &ring, NULL, 0));
+    assert_thrd(cp_ring_consumer_init(&replicate, &ring, NULL, 0));
+    cp_ring_consumer_t* both[] = { &journal, &replicate };
+    assert_thrd(cp_ring_consumer_init(&logic, &ring, both, 2));
+
+    Stage stages[3] = {
+        { &journal, STAGE_JOURNAL, 0, false, false },
+        { &replicate, STAGE_REPLICATE, 0, false, false },
+        { &logic, STAGE_LOGIC, 0, false, false }
+    };
+    thrd_t threads[3];
+    for(int i = 0; i < 3; i++)
+        assert_thrd(thrd_create(threads + i, (int(*)(void*))run_stage, stages + i));
+
+    for(int64_t i = 0; i < events; i++) {
+        int64_t sequence = cp_ring_claim(&ring, 1);
+        ck_assert(sequence == i);
+        Event* event = cp_ring_slot(&ring, sequence);
+        *event = (Event){ i, 0, 0, 0 };
+        cp_ring_publish(&ring, sequence, 1);
+    }
+    cp_ring_close(&ring);
+
+    for(int i = 0; i < 3; i++) {
+        int result;
+        thrd_join(threads[i], &result);
+        ck_assert(result == 1);
+        ck_assert(stages[i].seen == events);
+        ck_assert(!stages[i].out_of_order);
+        ck_assert(!stages[i].missed_dependency);
+    }
+    cp_ring_destroy(&ring);
+}
+
+START_TEST(diamond_sees_every_event_in_order) {
+    // Spinning consumers only make progress between preemptions when there
+    // are fewer cores than threads.
+    run_diamond(CP_RING_BUSY_SPIN, EVENTS / 100);
+    run_diamond(CP_RING_YIELD, EVENTS);
+    run_diamond(CP_RING_PARK, EVENTS);
+}
+END_TEST
+
+#define PRODUCERS 4
+#define PER_PRODUCER 20000
+
+typedef struct Producer {
+    cp_ring_t* ring;
+    int id;
+} Producer;
+
+static int produce(Producer* producer) {
+    for(int64_t i = 0; i < PER_PRODUCER; i++) {
+        // Some events go in batches, to mix claim sizes.
+        size_t count = (i % 7 == 0 && i + 3 <= PER_PRODUCER) ? 3 : 1;
+        int64_t first = cp_ring_claim(producer->ring, count);
+        for(size_t j = 0; j < count; j++) {
+            Event* event = cp_ring_slot(producer->ring, first + (int64_t)j);
+            *event = (Event){ i + (int64_t)j, producer->id, 0, 0 };
+        }
+        cp_ring_publish(producer->ring, first, count);
+        i += (int64_t)count - 1;
+    }
+    return 1;
+}
+
+typedef struct Tally {
+    cp_ring_consumer_t* consumer;
+    int64_t next[PRODUCERS];
+    int64_t total;
+    bool out_of_order;
+} Tally;
+
+static int tally(Tally* tally) {
+    int64_t first;
+    size_t count;
+    while((count = cp_ring_wait(tally->consumer, &first)) > 0) {
+        for(size_t i = 0; i < count; i++) {
+            Event* event = cp_ring_slot(tally->consumer->ring, first + (int64_t)i);
+            if(event->value != tally->next[event->producer])
+                tally->out_of_order = true;
+            tally->next[event->producer] = event->value + 1;
+            tally->total++;
+        }
+        cp_ring_release(tally->consumer, count);
+    }
+    return 1;
+}
+
+START_TEST(multiple_producers_keep_their_own_order) {
+    int waits[] = { CP_RING_YIELD, CP_RING_PARK };
+    for(int w = 0; w < 2; w++) {
+        cp_ring_t ring;
+        cp_ring_consumer_t consumers[2];
+        Tally tallies[2] = { { 0 } };
+        thrd_t producers[PRODUCERS], consumer_threads[2];
+        Producer args[PRODUCERS];
+
+        assert_thrd(cp_ring_init(&ring, sizeof(Event), CAPACITY, CP_RING_MULTI_PRODUCER, waits[w]));
+        for(int i = 0; i < 2; i++) {
+            assert_thrd(cp_ring_consumer_init(consumers + i, &ring, NULL, 0));
+            tallies[i].consumer = consumers + i;
+            assert_thrd(thrd_create(consumer_threads + i, (int(*)(void*))tally, tallies + i));
+        }
+        for(int i = 0; i < PRODUCERS; i++) {
+            args[i] = (Producer){ &ring, i };
+            assert_thrd(thrd_create(producers + i, (int(*)(void*))produce, args + i));
+        }
+        for(int i = 0; i < PRODUCERS; i++) {
+            int result;
+            thrd_join(producers[i], &result);
+            ck_assert(result == 1);
+        }
+        cp_ring_close(&ring);
+
+        for(int i = 0; i < 2; i++) {
+            int result;
+            thrd_join(consumer_threads[i], &result);
+            ck_assert(result == 1);
+            ck_assert(tallies[i].total == PRODUCERS * PER_PRODUCER);
+            ck_assert(!tallies[i].out_of_order);
+            for(int p = 0; p < PRODUCERS; p++)
+                ck_assert(tallies[i].next[p] == PER_PRODUCER);
+        }
+        cp_ring_destroy(&ring);
+    }
+}
+END_TEST
+
+START_TEST(wait_returns_whole_batch) {
+    cp_ring_t ring;
+    cp_ring_consumer_t consumer;
+    int64_t first;
+    assert_thrd(cp_ring_init(&ring, sizeof(int64_t), 16, CP_RING_SINGLE_PRODUCER, CP_RING_PARK));
+    assert_thrd(cp_ring_consumer_init(&consumer, &ring, NULL, 0));
+
+    ck_assert(cp_ring_poll(&consumer, &first) == 0);
+    for(int64_t i = 0; i < 10; i++)
+        cp_ring_put(&ring, &i);
+    ck_assert(cp_ring_wait(&consumer, &first) == 10);
+    ck_assert(first == 0);
+    for(int64_t i = 0; i < 10; i++)
+        ck_assert(*(int64_t*)cp_ring_slot(&ring, first + i) == i);
+
+    // Releasing part of a batch leaves the rest available.
+    cp_ring_release(&consumer, 4);
+    ck_assert(cp_ring_poll(&consumer, &first) == 6);
+    ck_assert(first == 4);
+    cp_ring_release(&consumer, 6);
+    ck_assert(cp_ring_poll(&consumer, &first) == 0);
+
+    cp_ring_destroy(&ring);
+}
+END_TEST
+
+static int wait_for_close(cp_ring_consumer_t* consumer) {
+    int64_t first;
+    return (int)cp_ring_wait(consumer, &first);
+}
+
+START_TEST(close_wakes_waiting_consumer) {
+    cp_ring_t ring;
+    cp_ring_consumer_t consumer;
+    thrd_t thread;
+    int result;
+    assert_thrd(cp_ring_init(&ring, sizeof(int64_t), 16, CP_RING_SINGLE_PRODUCER, CP_RING_PARK));
+    assert_thrd(cp_ring_consumer_init(&consumer, &ring, NULL, 0));
+
+    assert_thrd(thrd_create(&thread, (int(*)(void*))wait_for_close, &consumer));
+    thrd_sleep(&ms2ts(50), NULL);
+    cp_ring_close(&ring);
+    thrd_join(thread, &result);
+    ck_assert(result == 0);
+
+    cp_ring_destroy(&ring);
+}
+END_TEST
+
+START_TEST(init_checks_arguments) {
+    cp_ring_t ring;
+    cp_ring_consumer_t consumers[CP_RING_MAX_CONSUMERS + 1];
+    ck_assert(cp_ring_init(&ring, sizeof(int), 12, CP_RING_SINGLE_PRODUCER, CP_RING_PARK) == thrd_error);
+    ck_assert(cp_ring_init(&ring, 0, 16, CP_RING_SINGLE_PRODUCER, CP_RING_PARK) == thrd_error);
+    ck_assert(cp_ring_init(&ring, sizeof(int), 16, 7, CP_RING_PARK) == thrd_error);
+
+    assert_thrd(cp_ring_init(&ring, sizeof(int), 16, CP_RING_SINGLE_PRODUCER, CP_RING_BUSY_SPIN));
+    ck_assert(cp_ring_claim(&ring, 17) == -1);
+    for(int i = 0; i < CP_RING_MAX_CONSUMERS; i++)
+        assert_thrd(cp_ring_consumer_init(consumers + i, &ring, NULL, 0));
+    ck_assert(cp_ring_consumer_init(consumers + CP_RING_MAX_CONSUMERS, &ring, NULL, 0) == thrd_error);
+    cp_ring_destroy(&ring);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Ring Tests");
+    TCase* tc = tcase_create("Ring Tests");
+
+    tcase_add_checked_fixture(tc, ring_test_start, NULL);
+    tcase_set_timeout(tc, 60);
+
+    tcase_add_test(tc, diamond_sees_every_event_in_order);
+    tcase_add_test(tc, multiple_producers_keep_their_own_order);
+    tcase_add_test(tc, wait_returns_whole_batch);
+    tcase_add_test(tc, close_wakes_waiting_consumer);
+    tcase_add_test(tc, init_checks_arguments);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
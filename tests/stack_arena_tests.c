@@ -0,0 +1,203 @@
+#include <check.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_stack_arena.h"
+#include "test_utils.h"
+
+#if defined(__linux__)
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+static int test_num = 0;
+
+static void stack_arena_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+#define STACKS 4
+#define STACK_SIZE (256 * 1024)
+
+typedef struct Probe {
+    cp_stack_arena_t* arena;
+    int value;
+    uintptr_t local;
+} Probe;
+
+static int record_stack(Probe* probe) {
+    int local = probe->value;
+    probe->local = (uintptr_t)&local;
+    return local * 2;
+}
+
+START_TEST(threads_run_on_arena_stacks) {
+    cp_stack_arena_t arena;
+    Probe probes[STACKS];
+    thrd_t threads[STACKS];
+    assert_thrd(cp_stack_arena_init(&arena, STACKS, STACK_SIZE, 0));
+
+    for(int i = 0; i < STACKS; i++) {
+        probes[i] = (Probe){ &arena, i + 1, 0 };
+        assert_thrd(cp_stack_arena_create(&arena, threads + i, (thrd_start_t)record_stack, probes + i));
+    }
+    for(int i = 0; i < STACKS; i++) {
+        int result;
+        assert_thrd(cp_stack_arena_join(&arena, threads[i], &result));
+        ck_assert(result == (i + 1) * 2);
+#if CP_STACK_ARENA_NATIVE
+        uintptr_t start = (uintptr_t)arena.base;
+        ck_assert(probes[i].local > start && probes[i].local < start + arena.mapped_size);
+#endif
+    }
+
+    cp_stack_arena_stats_t stats;
+    assert_thrd(cp_stack_arena_stats(&arena, &stats));
+    ck_assert(stats.stacks == STACKS);
+    ck_assert(stats.stack_size >= STACK_SIZE);
+    ck_assert(stats.in_use == 0);
+    ck_assert(stats.peak_in_use >= 1);
+    ck_assert(stats.created == STACKS);
+    cp_stack_arena_destroy(&arena);
+}
+END_TEST
+
+static int wait_for_flag(cp_atomic32* flag) {
+    while(!cp_atomic_load32(flag))
+        thrd_yield();
+    return 1;
+}
+
+START_TEST(stacks_are_reused_after_join) {
+    cp_stack_arena_t arena;
+    thrd_t threads[3];
+    cp_atomic32 release = 0;
+    int result;
+    assert_thrd(cp_stack_arena_init(&arena, 2, STACK_SIZE, 0));
+
+    assert_thrd(cp_stack_arena_create(&arena, threads, (thrd_start_t)wait_for_flag, (void*)&release));
+    assert_thrd(cp_stack_arena_create(&arena, threads + 1, (thrd_start_t)wait_for_flag, (void*)&release));
+    ck_assert(cp_stack_arena_create(&arena, threads + 2, (thrd_start_t)wait_for_flag, (void*)&release) == thrd_nomem);
+
+    cp_atomic_store32(&release, 1);
+    assert_thrd(cp_stack_arena_join(&arena, threads[0], &result));
+    ck_assert(result == 1);
+    assert_thrd(cp_stack_arena_join(&arena, threads[1], &result));
+
+    // The same two stacks carry any number of threads in turn.
+    for(int i = 0; i < 50; i++) {
+        Probe probe = { &arena, i, 0 };
+        assert_thrd(cp_stack_arena_create(&arena, threads, (thrd_start_t)record_stack, &probe));
+        assert_thrd(cp_stack_arena_join(&arena, threads[0], &result));
+        ck_assert(result == i * 2);
+    }
+
+    cp_stack_arena_stats_t stats;
+    assert_thrd(cp_stack_arena_stats(&arena, &stats));
+    ck_assert(stats.created == 52);
+    ck_assert(stats.exhausted == 1);
+    ck_assert(stats.peak_in_use == 2);
+    ck_assert(stats.in_use == 0);
+    cp_stack_arena_destroy(&arena);
+}
+END_TEST
+
+START_TEST(prefault_makes_stacks_resident) {
+#if CP_STACK_ARENA_NATIVE
+    cp_stack_arena_t arena;
+    cp_stack_arena_stats_t stats;
+
+    assert_thrd(cp_stack_arena_init(&arena, STACKS, STACK_SIZE, 0));
+    assert_thrd(cp_stack_arena_stats(&arena, &stats));
+    ck_assert(stats.resident_bytes < stats.stack_size);
+    cp_stack_arena_destroy(&arena);
+
+    assert_thrd(cp_stack_arena_init(&arena, STACKS, STACK_SIZE, CP_STACK_PREFAULT));
+    assert_thrd(cp_stack_arena_stats(&arena, &stats));
+    ck_assert(stats.resident_bytes == stats.stack_size * STACKS);
+    cp_stack_arena_destroy(&arena);
+
+    // Huge pages may not be available, but the arena still works.
+    Probe probe = { &arena, 3, 0 };
+    thrd_t thread;
+    int result;
+    assert_thrd(cp_stack_arena_init(&arena, 2, STACK_SIZE, CP_STACK_HUGE_PAGES | CP_STACK_PREFAULT));
+    assert_thrd(cp_stack_arena_stats(&arena, &stats));
+    ck_assert(stats.stack_size % (2 << 20) == 0);
+    assert_thrd(cp_stack_arena_create(&arena, &thread, (thrd_start_t)record_stack, &probe));
+    assert_thrd(cp_stack_arena_join(&arena, thread, &result));
+    ck_assert(result == 6);
+    cp_stack_arena_destroy(&arena);
+#endif
+}
+END_TEST
+
+#if CP_STACK_ARENA_NATIVE
+
+// Never reached in practice, but the compiler can't tell, so it doesn't
+// warn about the recursion.
+static volatile int depth_limit = 1 << 30;
+
+static int recurse(int depth) {
+    volatile char frame[1024];
+    if(depth >= depth_limit)
+        return 0;
+    frame[0] = (char)depth;
+    return recurse(depth + 1) + frame[0];
+}
+
+static int overflow(void* arg) {
+    return recurse(0);
+}
+
+#endif
+
+START_TEST(overflow_hits_guard_page) {
+#if CP_STACK_ARENA_NATIVE
+    // The overflow kills the process, so it happens in a child.
+    pid_t child = fork();
+    ck_assert(child >= 0);
+    if(child == 0) {
+        cp_stack_arena_t arena;
+        thrd_t thread;
+        if(cp_stack_arena_init(&arena, 1, STACK_SIZE, 0) != thrd_success)
+            _exit(1);
+        if(cp_stack_arena_create(&arena, &thread, overflow, NULL) != thrd_success)
+            _exit(1);
+        cp_stack_arena_join(&arena, thread, NULL);
+        _exit(0);
+    }
+
+    int status;
+    ck_assert(waitpid(child, &status, 0) == child);
+    ck_assert(WIFSIGNALED(status));
+    ck_assert(WTERMSIG(status) == SIGSEGV);
+#endif
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Stack Arena Tests");
+    TCase* tc = tcase_create("Stack Arena Tests");
+
+    tcase_add_checked_fixture(tc, stack_arena_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, threads_run_on_arena_stacks);
+    tcase_add_test(tc, stacks_are_reused_after_join);
+    tcase_add_test(tc, prefault_makes_stacks_resident);
+    tcase_add_test(tc, overflow_hits_guard_page);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
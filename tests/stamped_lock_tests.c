@@ -0,0 +1,211 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_stamped_lock.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+static cp_stamped_lock_t lock;
+
+static void stamped_test_start(void) {
+    printf("Test number %d\n", test_num++);
+    assert_thrd(cp_stamped_lock_init(&lock));
+}
+
+static void stamped_test_end(void) {
+    cp_stamped_lock_destroy(&lock);
+}
+
+START_TEST(stamped_optimistic_read_is_invalidated_by_writes) {
+    cp_stamp_t stamp = cp_stamped_lock_optimistic(&lock);
+    ck_assert(stamp != 0);
+    ck_assert(cp_stamped_lock_validate(&lock, stamp));
+
+    // Read locks don't invalidate optimistic stamps.
+    cp_stamp_t read = cp_stamped_lock_read(&lock);
+    ck_assert(cp_stamped_lock_validate(&lock, stamp));
+    cp_stamped_lock_read_unlock(&lock, read);
+    ck_assert(cp_stamped_lock_validate(&lock, stamp));
+
+    cp_stamp_t write = cp_stamped_lock_write(&lock);
+    ck_assert(cp_stamped_lock_optimistic(&lock) == 0);
+    ck_assert(!cp_stamped_lock_validate(&lock, stamp));
+    ck_assert(cp_stamped_lock_validate(&lock, write));
+    cp_stamped_lock_write_unlock(&lock, write);
+
+    // Still invalid after the writer left, the version moved on.
+    ck_assert(!cp_stamped_lock_validate(&lock, stamp));
+    ck_assert(!cp_stamped_lock_validate(&lock, 0));
+    cp_stamp_t next = cp_stamped_lock_optimistic(&lock);
+    ck_assert(next != 0 && next != stamp);
+}
+END_TEST
+
+START_TEST(stamped_modes_exclude_each_other) {
+    cp_stamp_t first = cp_stamped_lock_try_read(&lock);
+    cp_stamp_t second = cp_stamped_lock_try_read(&lock);
+    ck_assert(first && second);
+    ck_assert(cp_stamped_lock_try_write(&lock) == 0);
+
+    cp_stamped_lock_read_unlock(&lock, first);
+    ck_assert(cp_stamped_lock_try_write(&lock) == 0);
+    cp_stamped_lock_unlock(&lock, second);
+
+    cp_stamp_t write = cp_stamped_lock_try_write(&lock);
+    ck_assert(write != 0);
+    ck_assert(cp_stamped_lock_try_read(&lock) == 0);
+    ck_assert(cp_stamped_lock_try_write(&lock) == 0);
+    cp_stamped_lock_unlock(&lock, write);
+
+    ck_assert((first = cp_stamped_lock_try_read(&lock)) != 0);
+    cp_stamped_lock_read_unlock(&lock, first);
+}
+END_TEST
+
+START_TEST(stamped_converts_to_write) {
+    // From an optimistic stamp, only while it's still valid.
+    cp_stamp_t stamp = cp_stamped_lock_optimistic(&lock);
+    cp_stamp_t write = cp_stamped_lock_try_convert_to_write(&lock, stamp);
+    ck_assert(write != 0);
+    ck_assert(cp_stamped_lock_try_read(&lock) == 0);
+    ck_assert(cp_stamped_lock_try_convert_to_write(&lock, write) == write);
+    cp_stamped_lock_write_unlock(&lock, write);
+    ck_assert(cp_stamped_lock_try_convert_to_write(&lock, stamp) == 0);
+
+    // From a read lock, only when it's the only reader.
+    cp_stamp_t mine = cp_stamped_lock_read(&lock);
+    cp_stamp_t other = cp_stamped_lock_read(&lock);
+    ck_assert(cp_stamped_lock_try_convert_to_write(&lock, mine) == 0);
+    cp_stamped_lock_read_unlock(&lock, other);
+
+    write = cp_stamped_lock_try_convert_to_write(&lock, mine);
+    ck_assert(write != 0);
+    ck_assert(cp_stamped_lock_try_read(&lock) == 0);
+    cp_stamped_lock_unlock(&lock, write);
+
+    // An optimistic stamp can't upgrade past a reader.
+    stamp = cp_stamped_lock_optimistic(&lock);
+    other = cp_stamped_lock_read(&lock);
+    ck_assert(cp_stamped_lock_try_convert_to_write(&lock, stamp) == 0);
+    cp_stamped_lock_read_unlock(&lock, other);
+}
+END_TEST
+
+#define RECORD_WRITES 20000
+
+// Writers keep both halves equal. Any read that validates must see them equal.
+typedef struct Record {
+    cp_atomic64 a;
+    cp_atomic64 b;
+} Record;
+
+static Record record;
+static cp_atomic32 writers_done;
+static cp_atomic32 torn_reads;
+
+static int record_writer(void* arg) {
+    for(int i = 0; i < RECORD_WRITES; i++) {
+        cp_stamp_t stamp = cp_stamped_lock_write(&lock);
+        int64_t next = cp_atomic_load64(&record.a) + 1;
+        cp_atomic_store64(&record.a, next);
+        cp_atomic_store64(&record.b, next);
+        cp_stamped_lock_write_unlock(&lock, stamp);
+    }
+    cp_atomic_fetch_add32(&writers_done, 1);
+    return 0;
+}
+
+static int record_reader(void* arg) {
+    while(cp_atomic_load32(&writers_done) < 2) {
+        cp_stamp_t stamp = cp_stamped_lock_optimistic(&lock);
+        int64_t a = cp_atomic_load64(&record.a);
+        int64_t b = cp_atomic_load64(&record.b);
+        if(cp_stamped_lock_validate(&lock, stamp)) {
+            if(a != b)
+                cp_atomic_fetch_add32(&torn_reads, 1);
+            continue;
+        }
+
+        stamp = cp_stamped_lock_read(&lock);
+        if(cp_atomic_load64(&record.a) != cp_atomic_load64(&record.b))
+            cp_atomic_fetch_add32(&torn_reads, 1);
+        cp_stamped_lock_read_unlock(&lock, stamp);
+    }
+    return 0;
+}
+
+START_TEST(stamped_readers_never_see_torn_records) {
+    record.a = record.b = 0;
+    writers_done = 0;
+    torn_reads = 0;
+
+    thrd_t threads[6];
+    for(int i = 0; i < 4; i++)
+        assert_thrd(thrd_create(threads + i, record_reader, NULL));
+    assert_thrd(thrd_create(threads + 4, record_writer, NULL));
+    assert_thrd(thrd_create(threads + 5, record_writer, NULL));
+    for(int i = 0; i < 6; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    ck_assert(torn_reads == 0);
+    ck_assert(record.a == 2 * RECORD_WRITES);
+}
+END_TEST
+
+static cp_atomic32 writer_got_in;
+
+static int blocked_writer(void* arg) {
+    cp_stamp_t stamp = cp_stamped_lock_write(&lock);
+    cp_atomic_store32(&writer_got_in, 1);
+    cp_stamped_lock_write_unlock(&lock, stamp);
+    return 0;
+}
+
+START_TEST(stamped_waiting_writer_blocks_new_readers) {
+    writer_got_in = 0;
+    cp_stamp_t held = cp_stamped_lock_read(&lock);
+
+    thrd_t writer;
+    assert_thrd(thrd_create(&writer, blocked_writer, NULL));
+
+    // Once the writer parks, new readers have to wait behind it.
+    while(!(cp_atomic_load64(&lock.state) & CP_STAMP_WRITER_PENDING))
+        thrd_sleep(&ms2ts(1), NULL);
+    ck_assert(cp_stamped_lock_try_read(&lock) == 0);
+    ck_assert(!writer_got_in);
+
+    cp_stamped_lock_read_unlock(&lock, held);
+    assert_thrd(thrd_join(writer, NULL));
+    ck_assert(writer_got_in);
+
+    held = cp_stamped_lock_try_read(&lock);
+    ck_assert(held != 0);
+    cp_stamped_lock_read_unlock(&lock, held);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Stamped Lock Tests");
+    TCase* tc = tcase_create("Stamped Lock Tests");
+
+    tcase_add_checked_fixture(tc, stamped_test_start, stamped_test_end);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, stamped_optimistic_read_is_invalidated_by_writes);
+    tcase_add_test(tc, stamped_modes_exclude_each_other);
+    tcase_add_test(tc, stamped_converts_to_write);
+    tcase_add_test(tc, stamped_readers_never_see_torn_records);
+    tcase_add_test(tc, stamped_waiting_writer_blocks_new_readers);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
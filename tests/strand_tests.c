@@ -0,0 +1,236 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_pool.h"
+#include "../cp_strand.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void strand_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+#define POSTERS 4
+#define POSTS 20000
+
+// Shared state that is only ever touched from inside the strand, so none of
+// it needs to be atomic. inside catches two tasks running at once.
+typedef struct Guarded {
+    cp_strand_t* strand;
+    cp_atomic32 inside;
+    int overlaps;
+    int out_of_order;
+    int outside_strand;
+    int last[POSTERS];
+    int count;
+} Guarded;
+
+typedef struct Step {
+    cp_strand_task_t task;
+    Guarded* guarded;
+    int poster;
+    int sequence;
+} Step;
+
+static void run_step(cp_strand_task_t* task) {
+    Step* step = (Step*)task;
+    Guarded* guarded = step->guarded;
+    if(cp_atomic_exchange32(&guarded->inside, 1) != 0)
+        guarded->overlaps++;
+    if(!cp_strand_running_in_this_thread(guarded->strand))
+        guarded->outside_strand++;
+
+    if(step->sequence != guarded->last[step->poster] + 1)
+        guarded->out_of_order++;
+    guarded->last[step->poster] = step->sequence;
+    guarded->count++;
+
+    cp_atomic_store32(&guarded->inside, 0);
+}
+
+static void guarded_init(Guarded* guarded, cp_strand_t* strand) {
+    guarded->strand = strand;
+    guarded->inside = 0;
+    guarded->overlaps = 0;
+    guarded->out_of_order = 0;
+    guarded->outside_strand = 0;
+    guarded->count = 0;
+    for(int i = 0; i < POSTERS; i++)
+        guarded->last[i] = -1;
+}
+
+START_TEST(inline_strand_runs_tasks_in_order) {
+    cp_strand_t strand;
+    Guarded guarded;
+    Step steps[100];
+    assert_thrd(cp_strand_init(&strand, NULL));
+    guarded_init(&guarded, &strand);
+
+    // Nobody else owns the strand, so every post runs before returning.
+    for(int i = 0; i < 100; i++) {
+        steps[i] = (Step){ { run_step }, &guarded, 0, i };
+        assert_thrd(cp_strand_post(&strand, &steps[i].task));
+        ck_assert(guarded.count == i + 1);
+    }
+    ck_assert(guarded.out_of_order == 0);
+    ck_assert(guarded.outside_strand == 0);
+    ck_assert(!cp_strand_running_in_this_thread(&strand));
+
+    ck_assert(cp_strand_post(&strand, NULL) == thrd_error);
+    cp_strand_destroy(&strand);
+}
+END_TEST
+
+typedef struct Poster {
+    Guarded* guarded;
+    Step* steps;
+    int id;
+} Poster;
+
+static int post_steps(Poster* poster) {
+    for(int i = 0; i < POSTS; i++) {
+        poster->steps[i] = (Step){ { run_step }, poster->guarded, poster->id, i };
+        cp_strand_post(poster->guarded->strand, &poster->steps[i].task);
+        if(i % 1000 == 0)
+            thrd_yield();
+    }
+    return 0;
+}
+
+static void check_posters(cp_pool_t* pool) {
+    cp_strand_t strand;
+    Guarded guarded;
+    thrd_t threads[POSTERS];
+    Poster posters[POSTERS];
+    assert_thrd(cp_strand_init(&strand, pool));
+    guarded_init(&guarded, &strand);
+
+    for(int i = 0; i < POSTERS; i++) {
+        posters[i] = (Poster){ &guarded, malloc(sizeof(Step) * POSTS), i };
+        assert_thrd(thrd_create(threads + i, (thrd_start_t)post_steps, posters + i));
+    }
+    for(int i = 0; i < POSTERS; i++)
+        assert_thrd(thrd_join(threads[i], NULL));
+
+    // With a pool the last tasks may still be running.
+    while(cp_atomic_load32(&strand.count) != 0)
+        thrd_yield();
+
+    ck_assert(guarded.count == POSTERS * POSTS);
+    ck_assert(guarded.overlaps == 0);
+    ck_assert(guarded.out_of_order == 0);
+    ck_assert(guarded.outside_strand == 0);
+    for(int i = 0; i < POSTERS; i++) {
+        ck_assert(guarded.last[i] == POSTS - 1);
+        free(posters[i].steps);
+    }
+    cp_strand_destroy(&strand);
+}
+
+START_TEST(posts_from_many_threads_run_one_at_a_time) {
+    check_posters(NULL);
+}
+END_TEST
+
+START_TEST(pool_strand_runs_one_at_a_time) {
+    cp_pool_t pool;
+    assert_thrd(cp_pool_init(&pool, 3));
+    check_posters(&pool);
+    cp_pool_destroy(&pool);
+}
+END_TEST
+
+typedef struct Reposter {
+    cp_strand_task_t task;
+    cp_strand_t* strand;
+    int depth;
+    int order[8];
+    int count;
+} Reposter;
+
+static void repost(cp_strand_task_t* task) {
+    Reposter* reposter = (Reposter*)task;
+    int depth = reposter->depth++;
+    reposter->order[reposter->count++] = depth;
+    if(depth < 3) {
+        // Queued behind this task instead of running inside it.
+        cp_strand_post(reposter->strand, task);
+        reposter->order[reposter->count++] = -depth - 1;
+    }
+}
+
+START_TEST(posting_from_a_task_queues_behind_it) {
+    cp_strand_t strand;
+    Reposter reposter = { { repost }, &strand };
+    assert_thrd(cp_strand_init(&strand, NULL));
+
+    assert_thrd(cp_strand_post(&strand, &reposter.task));
+    int expected[] = { 0, -1, 1, -2, 2, -3, 3 };
+    ck_assert(reposter.count == 7);
+    for(int i = 0; i < 7; i++)
+        ck_assert(reposter.order[i] == expected[i]);
+    cp_strand_destroy(&strand);
+}
+END_TEST
+
+typedef struct Nested {
+    cp_strand_task_t task;
+    cp_strand_t* outer;
+    cp_strand_t* inner;
+    int in_both;
+} Nested;
+
+static void nested_inner(cp_strand_task_t* task) {
+    Nested* nested = (Nested*)task;
+    nested->in_both = cp_strand_running_in_this_thread(nested->outer) && cp_strand_running_in_this_thread(nested->inner);
+}
+
+static void nested_outer(cp_strand_task_t* task) {
+    Nested* nested = (Nested*)task;
+    nested->task.func = nested_inner;
+    cp_strand_post(nested->inner, task);
+}
+
+START_TEST(idle_strand_runs_nested_in_a_task) {
+    cp_strand_t outer, inner;
+    Nested nested = { { nested_outer }, &outer, &inner, 0 };
+    assert_thrd(cp_strand_init(&outer, NULL));
+    assert_thrd(cp_strand_init(&inner, NULL));
+
+    assert_thrd(cp_strand_post(&outer, &nested.task));
+    ck_assert(nested.in_both);
+    ck_assert(!cp_strand_running_in_this_thread(&outer));
+    ck_assert(!cp_strand_running_in_this_thread(&inner));
+
+    cp_strand_destroy(&inner);
+    cp_strand_destroy(&outer);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Strand Tests");
+    TCase* tc = tcase_create("Strand Tests");
+
+    tcase_add_checked_fixture(tc, strand_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, inline_strand_runs_tasks_in_order);
+    tcase_add_test(tc, posts_from_many_threads_run_one_at_a_time);
+    tcase_add_test(tc, pool_strand_runs_one_at_a_time);
+    tcase_add_test(tc, posting_from_a_task_queues_behind_it);
+    tcase_add_test(tc, idle_strand_runs_nested_in_a_task);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,185 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_taskgraph.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+static cp_pool_t pool;
+
+static void taskgraph_test_start(void) {
+    printf("Test number %d\n", test_num++);
+    assert_thrd(cp_pool_init(&pool, 3));
+}
+
+static void taskgraph_test_end(void) {
+    cp_pool_destroy(&pool);
+}
+
+// Each task records the order it finished in, so edges can be checked
+// against it afterwards.
+typedef struct Ordered {
+    cp_atomic32* clock;
+    int finished_at;
+} Ordered;
+
+static void ordered_run(void* arg) {
+    Ordered* task = arg;
+    task->finished_at = cp_atomic_fetch_add32(task->clock, 1);
+}
+
+START_TEST(taskgraph_diamond_respects_edges) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+
+    cp_atomic32 clock = 0;
+    Ordered tasks[4];
+    int ids[4];
+    for(int i = 0; i < 4; i++) {
+        tasks[i] = (Ordered){ &clock, -1 };
+        assert_thrd(cp_taskgraph_add(&graph, ids + i, ordered_run, tasks + i));
+    }
+    assert_thrd(cp_taskgraph_precede(&graph, ids[0], ids[1]));
+    assert_thrd(cp_taskgraph_precede(&graph, ids[0], ids[2]));
+    assert_thrd(cp_taskgraph_precede(&graph, ids[1], ids[3]));
+    assert_thrd(cp_taskgraph_precede(&graph, ids[2], ids[3]));
+
+    assert_thrd(cp_taskgraph_run_and_wait(&graph));
+
+    ck_assert(tasks[0].finished_at == 0);
+    ck_assert(tasks[1].finished_at > 0 && tasks[1].finished_at < 3);
+    ck_assert(tasks[2].finished_at > 0 && tasks[2].finished_at < 3);
+    ck_assert(tasks[3].finished_at == 3);
+
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+START_TEST(taskgraph_chain_runs_in_order) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+
+    cp_atomic32 clock = 0;
+    Ordered tasks[200];
+    int previous = -1;
+    for(int i = 0; i < 200; i++) {
+        int id;
+        tasks[i] = (Ordered){ &clock, -1 };
+        assert_thrd(cp_taskgraph_add(&graph, &id, ordered_run, tasks + i));
+        if(previous >= 0)
+            assert_thrd(cp_taskgraph_precede(&graph, previous, id));
+        previous = id;
+    }
+
+    assert_thrd(cp_taskgraph_run_and_wait(&graph));
+    for(int i = 0; i < 200; i++)
+        ck_assert(tasks[i].finished_at == i);
+
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+static void count_run(void* arg) {
+    cp_atomic_fetch_add32(arg, 1);
+}
+
+START_TEST(taskgraph_reruns_without_rebuilding) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+
+    // One root fanning out to a wide layer that fans back in.
+    cp_atomic32 counter = 0;
+    int root, sink;
+    assert_thrd(cp_taskgraph_add(&graph, &root, count_run, (void*)&counter));
+    assert_thrd(cp_taskgraph_add(&graph, &sink, count_run, (void*)&counter));
+    for(int i = 0; i < 1000; i++) {
+        int id;
+        assert_thrd(cp_taskgraph_add(&graph, &id, count_run, (void*)&counter));
+        assert_thrd(cp_taskgraph_precede(&graph, root, id));
+        assert_thrd(cp_taskgraph_precede(&graph, id, sink));
+    }
+
+    for(int run = 1; run <= 10; run++) {
+        assert_thrd(cp_taskgraph_run(&graph));
+        assert_thrd(cp_taskgraph_wait(&graph));
+        ck_assert(cp_atomic_load32(&counter) == run * 1002);
+    }
+
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+static void slow_run(void* arg) {
+    thrd_sleep(&ms2ts(100), NULL);
+}
+
+START_TEST(taskgraph_run_while_running_is_busy) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+
+    int id;
+    assert_thrd(cp_taskgraph_add(&graph, &id, slow_run, NULL));
+    assert_thrd(cp_taskgraph_run(&graph));
+    ck_assert(cp_taskgraph_run(&graph) == thrd_busy);
+    ck_assert(cp_taskgraph_add(&graph, &id, slow_run, NULL) == thrd_busy);
+    assert_thrd(cp_taskgraph_wait(&graph));
+
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+START_TEST(taskgraph_rejects_cycles) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+
+    cp_atomic32 counter = 0;
+    int a, b, c;
+    assert_thrd(cp_taskgraph_add(&graph, &a, count_run, (void*)&counter));
+    assert_thrd(cp_taskgraph_add(&graph, &b, count_run, (void*)&counter));
+    assert_thrd(cp_taskgraph_add(&graph, &c, count_run, (void*)&counter));
+    assert_thrd(cp_taskgraph_precede(&graph, a, b));
+    assert_thrd(cp_taskgraph_precede(&graph, b, c));
+    assert_thrd(cp_taskgraph_precede(&graph, c, b));
+    ck_assert(cp_taskgraph_precede(&graph, a, a) == thrd_error);
+    ck_assert(cp_taskgraph_precede(&graph, a, 7) == thrd_error);
+
+    ck_assert(cp_taskgraph_run(&graph) == thrd_error);
+    ck_assert(counter == 0);
+
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+START_TEST(taskgraph_empty_graph_completes) {
+    cp_taskgraph_t graph;
+    assert_thrd(cp_taskgraph_init(&graph, &pool));
+    assert_thrd(cp_taskgraph_run_and_wait(&graph));
+    cp_taskgraph_destroy(&graph);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Task Graph Tests");
+    TCase* tc = tcase_create("Task Graph Tests");
+
+    tcase_add_checked_fixture(tc, taskgraph_test_start, taskgraph_test_end);
+
+    tcase_add_test(tc, taskgraph_diamond_respects_edges);
+    tcase_add_test(tc, taskgraph_chain_runs_in_order);
+    tcase_add_test(tc, taskgraph_reruns_without_rebuilding);
+    tcase_add_test(tc, taskgraph_run_while_running_is_busy);
+    tcase_add_test(tc, taskgraph_rejects_cycles);
+    tcase_add_test(tc, taskgraph_empty_graph_completes);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+#include <check.h>
+
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_thrd_group.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void thrd_group_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static struct timespec deadline_in(int ms) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+#define THREADS 5
+
+typedef struct Sleeper {
+    int id;
+    int ms;
+} Sleeper;
+
+static int sleep_then_return(Sleeper* sleeper) {
+    thrd_sleep(&ms2ts(sleeper->ms), NULL);
+    return sleeper->id;
+}
+
+START_TEST(join_any_returns_threads_as_they_finish) {
+    cp_thrd_group_t group;
+    thrd_t threads[THREADS];
+    Sleeper sleepers[THREADS];
+    assert_thrd(cp_thrd_group_init(&group));
+
+    // The first thread started is the last to finish.
+    for(int i = 0; i < THREADS; i++) {
+        sleepers[i] = (Sleeper){ i, (THREADS - i) * 40 };
+        assert_thrd(cp_thrd_group_create(&group, threads + i, (thrd_start_t)sleep_then_return, sleepers + i));
+    }
+    ck_assert(cp_thrd_group_size(&group) == THREADS);
+
+    for(int i = THREADS - 1; i >= 0; i--) {
+        thrd_t thread;
+        int result;
+        assert_thrd(cp_thrd_group_join_any(&group, &thread, &result, NULL));
+        ck_assert(result == i);
+        ck_assert(thrd_equal(thread, threads[i]));
+    }
+    ck_assert(cp_thrd_group_size(&group) == 0);
+
+    thrd_t thread;
+    ck_assert(cp_thrd_group_join_any(&group, &thread, NULL, NULL) == thrd_error);
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+static int wait_for_flag(cp_atomic32* flag) {
+    while(!cp_atomic_load32(flag))
+        thrd_sleep(&ms2ts(5), NULL);
+    return 7;
+}
+
+START_TEST(timed_join_of_one_thread) {
+    cp_thrd_group_t group;
+    thrd_t slow, fast;
+    cp_atomic32 release = 0;
+    Sleeper quick = { 3, 10 };
+    int result;
+    assert_thrd(cp_thrd_group_init(&group));
+    assert_thrd(cp_thrd_group_create(&group, &slow, (thrd_start_t)wait_for_flag, (void*)&release));
+    assert_thrd(cp_thrd_group_create(&group, &fast, (thrd_start_t)sleep_then_return, &quick));
+
+    // Another thread finishing doesn't end the wait for this one.
+    struct timespec deadline = deadline_in(100);
+    ck_assert(cp_thrd_group_join(&group, slow, &result, &deadline) == thrd_timedout);
+    ck_assert(cp_thrd_group_size(&group) == 2);
+
+    assert_thrd(cp_thrd_group_join(&group, fast, &result, NULL));
+    ck_assert(result == 3);
+    ck_assert(cp_thrd_group_join(&group, fast, &result, NULL) == thrd_error);
+
+    cp_atomic_store32(&release, 1);
+    deadline = deadline_in(5000);
+    assert_thrd(cp_thrd_group_join(&group, slow, &result, &deadline));
+    ck_assert(result == 7);
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+START_TEST(join_all_with_deadline) {
+    cp_thrd_group_t group;
+    thrd_t threads[THREADS + 1];
+    Sleeper sleepers[THREADS];
+    cp_atomic32 release = 0;
+    assert_thrd(cp_thrd_group_init(&group));
+
+    for(int i = 0; i < THREADS; i++) {
+        sleepers[i] = (Sleeper){ i, 10 };
+        assert_thrd(cp_thrd_group_create(&group, threads + i, (thrd_start_t)sleep_then_return, sleepers + i));
+    }
+    assert_thrd(cp_thrd_group_create(&group, threads + THREADS, (thrd_start_t)wait_for_flag, (void*)&release));
+
+    // The finished threads are joined, the stuck one stays.
+    struct timespec deadline = deadline_in(200);
+    ck_assert(cp_thrd_group_join_all(&group, &deadline) == thrd_timedout);
+    ck_assert(cp_thrd_group_size(&group) == 1);
+
+    cp_atomic_store32(&release, 1);
+    assert_thrd(cp_thrd_group_join_all(&group, NULL));
+    ck_assert(cp_thrd_group_size(&group) == 0);
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+static int exit_early(void* arg) {
+    thrd_exit(11);
+    return 0;
+}
+
+START_TEST(thrd_exit_is_reported) {
+    cp_thrd_group_t group;
+    thrd_t thread, joined;
+    int result;
+    assert_thrd(cp_thrd_group_init(&group));
+    assert_thrd(cp_thrd_group_create(&group, &thread, exit_early, NULL));
+
+    struct timespec deadline = deadline_in(5000);
+    assert_thrd(cp_thrd_group_join_any(&group, &joined, &result, &deadline));
+    ck_assert(thrd_equal(joined, thread));
+    ck_assert(result == 11);
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+START_TEST(destroy_joins_remaining_threads) {
+    cp_thrd_group_t group;
+    thrd_t thread;
+    Sleeper sleeper = { 0, 50 };
+    assert_thrd(cp_thrd_group_init(&group));
+    assert_thrd(cp_thrd_group_create(&group, &thread, (thrd_start_t)sleep_then_return, &sleeper));
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+typedef struct Joiner {
+    cp_thrd_group_t* group;
+    thrd_t thread;
+    int result;
+} Joiner;
+
+static int join_one(Joiner* joiner) {
+    return cp_thrd_group_join(joiner->group, joiner->thread, &joiner->result, NULL);
+}
+
+START_TEST(join_any_skips_thread_being_joined) {
+    cp_thrd_group_t group;
+    thrd_t first, second, joiner_thread, joined;
+    Sleeper early = { 1, 50 };
+    Sleeper late = { 2, 150 };
+    int result;
+    assert_thrd(cp_thrd_group_init(&group));
+    assert_thrd(cp_thrd_group_create(&group, &first, (thrd_start_t)sleep_then_return, &early));
+    assert_thrd(cp_thrd_group_create(&group, &second, (thrd_start_t)sleep_then_return, &late));
+
+    // The first thread to finish is already being waited for, so join_any
+    // has to leave it to that join and take the other one.
+    Joiner joiner = { &group, first, -1 };
+    assert_thrd(thrd_create(&joiner_thread, (thrd_start_t)join_one, &joiner));
+    thrd_sleep(&ms2ts(20), NULL);
+    ck_assert(cp_thrd_group_join(&group, first, &result, NULL) == thrd_error);
+
+    assert_thrd(cp_thrd_group_join_any(&group, &joined, &result, NULL));
+    ck_assert(thrd_equal(joined, second));
+    ck_assert(result == 2);
+
+    assert_thrd(thrd_join(joiner_thread, &result));
+    assert_thrd(result);
+    ck_assert(joiner.result == 1);
+    ck_assert(cp_thrd_group_size(&group) == 0);
+    cp_thrd_group_destroy(&group);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Thread Group Tests");
+    TCase* tc = tcase_create("Thread Group Tests");
+
+    tcase_add_checked_fixture(tc, thrd_group_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, join_any_returns_threads_as_they_finish);
+    tcase_add_test(tc, timed_join_of_one_thread);
+    tcase_add_test(tc, join_all_with_deadline);
+    tcase_add_test(tc, thrd_exit_is_reported);
+    tcase_add_test(tc, destroy_joins_remaining_threads);
+    tcase_add_test(tc, join_any_skips_thread_being_joined);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,143 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_thrd_stats.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void thrd_stats_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static volatile unsigned long long burned;
+
+// Spins until the thread has used ms more CPU time by its own count.
+static void burn_cpu(int ms) {
+    cp_thrd_stats_t stats;
+    assert_thrd(cp_thrd_stats(&stats, thrd_current()));
+    long long end = stats.cpu_ns + ms * 1000000ll;
+    do {
+        for(int i = 0; i < 100000; i++)
+            burned += i;
+        assert_thrd(cp_thrd_stats(&stats, thrd_current()));
+    } while(stats.cpu_ns < end);
+}
+
+static int find(const cp_thrd_info_t* threads, size_t count, const char* name) {
+    for(size_t i = 0; i < count; i++) {
+        if(strcmp(threads[i].name, name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+START_TEST(stats_of_calling_thread) {
+    cp_thrd_stats_t before, after;
+    assert_thrd(cp_thrd_stats(&before, thrd_current()));
+    burn_cpu(50);
+    assert_thrd(cp_thrd_stats(&after, thrd_current()));
+
+    ck_assert(after.cpu_ns - before.cpu_ns >= 50000000ll);
+    ck_assert(after.user_ns >= before.user_ns);
+    ck_assert(after.user_ns > 0);
+    ck_assert(after.system_ns >= 0);
+    ck_assert(after.last_cpu >= 0);
+#if defined(__linux__)
+    ck_assert(after.voluntary_switches >= 0);
+    ck_assert(after.involuntary_switches >= 0);
+#endif
+}
+END_TEST
+
+static cp_atomic32 worker_ready;
+static cp_atomic32 worker_release;
+
+static int named_worker(void* arg) {
+    burn_cpu(30);
+    cp_atomic_store32(&worker_ready, 1);
+    while(!cp_atomic_load32(&worker_release))
+        thrd_sleep(&ms2ts(1), NULL);
+    return 0;
+}
+
+START_TEST(registry_lists_named_threads_until_they_exit) {
+    worker_ready = 0;
+    worker_release = 0;
+    assert_thrd(cp_thrd_register("test main"));
+
+    thrd_t thread;
+    assert_thrd(cp_thrd_create_named(&thread, named_worker, NULL, "stats worker"));
+    while(!cp_atomic_load32(&worker_ready))
+        thrd_yield();
+
+    cp_thrd_info_t threads[16];
+    size_t count = cp_thrd_list(threads, 16);
+    ck_assert(count == 2);
+    ck_assert(find(threads, count, "test main") >= 0);
+    int index = find(threads, count, "stats worker");
+    ck_assert(index >= 0);
+
+    cp_thrd_stats_t stats;
+    assert_thrd(cp_thrd_stats(&stats, threads[index].thread));
+    ck_assert(stats.cpu_ns >= 30000000ll);
+    ck_assert(stats.user_ns >= 0);
+#if defined(__linux__)
+    // Sleeping in thrd_sleep gives up the CPU.
+    ck_assert(stats.voluntary_switches > 0);
+    ck_assert(stats.last_cpu >= 0);
+#endif
+
+    // Only the registered count comes back when the array is too small.
+    ck_assert(cp_thrd_list(threads, 1) == 2);
+
+    cp_atomic_store32(&worker_release, 1);
+    assert_thrd(thrd_join(thread, NULL));
+    count = cp_thrd_list(threads, 16);
+    ck_assert(count == 1);
+    ck_assert(find(threads, count, "stats worker") < 0);
+
+    cp_thrd_unregister();
+    ck_assert(cp_thrd_list(threads, 16) == 0);
+}
+END_TEST
+
+START_TEST(register_renames_and_truncates) {
+    assert_thrd(cp_thrd_register("first"));
+    assert_thrd(cp_thrd_register("a name that is much longer than the registry keeps"));
+
+    cp_thrd_info_t threads[4];
+    ck_assert(cp_thrd_list(threads, 4) == 1);
+    ck_assert(strlen(threads[0].name) == CP_THRD_NAME_SIZE - 1);
+    ck_assert(strncmp(threads[0].name, "a name that is much longer", 26) == 0);
+    cp_thrd_unregister();
+
+    ck_assert(cp_thrd_register(NULL) == thrd_error);
+    ck_assert(cp_thrd_stats(NULL, thrd_current()) == thrd_error);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Thread Statistics Tests");
+    TCase* tc = tcase_create("Thread Statistics Tests");
+
+    tcase_add_checked_fixture(tc, thrd_stats_test_start, NULL);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, stats_of_calling_thread);
+    tcase_add_test(tc, registry_lists_named_threads_until_they_exit);
+    tcase_add_test(tc, register_renames_and_truncates);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
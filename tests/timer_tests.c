@@ -0,0 +1,206 @@
+#include <check.h>
+#include <stdio.h>
+
+#include "../cpthreads.h"
+#include "../cp_timer.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void timer_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static void count_call(void* arg) {
+    (*(int*)arg)++;
+}
+
+START_TEST(timer_fires_after_ticks) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 1));
+
+    cp_timer_t timer = { 0 };
+    int counter = 0;
+    assert_thrd(cp_timer_wheel_schedule(&wheel, &timer, 10, count_call, &counter));
+    ck_assert(cp_timer_pending(&timer));
+
+    ck_assert(cp_timer_wheel_advance(&wheel, 9) == 0);
+    ck_assert(counter == 0);
+    ck_assert(cp_timer_wheel_advance(&wheel, 1) == 1);
+    ck_assert(counter == 1);
+    ck_assert(!cp_timer_pending(&timer));
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+START_TEST(timer_rounds_up_to_ticks) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 10));
+
+    cp_timer_t timer = { 0 };
+    int counter = 0;
+    assert_thrd(cp_timer_wheel_schedule(&wheel, &timer, 25, count_call, &counter));
+
+    cp_timer_wheel_advance(&wheel, 2);
+    ck_assert(counter == 0);
+    cp_timer_wheel_advance(&wheel, 1);
+    ck_assert(counter == 1);
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+START_TEST(timer_cancel_prevents_firing) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 1));
+
+    cp_timer_t timers[100] = { 0 };
+    int counter = 0;
+    for(int i = 0; i < 100; i++)
+        assert_thrd(cp_timer_wheel_schedule(&wheel, timers + i, 50, count_call, &counter));
+    for(int i = 0; i < 100; i += 2)
+        assert_thrd(cp_timer_wheel_cancel(&wheel, timers + i));
+    ck_assert(cp_timer_wheel_cancel(&wheel, timers) == thrd_error);
+
+    ck_assert(cp_timer_wheel_advance(&wheel, 100) == 50);
+    ck_assert(counter == 50);
+    ck_assert(cp_timer_wheel_cancel(&wheel, timers + 1) == thrd_error);
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+START_TEST(timer_long_horizons_cascade_exactly) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 1));
+
+    // Deadlines on every level, including just either side of the boundaries.
+    unsigned long long delays[] = { 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262145, 300000, 20000000 };
+    int count = sizeof(delays) / sizeof(*delays);
+    cp_timer_t timers[sizeof(delays) / sizeof(*delays)] = { 0 };
+    int counters[sizeof(delays) / sizeof(*delays)] = { 0 };
+
+    cp_timer_wheel_advance(&wheel, 12345);
+    for(int i = 0; i < count; i++)
+        assert_thrd(cp_timer_wheel_schedule(&wheel, timers + i, delays[i], count_call, counters + i));
+
+    for(int i = 0; i < count; i++) {
+        // Advance to one tick before the deadline, then onto it.
+        unsigned long long target = 12345 + delays[i];
+        cp_timer_wheel_advance(&wheel, target - 1 - wheel.current);
+        ck_assert(counters[i] == 0);
+        cp_timer_wheel_advance(&wheel, 1);
+        ck_assert(counters[i] == 1);
+    }
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+static int batches = 0;
+static int batched = 0;
+
+static void count_batch(cp_timer_t** timers, int count, void* ctx) {
+    batches++;
+    batched += count;
+    for(int i = 0; i < count; i++)
+        timers[i]->func(timers[i]->arg);
+}
+
+START_TEST(timer_expired_dispatched_in_batch) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 1));
+    cp_timer_wheel_set_dispatch(&wheel, count_batch, NULL);
+    batches = 0;
+    batched = 0;
+
+    cp_timer_t timers[1000] = { 0 };
+    int counter = 0;
+    for(int i = 0; i < 1000; i++)
+        assert_thrd(cp_timer_wheel_schedule(&wheel, timers + i, 1 + i % 300, count_call, &counter));
+
+    ck_assert(cp_timer_wheel_advance(&wheel, 300) == 1000);
+    ck_assert(batches == 1);
+    ck_assert(batched == 1000);
+    ck_assert(counter == 1000);
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+typedef struct Rearm {
+    cp_timer_wheel_t* wheel;
+    cp_timer_t timer;
+    int remaining;
+} Rearm;
+
+static void rearm_call(void* arg) {
+    Rearm* rearm = arg;
+    if(--rearm->remaining > 0)
+        cp_timer_wheel_schedule(rearm->wheel, &rearm->timer, 5, rearm_call, rearm);
+}
+
+START_TEST(timer_reschedules_from_callback) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 1));
+
+    Rearm rearm = { &wheel, { 0 }, 4 };
+    assert_thrd(cp_timer_wheel_schedule(&wheel, &rearm.timer, 5, rearm_call, &rearm));
+    for(int i = 0; i < 20; i++)
+        cp_timer_wheel_advance(&wheel, 1);
+
+    ck_assert(rearm.remaining == 0);
+    ck_assert(!cp_timer_pending(&rearm.timer));
+
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+START_TEST(timer_driver_thread_fires) {
+    cp_timer_wheel_t wheel;
+    assert_thrd(cp_timer_wheel_init(&wheel, 5));
+    assert_thrd(cp_timer_wheel_start(&wheel));
+
+    // Let the driver go idle first so scheduling has to wake it.
+    thrd_sleep(&ms2ts(50), NULL);
+
+    cp_timer_t fired = { 0 }, cancelled = { 0 };
+    int counter = 0;
+    assert_thrd(cp_timer_wheel_schedule(&wheel, &fired, 50, count_call, &counter));
+    assert_thrd(cp_timer_wheel_schedule(&wheel, &cancelled, 60, count_call, &counter));
+    assert_thrd(cp_timer_wheel_cancel(&wheel, &cancelled));
+
+    thrd_sleep(&ms2ts(20), NULL);
+    ck_assert(counter == 0);
+    thrd_sleep(&ms2ts(300), NULL);
+    ck_assert(counter == 1);
+
+    assert_thrd(cp_timer_wheel_stop(&wheel));
+    cp_timer_wheel_destroy(&wheel);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Timer Wheel Tests");
+    TCase* tc = tcase_create("Timer Wheel Tests");
+
+    tcase_add_checked_fixture(tc, timer_test_start, NULL);
+
+    tcase_add_test(tc, timer_fires_after_ticks);
+    tcase_add_test(tc, timer_rounds_up_to_ticks);
+    tcase_add_test(tc, timer_cancel_prevents_firing);
+    tcase_add_test(tc, timer_long_horizons_cascade_exactly);
+    tcase_add_test(tc, timer_expired_dispatched_in_batch);
+    tcase_add_test(tc, timer_reschedules_from_callback);
+    tcase_add_test(tc, timer_driver_thread_fires);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
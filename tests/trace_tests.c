@@ -0,0 +1,213 @@
+#ifndef CP_TRACE
+#define CP_TRACE
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpthreads.h"
+#include "../cp_atomic.h"
+#include "../cp_trace.h"
+#include "test_utils.h"
+
+static int test_num = 0;
+
+static void trace_test_start(void) {
+    printf("Test number %d\n", test_num++);
+}
+
+static void trace_test_end(void) {
+    cp_trace_stop();
+    cp_trace_clear();
+}
+
+// Exports into a string so tests can look for events in it.
+static char* export_to_string(void) {
+    FILE* file = tmpfile();
+    ck_assert(file != NULL);
+    assert_thrd(cp_trace_export_chrome(file));
+
+    long size = ftell(file);
+    char* text = malloc(size + 1);
+    rewind(file);
+    ck_assert(fread(text, 1, size, file) == (size_t)size);
+    text[size] = 0;
+    fclose(file);
+    return text;
+}
+
+static int count_of(const char* text, const char* pattern) {
+    int count = 0;
+    size_t length = strlen(pattern);
+    while((text = strstr(text, pattern)) != NULL) {
+        count++;
+        text += length;
+    }
+    return count;
+}
+
+static mtx_t mutex;
+static cnd_t cond;
+static cp_atomic32 holding;
+
+static int hold_mutex(void* arg) {
+    cp_trace_set_thread_name("holder");
+    mtx_lock(&mutex);
+    cp_atomic_store32(&holding, 1);
+    thrd_sleep(&ms2ts(30), NULL);
+    mtx_unlock(&mutex);
+    return 0;
+}
+
+START_TEST(trace_records_contended_lock_and_lifecycle) {
+    assert_thrd(mtx_init(&mutex, mtx_plain));
+    holding = 0;
+    assert_thrd(cp_trace_start(0));
+    ck_assert(cp_trace_start(0) == thrd_error);
+
+    thrd_t thread;
+    assert_thrd(thrd_create(&thread, hold_mutex, NULL));
+    while(!cp_atomic_load32(&holding))
+        thrd_yield();
+
+    mtx_lock(&mutex);
+    mtx_unlock(&mutex);
+    assert_thrd(thrd_join(thread, NULL));
+    cp_trace_stop();
+
+    char* text = export_to_string();
+    ck_assert(strncmp(text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 38) == 0);
+    ck_assert_int_eq(count_of(text, "\"name\":\"mtx_lock\",\"ph\":\"B\""), 1);
+    ck_assert_int_eq(count_of(text, "\"name\":\"mtx_lock\",\"ph\":\"E\""), 1);
+    ck_assert_int_eq(count_of(text, "\"name\":\"thrd_create\""), 1);
+    ck_assert_int_eq(count_of(text, "\"name\":\"thrd_start\""), 1);
+    ck_assert_int_eq(count_of(text, "\"name\":\"thrd_exit\""), 1);
+    ck_assert_int_eq(count_of(text, "\"name\":\"thrd_sleep\",\"ph\":\"B\""), 1);
+    ck_assert_int_eq(count_of(text, "\"args\":{\"name\":\"holder\"}"), 1);
+    free(text);
+    mtx_destroy(&mutex);
+}
+END_TEST
+
+START_TEST(trace_skips_uncontended_locks) {
+    assert_thrd(mtx_init(&mutex, mtx_plain | mtx_recursive));
+    assert_thrd(cp_trace_start(0));
+
+    for(int i = 0; i < 100; i++) {
+        mtx_lock(&mutex);
+        mtx_lock(&mutex);
+        mtx_unlock(&mutex);
+        mtx_unlock(&mutex);
+    }
+    cp_trace_stop();
+
+    char* text = export_to_string();
+    ck_assert_int_eq(count_of(text, "mtx_lock"), 0);
+    free(text);
+    mtx_destroy(&mutex);
+}
+END_TEST
+
+static int signal_later(void* arg) {
+    thrd_sleep(&ms2ts(20), NULL);
+    mtx_lock(&mutex);
+    cp_atomic_store32(&holding, 1);
+    cnd_signal(&cond);
+    mtx_unlock(&mutex);
+    return 0;
+}
+
+START_TEST(trace_records_condition_waits) {
+    assert_thrd(mtx_init(&mutex, mtx_plain));
+    assert_thrd(cnd_init(&cond));
+    holding = 0;
+    assert_thrd(cp_trace_start(0));
+
+    thrd_t thread;
+    assert_thrd(thrd_create(&thread, signal_later, NULL));
+    mtx_lock(&mutex);
+    while(!cp_atomic_load32(&holding))
+        cnd_wait(&cond, &mutex);
+    mtx_unlock(&mutex);
+
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    mtx_lock(&mutex);
+    ck_assert(cnd_timedwait(&cond, &mutex, &deadline) == thrd_timedout);
+    mtx_unlock(&mutex);
+
+    assert_thrd(thrd_join(thread, NULL));
+    cp_trace_stop();
+
+    char* text = export_to_string();
+    ck_assert(count_of(text, "\"name\":\"cnd_wait\",\"ph\":\"B\"") >= 2);
+    ck_assert_int_eq(count_of(text, "\"name\":\"cnd_wait\",\"ph\":\"B\""), count_of(text, "\"name\":\"cnd_wait\",\"ph\":\"E\""));
+
+    // The timed out wait reports its result.
+    char timedout[32];
+    snprintf(timedout, sizeof(timedout), "\"result\":%d}", thrd_timedout);
+    ck_assert(strstr(text, timedout) != NULL);
+    free(text);
+    cnd_destroy(&cond);
+    mtx_destroy(&mutex);
+}
+END_TEST
+
+START_TEST(trace_ring_keeps_newest_events) {
+    assert_thrd(cp_trace_start(6));
+
+    // Rounded up to 8 events, each sleep records two.
+    struct timespec none = { 0, 0 };
+    for(int i = 0; i < 50; i++)
+        thrd_sleep(&none, NULL);
+    cp_trace_stop();
+
+    char* text = export_to_string();
+    ck_assert_int_eq(count_of(text, "\"name\":\"thrd_sleep\""), 8);
+    free(text);
+}
+END_TEST
+
+START_TEST(trace_records_nothing_while_stopped) {
+    struct timespec none = { 0, 0 };
+    thrd_sleep(&none, NULL);
+
+    assert_thrd(cp_trace_start(0));
+    cp_trace_stop();
+    thrd_sleep(&none, NULL);
+
+    char* text = export_to_string();
+    ck_assert_int_eq(count_of(text, "thrd_sleep"), 0);
+    free(text);
+}
+END_TEST
+
+int main(void) {
+    Suite* s = suite_create("Trace Tests");
+    TCase* tc = tcase_create("Trace Tests");
+
+    tcase_add_checked_fixture(tc, trace_test_start, trace_test_end);
+    tcase_set_timeout(tc, 30);
+
+    tcase_add_test(tc, trace_records_contended_lock_and_lifecycle);
+    tcase_add_test(tc, trace_skips_uncontended_locks);
+    tcase_add_test(tc, trace_records_condition_waits);
+    tcase_add_test(tc, trace_ring_keeps_newest_events);
+    tcase_add_test(tc, trace_records_nothing_while_stopped);
+
+    suite_add_tcase(s, tc);
+
+    SRunner* sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}